@@ -0,0 +1,275 @@
+/**
+ * Copyright (c) 2016 Eugene Lazin <4lazin@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "binaryparser.h"
+#include "protocolparser.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <boost/exception/all.hpp>
+
+namespace Akumuli {
+
+const char BinaryProtocol::MAGIC[4] = { 'A', 'K', 'B', '1' };
+
+static void put_varint(u64 value, std::vector<char>* out) {
+    while (value >= 0x80) {
+        out->push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out->push_back(static_cast<char>(value));
+}
+
+template<class T>
+static void put_raw(T value, std::vector<char>* out) {
+    char buf[sizeof(T)];
+    memcpy(buf, &value, sizeof(T));
+    out->insert(out->end(), buf, buf + sizeof(T));
+}
+
+static void put_points(const aku_Timestamp* ts, const double* xs, u32 n, std::vector<char>* out) {
+    put_raw<u32>(n, out);
+    if (n != 0) {
+        put_raw<u64>(ts[0], out);
+        for (u32 i = 1; i < n; i++) {
+            i64 delta = static_cast<i64>(ts[i] - ts[i - 1]);
+            put_varint(static_cast<u64>((delta << 1) ^ (delta >> 63)), out);
+        }
+        for (u32 i = 0; i < n; i++) {
+            put_raw<double>(xs[i], out);
+        }
+    }
+}
+
+static void put_name(std::string const& name, std::vector<char>* out) {
+    put_raw<u16>(static_cast<u16>(name.size()), out);
+    out->insert(out->end(), name.begin(), name.end());
+}
+
+//! Write frame size (frame should start at `start`)
+static void finish_frame(size_t start, std::vector<char>* out) {
+    u32 size = static_cast<u32>(out->size() - start - sizeof(u32));
+    memcpy(out->data() + start, &size, sizeof(u32));
+}
+
+void BinaryProtocol::encode_frame(aku_ParamId id, std::string const& name, const aku_Timestamp* ts,
+                                  const double* xs, u32 n, std::vector<char>* out)
+{
+    size_t start = out->size();
+    put_raw<u32>(0, out);  // placeholder
+    if (name.empty()) {
+        put_raw<u8>(SERIES_ID, out);
+        put_raw<u64>(id, out);
+    } else {
+        put_raw<u8>(SERIES_NAME, out);
+        put_name(name, out);
+    }
+    put_points(ts, xs, n, out);
+    finish_frame(start, out);
+}
+
+void BinaryProtocol::encode_alias_frame(u32 alias, const aku_Timestamp* ts, const double* xs, u32 n,
+                                        std::vector<char>* out)
+{
+    size_t start = out->size();
+    put_raw<u32>(0, out);  // placeholder
+    put_raw<u8>(SERIES_ALIAS, out);
+    put_raw<u32>(alias, out);
+    put_points(ts, xs, n, out);
+    finish_frame(start, out);
+}
+
+void BinaryProtocol::encode_alias_definition(u32 alias, std::string const& name, std::vector<char>* out) {
+    size_t start = out->size();
+    put_raw<u32>(0, out);  // placeholder
+    put_raw<u8>(DEFINE_ALIAS, out);
+    put_raw<u32>(alias, out);
+    put_name(name, out);
+    finish_frame(start, out);
+}
+
+static void throw_frame_error(const char* msg, size_t pos) {
+    BOOST_THROW_EXCEPTION(ProtocolParserError(std::string("bad frame - ") + msg, static_cast<int>(pos)));
+}
+
+template<class T>
+static T get_raw(const Byte** p, const Byte* end) {
+    if (end - *p < static_cast<std::ptrdiff_t>(sizeof(T))) {
+        throw_frame_error("unexpected end of frame", 0);
+    }
+    T value;
+    memcpy(&value, *p, sizeof(T));
+    *p += sizeof(T);
+    return value;
+}
+
+static u64 get_varint(const Byte** p, const Byte* end) {
+    u64 result = 0;
+    int shift = 0;
+    const Byte* it = *p;
+    while (it < end && shift < 64) {
+        u64 byte = static_cast<u8>(*it++);
+        result |= (byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            *p = it;
+            return result;
+        }
+        shift += 7;
+    }
+    throw_frame_error("bad timestamp delta", 0);
+    return 0;
+}
+
+BinaryFrameParser::BinaryFrameParser(std::shared_ptr<ProtocolConsumer> consumer, SeriesDictionary* dict)
+    : consumer_(consumer)
+    , dict_(dict)
+{
+}
+
+void BinaryFrameParser::decode_frame(const Byte* frame, size_t size, std::vector<aku_Sample>* out) {
+    const Byte* p = frame;
+    const Byte* end = frame + size;
+    aku_Sample sample = {};
+    u8 type = get_raw<u8>(&p, end);
+    if (type == BinaryProtocol::SERIES_ID) {
+        sample.paramid = get_raw<u64>(&p, end);
+    } else if (type == BinaryProtocol::SERIES_NAME) {
+        u16 len = get_raw<u16>(&p, end);
+        if (end - p < len) {
+            throw_frame_error("unexpected end of frame", 0);
+        }
+        aku_Status status = consumer_->series_to_param_id(p, len, &sample);
+        if (status != AKU_SUCCESS) {
+            throw_frame_error(aku_error_message(status), 0);
+        }
+        p += len;
+    } else if (type == BinaryProtocol::SERIES_ALIAS) {
+        u32 alias = get_raw<u32>(&p, end);
+        if (dict_ == nullptr) {
+            throw_frame_error("series aliases are not supported", 0);
+        }
+        if (dict_->resolve(alias, &sample) != AKU_SUCCESS) {
+            throw_frame_error("unknown series alias", 0);
+        }
+    } else if (type == BinaryProtocol::DEFINE_ALIAS) {
+        u32 alias = get_raw<u32>(&p, end);
+        u16 len = get_raw<u16>(&p, end);
+        if (end - p != len) {
+            throw_frame_error("unexpected frame size", 0);
+        }
+        if (dict_ == nullptr) {
+            throw_frame_error("series aliases are not supported", 0);
+        }
+        aku_Status status = dict_->define(alias, p, len, *consumer_);
+        if (status != AKU_SUCCESS) {
+            throw_frame_error(aku_error_message(status), 0);
+        }
+        return;
+    } else {
+        throw_frame_error("unknown frame type", 0);
+    }
+    u32 count = get_raw<u32>(&p, end);
+    if (count == 0) {
+        return;
+    }
+    // Each data point takes at least 9 bytes (delta + value)
+    if (static_cast<size_t>(end - p) < count*9ul - 1) {
+        throw_frame_error("unexpected end of frame", 0);
+    }
+    size_t first = out->size();
+    out->resize(first + count);
+    try {
+        sample.payload.type = AKU_PAYLOAD_FLOAT;
+        sample.payload.size = sizeof(aku_Sample);
+        sample.timestamp = get_raw<u64>(&p, end);
+        (*out)[first] = sample;
+        for (u32 i = 1; i < count; i++) {
+            u64 zz = get_varint(&p, end);
+            i64 delta = static_cast<i64>(zz >> 1) ^ -static_cast<i64>(zz & 1);
+            sample.timestamp += static_cast<u64>(delta);
+            (*out)[first + i] = sample;
+        }
+        if (static_cast<size_t>(end - p) != count*sizeof(double)) {
+            throw_frame_error("unexpected frame size", 0);
+        }
+    } catch (...) {
+        // Invalid frame shouldn't leave anything in the output (values are not set yet)
+        out->resize(first);
+        throw;
+    }
+    for (u32 i = 0; i < count; i++) {
+        memcpy(&(*out)[first + i].payload.float64, p, sizeof(double));
+        p += sizeof(double);
+    }
+}
+
+void BinaryFrameParser::parse(const Byte* begin, const Byte* end, std::vector<aku_Sample>* out) {
+    const Byte* p = begin;
+    if (!pending_.empty()) {
+        // Complete the frame from the previous PDU, frame header goes first
+        auto take = [&](size_t need) {
+            size_t nbytes = std::min(need - pending_.size(), static_cast<size_t>(end - p));
+            pending_.insert(pending_.end(), p, p + nbytes);
+            p += nbytes;
+            return pending_.size() == need;
+        };
+        if (pending_.size() < sizeof(u32) && !take(sizeof(u32))) {
+            return;
+        }
+        u32 size;
+        memcpy(&size, pending_.data(), sizeof(u32));
+        if (size > BinaryProtocol::FRAME_SIZE_MAX) {
+            throw_frame_error("frame is too large", 0);
+        }
+        if (!take(sizeof(u32) + size)) {
+            return;
+        }
+        decode_frame(pending_.data() + sizeof(u32), size, out);
+        pending_.clear();
+    }
+    while (p < end) {
+        if (end - p < static_cast<std::ptrdiff_t>(sizeof(u32))) {
+            break;
+        }
+        u32 size;
+        memcpy(&size, p, sizeof(u32));
+        if (size > BinaryProtocol::FRAME_SIZE_MAX) {
+            throw_frame_error("frame is too large", 0);
+        }
+        if (static_cast<size_t>(end - p) - sizeof(u32) < size) {
+            break;
+        }
+        decode_frame(p + sizeof(u32), size, out);
+        p += sizeof(u32) + size;
+    }
+    // Incomplete frame
+    pending_.insert(pending_.end(), p, end);
+}
+
+bool BinaryFrameParser::has_pending() const {
+    return !pending_.empty();
+}
+
+void BinaryFrameParser::reset() {
+    pending_.clear();
+}
+
+void BinaryFrameParser::set_dictionary(SeriesDictionary* dict) {
+    dict_ = dict;
+}
+
+}  // namespace
@@ -0,0 +1,116 @@
+/**
+ * Copyright (c) 2016 Eugene Lazin <4lazin@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "protocol_consumer.h"
+#include "series_dictionary.h"
+#include "stream.h"
+
+namespace Akumuli {
+
+/** Binary columnar protocol.
+  * Connection should start with the magic prefix (`MAGIC`), after that client sends a
+  * sequence of frames. All integers are little-endian.
+  *
+  * Frame layout:
+  * @code
+  * u32     frame size (not including this field)
+  * u8      frame type
+  * u64     series id                           (SERIES_ID frame)
+  * u16     length + series name bytes          (SERIES_NAME frame)
+  * u32     series alias                        (SERIES_ALIAS frame)
+  * u32     number of data points (N)
+  * u64     timestamp of the first data point
+  * varint  N-1 timestamp deltas (zigzag encoded LEB128)
+  * f64     N values
+  * @endcode
+  * All data points in the frame belongs to the same series.
+  *
+  * DEFINE_ALIAS frame binds alias to series name (see `SeriesDictionary`), it
+  * doesn't contain any data points:
+  * @code
+  * u32     frame size
+  * u8      frame type (DEFINE_ALIAS)
+  * u32     series alias
+  * u16     length + series name bytes
+  * @endcode
+  */
+struct BinaryProtocol {
+    //! Magic prefix
+    static const char MAGIC[4];
+
+    enum FrameType {
+        SERIES_ID    = 1,
+        SERIES_NAME  = 2,
+        SERIES_ALIAS = 3,
+        DEFINE_ALIAS = 4,
+    };
+
+    enum {
+        FRAME_SIZE_MAX = 0x100000,  //< Max frame size (1MB)
+    };
+
+    /** Encode frame (can be used by the clients).
+      * @param name series name (used if not empty, otherwise `id` is used)
+      */
+    static void encode_frame(aku_ParamId id, std::string const& name, const aku_Timestamp* ts,
+                             const double* xs, u32 n, std::vector<char>* out);
+
+    //! Encode frame that uses series alias
+    static void encode_alias_frame(u32 alias, const aku_Timestamp* ts, const double* xs, u32 n,
+                                   std::vector<char>* out);
+
+    //! Encode DEFINE_ALIAS frame
+    static void encode_alias_definition(u32 alias, std::string const& name, std::vector<char>* out);
+};
+
+
+/** Incremental decoder of the binary frames.
+  * Complete frames are decoded in place, only incomplete frame at the end of the
+  * PDU is copied to internal buffer.
+  */
+class BinaryFrameParser {
+    std::shared_ptr<ProtocolConsumer> consumer_;
+    SeriesDictionary*                 dict_;     //< Connection's series dictionary (can be null)
+    std::vector<Byte>                 pending_;  //< Incomplete frame
+
+    //! Decode one frame
+    void decode_frame(const Byte* frame, size_t size, std::vector<aku_Sample>* out);
+
+public:
+    BinaryFrameParser(std::shared_ptr<ProtocolConsumer> consumer, SeriesDictionary* dict);
+
+    /** Parse data from the buffer, decoded samples are appended to `out`.
+      * @throw ProtocolParserError on error
+      */
+    void parse(const Byte* begin, const Byte* end, std::vector<aku_Sample>* out);
+
+    //! Returns true if there is incomplete frame
+    bool has_pending() const;
+
+    //! Drop incomplete frame
+    void reset();
+
+    //! Change series dictionary (nullptr - frames that use aliases are rejected)
+    void set_dictionary(SeriesDictionary* dict);
+};
+
+}  // namespace
@@ -2,6 +2,8 @@
 #include "logger.h"
 #include "utility.h"
 
+#include <algorithm>
+#include <sstream>
 #include <thread>
 
 #include <boost/exception/all.hpp>
@@ -92,61 +94,248 @@ std::string AkumuliConnection::get_all_stats() {
     std::vector<char> buffer;
     buffer.resize(0x1000);
     int nbytes = aku_json_stats(db_, buffer.data(), buffer.size());
-    if (nbytes > 0) {
+    if (nbytes < -1) {
+        // Buffer is too small, negative value is a required size
+        buffer.resize(static_cast<size_t>(-nbytes) + 1);
+        nbytes = aku_json_stats(db_, buffer.data(), buffer.size());
+    }
+    if (nbytes <= 0) {
+        return "nope!";
+    }
+    std::map<std::string, u64> counters;
+    {
+        std::lock_guard<std::mutex> guard(stats_lock_);
+        for (auto const& src: stats_sources_) {
+            src(&counters);
+        }
+    }
+    if (counters.empty()) {
         return std::string(buffer.data(), buffer.data() + nbytes);
     }
-    return "nope!";
+    boost::property_tree::ptree ptree;
+    std::stringstream in(std::string(buffer.data(), buffer.data() + nbytes));
+    boost::property_tree::json_parser::read_json(in, ptree);
+    for (auto const& kv: counters) {
+        ptree.put(kv.first, kv.second);
+    }
+    std::stringstream out;
+    boost::property_tree::json_parser::write_json(out, ptree, true);
+    return out.str();
+}
+
+void AkumuliConnection::add_stats_source(StatsSource src) {
+    std::lock_guard<std::mutex> guard(stats_lock_);
+    stats_sources_.push_back(src);
+}
+
+// Sample ring
+
+SampleRing::SampleRing()
+    : head{0}
+    , next(0)
+    , cached_tail(0)
+    , tail{0}
+    , closed{false}
+    , drain_wait{false}
+    , samples(CAPACITY)
+{
+}
+
+u32 SampleRing::peek(const aku_Sample** first) const {
+    u64 t = tail.load(std::memory_order_relaxed);
+    u64 h = head.load(std::memory_order_acquire);
+    u64 offset = t & (CAPACITY - 1);
+    *first = samples.data() + offset;
+    return static_cast<u32>(std::min(h - t, CAPACITY - offset));
+}
+
+void SampleRing::release(u32 n) {
+    tail.store(tail.load(std::memory_order_relaxed) + n, std::memory_order_release);
+}
+
+u32 SampleRing::depth() const {
+    return static_cast<u32>(head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire));
+}
+
+bool SampleRing::empty() const {
+    return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+}
+
+void SampleRing::notify_drained() {
+    // Pairs with the fence in `PipelineSpout::wait_for_drain`, either producer
+    // sees released samples or consumer sees the flag
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (AKU_UNLIKELY(drain_wait.load(std::memory_order_relaxed)) && depth() <= CAPACITY/2) {
+        if (drain_wait.exchange(false)) {
+            on_drain();
+        }
+    }
 }
 
 // Pipeline spout
-PipelineSpout::PipelineSpout(std::shared_ptr<Queue> q, BackoffPolicy bp, std::shared_ptr<DbConnection> con)
-    : created_{0}
-    , deleted_{0}
-    , pool_()
-    , queue_(q)
+PipelineSpout::PipelineSpout(std::vector<PRing> const& lanes, BackoffPolicy bp, std::shared_ptr<DbConnection> con,
+                             std::shared_ptr<PipelineStats> stats)
+    : lanes_(lanes)
+    , nlanes_(static_cast<u32>(lanes.size()))
     , backoff_(bp)
     , logger_("pipeline-spout", 32)
     , db_(con)
+    , stats_(stats)
+    , backlog_pos_(0)
 {
-    pool_.resize(POOL_SIZE);
-    for(int ix = POOL_SIZE; ix --> 0;) {
-        pool_.at(ix).reset(new TVal());
-    }
 }
 
 PipelineSpout::~PipelineSpout() {
+    flush_cache_stats();
+    for (auto& ring: lanes_) {
+        ring->closed.store(true, std::memory_order_release);
+    }
 }
 
 void PipelineSpout::set_error_cb(PipelineErrorCb cb) {
-    on_error_ = cb;
+    for (auto& ring: lanes_) {
+        ring->on_error = cb;
+    }
 }
 
-void PipelineSpout::write(const aku_Sample& sample) {
-    int ix = get_index_of_empty_slot();
-    while (AKU_UNLIKELY(ix < 0)) {
-        ix = get_index_of_empty_slot();
-        if (ix < 0 && backoff_ == AKU_LINEAR_BACKOFF) {
+void PipelineSpout::set_drain_cb(PipelineDrainCb cb) {
+    for (auto& ring: lanes_) {
+        ring->on_drain = cb;
+    }
+}
+
+bool PipelineSpout::push_slow(u32 ixlane, const aku_Sample& sample) {
+    auto& ring = *lanes_[ixlane];
+    // Worker should be able to see everything that was pushed before
+    ring.publish();
+    while (!ring.push(sample)) {
+        if (backoff_ == AKU_LINEAR_BACKOFF) {
             std::this_thread::yield();
-            continue;
-        } else if ( ix < 0 && backoff_ == AKU_THROTTLE) {
+        } else {
+            // AKU_THROTTLE, data is dropped if ring is still full
             std::this_thread::sleep_for(std::chrono::milliseconds(1));
-            return;
+            return ring.push(sample);
         }
     }
+    return true;
+}
 
-    auto pvalue = pool_.at(ix).get();
+void PipelineSpout::write(const aku_Sample& sample) {
+    write_batch(&sample, 1);
+}
+
+void PipelineSpout::write_batch(const aku_Sample* samples, size_t n) {
+    if (AKU_UNLIKELY(!backlog_.empty())) {
+        // Order should be preserved, new data can't bypass the backlog
+        backlog_.insert(backlog_.end(), samples, samples + n);
+        drain_backlog();
+        return;
+    }
+    if (nlanes_ == 1) {
+        auto& ring = *lanes_[0];
+        for (size_t i = 0; i < n; i++) {
+            if (AKU_UNLIKELY(!ring.push(samples[i]))) {
+                if (backoff_ == AKU_FLOW_CONTROL) {
+                    backlog_.assign(samples + i, samples + n);
+                    break;
+                }
+                push_slow(0, samples[i]);
+            }
+        }
+        ring.publish();
+        return;
+    }
+    for (size_t i = 0; i < n; i++) {
+        u32 ixlane = static_cast<u32>(samples[i].paramid % nlanes_);
+        if (AKU_UNLIKELY(!lanes_[ixlane]->push(samples[i]))) {
+            if (backoff_ == AKU_FLOW_CONTROL) {
+                backlog_.assign(samples + i, samples + n);
+                break;
+            }
+            push_slow(ixlane, samples[i]);
+        }
+    }
+    for (auto& ring: lanes_) {
+        if (ring->next != ring->head.load(std::memory_order_relaxed)) {
+            ring->publish();
+        }
+    }
+}
+
+bool PipelineSpout::is_congested() const {
+    return !backlog_.empty();
+}
+
+bool PipelineSpout::drain_backlog() {
+    while (backlog_pos_ < backlog_.size()) {
+        const aku_Sample& sample = backlog_[backlog_pos_];
+        u32 ixlane = nlanes_ == 1 ? 0 : static_cast<u32>(sample.paramid % nlanes_);
+        if (!lanes_[ixlane]->push(sample)) {
+            break;
+        }
+        backlog_pos_++;
+    }
+    for (auto& ring: lanes_) {
+        ring->publish();
+    }
+    if (backlog_pos_ < backlog_.size()) {
+        return false;
+    }
+    backlog_.clear();
+    backlog_pos_ = 0;
+    for (auto const& ring: lanes_) {
+        if (ring->depth() > SampleRing::CAPACITY/2) {
+            return false;
+        }
+    }
+    return true;
+}
 
-    pvalue->sample   =     sample;
-    pvalue->cnt      =  &deleted_;
-    pvalue->on_error = &on_error_;
+bool PipelineSpout::wait_for_drain() {
+    for (auto& ring: lanes_) {
+        ring->drain_wait.store(true, std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (drain_backlog()) {
+        for (auto& ring: lanes_) {
+            ring->drain_wait.store(false, std::memory_order_relaxed);
+        }
+        return true;
+    }
+    return false;
+}
 
-    while (!queue_->push(pvalue)) {
-        std::this_thread::yield();
+void PipelineSpout::report_pause(u64 usec) {
+    if (stats_) {
+        stats_->npauses.fetch_add(1, std::memory_order_relaxed);
+        stats_->pause_time.fetch_add(usec, std::memory_order_relaxed);
     }
 }
 
 aku_Status PipelineSpout::series_to_param_id(const char *str, size_t strlen, aku_Sample *sample) {
-    return db_->series_to_param_id(str, strlen, sample);
+    u64 hash = SeriesNameCache::hash(str, strlen);
+    aku_ParamId id;
+    bool hit = cache_.lookup(str, strlen, hash, &id);
+    if (AKU_UNLIKELY(cache_.hits() + cache_.misses() >= CACHE_STATS_PERIOD)) {
+        flush_cache_stats();
+    }
+    if (hit) {
+        sample->paramid = id;
+        return AKU_SUCCESS;
+    }
+    auto status = db_->series_to_param_id(str, strlen, sample);
+    if (status == AKU_SUCCESS) {
+        cache_.insert(str, strlen, hash, sample->paramid);
+    }
+    return status;
+}
+
+void PipelineSpout::flush_cache_stats() {
+    if (stats_) {
+        stats_->hits.fetch_add(cache_.hits(), std::memory_order_relaxed);
+        stats_->misses.fetch_add(cache_.misses(), std::memory_order_relaxed);
+    }
+    cache_.reset_stats();
 }
 
 void PipelineSpout::add_bulk_string(const Byte *buffer, size_t n) {
@@ -154,90 +343,129 @@ void PipelineSpout::add_bulk_string(const Byte *buffer, size_t n) {
     throw std::runtime_error("not implemented");
 }
 
-int PipelineSpout::get_index_of_empty_slot() {
-    if (created_ - deleted_ < POOL_SIZE) {
-        // There is some space in the pool
-        auto result = created_  % POOL_SIZE;
-        created_++;
-        return result;
-    }
-    return -1;
-}
-
 bool PipelineSpout::is_empty() const {
-    return created_ == deleted_;
+    if (!backlog_.empty()) {
+        return false;
+    }
+    for (auto const& ring: lanes_) {
+        if (!ring->empty()) {
+            return false;
+        }
+    }
+    return true;
 }
 
 // Ingestion pipeline
 
-IngestionPipeline::IngestionPipeline(std::shared_ptr<DbConnection> con, BackoffPolicy bp)
+IngestionPipeline::IngestionPipeline(std::shared_ptr<DbConnection> con, BackoffPolicy bp, int nworkers)
     : con_(con)
-    , ixmake_{0}
-    , stopbar_(2)
-    , startbar_(2)
+    , nworkers_(std::max(1u, std::min(nworkers > 0 ? static_cast<u32>(nworkers)
+                                                   : std::thread::hardware_concurrency(),
+                                      static_cast<u32>(MAX_WORKERS))))
+    , workers_(new WorkerRings[nworkers_])
+    , stopping_{false}
+    , stopbar_(nworkers_ + 1)
+    , closebar_(nworkers_)
+    , startbar_(nworkers_ + 1)
     , backoff_(bp)
     , logger_("ingestion-pipeline", 32)
-
+    , stats_(std::make_shared<PipelineStats>())
 {
-    for (int i = N_QUEUES; i --> 0;) {
-        queues_.push_back(std::make_shared<PipelineSpout::Queue>(PipelineSpout::QCAP));
+    stats_->hits       = 0;
+    stats_->misses     = 0;
+    stats_->npauses    = 0;
+    stats_->pause_time = 0;
+    for (u32 i = 0; i < nworkers_; i++) {
+        workers_[i].version = 0;
+    }
+}
+
+void IngestionPipeline::worker_loop(u32 ixworker) {
+    WorkerRings& shared = workers_[ixworker];
+    std::vector<PipelineSpout::PRing> rings;
+    u64 version = ~0ull;
+    const int IDLE_THRESHOLD = 0x10000;
+    int idle_count = 0;
+    while (true) {
+        // Flag should be checked before the rings, everything that was published
+        // before `stop` call will be written during this iteration
+        bool stopping = stopping_.load(std::memory_order_acquire);
+        if (shared.version.load(std::memory_order_acquire) != version) {
+            // Spout was added or removed
+            std::lock_guard<std::mutex> guard(shared.mutex);
+            version = shared.version.load(std::memory_order_relaxed);
+            rings = shared.rings;
+        }
+        bool progress = false;
+        bool closed   = false;
+        for (auto& ring: rings) {
+            const aku_Sample* samples;
+            u32 n = ring->peek(&samples);
+            while (n) {
+                for (u32 i = 0; i < n; i++) {
+                    auto error = con_->write(samples[i]);
+                    if (AKU_UNLIKELY(error != AKU_SUCCESS)) {
+                        ring->on_error(error, ring->tail.load(std::memory_order_relaxed) + i);
+                    }
+                }
+                ring->release(n);
+                progress = true;
+                n = ring->peek(&samples);
+                if (n == 0) {
+                    ring->notify_drained();
+                }
+            }
+            closed |= ring->closed.load(std::memory_order_acquire);
+        }
+        if (closed) {
+            // Remove rings of destroyed spouts, ring can't be changed after
+            // `closed` flag is set so no data can be lost
+            std::lock_guard<std::mutex> guard(shared.mutex);
+            auto it = std::remove_if(shared.rings.begin(), shared.rings.end(),
+                                     [](PipelineSpout::PRing const& ring) {
+                                         return ring->closed.load(std::memory_order_acquire)
+                                             && ring->empty();
+                                     });
+            if (it != shared.rings.end()) {
+                shared.rings.erase(it, shared.rings.end());
+                shared.version++;
+            }
+        }
+        if (progress) {
+            idle_count = 0;
+        } else if (stopping) {
+            break;
+        } else {
+            idle_count++;
+            if (idle_count > IDLE_THRESHOLD) {
+                // in idle state
+                // check all rings and go idle again
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+    }
+    // Database should be closed after all writes are completed
+    closebar_.wait();
+    if (ixworker == 0) {
+        logger_.info() << "Closing akumuli database";
+        con_->close();
     }
 }
 
 void IngestionPipeline::start() {
     auto self = shared_from_this();
-    auto worker = [self]() {
+    auto worker = [self](u32 ixworker) {
         try {
-            self->logger_.info() << "Starting pipeline worker";
+            self->logger_.info() << "Starting pipeline worker " << ixworker;
             self->startbar_.wait();
-            self->logger_.info() << "Pipeline worker started";
-
-            // Write loop (should be unique)
-            PipelineSpout::TVal *val;
-            int poison_cnt = 0;
-            std::vector<PipelineSpout::PQueue> queues = self->queues_;
-            const int IDLE_THRESHOLD = 0x10000;
-            int idle_count = 0;
-            for (int ix = 0; true; ix++) {
-                auto& qref = queues.at(ix % N_QUEUES);
-                if (qref->pop(val)) {
-                    idle_count = 0;
-                    // New write
-                    if (AKU_UNLIKELY(val->cnt == nullptr)) {  //poisoned
-                        poison_cnt++;
-                        if (poison_cnt == N_QUEUES) {
-                            // Check
-                            for (auto& x: self->queues_) {
-                                if (!x->empty()) {
-                                    self->logger_.error() << "Queue not empty, some data will be lost.";
-                                }
-                            }
-                            self->logger_.info() << "Closing akumuli database";
-                            self->con_->close();
-                            // Stop
-                            self->logger_.info() << "Stopping pipeline worker";
-                            self->stopbar_.wait();
-                            self->logger_.info() << "Pipeline worker stopped";
-                            return;
-                        }
-                    } else {
-                        auto error = self->con_->write(val->sample);
-                        (*val->cnt)++;
-                        if (AKU_UNLIKELY(error != AKU_SUCCESS)) {
-                            (*val->on_error)(error, *val->cnt);
-                        }
-                    }
-                } else {
-                    idle_count++;
-                    if (idle_count > IDLE_THRESHOLD) {
-                        if (idle_count % N_QUEUES == 0) {
-                            // in idle state
-                            // check all queues and go idle again
-                            std::this_thread::sleep_for(std::chrono::milliseconds(1));
-                        }
-                    }
-                }
-            }
+            self->logger_.info() << "Pipeline worker " << ixworker << " started";
+
+            self->worker_loop(ixworker);
+
+            // Stop
+            self->logger_.info() << "Stopping pipeline worker " << ixworker;
+            self->stopbar_.wait();
+            self->logger_.info() << "Pipeline worker " << ixworker << " stopped";
         } catch (...) {
             // Fatal error. Report. Die!
             self->logger_.error() << "Fatal error in ingestion pipeline worker thread!";
@@ -246,8 +474,10 @@ void IngestionPipeline::start() {
         }
     };
 
-    std::thread th(worker);
-    th.detach();
+    for (u32 ix = 0; ix < nworkers_; ix++) {
+        std::thread th(worker, ix);
+        th.detach();
+    }
 
     logger_.info() << "Starting pipeline";
     startbar_.wait();
@@ -255,23 +485,74 @@ void IngestionPipeline::start() {
 }
 
 std::shared_ptr<PipelineSpout> IngestionPipeline::make_spout() {
-    ixmake_++;
-    return std::make_shared<PipelineSpout>(queues_.at(ixmake_ % N_QUEUES), backoff_, con_);
+    return make_spout(backoff_);
 }
 
-PipelineSpout::TVal* IngestionPipeline::POISON = new PipelineSpout::TVal{{}, nullptr, nullptr};
+std::shared_ptr<PipelineSpout> IngestionPipeline::make_spout(BackoffPolicy bp) {
+    std::vector<PipelineSpout::PRing> lanes;
+    for (u32 ixworker = 0; ixworker < nworkers_; ixworker++) {
+        auto ring = std::make_shared<SampleRing>();
+        WorkerRings& shared = workers_[ixworker];
+        std::lock_guard<std::mutex> guard(shared.mutex);
+        shared.rings.push_back(ring);
+        shared.version++;
+        lanes.push_back(ring);
+    }
+    return std::make_shared<PipelineSpout>(lanes, bp, con_, stats_);
+}
 
-int IngestionPipeline::TIMEOUT = 15000;  // 15 seconds
+u32 IngestionPipeline::get_nworkers() const {
+    return nworkers_;
+}
 
-void IngestionPipeline::stop() {
-    logger_.info() << "Trying to stop pipeline, pushing poison to nodes";
-    for (auto& q: queues_) {
-        while(!q->push(POISON)) {
-            std::this_thread::yield();
+void IngestionPipeline::get_series_cache_stats(u64* hits, u64* misses) const {
+    *hits   = stats_->hits.load(std::memory_order_relaxed);
+    *misses = stats_->misses.load(std::memory_order_relaxed);
+}
+
+void IngestionPipeline::get_flow_control_stats(u64* npauses, u64* pause_time) const {
+    *npauses    = stats_->npauses.load(std::memory_order_relaxed);
+    *pause_time = stats_->pause_time.load(std::memory_order_relaxed);
+}
+
+void IngestionPipeline::get_stats(std::map<std::string, u64>* out) {
+    u64 hits, misses;
+    get_series_cache_stats(&hits, &misses);
+    (*out)["series_cache.hits"]   = hits;
+    (*out)["series_cache.misses"] = misses;
+    u64 npauses, pause_time;
+    get_flow_control_stats(&npauses, &pause_time);
+    (*out)["flow_control.pauses"]        = npauses;
+    (*out)["flow_control.pause_time_us"] = pause_time;
+    (*out)["pipeline.queue_depth"]       = get_queue_depth();
+}
+
+u64 IngestionPipeline::get_queue_depth() {
+    u64 depth = 0;
+    for (u32 ix = 0; ix < nworkers_; ix++) {
+        WorkerRings& shared = workers_[ix];
+        std::lock_guard<std::mutex> guard(shared.mutex);
+        for (auto const& ring: shared.rings) {
+            depth += ring->depth();
         }
     }
-    logger_.info() << "Trying to stop pipeline, waiting for worker to stop";
+    return depth;
+}
+
+int IngestionPipeline::TIMEOUT = 15000;  // 15 seconds
+
+void IngestionPipeline::stop() {
+    logger_.info() << "Trying to stop pipeline";
+    stopping_.store(true, std::memory_order_release);
+    logger_.info() << "Trying to stop pipeline, waiting for workers to stop";
     stopbar_.wait();
+    u64 hits, misses;
+    get_series_cache_stats(&hits, &misses);
+    logger_.info() << "Series name cache hits: " << hits << ", misses: " << misses << ", hit rate: "
+                   << (hits + misses ? 100.0 * hits / (hits + misses) : 0.0) << "%";
+    u64 npauses, pause_time;
+    get_flow_control_stats(&npauses, &pause_time);
+    logger_.info() << "Flow control pauses: " << npauses << ", total pause time: " << pause_time << "us";
     logger_.info() << "Pipeline stopped (IngestionPipeline::stop)";
 }
 
@@ -17,14 +17,18 @@
 #pragma once
 #include <atomic>
 #include <functional>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
-#include <boost/lockfree/queue.hpp>
 #include <boost/thread/barrier.hpp>
 
 #include "logger.h"
 #include "protocol_consumer.h"
+#include "series_cache.h"
+#include "utility.h"
 // akumuli-storage API
 #include "akumuli.h"
 #include "akumuli_config.h"
@@ -77,9 +81,14 @@ public:
         MaxThroughput     = 4,
     };
 
+    //! Callback that adds named counters of the daemon component to the stats output
+    typedef std::function<void(std::map<std::string, u64>*)> StatsSource;
+
 private:
-    std::string   dbpath_;
-    aku_Database* db_;
+    std::string              dbpath_;
+    aku_Database*            db_;
+    std::mutex               stats_lock_;
+    std::vector<StatsSource> stats_sources_;
 
 public:
     AkumuliConnection(const char* path, bool hugetlb, Durability durability,
@@ -95,109 +104,228 @@ public:
 
     virtual aku_Status series_to_param_id(const char* name, size_t size, aku_Sample* sample);
 
+    //! Returns storage stats (see `aku_json_stats`) and counters of all stats sources
     virtual std::string get_all_stats();
-};
-
-using boost::lockfree::queue;
-using boost::lockfree::capacity;
 
+    //! Add counters of the daemon component (e.g. ingestion pipeline) to `get_all_stats` output
+    void add_stats_source(StatsSource src);
+};
 
 enum BackoffPolicy {
     AKU_THROTTLE,
     AKU_LINEAR_BACKOFF,
+    //! Spout never blocks or drops data, samples that doesn't fit into the
+    //! pipeline are stored in spout's backlog and client should stop sending
+    //! data until the backlog is drained (see `PipelineSpout::is_congested`)
+    AKU_FLOW_CONTROL,
 };
 
 
 //! Callback from pipeline to session
 typedef std::function<void(aku_Status, u64)> PipelineErrorCb;
 
+//! Callback from pipeline to paused session, called when the spout can receive new data
+typedef std::function<void()> PipelineDrainCb;
+
+
+//! Counters shared by all spouts of the pipeline
+struct PipelineStats {
+    std::atomic<u64> hits;        //< Series name cache hits
+    std::atomic<u64> misses;      //< Series name cache misses
+    std::atomic<u64> npauses;     //< Number of times clients was paused by flow control
+    std::atomic<u64> pause_time;  //< Total pause duration in microseconds
+};
+
+
+/** Single producer single consumer ring of samples.
+  * Producer (spout) copies samples to the ring and publishes them by advancing
+  * `head` once per batch, consumer (pipeline worker) writes all published samples
+  * and releases them by advancing `tail` once. Each side updates only its own index
+  * and caches other side's index, so there is no atomic operations per sample.
+  * Indexes are placed in different cache lines.
+  */
+struct SampleRing {
+    enum {
+        CAPACITY = 0x400,  //< Should be a power of two
+    };
+    typedef struct { char emptybits[64]; } Padding;  //< Padding
+
+    std::atomic<u64>        head;         //< End of published samples (written by producer)
+    u64                     next;         //< End of pushed samples (producer only)
+    u64                     cached_tail;  //< Last seen value of `tail` (producer only)
+    Padding                 pad0;
+    std::atomic<u64>        tail;         //< End of written samples (written by consumer)
+    Padding                 pad1;
+    std::atomic<bool>       closed;       //< Producer is destroyed
+    std::atomic<bool>       drain_wait;   //< Producer waits for `on_drain` call
+    PipelineErrorCb         on_error;     //< Session callback
+    PipelineDrainCb         on_drain;     //< Session callback
+    std::vector<aku_Sample> samples;
+
+    SampleRing();
+
+    //! Producer side. Copy sample to the ring, returns false if ring is full.
+    bool push(const aku_Sample& sample) {
+        if (AKU_UNLIKELY(next - cached_tail == CAPACITY)) {
+            cached_tail = tail.load(std::memory_order_acquire);
+            if (next - cached_tail == CAPACITY) {
+                return false;
+            }
+        }
+        samples[next & (CAPACITY - 1)] = sample;
+        next++;
+        return true;
+    }
+
+    //! Producer side. Make all pushed samples visible to consumer.
+    void publish() {
+        head.store(next, std::memory_order_release);
+    }
+
+    /** Consumer side. Get published samples (only contiguous part).
+      * @return number of samples
+      */
+    u32 peek(const aku_Sample** first) const;
+
+    //! Consumer side. Release `n` samples returned by `peek`.
+    void release(u32 n);
+
+    //! Number of published samples that wasn't written yet
+    u32 depth() const;
+
+    //! Returns true if all published samples are released
+    bool empty() const;
+
+    /** Consumer side. Call `on_drain` if producer waits for it and the ring
+      * is at most half full. Should be called after `release`.
+      */
+    void notify_drained();
+};
+
 
 /** Pipeline's spout.
   * Object of this class can be used to ingest data to pipeline.
-  * It should be connected with IngestionPipeline instance with
-  * the shared queue. Pooling is used to simplify allocator's
-  * life. All TVals should be deleted in the same thread where
-  * they was created. This shuld minimize contention inside
-  * allocator and limit overall memory usage (no need to create
-  * pool of objects beforehand).
+  * Spout has one lane per pipeline worker, sample is routed to
+  * the lane using its param id. Lane is a SPSC ring of samples
+  * shared with the worker. All samples passed to `write_batch`
+  * are published at once before `write_batch` returns.
   */
 struct PipelineSpout : ProtocolConsumer {
 
     // Constants
     enum {
-        //! PVal pool size
-        POOL_SIZE = 0x200,
-        QCAP      = 0x10,
+        //! Number of series name lookups between cache stats updates
+        CACHE_STATS_PERIOD = 0x1000,
     };
 
     // Typedefs
-    typedef struct { char emptybits[64]; } Padding;  //< Padding
-    typedef std::atomic<u64> SpoutCounter;           //< Shared counter
-    typedef struct {
-        aku_Sample       sample;                      //< Value
-        SpoutCounter*    cnt;                         //< Pointer to spout's shared counter
-        PipelineErrorCb* on_error;                    //< On error callback
-    } TVal;                                           //< Value
-    typedef std::shared_ptr<TVal>         PVal;       //< Pointer to value
-    typedef queue<TVal*>                  Queue;      //< Queue class
-    typedef std::shared_ptr<Queue>        PQueue;     //< Pointer to queue
+    typedef std::shared_ptr<SampleRing>   PRing;      //< Pointer to ring
     typedef std::shared_ptr<DbConnection> PDatabase;  //< Database "connection"
 
     // Data
-    SpoutCounter        created_;  //< Created elements counter
-    Padding             pad0;
-    SpoutCounter        deleted_;  //< Deleted elements counter
-    std::vector<PVal>   pool_;     //< TVal pool
-    Padding             pad1;
-    PQueue              queue_;  //< Queue
+    std::vector<PRing>  lanes_;   //< Rings (one per worker)
+    const u32           nlanes_;  //< Number of lanes
     const BackoffPolicy backoff_;
-    Logger              logger_;    //< Logger instance
-    PipelineErrorCb     on_error_;  //< Session callback
+    Logger              logger_;  //< Logger instance
     PDatabase           db_;
+    SeriesNameCache     cache_;   //< Raw series name -> param id cache
+    std::shared_ptr<PipelineStats> stats_;  //< Pipeline's counters
+    std::vector<aku_Sample> backlog_;      //< Samples that doesn't fit into the rings (AKU_FLOW_CONTROL)
+    size_t                  backlog_pos_;  //< Position of the first sample in the backlog
 
     // C-tor
-    PipelineSpout(std::shared_ptr<Queue> q, BackoffPolicy bp, std::shared_ptr<DbConnection> con);
+    PipelineSpout(std::vector<PRing> const& lanes, BackoffPolicy bp, std::shared_ptr<DbConnection> con,
+                  std::shared_ptr<PipelineStats> stats = std::shared_ptr<PipelineStats>());
     ~PipelineSpout();
 
     void set_error_cb(PipelineErrorCb cb);
 
+    void set_drain_cb(PipelineDrainCb cb);
+
     // ProtocolConsumer
     virtual void write(const aku_Sample& sample);
+    virtual void write_batch(const aku_Sample* samples, size_t n);
     virtual void add_bulk_string(const Byte* buffer, size_t n);
 
     // Utility
-    //! Reserve index for the next TVal in the pool or negative value on error.
-    int get_index_of_empty_slot();
+    /** Push sample to the full lane, wait if needed (depends on backoff policy).
+      * @return false if sample was dropped
+      */
+    bool push_slow(u32 lane, const aku_Sample& sample);
+
+    /** Returns true if the backlog is not empty. Client shouldn't send new data
+      * until `drain_backlog` returns true.
+      */
+    bool is_congested() const;
+
+    /** Move samples from the backlog to the pipeline.
+      * @return true if the backlog is empty and pipeline is able to receive
+      *         new data (all lanes are at most half full)
+      */
+    bool drain_backlog();
+
+    /** Drain the backlog or ask pipeline workers to call the drain callback
+      * when they release enough samples from the rings, after that client should
+      * call `wait_for_drain` again. Callback can be called spuriously.
+      * @return true if the backlog is drained (same as `drain_backlog`)
+      */
+    bool wait_for_drain();
+
+    //! Add client's pause duration (in microseconds) to pipeline's counters
+    void report_pause(u64 usec);
 
     /** Dump all errors to ostr or report that everything is OK
       * @param ostr stream to write
       */
     void get_error(std::ostream& ostr);
 
+    /** Convert series name to param id.
+      * Series name cache is checked first, normalization and matching
+      * is performed only on cache miss.
+      */
     aku_Status series_to_param_id(const char* str, size_t strlen, aku_Sample* sample);
 
-    /** Returns true if all TVal's is processed */
+    //! Add cache hits and misses to pipeline's counters
+    void flush_cache_stats();
+
+    /** Returns true if all samples is processed (including backlog) */
     bool is_empty() const;
 };
 
 class IngestionPipeline : public std::enable_shared_from_this<IngestionPipeline> {
     enum {
-        N_QUEUES = 8,
+        MAX_WORKERS = 0x40,
+    };
+    typedef boost::barrier Barr;
+
+    //! Rings that should be processed by one worker
+    struct WorkerRings {
+        std::mutex                        mutex;
+        std::vector<PipelineSpout::PRing> rings;
+        std::atomic<u64>                  version;  //< Incremented on every change
     };
-    typedef boost::barrier             Barr;
+
     std::shared_ptr<DbConnection>      con_;       //< DB connection
-    std::vector<PipelineSpout::PQueue> queues_;    //< Queues collection
-    std::atomic<int>                   ixmake_;    //< Index for the make_spout mehtod
+    const u32                          nworkers_;  //< Number of worker threads
+    std::unique_ptr<WorkerRings[]>     workers_;   //< Rings of all spouts (per worker)
+    std::atomic<bool>                  stopping_;  //< Workers should stop after all rings are drained
     Barr                               stopbar_;   //< Stopping barrier
+    Barr                               closebar_;  //< All workers are stopped, db can be closed
     Barr                               startbar_;  //< Stopping barrier
-    static PipelineSpout::TVal*        POISON;     //< Poisoned object to stop worker thread
     static int                         TIMEOUT;    //< Close timeout
     const BackoffPolicy                backoff_;   //< Back-pressure policy
     Logger                             logger_;    //< Logger instance
+    std::shared_ptr<PipelineStats>     stats_;     //< Counters shared with spouts
+
+    //! Worker thread body
+    void worker_loop(u32 ixworker);
 public:
     /** Create new pipeline topology.
+      * @param nworkers number of worker threads, samples are routed to workers
+      *        by param id so all samples of the same series are written by one
+      *        thread in order (0 - one worker per CPU)
       */
-    IngestionPipeline(std::shared_ptr<DbConnection> con, BackoffPolicy bp = AKU_THROTTLE);
+    IngestionPipeline(std::shared_ptr<DbConnection> con, BackoffPolicy bp = AKU_THROTTLE, int nworkers = 1);
 
     /** Run pipeline topology.
       */
@@ -206,6 +334,32 @@ public:
     /** Add new pipeline spout. */
     std::shared_ptr<PipelineSpout> make_spout();
 
+    /** Add new pipeline spout that uses its own back-pressure policy
+      * (e.g. AKU_FLOW_CONTROL for clients that can be paused).
+      */
+    std::shared_ptr<PipelineSpout> make_spout(BackoffPolicy bp);
+
+    /** Get series name cache counters (sum across all spouts).
+      * Counters are updated periodically and when spout is destroyed.
+      */
+    void get_series_cache_stats(u64* hits, u64* misses) const;
+
+    /** Get flow control counters.
+      * @param npauses number of times clients was paused
+      * @param pause_time total pause duration in microseconds
+      */
+    void get_flow_control_stats(u64* npauses, u64* pause_time) const;
+
+    //! Number of samples queued in all spouts' rings
+    u64 get_queue_depth();
+
+    /** Get all pipeline counters (in format of the `AkumuliConnection::StatsSource`).
+      */
+    void get_stats(std::map<std::string, u64>* out);
+
+    //! Number of worker threads
+    u32 get_nworkers() const;
+
     void stop();
 };
 
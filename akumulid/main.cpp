@@ -14,6 +14,7 @@
 #include <boost/property_tree/ini_parser.hpp>
 #include <boost/program_options.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/exception/all.hpp>
 
 #include <apr_errno.h>
 
@@ -73,6 +74,11 @@ huge_tlb = 0
 # define size of this cache (default value: 512Mb).
 max_cache_size=536870912
 
+# Number of  ingestion  pipeline  writer  threads.  Data points
+# are routed  to  writers  by series id,  so every series is
+# written by exactly one thread (0 - one writer per CPU).
+ingestion_writers=1
+
 
 # HTTP server config
 
@@ -88,6 +94,18 @@ port=8181
 port=8282
 # worker pool size
 pool_size=1
+# receive buffer size in bytes (each connection has at least one
+# such buffer, buffers are reused)
+buffer_size=65536
+# shard-per-core mode: every worker accepts connections on its own
+# SO_REUSEPORT socket and serves them without cross-thread handoff
+# (pool_size=0 creates one worker per CPU)
+shard_per_core=0
+# pin worker threads to CPUs
+cpu_affinity=0
+# backpressure: stop reading from the client when ingestion
+# pipeline is overloaded instead of dropping samples
+backpressure=0
 
 
 # UDP ingestion server config (delete to disable)
@@ -97,6 +115,11 @@ pool_size=1
 port=8383
 # worker pool size
 pool_size=1
+# socket receive buffer size in bytes (0 - use system default,
+# actual size is limited by net.core.rmem_max)
+rcvbuf=0
+# busy polling timeout in microseconds (0 - disabled)
+busy_poll=0
 
 # Logging configuration
 # This is just a log4cxx configuration without any modifications
@@ -172,6 +195,10 @@ struct ConfigFile {
         return conf.get<u64>("max_cache_size");
     }
 
+    static int get_ingestion_writers(PTree conf) {
+        return conf.get<int>("ingestion_writers", 1);
+    }
+
     static int get_window(PTree conf) {
         std::string window = conf.get<std::string>("window");
         int r = 0;
@@ -212,6 +239,12 @@ struct ConfigFile {
         settings.name = "HTTP";
         settings.port = conf.get<int>("HTTP.port");
         settings.nworkers = -1;
+        settings.buffer_size = 0;
+        settings.shard_per_core = false;
+        settings.pin_threads = false;
+        settings.flow_control = false;
+        settings.recv_buffer_size = 0;
+        settings.busy_poll = 0;
         return settings;
     }
 
@@ -220,6 +253,12 @@ struct ConfigFile {
         settings.name = "UDP";
         settings.port = conf.get<int>("UDP.port");
         settings.nworkers = conf.get<int>("UDP.pool_size");
+        settings.buffer_size = 0;
+        settings.shard_per_core = false;
+        settings.pin_threads = false;
+        settings.flow_control = false;
+        settings.recv_buffer_size = conf.get<int>("UDP.rcvbuf", 0);
+        settings.busy_poll = conf.get<int>("UDP.busy_poll", 0);
         return settings;
     }
 
@@ -228,6 +267,12 @@ struct ConfigFile {
         settings.name = "TCP";
         settings.port = conf.get<int>("TCP.port");
         settings.nworkers = conf.get<int>("TCP.pool_size");
+        settings.buffer_size = conf.get<int>("TCP.buffer_size", 0);
+        settings.shard_per_core = conf.get<int>("TCP.shard_per_core", 0) != 0;
+        settings.pin_threads = conf.get<int>("TCP.cpu_affinity", 0) != 0;
+        settings.flow_control = conf.get<int>("TCP.backpressure", 0) != 0;
+        settings.recv_buffer_size = 0;
+        settings.busy_poll = 0;
         return settings;
     }
 
@@ -391,6 +436,7 @@ void cmd_run_server() {
     auto compression_threshold  = ConfigFile::get_compression_threshold(config);
     auto huge_tlb               = ConfigFile::get_huge_tlb(config);
     auto cache_size             = ConfigFile::get_cache_size(config);
+    auto ingestion_writers      = ConfigFile::get_ingestion_writers(config);
     auto ingestion_servers      = ConfigFile::get_server_settings(config);
 
     auto full_path = boost::filesystem::path(path) / "db.akumuli";
@@ -402,7 +448,14 @@ void cmd_run_server() {
                                                           window,
                                                           cache_size);
 
-    auto pipeline = std::make_shared<IngestionPipeline>(connection, AKU_LINEAR_BACKOFF);
+    auto pipeline = std::make_shared<IngestionPipeline>(connection, AKU_LINEAR_BACKOFF, ingestion_writers);
+    std::weak_ptr<IngestionPipeline> wpipeline = pipeline;  // connection shouldn't own the pipeline
+    connection->add_stats_source([wpipeline](std::map<std::string, u64>* out) {
+        auto pipeline = wpipeline.lock();
+        if (pipeline) {
+            pipeline->get_stats(out);
+        }
+    });
     auto qproc = std::make_shared<QueryProcessor>(connection, 1000);
 
     SignalHandler sighandler;
@@ -0,0 +1,898 @@
+/**
+ * Copyright (c) 2016 Eugene Lazin <4lazin@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "numparser.h"
+
+#include <cstdlib>
+#include <cstring>
+
+namespace Akumuli {
+
+namespace {
+
+enum {
+    //! Max number of significant digits that fits u64
+    MAX_DIGITS = 19,
+    //! Range of decimal exponents covered by the table
+    SMALLEST_POWER_OF_FIVE = -342,
+    LARGEST_POWER_OF_FIVE = 308,
+    // binary64 parameters
+    MANTISSA_BITS = 52,
+    MINIMUM_EXPONENT = -1023,
+    INFINITE_POWER = 0x7FF,
+    MIN_EXPONENT_ROUND_TO_EVEN = -4,
+    MAX_EXPONENT_ROUND_TO_EVEN = 23,
+};
+
+/** 128-bit approximations of the powers of five (5^-342 ... 5^308), most
+  * significant bit is always set. Two u64 values (high, low) per power.
+  */
+static const u64 POWER_OF_FIVE_128[] = {
+    0xeef453d6923bd65aul, 0x113faa2906a13b3ful,
+    0x9558b4661b6565f8ul, 0x4ac7ca59a424c507ul,
+    0xbaaee17fa23ebf76ul, 0x5d79bcf00d2df649ul,
+    0xe95a99df8ace6f53ul, 0xf4d82c2c107973dcul,
+    0x91d8a02bb6c10594ul, 0x79071b9b8a4be869ul,
+    0xb64ec836a47146f9ul, 0x9748e2826cdee284ul,
+    0xe3e27a444d8d98b7ul, 0xfd1b1b2308169b25ul,
+    0x8e6d8c6ab0787f72ul, 0xfe30f0f5e50e20f7ul,
+    0xb208ef855c969f4ful, 0xbdbd2d335e51a935ul,
+    0xde8b2b66b3bc4723ul, 0xad2c788035e61382ul,
+    0x8b16fb203055ac76ul, 0x4c3bcb5021afcc31ul,
+    0xaddcb9e83c6b1793ul, 0xdf4abe242a1bbf3dul,
+    0xd953e8624b85dd78ul, 0xd71d6dad34a2af0dul,
+    0x87d4713d6f33aa6bul, 0x8672648c40e5ad68ul,
+    0xa9c98d8ccb009506ul, 0x680efdaf511f18c2ul,
+    0xd43bf0effdc0ba48ul, 0x0212bd1b2566def2ul,
+    0x84a57695fe98746dul, 0x014bb630f7604b57ul,
+    0xa5ced43b7e3e9188ul, 0x419ea3bd35385e2dul,
+    0xcf42894a5dce35eaul, 0x52064cac828675b9ul,
+    0x818995ce7aa0e1b2ul, 0x7343efebd1940993ul,
+    0xa1ebfb4219491a1ful, 0x1014ebe6c5f90bf8ul,
+    0xca66fa129f9b60a6ul, 0xd41a26e077774ef6ul,
+    0xfd00b897478238d0ul, 0x8920b098955522b4ul,
+    0x9e20735e8cb16382ul, 0x55b46e5f5d5535b0ul,
+    0xc5a890362fddbc62ul, 0xeb2189f734aa831dul,
+    0xf712b443bbd52b7bul, 0xa5e9ec7501d523e4ul,
+    0x9a6bb0aa55653b2dul, 0x47b233c92125366eul,
+    0xc1069cd4eabe89f8ul, 0x999ec0bb696e840aul,
+    0xf148440a256e2c76ul, 0xc00670ea43ca250dul,
+    0x96cd2a865764dbcaul, 0x380406926a5e5728ul,
+    0xbc807527ed3e12bcul, 0xc605083704f5ecf2ul,
+    0xeba09271e88d976bul, 0xf7864a44c633682eul,
+    0x93445b8731587ea3ul, 0x7ab3ee6afbe0211dul,
+    0xb8157268fdae9e4cul, 0x5960ea05bad82964ul,
+    0xe61acf033d1a45dful, 0x6fb92487298e33bdul,
+    0x8fd0c16206306babul, 0xa5d3b6d479f8e056ul,
+    0xb3c4f1ba87bc8696ul, 0x8f48a4899877186cul,
+    0xe0b62e2929aba83cul, 0x331acdabfe94de87ul,
+    0x8c71dcd9ba0b4925ul, 0x9ff0c08b7f1d0b14ul,
+    0xaf8e5410288e1b6ful, 0x07ecf0ae5ee44dd9ul,
+    0xdb71e91432b1a24aul, 0xc9e82cd9f69d6150ul,
+    0x892731ac9faf056eul, 0xbe311c083a225cd2ul,
+    0xab70fe17c79ac6caul, 0x6dbd630a48aaf406ul,
+    0xd64d3d9db981787dul, 0x092cbbccdad5b108ul,
+    0x85f0468293f0eb4eul, 0x25bbf56008c58ea5ul,
+    0xa76c582338ed2621ul, 0xaf2af2b80af6f24eul,
+    0xd1476e2c07286faaul, 0x1af5af660db4aee1ul,
+    0x82cca4db847945caul, 0x50d98d9fc890ed4dul,
+    0xa37fce126597973cul, 0xe50ff107bab528a0ul,
+    0xcc5fc196fefd7d0cul, 0x1e53ed49a96272c8ul,
+    0xff77b1fcbebcdc4ful, 0x25e8e89c13bb0f7aul,
+    0x9faacf3df73609b1ul, 0x77b191618c54e9acul,
+    0xc795830d75038c1dul, 0xd59df5b9ef6a2417ul,
+    0xf97ae3d0d2446f25ul, 0x4b0573286b44ad1dul,
+    0x9becce62836ac577ul, 0x4ee367f9430aec32ul,
+    0xc2e801fb244576d5ul, 0x229c41f793cda73ful,
+    0xf3a20279ed56d48aul, 0x6b43527578c1110ful,
+    0x9845418c345644d6ul, 0x830a13896b78aaa9ul,
+    0xbe5691ef416bd60cul, 0x23cc986bc656d553ul,
+    0xedec366b11c6cb8ful, 0x2cbfbe86b7ec8aa8ul,
+    0x94b3a202eb1c3f39ul, 0x7bf7d71432f3d6a9ul,
+    0xb9e08a83a5e34f07ul, 0xdaf5ccd93fb0cc53ul,
+    0xe858ad248f5c22c9ul, 0xd1b3400f8f9cff68ul,
+    0x91376c36d99995beul, 0x23100809b9c21fa1ul,
+    0xb58547448ffffb2dul, 0xabd40a0c2832a78aul,
+    0xe2e69915b3fff9f9ul, 0x16c90c8f323f516cul,
+    0x8dd01fad907ffc3bul, 0xae3da7d97f6792e3ul,
+    0xb1442798f49ffb4aul, 0x99cd11cfdf41779cul,
+    0xdd95317f31c7fa1dul, 0x40405643d711d583ul,
+    0x8a7d3eef7f1cfc52ul, 0x482835ea666b2572ul,
+    0xad1c8eab5ee43b66ul, 0xda3243650005eecful,
+    0xd863b256369d4a40ul, 0x90bed43e40076a82ul,
+    0x873e4f75e2224e68ul, 0x5a7744a6e804a291ul,
+    0xa90de3535aaae202ul, 0x711515d0a205cb36ul,
+    0xd3515c2831559a83ul, 0x0d5a5b44ca873e03ul,
+    0x8412d9991ed58091ul, 0xe858790afe9486c2ul,
+    0xa5178fff668ae0b6ul, 0x626e974dbe39a872ul,
+    0xce5d73ff402d98e3ul, 0xfb0a3d212dc8128ful,
+    0x80fa687f881c7f8eul, 0x7ce66634bc9d0b99ul,
+    0xa139029f6a239f72ul, 0x1c1fffc1ebc44e80ul,
+    0xc987434744ac874eul, 0xa327ffb266b56220ul,
+    0xfbe9141915d7a922ul, 0x4bf1ff9f0062baa8ul,
+    0x9d71ac8fada6c9b5ul, 0x6f773fc3603db4a9ul,
+    0xc4ce17b399107c22ul, 0xcb550fb4384d21d3ul,
+    0xf6019da07f549b2bul, 0x7e2a53a146606a48ul,
+    0x99c102844f94e0fbul, 0x2eda7444cbfc426dul,
+    0xc0314325637a1939ul, 0xfa911155fefb5308ul,
+    0xf03d93eebc589f88ul, 0x793555ab7eba27caul,
+    0x96267c7535b763b5ul, 0x4bc1558b2f3458deul,
+    0xbbb01b9283253ca2ul, 0x9eb1aaedfb016f16ul,
+    0xea9c227723ee8bcbul, 0x465e15a979c1cadcul,
+    0x92a1958a7675175ful, 0x0bfacd89ec191ec9ul,
+    0xb749faed14125d36ul, 0xcef980ec671f667bul,
+    0xe51c79a85916f484ul, 0x82b7e12780e7401aul,
+    0x8f31cc0937ae58d2ul, 0xd1b2ecb8b0908810ul,
+    0xb2fe3f0b8599ef07ul, 0x861fa7e6dcb4aa15ul,
+    0xdfbdcece67006ac9ul, 0x67a791e093e1d49aul,
+    0x8bd6a141006042bdul, 0xe0c8bb2c5c6d24e0ul,
+    0xaecc49914078536dul, 0x58fae9f773886e18ul,
+    0xda7f5bf590966848ul, 0xaf39a475506a899eul,
+    0x888f99797a5e012dul, 0x6d8406c952429603ul,
+    0xaab37fd7d8f58178ul, 0xc8e5087ba6d33b83ul,
+    0xd5605fcdcf32e1d6ul, 0xfb1e4a9a90880a64ul,
+    0x855c3be0a17fcd26ul, 0x5cf2eea09a55067ful,
+    0xa6b34ad8c9dfc06ful, 0xf42faa48c0ea481eul,
+    0xd0601d8efc57b08bul, 0xf13b94daf124da26ul,
+    0x823c12795db6ce57ul, 0x76c53d08d6b70858ul,
+    0xa2cb1717b52481edul, 0x54768c4b0c64ca6eul,
+    0xcb7ddcdda26da268ul, 0xa9942f5dcf7dfd09ul,
+    0xfe5d54150b090b02ul, 0xd3f93b35435d7c4cul,
+    0x9efa548d26e5a6e1ul, 0xc47bc5014a1a6daful,
+    0xc6b8e9b0709f109aul, 0x359ab6419ca1091bul,
+    0xf867241c8cc6d4c0ul, 0xc30163d203c94b62ul,
+    0x9b407691d7fc44f8ul, 0x79e0de63425dcf1dul,
+    0xc21094364dfb5636ul, 0x985915fc12f542e4ul,
+    0xf294b943e17a2bc4ul, 0x3e6f5b7b17b2939dul,
+    0x979cf3ca6cec5b5aul, 0xa705992ceecf9c42ul,
+    0xbd8430bd08277231ul, 0x50c6ff782a838353ul,
+    0xece53cec4a314ebdul, 0xa4f8bf5635246428ul,
+    0x940f4613ae5ed136ul, 0x871b7795e136be99ul,
+    0xb913179899f68584ul, 0x28e2557b59846e3ful,
+    0xe757dd7ec07426e5ul, 0x331aeada2fe589cful,
+    0x9096ea6f3848984ful, 0x3ff0d2c85def7621ul,
+    0xb4bca50b065abe63ul, 0x0fed077a756b53a9ul,
+    0xe1ebce4dc7f16dfbul, 0xd3e8495912c62894ul,
+    0x8d3360f09cf6e4bdul, 0x64712dd7abbbd95cul,
+    0xb080392cc4349decul, 0xbd8d794d96aacfb3ul,
+    0xdca04777f541c567ul, 0xecf0d7a0fc5583a0ul,
+    0x89e42caaf9491b60ul, 0xf41686c49db57244ul,
+    0xac5d37d5b79b6239ul, 0x311c2875c522ced5ul,
+    0xd77485cb25823ac7ul, 0x7d633293366b828bul,
+    0x86a8d39ef77164bcul, 0xae5dff9c02033197ul,
+    0xa8530886b54dbdebul, 0xd9f57f830283fdfcul,
+    0xd267caa862a12d66ul, 0xd072df63c324fd7bul,
+    0x8380dea93da4bc60ul, 0x4247cb9e59f71e6dul,
+    0xa46116538d0deb78ul, 0x52d9be85f074e608ul,
+    0xcd795be870516656ul, 0x67902e276c921f8bul,
+    0x806bd9714632dff6ul, 0x00ba1cd8a3db53b6ul,
+    0xa086cfcd97bf97f3ul, 0x80e8a40eccd228a4ul,
+    0xc8a883c0fdaf7df0ul, 0x6122cd128006b2cdul,
+    0xfad2a4b13d1b5d6cul, 0x796b805720085f81ul,
+    0x9cc3a6eec6311a63ul, 0xcbe3303674053bb0ul,
+    0xc3f490aa77bd60fcul, 0xbedbfc4411068a9cul,
+    0xf4f1b4d515acb93bul, 0xee92fb5515482d44ul,
+    0x991711052d8bf3c5ul, 0x751bdd152d4d1c4aul,
+    0xbf5cd54678eef0b6ul, 0xd262d45a78a0635dul,
+    0xef340a98172aace4ul, 0x86fb897116c87c34ul,
+    0x9580869f0e7aac0eul, 0xd45d35e6ae3d4da0ul,
+    0xbae0a846d2195712ul, 0x8974836059cca109ul,
+    0xe998d258869facd7ul, 0x2bd1a438703fc94bul,
+    0x91ff83775423cc06ul, 0x7b6306a34627ddcful,
+    0xb67f6455292cbf08ul, 0x1a3bc84c17b1d542ul,
+    0xe41f3d6a7377eecaul, 0x20caba5f1d9e4a93ul,
+    0x8e938662882af53eul, 0x547eb47b7282ee9cul,
+    0xb23867fb2a35b28dul, 0xe99e619a4f23aa43ul,
+    0xdec681f9f4c31f31ul, 0x6405fa00e2ec94d4ul,
+    0x8b3c113c38f9f37eul, 0xde83bc408dd3dd04ul,
+    0xae0b158b4738705eul, 0x9624ab50b148d445ul,
+    0xd98ddaee19068c76ul, 0x3badd624dd9b0957ul,
+    0x87f8a8d4cfa417c9ul, 0xe54ca5d70a80e5d6ul,
+    0xa9f6d30a038d1dbcul, 0x5e9fcf4ccd211f4cul,
+    0xd47487cc8470652bul, 0x7647c3200069671ful,
+    0x84c8d4dfd2c63f3bul, 0x29ecd9f40041e073ul,
+    0xa5fb0a17c777cf09ul, 0xf468107100525890ul,
+    0xcf79cc9db955c2ccul, 0x7182148d4066eeb4ul,
+    0x81ac1fe293d599bful, 0xc6f14cd848405530ul,
+    0xa21727db38cb002ful, 0xb8ada00e5a506a7cul,
+    0xca9cf1d206fdc03bul, 0xa6d90811f0e4851cul,
+    0xfd442e4688bd304aul, 0x908f4a166d1da663ul,
+    0x9e4a9cec15763e2eul, 0x9a598e4e043287feul,
+    0xc5dd44271ad3cdbaul, 0x40eff1e1853f29fdul,
+    0xf7549530e188c128ul, 0xd12bee59e68ef47cul,
+    0x9a94dd3e8cf578b9ul, 0x82bb74f8301958ceul,
+    0xc13a148e3032d6e7ul, 0xe36a52363c1faf01ul,
+    0xf18899b1bc3f8ca1ul, 0xdc44e6c3cb279ac1ul,
+    0x96f5600f15a7b7e5ul, 0x29ab103a5ef8c0b9ul,
+    0xbcb2b812db11a5deul, 0x7415d448f6b6f0e7ul,
+    0xebdf661791d60f56ul, 0x111b495b3464ad21ul,
+    0x936b9fcebb25c995ul, 0xcab10dd900beec34ul,
+    0xb84687c269ef3bfbul, 0x3d5d514f40eea742ul,
+    0xe65829b3046b0afaul, 0x0cb4a5a3112a5112ul,
+    0x8ff71a0fe2c2e6dcul, 0x47f0e785eaba72abul,
+    0xb3f4e093db73a093ul, 0x59ed216765690f56ul,
+    0xe0f218b8d25088b8ul, 0x306869c13ec3532cul,
+    0x8c974f7383725573ul, 0x1e414218c73a13fbul,
+    0xafbd2350644eeacful, 0xe5d1929ef90898faul,
+    0xdbac6c247d62a583ul, 0xdf45f746b74abf39ul,
+    0x894bc396ce5da772ul, 0x6b8bba8c328eb783ul,
+    0xab9eb47c81f5114ful, 0x066ea92f3f326564ul,
+    0xd686619ba27255a2ul, 0xc80a537b0efefebdul,
+    0x8613fd0145877585ul, 0xbd06742ce95f5f36ul,
+    0xa798fc4196e952e7ul, 0x2c48113823b73704ul,
+    0xd17f3b51fca3a7a0ul, 0xf75a15862ca504c5ul,
+    0x82ef85133de648c4ul, 0x9a984d73dbe722fbul,
+    0xa3ab66580d5fdaf5ul, 0xc13e60d0d2e0ebbaul,
+    0xcc963fee10b7d1b3ul, 0x318df905079926a8ul,
+    0xffbbcfe994e5c61ful, 0xfdf17746497f7052ul,
+    0x9fd561f1fd0f9bd3ul, 0xfeb6ea8bedefa633ul,
+    0xc7caba6e7c5382c8ul, 0xfe64a52ee96b8fc0ul,
+    0xf9bd690a1b68637bul, 0x3dfdce7aa3c673b0ul,
+    0x9c1661a651213e2dul, 0x06bea10ca65c084eul,
+    0xc31bfa0fe5698db8ul, 0x486e494fcff30a62ul,
+    0xf3e2f893dec3f126ul, 0x5a89dba3c3efccfaul,
+    0x986ddb5c6b3a76b7ul, 0xf89629465a75e01cul,
+    0xbe89523386091465ul, 0xf6bbb397f1135823ul,
+    0xee2ba6c0678b597ful, 0x746aa07ded582e2cul,
+    0x94db483840b717eful, 0xa8c2a44eb4571cdcul,
+    0xba121a4650e4ddebul, 0x92f34d62616ce413ul,
+    0xe896a0d7e51e1566ul, 0x77b020baf9c81d17ul,
+    0x915e2486ef32cd60ul, 0x0ace1474dc1d122eul,
+    0xb5b5ada8aaff80b8ul, 0x0d819992132456baul,
+    0xe3231912d5bf60e6ul, 0x10e1fff697ed6c69ul,
+    0x8df5efabc5979c8ful, 0xca8d3ffa1ef463c1ul,
+    0xb1736b96b6fd83b3ul, 0xbd308ff8a6b17cb2ul,
+    0xddd0467c64bce4a0ul, 0xac7cb3f6d05ddbdeul,
+    0x8aa22c0dbef60ee4ul, 0x6bcdf07a423aa96bul,
+    0xad4ab7112eb3929dul, 0x86c16c98d2c953c6ul,
+    0xd89d64d57a607744ul, 0xe871c7bf077ba8b7ul,
+    0x87625f056c7c4a8bul, 0x11471cd764ad4972ul,
+    0xa93af6c6c79b5d2dul, 0xd598e40d3dd89bcful,
+    0xd389b47879823479ul, 0x4aff1d108d4ec2c3ul,
+    0x843610cb4bf160cbul, 0xcedf722a585139baul,
+    0xa54394fe1eedb8feul, 0xc2974eb4ee658828ul,
+    0xce947a3da6a9273eul, 0x733d226229feea32ul,
+    0x811ccc668829b887ul, 0x0806357d5a3f525ful,
+    0xa163ff802a3426a8ul, 0xca07c2dcb0cf26f7ul,
+    0xc9bcff6034c13052ul, 0xfc89b393dd02f0b5ul,
+    0xfc2c3f3841f17c67ul, 0xbbac2078d443ace2ul,
+    0x9d9ba7832936edc0ul, 0xd54b944b84aa4c0dul,
+    0xc5029163f384a931ul, 0x0a9e795e65d4df11ul,
+    0xf64335bcf065d37dul, 0x4d4617b5ff4a16d5ul,
+    0x99ea0196163fa42eul, 0x504bced1bf8e4e45ul,
+    0xc06481fb9bcf8d39ul, 0xe45ec2862f71e1d6ul,
+    0xf07da27a82c37088ul, 0x5d767327bb4e5a4cul,
+    0x964e858c91ba2655ul, 0x3a6a07f8d510f86ful,
+    0xbbe226efb628afeaul, 0x890489f70a55368bul,
+    0xeadab0aba3b2dbe5ul, 0x2b45ac74ccea842eul,
+    0x92c8ae6b464fc96ful, 0x3b0b8bc90012929dul,
+    0xb77ada0617e3bbcbul, 0x09ce6ebb40173744ul,
+    0xe55990879ddcaabdul, 0xcc420a6a101d0515ul,
+    0x8f57fa54c2a9eab6ul, 0x9fa946824a12232dul,
+    0xb32df8e9f3546564ul, 0x47939822dc96abf9ul,
+    0xdff9772470297ebdul, 0x59787e2b93bc56f7ul,
+    0x8bfbea76c619ef36ul, 0x57eb4edb3c55b65aul,
+    0xaefae51477a06b03ul, 0xede622920b6b23f1ul,
+    0xdab99e59958885c4ul, 0xe95fab368e45ecedul,
+    0x88b402f7fd75539bul, 0x11dbcb0218ebb414ul,
+    0xaae103b5fcd2a881ul, 0xd652bdc29f26a119ul,
+    0xd59944a37c0752a2ul, 0x4be76d3346f0495ful,
+    0x857fcae62d8493a5ul, 0x6f70a4400c562ddbul,
+    0xa6dfbd9fb8e5b88eul, 0xcb4ccd500f6bb952ul,
+    0xd097ad07a71f26b2ul, 0x7e2000a41346a7a7ul,
+    0x825ecc24c873782ful, 0x8ed400668c0c28c8ul,
+    0xa2f67f2dfa90563bul, 0x728900802f0f32faul,
+    0xcbb41ef979346bcaul, 0x4f2b40a03ad2ffb9ul,
+    0xfea126b7d78186bcul, 0xe2f610c84987bfa8ul,
+    0x9f24b832e6b0f436ul, 0x0dd9ca7d2df4d7c9ul,
+    0xc6ede63fa05d3143ul, 0x91503d1c79720dbbul,
+    0xf8a95fcf88747d94ul, 0x75a44c6397ce912aul,
+    0x9b69dbe1b548ce7cul, 0xc986afbe3ee11abaul,
+    0xc24452da229b021bul, 0xfbe85badce996168ul,
+    0xf2d56790ab41c2a2ul, 0xfae27299423fb9c3ul,
+    0x97c560ba6b0919a5ul, 0xdccd879fc967d41aul,
+    0xbdb6b8e905cb600ful, 0x5400e987bbc1c920ul,
+    0xed246723473e3813ul, 0x290123e9aab23b68ul,
+    0x9436c0760c86e30bul, 0xf9a0b6720aaf6521ul,
+    0xb94470938fa89bceul, 0xf808e40e8d5b3e69ul,
+    0xe7958cb87392c2c2ul, 0xb60b1d1230b20e04ul,
+    0x90bd77f3483bb9b9ul, 0xb1c6f22b5e6f48c2ul,
+    0xb4ecd5f01a4aa828ul, 0x1e38aeb6360b1af3ul,
+    0xe2280b6c20dd5232ul, 0x25c6da63c38de1b0ul,
+    0x8d590723948a535ful, 0x579c487e5a38ad0eul,
+    0xb0af48ec79ace837ul, 0x2d835a9df0c6d851ul,
+    0xdcdb1b2798182244ul, 0xf8e431456cf88e65ul,
+    0x8a08f0f8bf0f156bul, 0x1b8e9ecb641b58fful,
+    0xac8b2d36eed2dac5ul, 0xe272467e3d222f3ful,
+    0xd7adf884aa879177ul, 0x5b0ed81dcc6abb0ful,
+    0x86ccbb52ea94baeaul, 0x98e947129fc2b4e9ul,
+    0xa87fea27a539e9a5ul, 0x3f2398d747b36224ul,
+    0xd29fe4b18e88640eul, 0x8eec7f0d19a03aadul,
+    0x83a3eeeef9153e89ul, 0x1953cf68300424acul,
+    0xa48ceaaab75a8e2bul, 0x5fa8c3423c052dd7ul,
+    0xcdb02555653131b6ul, 0x3792f412cb06794dul,
+    0x808e17555f3ebf11ul, 0xe2bbd88bbee40bd0ul,
+    0xa0b19d2ab70e6ed6ul, 0x5b6aceaeae9d0ec4ul,
+    0xc8de047564d20a8bul, 0xf245825a5a445275ul,
+    0xfb158592be068d2eul, 0xeed6e2f0f0d56712ul,
+    0x9ced737bb6c4183dul, 0x55464dd69685606bul,
+    0xc428d05aa4751e4cul, 0xaa97e14c3c26b886ul,
+    0xf53304714d9265dful, 0xd53dd99f4b3066a8ul,
+    0x993fe2c6d07b7fabul, 0xe546a8038efe4029ul,
+    0xbf8fdb78849a5f96ul, 0xde98520472bdd033ul,
+    0xef73d256a5c0f77cul, 0x963e66858f6d4440ul,
+    0x95a8637627989aadul, 0xdde7001379a44aa8ul,
+    0xbb127c53b17ec159ul, 0x5560c018580d5d52ul,
+    0xe9d71b689dde71aful, 0xaab8f01e6e10b4a6ul,
+    0x9226712162ab070dul, 0xcab3961304ca70e8ul,
+    0xb6b00d69bb55c8d1ul, 0x3d607b97c5fd0d22ul,
+    0xe45c10c42a2b3b05ul, 0x8cb89a7db77c506aul,
+    0x8eb98a7a9a5b04e3ul, 0x77f3608e92adb242ul,
+    0xb267ed1940f1c61cul, 0x55f038b237591ed3ul,
+    0xdf01e85f912e37a3ul, 0x6b6c46dec52f6688ul,
+    0x8b61313bbabce2c6ul, 0x2323ac4b3b3da015ul,
+    0xae397d8aa96c1b77ul, 0xabec975e0a0d081aul,
+    0xd9c7dced53c72255ul, 0x96e7bd358c904a21ul,
+    0x881cea14545c7575ul, 0x7e50d64177da2e54ul,
+    0xaa242499697392d2ul, 0xdde50bd1d5d0b9e9ul,
+    0xd4ad2dbfc3d07787ul, 0x955e4ec64b44e864ul,
+    0x84ec3c97da624ab4ul, 0xbd5af13bef0b113eul,
+    0xa6274bbdd0fadd61ul, 0xecb1ad8aeacdd58eul,
+    0xcfb11ead453994baul, 0x67de18eda5814af2ul,
+    0x81ceb32c4b43fcf4ul, 0x80eacf948770ced7ul,
+    0xa2425ff75e14fc31ul, 0xa1258379a94d028dul,
+    0xcad2f7f5359a3b3eul, 0x096ee45813a04330ul,
+    0xfd87b5f28300ca0dul, 0x8bca9d6e188853fcul,
+    0x9e74d1b791e07e48ul, 0x775ea264cf55347eul,
+    0xc612062576589ddaul, 0x95364afe032a819eul,
+    0xf79687aed3eec551ul, 0x3a83ddbd83f52205ul,
+    0x9abe14cd44753b52ul, 0xc4926a9672793543ul,
+    0xc16d9a0095928a27ul, 0x75b7053c0f178294ul,
+    0xf1c90080baf72cb1ul, 0x5324c68b12dd6339ul,
+    0x971da05074da7beeul, 0xd3f6fc16ebca5e04ul,
+    0xbce5086492111aeaul, 0x88f4bb1ca6bcf585ul,
+    0xec1e4a7db69561a5ul, 0x2b31e9e3d06c32e6ul,
+    0x9392ee8e921d5d07ul, 0x3aff322e62439fd0ul,
+    0xb877aa3236a4b449ul, 0x09befeb9fad487c3ul,
+    0xe69594bec44de15bul, 0x4c2ebe687989a9b4ul,
+    0x901d7cf73ab0acd9ul, 0x0f9d37014bf60a11ul,
+    0xb424dc35095cd80ful, 0x538484c19ef38c95ul,
+    0xe12e13424bb40e13ul, 0x2865a5f206b06fbaul,
+    0x8cbccc096f5088cbul, 0xf93f87b7442e45d4ul,
+    0xafebff0bcb24aafeul, 0xf78f69a51539d749ul,
+    0xdbe6fecebdedd5beul, 0xb573440e5a884d1cul,
+    0x89705f4136b4a597ul, 0x31680a88f8953031ul,
+    0xabcc77118461cefcul, 0xfdc20d2b36ba7c3eul,
+    0xd6bf94d5e57a42bcul, 0x3d32907604691b4dul,
+    0x8637bd05af6c69b5ul, 0xa63f9a49c2c1b110ul,
+    0xa7c5ac471b478423ul, 0x0fcf80dc33721d54ul,
+    0xd1b71758e219652bul, 0xd3c36113404ea4a9ul,
+    0x83126e978d4fdf3bul, 0x645a1cac083126eaul,
+    0xa3d70a3d70a3d70aul, 0x3d70a3d70a3d70a4ul,
+    0xccccccccccccccccul, 0xcccccccccccccccdul,
+    0x8000000000000000ul, 0x0000000000000000ul,
+    0xa000000000000000ul, 0x0000000000000000ul,
+    0xc800000000000000ul, 0x0000000000000000ul,
+    0xfa00000000000000ul, 0x0000000000000000ul,
+    0x9c40000000000000ul, 0x0000000000000000ul,
+    0xc350000000000000ul, 0x0000000000000000ul,
+    0xf424000000000000ul, 0x0000000000000000ul,
+    0x9896800000000000ul, 0x0000000000000000ul,
+    0xbebc200000000000ul, 0x0000000000000000ul,
+    0xee6b280000000000ul, 0x0000000000000000ul,
+    0x9502f90000000000ul, 0x0000000000000000ul,
+    0xba43b74000000000ul, 0x0000000000000000ul,
+    0xe8d4a51000000000ul, 0x0000000000000000ul,
+    0x9184e72a00000000ul, 0x0000000000000000ul,
+    0xb5e620f480000000ul, 0x0000000000000000ul,
+    0xe35fa931a0000000ul, 0x0000000000000000ul,
+    0x8e1bc9bf04000000ul, 0x0000000000000000ul,
+    0xb1a2bc2ec5000000ul, 0x0000000000000000ul,
+    0xde0b6b3a76400000ul, 0x0000000000000000ul,
+    0x8ac7230489e80000ul, 0x0000000000000000ul,
+    0xad78ebc5ac620000ul, 0x0000000000000000ul,
+    0xd8d726b7177a8000ul, 0x0000000000000000ul,
+    0x878678326eac9000ul, 0x0000000000000000ul,
+    0xa968163f0a57b400ul, 0x0000000000000000ul,
+    0xd3c21bcecceda100ul, 0x0000000000000000ul,
+    0x84595161401484a0ul, 0x0000000000000000ul,
+    0xa56fa5b99019a5c8ul, 0x0000000000000000ul,
+    0xcecb8f27f4200f3aul, 0x0000000000000000ul,
+    0x813f3978f8940984ul, 0x4000000000000000ul,
+    0xa18f07d736b90be5ul, 0x5000000000000000ul,
+    0xc9f2c9cd04674edeul, 0xa400000000000000ul,
+    0xfc6f7c4045812296ul, 0x4d00000000000000ul,
+    0x9dc5ada82b70b59dul, 0xf020000000000000ul,
+    0xc5371912364ce305ul, 0x6c28000000000000ul,
+    0xf684df56c3e01bc6ul, 0xc732000000000000ul,
+    0x9a130b963a6c115cul, 0x3c7f400000000000ul,
+    0xc097ce7bc90715b3ul, 0x4b9f100000000000ul,
+    0xf0bdc21abb48db20ul, 0x1e86d40000000000ul,
+    0x96769950b50d88f4ul, 0x1314448000000000ul,
+    0xbc143fa4e250eb31ul, 0x17d955a000000000ul,
+    0xeb194f8e1ae525fdul, 0x5dcfab0800000000ul,
+    0x92efd1b8d0cf37beul, 0x5aa1cae500000000ul,
+    0xb7abc627050305adul, 0xf14a3d9e40000000ul,
+    0xe596b7b0c643c719ul, 0x6d9ccd05d0000000ul,
+    0x8f7e32ce7bea5c6ful, 0xe4820023a2000000ul,
+    0xb35dbf821ae4f38bul, 0xdda2802c8a800000ul,
+    0xe0352f62a19e306eul, 0xd50b2037ad200000ul,
+    0x8c213d9da502de45ul, 0x4526f422cc340000ul,
+    0xaf298d050e4395d6ul, 0x9670b12b7f410000ul,
+    0xdaf3f04651d47b4cul, 0x3c0cdd765f114000ul,
+    0x88d8762bf324cd0ful, 0xa5880a69fb6ac800ul,
+    0xab0e93b6efee0053ul, 0x8eea0d047a457a00ul,
+    0xd5d238a4abe98068ul, 0x72a4904598d6d880ul,
+    0x85a36366eb71f041ul, 0x47a6da2b7f864750ul,
+    0xa70c3c40a64e6c51ul, 0x999090b65f67d924ul,
+    0xd0cf4b50cfe20765ul, 0xfff4b4e3f741cf6dul,
+    0x82818f1281ed449ful, 0xbff8f10e7a8921a4ul,
+    0xa321f2d7226895c7ul, 0xaff72d52192b6a0dul,
+    0xcbea6f8ceb02bb39ul, 0x9bf4f8a69f764490ul,
+    0xfee50b7025c36a08ul, 0x02f236d04753d5b4ul,
+    0x9f4f2726179a2245ul, 0x01d762422c946590ul,
+    0xc722f0ef9d80aad6ul, 0x424d3ad2b7b97ef5ul,
+    0xf8ebad2b84e0d58bul, 0xd2e0898765a7deb2ul,
+    0x9b934c3b330c8577ul, 0x63cc55f49f88eb2ful,
+    0xc2781f49ffcfa6d5ul, 0x3cbf6b71c76b25fbul,
+    0xf316271c7fc3908aul, 0x8bef464e3945ef7aul,
+    0x97edd871cfda3a56ul, 0x97758bf0e3cbb5acul,
+    0xbde94e8e43d0c8ecul, 0x3d52eeed1cbea317ul,
+    0xed63a231d4c4fb27ul, 0x4ca7aaa863ee4bddul,
+    0x945e455f24fb1cf8ul, 0x8fe8caa93e74ef6aul,
+    0xb975d6b6ee39e436ul, 0xb3e2fd538e122b44ul,
+    0xe7d34c64a9c85d44ul, 0x60dbbca87196b616ul,
+    0x90e40fbeea1d3a4aul, 0xbc8955e946fe31cdul,
+    0xb51d13aea4a488ddul, 0x6babab6398bdbe41ul,
+    0xe264589a4dcdab14ul, 0xc696963c7eed2dd1ul,
+    0x8d7eb76070a08aecul, 0xfc1e1de5cf543ca2ul,
+    0xb0de65388cc8ada8ul, 0x3b25a55f43294bcbul,
+    0xdd15fe86affad912ul, 0x49ef0eb713f39ebeul,
+    0x8a2dbf142dfcc7abul, 0x6e3569326c784337ul,
+    0xacb92ed9397bf996ul, 0x49c2c37f07965404ul,
+    0xd7e77a8f87daf7fbul, 0xdc33745ec97be906ul,
+    0x86f0ac99b4e8dafdul, 0x69a028bb3ded71a3ul,
+    0xa8acd7c0222311bcul, 0xc40832ea0d68ce0cul,
+    0xd2d80db02aabd62bul, 0xf50a3fa490c30190ul,
+    0x83c7088e1aab65dbul, 0x792667c6da79e0faul,
+    0xa4b8cab1a1563f52ul, 0x577001b891185938ul,
+    0xcde6fd5e09abcf26ul, 0xed4c0226b55e6f86ul,
+    0x80b05e5ac60b6178ul, 0x544f8158315b05b4ul,
+    0xa0dc75f1778e39d6ul, 0x696361ae3db1c721ul,
+    0xc913936dd571c84cul, 0x03bc3a19cd1e38e9ul,
+    0xfb5878494ace3a5ful, 0x04ab48a04065c723ul,
+    0x9d174b2dcec0e47bul, 0x62eb0d64283f9c76ul,
+    0xc45d1df942711d9aul, 0x3ba5d0bd324f8394ul,
+    0xf5746577930d6500ul, 0xca8f44ec7ee36479ul,
+    0x9968bf6abbe85f20ul, 0x7e998b13cf4e1ecbul,
+    0xbfc2ef456ae276e8ul, 0x9e3fedd8c321a67eul,
+    0xefb3ab16c59b14a2ul, 0xc5cfe94ef3ea101eul,
+    0x95d04aee3b80ece5ul, 0xbba1f1d158724a12ul,
+    0xbb445da9ca61281ful, 0x2a8a6e45ae8edc97ul,
+    0xea1575143cf97226ul, 0xf52d09d71a3293bdul,
+    0x924d692ca61be758ul, 0x593c2626705f9c56ul,
+    0xb6e0c377cfa2e12eul, 0x6f8b2fb00c77836cul,
+    0xe498f455c38b997aul, 0x0b6dfb9c0f956447ul,
+    0x8edf98b59a373fecul, 0x4724bd4189bd5eacul,
+    0xb2977ee300c50fe7ul, 0x58edec91ec2cb657ul,
+    0xdf3d5e9bc0f653e1ul, 0x2f2967b66737e3edul,
+    0x8b865b215899f46cul, 0xbd79e0d20082ee74ul,
+    0xae67f1e9aec07187ul, 0xecd8590680a3aa11ul,
+    0xda01ee641a708de9ul, 0xe80e6f4820cc9495ul,
+    0x884134fe908658b2ul, 0x3109058d147fdcddul,
+    0xaa51823e34a7eedeul, 0xbd4b46f0599fd415ul,
+    0xd4e5e2cdc1d1ea96ul, 0x6c9e18ac7007c91aul,
+    0x850fadc09923329eul, 0x03e2cf6bc604ddb0ul,
+    0xa6539930bf6bff45ul, 0x84db8346b786151cul,
+    0xcfe87f7cef46ff16ul, 0xe612641865679a63ul,
+    0x81f14fae158c5f6eul, 0x4fcb7e8f3f60c07eul,
+    0xa26da3999aef7749ul, 0xe3be5e330f38f09dul,
+    0xcb090c8001ab551cul, 0x5cadf5bfd3072cc5ul,
+    0xfdcb4fa002162a63ul, 0x73d9732fc7c8f7f6ul,
+    0x9e9f11c4014dda7eul, 0x2867e7fddcdd9afaul,
+    0xc646d63501a1511dul, 0xb281e1fd541501b8ul,
+    0xf7d88bc24209a565ul, 0x1f225a7ca91a4226ul,
+    0x9ae757596946075ful, 0x3375788de9b06958ul,
+    0xc1a12d2fc3978937ul, 0x0052d6b1641c83aeul,
+    0xf209787bb47d6b84ul, 0xc0678c5dbd23a49aul,
+    0x9745eb4d50ce6332ul, 0xf840b7ba963646e0ul,
+    0xbd176620a501fbfful, 0xb650e5a93bc3d898ul,
+    0xec5d3fa8ce427afful, 0xa3e51f138ab4cebeul,
+    0x93ba47c980e98cdful, 0xc66f336c36b10137ul,
+    0xb8a8d9bbe123f017ul, 0xb80b0047445d4184ul,
+    0xe6d3102ad96cec1dul, 0xa60dc059157491e5ul,
+    0x9043ea1ac7e41392ul, 0x87c89837ad68db2ful,
+    0xb454e4a179dd1877ul, 0x29babe4598c311fbul,
+    0xe16a1dc9d8545e94ul, 0xf4296dd6fef3d67aul,
+    0x8ce2529e2734bb1dul, 0x1899e4a65f58660cul,
+    0xb01ae745b101e9e4ul, 0x5ec05dcff72e7f8ful,
+    0xdc21a1171d42645dul, 0x76707543f4fa1f73ul,
+    0x899504ae72497ebaul, 0x6a06494a791c53a8ul,
+    0xabfa45da0edbde69ul, 0x0487db9d17636892ul,
+    0xd6f8d7509292d603ul, 0x45a9d2845d3c42b6ul,
+    0x865b86925b9bc5c2ul, 0x0b8a2392ba45a9b2ul,
+    0xa7f26836f282b732ul, 0x8e6cac7768d7141eul,
+    0xd1ef0244af2364fful, 0x3207d795430cd926ul,
+    0x8335616aed761f1ful, 0x7f44e6bd49e807b8ul,
+    0xa402b9c5a8d3a6e7ul, 0x5f16206c9c6209a6ul,
+    0xcd036837130890a1ul, 0x36dba887c37a8c0ful,
+    0x802221226be55a64ul, 0xc2494954da2c9789ul,
+    0xa02aa96b06deb0fdul, 0xf2db9baa10b7bd6cul,
+    0xc83553c5c8965d3dul, 0x6f92829494e5acc7ul,
+    0xfa42a8b73abbf48cul, 0xcb772339ba1f17f9ul,
+    0x9c69a97284b578d7ul, 0xff2a760414536efbul,
+    0xc38413cf25e2d70dul, 0xfef5138519684abaul,
+    0xf46518c2ef5b8cd1ul, 0x7eb258665fc25d69ul,
+    0x98bf2f79d5993802ul, 0xef2f773ffbd97a61ul,
+    0xbeeefb584aff8603ul, 0xaafb550ffacfd8faul,
+    0xeeaaba2e5dbf6784ul, 0x95ba2a53f983cf38ul,
+    0x952ab45cfa97a0b2ul, 0xdd945a747bf26183ul,
+    0xba756174393d88dful, 0x94f971119aeef9e4ul,
+    0xe912b9d1478ceb17ul, 0x7a37cd5601aab85dul,
+    0x91abb422ccb812eeul, 0xac62e055c10ab33aul,
+    0xb616a12b7fe617aaul, 0x577b986b314d6009ul,
+    0xe39c49765fdf9d94ul, 0xed5a7e85fda0b80bul,
+    0x8e41ade9fbebc27dul, 0x14588f13be847307ul,
+    0xb1d219647ae6b31cul, 0x596eb2d8ae258fc8ul,
+    0xde469fbd99a05fe3ul, 0x6fca5f8ed9aef3bbul,
+    0x8aec23d680043beeul, 0x25de7bb9480d5854ul,
+    0xada72ccc20054ae9ul, 0xaf561aa79a10ae6aul,
+    0xd910f7ff28069da4ul, 0x1b2ba1518094da04ul,
+    0x87aa9aff79042286ul, 0x90fb44d2f05d0842ul,
+    0xa99541bf57452b28ul, 0x353a1607ac744a53ul,
+    0xd3fa922f2d1675f2ul, 0x42889b8997915ce8ul,
+    0x847c9b5d7c2e09b7ul, 0x69956135febada11ul,
+    0xa59bc234db398c25ul, 0x43fab9837e699095ul,
+    0xcf02b2c21207ef2eul, 0x94f967e45e03f4bbul,
+    0x8161afb94b44f57dul, 0x1d1be0eebac278f5ul,
+    0xa1ba1ba79e1632dcul, 0x6462d92a69731732ul,
+    0xca28a291859bbf93ul, 0x7d7b8f7503cfdcfeul,
+    0xfcb2cb35e702af78ul, 0x5cda735244c3d43eul,
+    0x9defbf01b061adabul, 0x3a0888136afa64a7ul,
+    0xc56baec21c7a1916ul, 0x088aaa1845b8fdd0ul,
+    0xf6c69a72a3989f5bul, 0x8aad549e57273d45ul,
+    0x9a3c2087a63f6399ul, 0x36ac54e2f678864bul,
+    0xc0cb28a98fcf3c7ful, 0x84576a1bb416a7ddul,
+    0xf0fdf2d3f3c30b9ful, 0x656d44a2a11c51d5ul,
+    0x969eb7c47859e743ul, 0x9f644ae5a4b1b325ul,
+    0xbc4665b596706114ul, 0x873d5d9f0dde1feeul,
+    0xeb57ff22fc0c7959ul, 0xa90cb506d155a7eaul,
+    0x9316ff75dd87cbd8ul, 0x09a7f12442d588f2ul,
+    0xb7dcbf5354e9beceul, 0x0c11ed6d538aeb2ful,
+    0xe5d3ef282a242e81ul, 0x8f1668c8a86da5faul,
+    0x8fa475791a569d10ul, 0xf96e017d694487bcul,
+    0xb38d92d760ec4455ul, 0x37c981dcc395a9acul,
+    0xe070f78d3927556aul, 0x85bbe253f47b1417ul,
+    0x8c469ab843b89562ul, 0x93956d7478ccec8eul,
+    0xaf58416654a6babbul, 0x387ac8d1970027b2ul,
+    0xdb2e51bfe9d0696aul, 0x06997b05fcc0319eul,
+    0x88fcf317f22241e2ul, 0x441fece3bdf81f03ul,
+    0xab3c2fddeeaad25aul, 0xd527e81cad7626c3ul,
+    0xd60b3bd56a5586f1ul, 0x8a71e223d8d3b074ul,
+    0x85c7056562757456ul, 0xf6872d5667844e49ul,
+    0xa738c6bebb12d16cul, 0xb428f8ac016561dbul,
+    0xd106f86e69d785c7ul, 0xe13336d701beba52ul,
+    0x82a45b450226b39cul, 0xecc0024661173473ul,
+    0xa34d721642b06084ul, 0x27f002d7f95d0190ul,
+    0xcc20ce9bd35c78a5ul, 0x31ec038df7b441f4ul,
+    0xff290242c83396ceul, 0x7e67047175a15271ul,
+    0x9f79a169bd203e41ul, 0x0f0062c6e984d386ul,
+    0xc75809c42c684dd1ul, 0x52c07b78a3e60868ul,
+    0xf92e0c3537826145ul, 0xa7709a56ccdf8a82ul,
+    0x9bbcc7a142b17ccbul, 0x88a66076400bb691ul,
+    0xc2abf989935ddbfeul, 0x6acff893d00ea435ul,
+    0xf356f7ebf83552feul, 0x0583f6b8c4124d43ul,
+    0x98165af37b2153deul, 0xc3727a337a8b704aul,
+    0xbe1bf1b059e9a8d6ul, 0x744f18c0592e4c5cul,
+    0xeda2ee1c7064130cul, 0x1162def06f79df73ul,
+    0x9485d4d1c63e8be7ul, 0x8addcb5645ac2ba8ul,
+    0xb9a74a0637ce2ee1ul, 0x6d953e2bd7173692ul,
+    0xe8111c87c5c1ba99ul, 0xc8fa8db6ccdd0437ul,
+    0x910ab1d4db9914a0ul, 0x1d9c9892400a22a2ul,
+    0xb54d5e4a127f59c8ul, 0x2503beb6d00cab4bul,
+    0xe2a0b5dc971f303aul, 0x2e44ae64840fd61dul,
+    0x8da471a9de737e24ul, 0x5ceaecfed289e5d2ul,
+    0xb10d8e1456105dadul, 0x7425a83e872c5f47ul,
+    0xdd50f1996b947518ul, 0xd12f124e28f77719ul,
+    0x8a5296ffe33cc92ful, 0x82bd6b70d99aaa6ful,
+    0xace73cbfdc0bfb7bul, 0x636cc64d1001550bul,
+    0xd8210befd30efa5aul, 0x3c47f7e05401aa4eul,
+    0x8714a775e3e95c78ul, 0x65acfaec34810a71ul,
+    0xa8d9d1535ce3b396ul, 0x7f1839a741a14d0dul,
+    0xd31045a8341ca07cul, 0x1ede48111209a050ul,
+    0x83ea2b892091e44dul, 0x934aed0aab460432ul,
+    0xa4e4b66b68b65d60ul, 0xf81da84d5617853ful,
+    0xce1de40642e3f4b9ul, 0x36251260ab9d668eul,
+    0x80d2ae83e9ce78f3ul, 0xc1d72b7c6b426019ul,
+    0xa1075a24e4421730ul, 0xb24cf65b8612f81ful,
+    0xc94930ae1d529cfcul, 0xdee033f26797b627ul,
+    0xfb9b7cd9a4a7443cul, 0x169840ef017da3b1ul,
+    0x9d412e0806e88aa5ul, 0x8e1f289560ee864eul,
+    0xc491798a08a2ad4eul, 0xf1a6f2bab92a27e2ul,
+    0xf5b5d7ec8acb58a2ul, 0xae10af696774b1dbul,
+    0x9991a6f3d6bf1765ul, 0xacca6da1e0a8ef29ul,
+    0xbff610b0cc6edd3ful, 0x17fd090a58d32af3ul,
+    0xeff394dcff8a948eul, 0xddfc4b4cef07f5b0ul,
+    0x95f83d0a1fb69cd9ul, 0x4abdaf101564f98eul,
+    0xbb764c4ca7a4440ful, 0x9d6d1ad41abe37f1ul,
+    0xea53df5fd18d5513ul, 0x84c86189216dc5edul,
+    0x92746b9be2f8552cul, 0x32fd3cf5b4e49bb4ul,
+    0xb7118682dbb66a77ul, 0x3fbc8c33221dc2a1ul,
+    0xe4d5e82392a40515ul, 0x0fabaf3feaa5334aul,
+    0x8f05b1163ba6832dul, 0x29cb4d87f2a7400eul,
+    0xb2c71d5bca9023f8ul, 0x743e20e9ef511012ul,
+    0xdf78e4b2bd342cf6ul, 0x914da9246b255416ul,
+    0x8bab8eefb6409c1aul, 0x1ad089b6c2f7548eul,
+    0xae9672aba3d0c320ul, 0xa184ac2473b529b1ul,
+    0xda3c0f568cc4f3e8ul, 0xc9e5d72d90a2741eul,
+    0x8865899617fb1871ul, 0x7e2fa67c7a658892ul,
+    0xaa7eebfb9df9de8dul, 0xddbb901b98feeab7ul,
+    0xd51ea6fa85785631ul, 0x552a74227f3ea565ul,
+    0x8533285c936b35deul, 0xd53a88958f87275ful,
+    0xa67ff273b8460356ul, 0x8a892abaf368f137ul,
+    0xd01fef10a657842cul, 0x2d2b7569b0432d85ul,
+    0x8213f56a67f6b29bul, 0x9c3b29620e29fc73ul,
+    0xa298f2c501f45f42ul, 0x8349f3ba91b47b8ful,
+    0xcb3f2f7642717713ul, 0x241c70a936219a73ul,
+    0xfe0efb53d30dd4d7ul, 0xed238cd383aa0110ul,
+    0x9ec95d1463e8a506ul, 0xf4363804324a40aaul,
+    0xc67bb4597ce2ce48ul, 0xb143c6053edcd0d5ul,
+    0xf81aa16fdc1b81daul, 0xdd94b7868e94050aul,
+    0x9b10a4e5e9913128ul, 0xca7cf2b4191c8326ul,
+    0xc1d4ce1f63f57d72ul, 0xfd1c2f611f63a3f0ul,
+    0xf24a01a73cf2dccful, 0xbc633b39673c8cecul,
+    0x976e41088617ca01ul, 0xd5be0503e085d813ul,
+    0xbd49d14aa79dbc82ul, 0x4b2d8644d8a74e18ul,
+    0xec9c459d51852ba2ul, 0xddf8e7d60ed1219eul,
+    0x93e1ab8252f33b45ul, 0xcabb90e5c942b503ul,
+    0xb8da1662e7b00a17ul, 0x3d6a751f3b936243ul,
+    0xe7109bfba19c0c9dul, 0x0cc512670a783ad4ul,
+    0x906a617d450187e2ul, 0x27fb2b80668b24c5ul,
+    0xb484f9dc9641e9daul, 0xb1f9f660802dedf6ul,
+    0xe1a63853bbd26451ul, 0x5e7873f8a0396973ul,
+    0x8d07e33455637eb2ul, 0xdb0b487b6423e1e8ul,
+    0xb049dc016abc5e5ful, 0x91ce1a9a3d2cda62ul,
+    0xdc5c5301c56b75f7ul, 0x7641a140cc7810fbul,
+    0x89b9b3e11b6329baul, 0xa9e904c87fcb0a9dul,
+    0xac2820d9623bf429ul, 0x546345fa9fbdcd44ul,
+    0xd732290fbacaf133ul, 0xa97c177947ad4095ul,
+    0x867f59a9d4bed6c0ul, 0x49ed8eabcccc485dul,
+    0xa81f301449ee8c70ul, 0x5c68f256bfff5a74ul,
+    0xd226fc195c6a2f8cul, 0x73832eec6fff3111ul,
+    0x83585d8fd9c25db7ul, 0xc831fd53c5ff7eabul,
+    0xa42e74f3d032f525ul, 0xba3e7ca8b77f5e55ul,
+    0xcd3a1230c43fb26ful, 0x28ce1bd2e55f35ebul,
+    0x80444b5e7aa7cf85ul, 0x7980d163cf5b81b3ul,
+    0xa0555e361951c366ul, 0xd7e105bcc332621ful,
+    0xc86ab5c39fa63440ul, 0x8dd9472bf3fefaa7ul,
+    0xfa856334878fc150ul, 0xb14f98f6f0feb951ul,
+    0x9c935e00d4b9d8d2ul, 0x6ed1bf9a569f33d3ul,
+    0xc3b8358109e84f07ul, 0x0a862f80ec4700c8ul,
+    0xf4a642e14c6262c8ul, 0xcd27bb612758c0faul,
+    0x98e7e9cccfbd7dbdul, 0x8038d51cb897789cul,
+    0xbf21e44003acdd2cul, 0xe0470a63e6bd56c3ul,
+    0xeeea5d5004981478ul, 0x1858ccfce06cac74ul,
+    0x95527a5202df0ccbul, 0x0f37801e0c43ebc8ul,
+    0xbaa718e68396cffdul, 0xd30560258f54e6baul,
+    0xe950df20247c83fdul, 0x47c6b82ef32a2069ul,
+    0x91d28b7416cdd27eul, 0x4cdc331d57fa5441ul,
+    0xb6472e511c81471dul, 0xe0133fe4adf8e952ul,
+    0xe3d8f9e563a198e5ul, 0x58180fddd97723a6ul,
+    0x8e679c2f5e44ff8ful, 0x570f09eaa7ea7648ul,
+};
+
+inline bool is_digit(char c) {
+    return static_cast<unsigned char>(c - '0') < 10;
+}
+
+//! Check that all eight bytes of the word are decimal digits
+inline bool is_eight_digits(u64 val) {
+    return (((val + 0x4646464646464646ul) | (val - 0x3030303030303030ul)) & 0x8080808080808080ul) == 0;
+}
+
+//! Convert eight digits (first character is most significant)
+inline u64 parse_eight_digits(u64 val) {
+    val -= 0x3030303030303030ul;
+    val = (val * 10) + (val >> 8);
+    val = (((val & 0x000000FF000000FFul) * 0x000F424000000064ul)
+        + (((val >> 16) & 0x000000FF000000FFul) * 0x0000271000000001ul)) >> 32;
+    return val;
+}
+
+//! Read digits, returns pointer to the first non-digit character
+inline const char* parse_digits(const char* p, const char* end, u64* w) {
+    u64 acc = *w;
+    while (end - p >= 8) {
+        u64 val;
+        memcpy(&val, p, sizeof(val));
+        if (!is_eight_digits(val)) {
+            break;
+        }
+        acc = acc*100000000ul + parse_eight_digits(val);
+        p += 8;
+    }
+    while (p != end && is_digit(*p)) {
+        acc = acc*10 + static_cast<u64>(*p - '0');
+        p++;
+    }
+    *w = acc;
+    return p;
+}
+
+/** Compute binary64 representation of `w * 10^q` (sign bit is not set).
+  * Returns false if the result can't be computed exactly.
+  */
+bool compute_float(int q, u64 w, u64* bits) {
+    if (w == 0 || q < SMALLEST_POWER_OF_FIVE) {
+        *bits = 0;
+        return true;
+    }
+    if (q > LARGEST_POWER_OF_FIVE) {
+        *bits = static_cast<u64>(INFINITE_POWER) << MANTISSA_BITS;
+        return true;
+    }
+    int lz = __builtin_clzll(w);
+    w <<= lz;
+
+    // Product of the normalized mantissa and 128-bit approximation of 5^q,
+    // only 55 most significant bits are needed.
+    const size_t index = 2*static_cast<size_t>(q - SMALLEST_POWER_OF_FIVE);
+    unsigned __int128 first = static_cast<unsigned __int128>(w) * POWER_OF_FIVE_128[index];
+    u64 high = static_cast<u64>(first >> 64);
+    u64 low = static_cast<u64>(first);
+    const u64 precision_mask = 0xFFFFFFFFFFFFFFFFul >> (MANTISSA_BITS + 3);
+    if ((high & precision_mask) == precision_mask) {
+        // Lower bits of the product are not known, use next 64 bits of the power
+        unsigned __int128 second = static_cast<unsigned __int128>(w) * POWER_OF_FIVE_128[index + 1];
+        u64 second_high = static_cast<u64>(second >> 64);
+        low += second_high;
+        if (second_high > low) {
+            high++;
+        }
+        if (low == 0xFFFFFFFFFFFFFFFFul && (q < -27 || q > 55)) {
+            return false;
+        }
+    }
+
+    int upperbit = static_cast<int>(high >> 63);
+    u64 mantissa = high >> (upperbit + 64 - MANTISSA_BITS - 3);
+    // floor(log2(10^q)) + 63
+    int power2 = (((152170 + 65536) * q) >> 16) + 63 + upperbit - lz - MINIMUM_EXPONENT;
+
+    if (power2 <= 0) {
+        // Subnormal number
+        if (-power2 + 1 >= 64) {
+            *bits = 0;
+            return true;
+        }
+        mantissa >>= -power2 + 1;
+        mantissa += (mantissa & 1);
+        mantissa >>= 1;
+        // Rounding can produce smallest normal number
+        power2 = (mantissa < (1ul << MANTISSA_BITS)) ? 0 : 1;
+        *bits = (mantissa & ~(1ul << MANTISSA_BITS)) | (static_cast<u64>(power2) << MANTISSA_BITS);
+        return true;
+    }
+
+    // Value is exactly between two floats, round to even
+    if (low <= 1 && q >= MIN_EXPONENT_ROUND_TO_EVEN && q <= MAX_EXPONENT_ROUND_TO_EVEN
+            && (mantissa & 3) == 1) {
+        if ((mantissa << (upperbit + 64 - MANTISSA_BITS - 3)) == high) {
+            mantissa &= ~1ul;
+        }
+    }
+    mantissa += (mantissa & 1);
+    mantissa >>= 1;
+    if (mantissa >= (2ul << MANTISSA_BITS)) {
+        mantissa = 1ul << MANTISSA_BITS;
+        power2++;
+    }
+    mantissa &= ~(1ul << MANTISSA_BITS);
+    if (power2 >= INFINITE_POWER) {
+        power2 = INFINITE_POWER;
+        mantissa = 0;
+    }
+    *bits = mantissa | (static_cast<u64>(power2) << MANTISSA_BITS);
+    return true;
+}
+
+const char* parse_with_strtod(const char* begin, double* result) {
+    char* endptr = nullptr;
+    *result = strtod(begin, &endptr);
+    return endptr;
+}
+
+}  // namespace
+
+const char* NumParser::parse_double(const char* begin, const char* end, double* result) {
+    const char* p = begin;
+    bool negative = false;
+    if (p != end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+    const char* digits = p;
+    u64 w = 0;
+    p = parse_digits(p, end, &w);
+    long ndigits = p - digits;
+    if (p != end && (*p == 'x' || *p == 'X')) {
+        // Hexadecimal float
+        return parse_with_strtod(begin, result);
+    }
+    long exponent = 0;
+    if (p != end && *p == '.') {
+        p++;
+        const char* fraction = p;
+        p = parse_digits(p, end, &w);
+        exponent = fraction - p;
+        ndigits += p - fraction;
+    }
+    if (ndigits == 0) {
+        // Not a decimal number (nan, inf, hexadecimal float, etc)
+        return parse_with_strtod(begin, result);
+    }
+    if (p != end && (*p == 'e' || *p == 'E')) {
+        const char* pexp = p++;
+        bool negexp = false;
+        if (p != end && (*p == '-' || *p == '+')) {
+            negexp = *p == '-';
+            p++;
+        }
+        if (p == end || !is_digit(*p)) {
+            // Not an exponent, e.g. "1e"
+            p = pexp;
+        } else {
+            long e = 0;
+            while (p != end && is_digit(*p)) {
+                if (e < 0x10000) {
+                    e = e*10 + (*p - '0');
+                }
+                p++;
+            }
+            exponent += negexp ? -e : e;
+        }
+    }
+    if (ndigits > MAX_DIGITS) {
+        // Leading zeroes are not significant
+        long nzeroes = 0;
+        for (const char* it = digits; it != end && (*it == '0' || *it == '.'); it++) {
+            nzeroes += *it == '0';
+        }
+        if (ndigits - nzeroes > MAX_DIGITS) {
+            return parse_with_strtod(begin, result);
+        }
+    }
+    if (exponent == 0) {
+        // Integer fast path (conversion is correctly rounded)
+        double value = static_cast<double>(w);
+        *result = negative ? -value : value;
+        return p;
+    }
+    if (exponent < -0x10000) {
+        exponent = -0x10000;
+    } else if (exponent > 0x10000) {
+        exponent = 0x10000;
+    }
+    u64 bits;
+    if (!compute_float(static_cast<int>(exponent), w, &bits)) {
+        return parse_with_strtod(begin, result);
+    }
+    bits |= static_cast<u64>(negative) << 63;
+    memcpy(result, &bits, sizeof(bits));
+    return p;
+}
+
+}  // namespace
@@ -0,0 +1,44 @@
+/**
+ * Copyright (c) 2016 Eugene Lazin <4lazin@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "akumuli_def.h"
+
+namespace Akumuli {
+
+/** Locale independent decimal to double conversion.
+  * Parses `[+-]digits[.digits][(e|E)[+-]digits]` directly from the input span
+  * without copying. Numbers without fraction and exponent (most metric values)
+  * are converted using the integer fast path, everything else is converted using
+  * Eisel-Lemire algorithm (result is correctly rounded, same as `strtod`).
+  * Input that can't be handled (more than 19 significant digits, "inf", "nan",
+  * hexadecimal floats, etc) is passed to `strtod`.
+  */
+struct NumParser {
+
+    /** Parse double value.
+      * @param begin points to the first character
+      * @param end points to the end of the span (`end` should be dereferenceable and
+      *        shouldn't be a digit or a part of the number, e.g. "\r" or "\n")
+      * @param result output value
+      * @return pointer to the first character after the number or `begin` if
+      *         number can't be parsed
+      */
+    static const char* parse_double(const char* begin, const char* end, double* result);
+};
+
+}  // namespace
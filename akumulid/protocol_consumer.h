@@ -30,6 +30,13 @@ struct ProtocolConsumer {
 
     virtual void write(const aku_Sample&) = 0;
 
+    //! Write several samples at once
+    virtual void write_batch(const aku_Sample* samples, size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            write(samples[i]);
+        }
+    }
+
     // TODO: remove this function, bulk string decoding should be done inside ProtocolParser
     virtual void add_bulk_string(const Byte* buffer, size_t n) = 0;
 
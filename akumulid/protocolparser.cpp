@@ -1,24 +1,39 @@
 #include "protocolparser.h"
+#include "numparser.h"
 #include "resp.h"
+#include <cstring>
 #include <sstream>
 #include <boost/algorithm/string.hpp>
+#include <boost/exception/all.hpp>
 
 namespace Akumuli {
 
+enum {
+    //! Longest possible line (type byte + string + "\r\n")
+    LINE_LENGTH_MAX = RESPStream::STRING_LENGTH_MAX + 3,
+    //! Maximum number of decimal digits in u64
+    INT_DIGITS_MAX = 20,
+    //! Longest possible timestamp string
+    TIMESTAMP_LENGTH_MAX = 0x40,
+    //! Max number of samples passed to consumer at once
+    BATCH_SIZE = 0x100,
+};
+
 
 ProtocolParserError::ProtocolParserError(std::string line, int pos)
     : StreamError(line, pos)
 {
 }
 
-const PDU ProtocolParser::POISON_ = {
-    std::shared_ptr<const Byte>(),
-    0u, 0u
-};
-
 ProtocolParser::ProtocolParser(std::shared_ptr<ProtocolConsumer> consumer)
-    : caller_(nullptr)
+    : mode_(DETECT)
+    , alias_(0)
+    , binary_(consumer, &dict_)
+    , field_(PARAM_ID)
+    , sample_()
     , done_(false)
+    , defer_flush_(false)
+    , datagrams_(false)
     , consumer_(consumer)
     , logger_("protocol-parser", 32)
 {
@@ -26,250 +41,264 @@ ProtocolParser::ProtocolParser(std::shared_ptr<ProtocolConsumer> consumer)
 
 void ProtocolParser::start() {
     logger_.info() << "Starting protocol parser";
-    auto fn = std::bind(&ProtocolParser::worker, this, std::placeholders::_1);
-    coroutine_.reset(new Coroutine(fn));
+    mode_ = DETECT;
+    field_ = PARAM_ID;
+    pending_.clear();
+    pending_.reserve(LINE_LENGTH_MAX);
+    batch_.clear();
+    batch_.reserve(BATCH_SIZE);
+    done_ = false;
 }
 
-void ProtocolParser::worker(Caller& caller) {
-    // Remember caller for use in ByteStreamReader's methods
-    set_caller(caller);
-    // Buffer to read strings from
-    const int     buffer_len         = RESPStream::STRING_LENGTH_MAX;
-    Byte          buffer[buffer_len] = {};
-    int           bytes_read         = 0;
-    // Data to read
-    std::string   sid;
-    aku_Sample    sample;
-    aku_Status    status = AKU_SUCCESS;
-    //
-    try {
-        RESPStream stream(this);
-        while(true) {
-            // read id
-            auto next = stream.next_type();
-            switch(next) {
-            case RESPStream::INTEGER:
-                sample.paramid = stream.read_int();
-                break;
-            case RESPStream::STRING:
-                bytes_read = stream.read_string(buffer, buffer_len);
-                status = consumer_->series_to_param_id(buffer, bytes_read, &sample);
-                if (status != AKU_SUCCESS){
-                    std::string msg;
-                    size_t pos;
-                    std::tie(msg, pos) = get_error_context(aku_error_message(status));
-                    BOOST_THROW_EXCEPTION(ProtocolParserError(msg, pos));
-                }
-                break;
-            default:
-                // Bad frame
-                {
-                    std::string msg;
-                    size_t pos;
-                    std::tie(msg, pos) = get_error_context("unexpected parameter id format");
-                    BOOST_THROW_EXCEPTION(ProtocolParserError(msg, pos));
-                }
-            };
-
-            // read ts
-            next = stream.next_type();
-            switch(next) {
-            case RESPStream::INTEGER:
-                sample.timestamp = stream.read_int();
-                break;
-            case RESPStream::STRING:
-                bytes_read = stream.read_string(buffer, buffer_len);
-                buffer[bytes_read] = '\0';
-                if (aku_parse_timestamp(buffer, &sample) == AKU_SUCCESS) {
-                    break;
-                }
-            default:
-                {
-                    std::string msg;
-                    size_t pos;
-                    std::tie(msg, pos) = get_error_context("Unexpected parameter timestamp format");
-                    BOOST_THROW_EXCEPTION(ProtocolParserError(msg, pos));
-                }
-            };
-
-            // read value
-            next = stream.next_type();
-            switch(next) {
-            case RESPStream::INTEGER:
-                sample.payload.type = AKU_PAYLOAD_FLOAT;
-                sample.payload.float64 = stream.read_int();
-                sample.payload.size = sizeof(aku_Sample);
-                break;
-            case RESPStream::STRING:
-                bytes_read = stream.read_string(buffer, buffer_len);
-                buffer[bytes_read] = '\0';
-                sample.payload.type = AKU_PAYLOAD_FLOAT;
-                sample.payload.float64 = strtod(buffer, nullptr);
-                sample.payload.size = sizeof(aku_Sample);
-                memset(buffer, 0, bytes_read);
-                break;
-            default:
-                // Bad frame
-                {
-                    std::string msg;
-                    size_t pos;
-                    std::tie(msg, pos) = get_error_context("Unexpected parameter value format");
-                    BOOST_THROW_EXCEPTION(ProtocolParserError(msg, pos));
-                }
-            };
+void ProtocolParser::parse_next(PDU pdu) {
+    parse_chunk(pdu.buffer.get() + pdu.pos, pdu.buffer.get() + pdu.size);
+    flush();
+}
 
-            consumer_->write(sample);
+size_t ProtocolParser::parse_batch(const mmsghdr* msgs, size_t n) {
+    size_t nerrors = 0;
+    defer_flush_ = true;
+    datagrams_ = true;
+    binary_.set_dictionary(nullptr);
+    for (size_t i = 0; i < n; i++) {
+        // Datagrams are independent, nothing from the previous one (incomplete
+        // element, stream format) should affect parsing of the next one
+        reset();
+        auto begin = static_cast<const Byte*>(msgs[i].msg_hdr.msg_iov->iov_base);
+        try {
+            parse_chunk(begin, begin + msgs[i].msg_len);
+            if (!pending_.empty() || field_ != PARAM_ID || binary_.has_pending()) {
+                logger_.error() << "Incomplete element at the end of the datagram";
+                nerrors++;
+            }
+        } catch (StreamError const& err) {
+            logger_.error() << err.what();
+            nerrors++;
         }
-    } catch(EStopIteration const&) {
-        logger_.info() << "EStopIteration";
-        done_ = true;
     }
+    reset();
+    binary_.set_dictionary(&dict_);
+    datagrams_ = false;
+    defer_flush_ = false;
+    flush();
+    return nerrors;
 }
 
-void ProtocolParser::set_caller(Caller& caller) {
-    caller_ = &caller;
-}
-
-void ProtocolParser::yield_to_worker() {
-    coroutine_->operator()();
+void ProtocolParser::reset() {
+    mode_ = DETECT;
+    field_ = PARAM_ID;
+    pending_.clear();
+    binary_.reset();
 }
 
-void ProtocolParser::yield_to_client() const {
-    (*caller_)();
-}
-
-void ProtocolParser::throw_if_poisoned(PDU const& top) const {
-    if (top.size == 0 && top.pos == 0) {
-        throw EStopIteration();
+void ProtocolParser::parse_chunk(const Byte* p, const Byte* end) {
+    const size_t magic_size = sizeof(BinaryProtocol::MAGIC);
+    while (mode_ == DETECT && p < end) {
+        // Valid RESP stream can't start with the magic prefix
+        pending_.push_back(*p++);
+        size_t n = pending_.size();
+        if (pending_[n - 1] != BinaryProtocol::MAGIC[n - 1]) {
+            logger_.trace() << "RESP stream detected";
+            mode_ = RESP;
+            std::vector<Byte> head;
+            std::swap(head, pending_);
+            parse_resp(head.data(), head.data() + head.size());
+        } else if (n == magic_size) {
+            logger_.info() << "Binary stream detected";
+            mode_ = BINARY;
+            pending_.clear();
+        }
+    }
+    if (mode_ == BINARY) {
+        try {
+            binary_.parse(p, end, &batch_);
+        } catch (...) {
+            // Samples decoded before the error should be written
+            flush();
+            throw;
+        }
+    } else {
+        parse_resp(p, end);
     }
 }
 
-void ProtocolParser::parse_next(PDU pdu) {
-    buffers_.push(pdu);
-    yield_to_worker();
-}
-
-Byte ProtocolParser::get() {
-    while(true) {
-        if (buffers_.empty()) {
-            yield_to_client();
+void ProtocolParser::parse_resp(const Byte* p, const Byte* end) {
+    while (p < end) {
+        auto nl = static_cast<const Byte*>(memchr(p, '\n', static_cast<size_t>(end - p)));
+        if (nl == nullptr) {
+            // Incomplete line, should be completed by the next PDU
+            pending_.insert(pending_.end(), p, end);
+            if (pending_.size() > LINE_LENGTH_MAX) {
+                throw_error<RESPError>("out of quota", pending_.data(), pending_.size(), pending_.size());
+            }
+            break;
         }
-        auto& top = buffers_.front();
-        throw_if_poisoned(top);
-        if (top.pos < top.size) {
-            auto buf = top.buffer.get();
-            return buf[top.pos++];
+        nl++;
+        if (pending_.empty()) {
+            parse_line(p, static_cast<size_t>(nl - p));
+        } else {
+            pending_.insert(pending_.end(), p, nl);
+            parse_line(pending_.data(), pending_.size());
+            pending_.clear();
         }
-        buffers_.pop();
-        yield_to_client();
+        p = nl;
     }
-    auto ctx = get_error_context("unexpected end of stream");
-    BOOST_THROW_EXCEPTION(ProtocolParserError(std::get<0>(ctx), std::get<1>(ctx)));
 }
 
-Byte ProtocolParser::pick() const {
-    while(true) {
-        if (buffers_.empty()) {
-            yield_to_client();
+void ProtocolParser::parse_line(const Byte* line, size_t size) {
+    // Note: both \r\n and \n line endings are supported
+    const Byte* end = line + size - 1;
+    if (end > line && end[-1] == '\r') {
+        end--;
+    }
+    const Byte type = *line;
+    const Byte* body = line + 1;
+    size_t body_size = end > body ? static_cast<size_t>(end - body) : 0u;
+    if (type == '+') {
+        if (body_size > RESPStream::STRING_LENGTH_MAX) {
+            throw_error<RESPError>("out of quota", line, size, RESPStream::STRING_LENGTH_MAX);
         }
-        auto& top = buffers_.front();
-        throw_if_poisoned(top);
-        if (top.pos < top.size) {
-            auto buf = top.buffer.get();
-            return buf[top.pos];
+        auto cr = static_cast<const Byte*>(memchr(body, '\r', body_size));
+        if (cr != nullptr) {
+            throw_error<RESPError>("bad end of sequence", line, size, static_cast<size_t>(cr - line) + 1);
         }
-        buffers_.pop();
-        yield_to_client();
     }
-    auto ctx = get_error_context("unexpected end of stream");
-    BOOST_THROW_EXCEPTION(ProtocolParserError(std::get<0>(ctx), std::get<1>(ctx)));
-}
-
-bool ProtocolParser::is_eof() {
-    return done_;
-}
-
-int ProtocolParser::read(Byte *buffer, size_t buffer_len) {
-    int bytes_copied = 0;
-    while(true) {
-        if (buffers_.empty()) {
-            yield_to_client();
+    switch (field_) {
+    case PARAM_ID:
+        if (type == ':') {
+            sample_.paramid = parse_int(line, size, end);
+        } else if (type == '+') {
+            aku_Status status = consumer_->series_to_param_id(body, body_size, &sample_);
+            if (status != AKU_SUCCESS) {
+                throw_error<ProtocolParserError>(aku_error_message(status), line, size, 1);
+            }
+        } else if (type == '@') {
+            if (datagrams_) {
+                throw_error<ProtocolParserError>("series aliases are not supported", line, size, 1);
+            }
+            if (dict_.resolve(parse_int(line, size, end), &sample_) != AKU_SUCCESS) {
+                throw_error<ProtocolParserError>("unknown series alias", line, size, 1);
+            }
+        } else if (type == '*') {
+            // Alias definition
+            if (datagrams_) {
+                throw_error<ProtocolParserError>("series aliases are not supported", line, size, 1);
+            }
+            if (parse_int(line, size, end) != 2) {
+                throw_error<ProtocolParserError>("unexpected array size", line, size, 1);
+            }
+            field_ = ALIAS_ID;
+            break;
+        } else {
+            throw_error<ProtocolParserError>("unexpected parameter id format", line, size, 1);
         }
-        auto& top = buffers_.front();
-        if (top.pos < top.size) {
-            size_t sz = top.size - top.pos;
-            size_t bytes_to_copy = std::min(sz, buffer_len);
-            memcpy(buffer, top.buffer.get() + top.pos, bytes_to_copy);
-            bytes_copied += (int)bytes_to_copy;
-            top.pos += bytes_to_copy;
-            if (bytes_to_copy == buffer_len) {
-                // everything is copied!
-                break;
-            } else {
-                // continue reading from the next buffer in the queue
-                buffer += bytes_to_copy;
-                buffer_len -= bytes_to_copy;
+        field_ = TIMESTAMP;
+        break;
+    case TIMESTAMP:
+        if (type == ':') {
+            sample_.timestamp = parse_int(line, size, end);
+        } else {
+            Byte buffer[TIMESTAMP_LENGTH_MAX];
+            if (type != '+' || body_size >= TIMESTAMP_LENGTH_MAX) {
+                throw_error<ProtocolParserError>("Unexpected parameter timestamp format", line, size, 1);
+            }
+            memcpy(buffer, body, body_size);
+            buffer[body_size] = '\0';
+            if (aku_parse_timestamp(buffer, &sample_) != AKU_SUCCESS) {
+                throw_error<ProtocolParserError>("Unexpected parameter timestamp format", line, size, 1);
             }
         }
-        buffers_.pop();
-    }
-    return bytes_copied;
-}
-
-void ProtocolParser::close() {
-    buffers_.push(POISON_);
-    // stop worker
-    yield_to_worker();
+        field_ = VALUE;
+        break;
+    case VALUE:
+        if (type == ':') {
+            sample_.payload.float64 = parse_int(line, size, end);
+        } else if (type == '+') {
+            // Line is always terminated by '\n' so parser can't read past its end
+            NumParser::parse_double(body, end, &sample_.payload.float64);
+        } else {
+            throw_error<ProtocolParserError>("Unexpected parameter value format", line, size, 1);
+        }
+        sample_.payload.type = AKU_PAYLOAD_FLOAT;
+        sample_.payload.size = sizeof(aku_Sample);
+        batch_.push_back(sample_);
+        if (batch_.size() == BATCH_SIZE && !defer_flush_) {
+            flush();
+        }
+        field_ = PARAM_ID;
+        break;
+    case ALIAS_ID:
+        if (type != ':') {
+            throw_error<ProtocolParserError>("unexpected alias format", line, size, 1);
+        }
+        alias_ = parse_int(line, size, end);
+        field_ = ALIAS_NAME;
+        break;
+    case ALIAS_NAME:
+        if (type != '+') {
+            throw_error<ProtocolParserError>("unexpected series name format", line, size, 1);
+        } else {
+            aku_Status status = dict_.define(alias_, body, body_size, *consumer_);
+            if (status != AKU_SUCCESS) {
+                throw_error<ProtocolParserError>(aku_error_message(status), line, size, 1);
+            }
+        }
+        field_ = PARAM_ID;
+        break;
+    };
 }
 
-std::tuple<std::string, size_t> ProtocolParser::get_error_from_pdu(PDU const& pdu) const {
-    const char* origin = pdu.buffer.get();
-    // Scan to PDU head
-    if (pdu.pos == 0) {
-        // Error in first symbol
-        size_t size = std::min(pdu.size, (size_t)StreamError::MAX_LENGTH);
-        auto res = std::string(origin, origin + size);
-        boost::algorithm::replace_all(res, "\r", "\\r");
-        boost::algorithm::replace_all(res, "\n", "\\n");
-        return std::make_pair(res, 0);
+u64 ProtocolParser::parse_int(const Byte* line, size_t size, const Byte* end) {
+    const Byte* body = line + 1;
+    if (end - body > INT_DIGITS_MAX) {
+        throw_error<RESPError>("integer is too long", line, size, INT_DIGITS_MAX + 1);
     }
-    auto pdu_pos = pdu.pos;
-    auto ipos = origin + pdu_pos;   // Iterator
-    auto begin = origin;            // PDU begining
-    while (ipos > origin) {
-        if (*ipos == '\n') {        // Stop when prev. PDU begining or origin was reached
-            break;
+    u64 result = 0;
+    for (const Byte* it = body; it < end; it++) {
+        Byte c = *it;
+        // c must be in [0x30:0x39] range
+        if (c > 0x39 || c < 0x30) {
+            throw_error<RESPError>("can't parse integer (character value out of range)",
+                                   line, size, static_cast<size_t>(it - line) + 1);
         }
-        begin = ipos;
-        ipos--;
+        result = result*10 + static_cast<u64>(c & 0x0F);
     }
-    auto delta = (begin - origin);       // PDU begining position from the origin
-    auto size = pdu.size - delta;
-    auto position = pdu_pos - delta;
-    if (position < StreamError::MAX_LENGTH) {
-        // Truncate string if it wouldn't hide error (most of the PDU's is small so
-        // this will be almost always the case).
-        size = std::min(size, (size_t)StreamError::MAX_LENGTH);
+    return result;
+}
+
+void ProtocolParser::flush() {
+    if (!batch_.empty()) {
+        consumer_->write_batch(batch_.data(), batch_.size());
+        batch_.clear();
     }
-    auto res = std::string(begin, begin + size);
-    boost::algorithm::replace_all(res, "\r", "\\r");
-    boost::algorithm::replace_all(res, "\n", "\\n");
-    return std::make_pair(res, position);
 }
 
-std::tuple<std::string, size_t> ProtocolParser::get_error_context(const char* msg) const {
-    if (buffers_.empty()) {
-        return std::make_tuple(std::string("Can't generate error, no data"), 0u);
+template<class Error>
+void ProtocolParser::throw_error(const char* msg, const Byte* line, size_t size, size_t pos) {
+    // Samples parsed before the error should be written
+    flush();
+    if (pos < StreamError::MAX_LENGTH) {
+        // Truncate string if it wouldn't hide error (most of the PDU's is small so
+        // this will be almost always the case).
+        size = std::min(size, (size_t)StreamError::MAX_LENGTH);
     }
-    auto& top = buffers_.front();
-    std::string err;
-    size_t pos;
-    std::tie(err, pos) = get_error_from_pdu(top);
+    auto err = std::string(line, line + size);
+    boost::algorithm::replace_all(err, "\r", "\\r");
+    boost::algorithm::replace_all(err, "\n", "\\n");
     std::stringstream message;
     message << msg << " - ";
     pos += message.str().size();
     message << err;
-    return std::make_tuple(message.str(), pos);
+    BOOST_THROW_EXCEPTION(Error(message.str(), static_cast<int>(pos)));
+}
+
+void ProtocolParser::close() {
+    if (!pending_.empty() || binary_.has_pending()) {
+        logger_.error() << "Incomplete element at the end of the stream";
+        pending_.clear();
+    }
+    flush();
+    done_ = true;
 }
 
 }
@@ -16,44 +16,18 @@
 
 #pragma once
 
-// Using old-style boost.coroutines
 #include <cstdint>
 #include <memory>
-#include <queue>
 #include <vector>
 
+#include <sys/socket.h>
+
+#include "binaryparser.h"
 #include "logger.h"
 #include "protocol_consumer.h"
 #include "resp.h"
 #include "stream.h"
 
-#include <boost/version.hpp>
-
-#if BOOST_VERSION <= 105500
-
-#define BOOST_COROUTINES_BIDIRECT
-#include <boost/coroutine/all.hpp>
-
-namespace Akumuli {
-
-typedef boost::coroutines::coroutine<void()> Coroutine;
-typedef typename Coroutine::caller_type Caller;
-
-}
-
-#else
-
-#include <boost/coroutine/asymmetric_coroutine.hpp>
-
-namespace Akumuli {
-
-typedef typename boost::coroutines::asymmetric_coroutine<void>::push_type Coroutine;
-typedef typename boost::coroutines::asymmetric_coroutine<void>::pull_type Caller;
-
-}
-
-#endif
-
 namespace Akumuli {
 
 /** Protocol Data Unit */
@@ -69,43 +43,99 @@ struct ProtocolParserError : StreamError {
 };
 
 
-//! Stop iteration exception
-struct EStopIteration {};
-
-
-class ProtocolParser : ByteStreamReader {
-    mutable std::shared_ptr<Coroutine> coroutine_;
-    mutable Caller*                    caller_;
-    mutable std::queue<PDU>            buffers_;
-    static const PDU                   POISON_;  //< This object marks end of the stream
+/** RESP protocol parser.
+  * Resumable state machine, each PDU is scanned in place line by line (line boundaries
+  * are found using memchr). Only the incomplete line at the end of the PDU is copied
+  * to internal buffer, parsing of this line is continued when next PDU arrives.
+  * Samples are passed to consumer in batches (one batch per PDU or one batch per
+  * `parse_batch` call).
+  * If stream starts with `BinaryProtocol::MAGIC` prefix it's decoded using
+  * binary protocol instead of RESP.
+  *
+  * Series aliases (see `SeriesDictionary`). RESP array of two elements (integer alias and
+  * series name) can be used instead of the data point to define an alias, e.g.
+  * "*2\r\n:1\r\n+cpu host=A\r\n". After that "@1\r\n" can be used in place of the
+  * series name. Aliases are not supported by `parse_batch` (datagrams can come from
+  * different senders).
+  */
+class ProtocolParser {
+    //! Stream format
+    enum Mode {
+        DETECT,
+        RESP,
+        BINARY,
+    };
+
+    //! Element of the data point that should be parsed next
+    enum Field {
+        PARAM_ID,
+        TIMESTAMP,
+        VALUE,
+        ALIAS_ID,    //< Alias definition, alias
+        ALIAS_NAME,  //< Alias definition, series name
+    };
+
+    Mode                               mode_;     //< Stream format
+    SeriesDictionary                   dict_;     //< Series aliases
+    u64                                alias_;    //< Alias that is being defined
+    BinaryFrameParser                  binary_;   //< Binary protocol decoder
+    Field                              field_;    //< Next element
+    aku_Sample                         sample_;   //< Sample that is being parsed
+    std::vector<Byte>                  pending_;  //< Incomplete line from the previous PDU
+    std::vector<aku_Sample>            batch_;    //< Parsed samples
     bool                               done_;
+    bool                               defer_flush_;  //< Don't limit the batch size
+    bool                               datagrams_;    //< Parsing datagrams (`parse_batch` call)
     std::shared_ptr<ProtocolConsumer>  consumer_;
     Logger                             logger_;
 
-    void worker(Caller& yield);
-    void set_caller(Caller& caller);
-    //! Yield control to worker
-    void yield_to_worker();
-    //! Yield control to external code
-    void yield_to_client() const;
-    //! Throw exception if poisoned
-    void throw_if_poisoned(PDU const& top) const;
-    //! Generate error message
-    std::tuple<std::string, size_t> get_error_from_pdu(PDU const& pdu) const;
+    //! Parse next chunk of the stream (without flushing the batch)
+    void parse_chunk(const Byte* begin, const Byte* end);
+
+    //! Parse RESP encoded data
+    void parse_resp(const Byte* begin, const Byte* end);
+
+    /** Parse one line (RESP element).
+      * @param line points to the first byte of the line
+      * @param size line size (including terminating '\n')
+      */
+    void parse_line(const Byte* line, size_t size);
+
+    //! Parse body of the integer element (`end` points to the end of the body)
+    u64 parse_int(const Byte* line, size_t size, const Byte* end);
+
+    //! Pass all parsed samples to consumer
+    void flush();
+
+    //! Drop incomplete elements and detect stream format again (aliases are preserved)
+    void reset();
+
+    /** Flush parsed samples and throw an exception.
+      * @param pos error position inside the line (1-based)
+      */
+    template<class Error>
+    void throw_error(const char* msg, const Byte* line, size_t size, size_t pos);
 
 public:
     ProtocolParser(std::shared_ptr<ProtocolConsumer> consumer);
     void start();
     void parse_next(PDU pdu);
 
-    // ByteStreamReader interface
-public:
-    virtual Byte get();
-    virtual Byte pick() const;
-    virtual bool is_eof();
-    virtual int read(Byte* buffer, size_t buffer_len);
-    virtual void close();
-    virtual std::tuple<std::string, size_t> get_error_context(const char* msg) const;
+    /** Parse messages received by `recvmmsg` in one call.
+      * Messages are independent, each one should contain only complete elements
+      * (parser state is reset before each message, as if new stream is started).
+      * Series aliases can't be defined or used. All parsed samples are passed to
+      * consumer using one `write_batch` call.
+      * Error in one message doesn't affect the next messages: error is logged and
+      * parsing continues with the next message. Samples parsed before the error are
+      * written. Message that ends with incomplete element is counted as an error.
+      * @param msgs array of messages (each message should have single iovec)
+      * @param n number of received messages
+      * @return number of messages that couldn't be parsed
+      */
+    size_t parse_batch(const mmsghdr* msgs, size_t n);
+
+    void close();
 };
 
 
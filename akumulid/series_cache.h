@@ -0,0 +1,179 @@
+/**
+ * Copyright (c) 2016 Eugene Lazin <4lazin@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstring>
+#include <vector>
+
+#include "akumuli_def.h"
+
+namespace Akumuli {
+
+/** Cache of raw (not normalized) series names.
+  * Maps series name bytes, exactly as they were received from the client,
+  * to param id. Hit allows to skip both normalization and matching.
+  * Cache is 2-way set associative, set is chosen using hash of the
+  * series name, key is compared byte-by-byte so hash collisions can't
+  * produce wrong param id. Names longer than KEY_SIZE_MAX are not cached.
+  * Cache starts small (MIN_SETS sets are allocated on first insert) and doubles
+  * its size instead of evicting entries, until NSETS is reached, so connections
+  * that write only a few series don't pin the whole table.
+  * Not thread safe, should be owned by one connection (spout).
+  */
+class SeriesNameCache {
+public:
+    enum {
+        NSETS        = 0x200,  //< Max number of sets (should be a power of two)
+        MIN_SETS     = 0x10,   //< Initial number of sets (should be a power of two)
+        NWAYS        = 2,      //< Number of entries in each set
+        KEY_SIZE_MAX = 0x80,   //< Max cached series name length
+    };
+
+private:
+    //! Cache set, keys are stored separately
+    struct Set {
+        u64         hash[NWAYS];
+        aku_ParamId id[NWAYS];
+        u16         len[NWAYS];  //< Key length (0 - empty entry)
+        u16         victim;      //< Way that should be replaced next
+    };
+
+    std::vector<Set>  sets_;     //< Allocated on first insert
+    std::vector<char> keys_;     //< Key bytes, KEY_SIZE_MAX per entry
+    u64               nsets_;    //< Number of sets (0 if not allocated)
+    u64               hits_;
+    u64               misses_;
+
+    char* key(u64 set, u32 way) {
+        return keys_.data() + (set * NWAYS + way) * KEY_SIZE_MAX;
+    }
+
+    /** Change number of sets, entries are moved to the new table.
+      * Entries of the set `i` can only go to sets `i` and `i + nsets_`, so
+      * nothing is evicted when the table is doubled.
+      */
+    void resize(u64 nsets) {
+        std::vector<Set>  sets(nsets, Set());
+        std::vector<char> keys(nsets * NWAYS * KEY_SIZE_MAX);
+        for (u64 ixold = 0; ixold < nsets_; ixold++) {
+            Set const& old = sets_[ixold];
+            for (u32 way = 0; way < NWAYS; way++) {
+                if (old.len[way] == 0) {
+                    continue;
+                }
+                u64  ixset = old.hash[way] & (nsets - 1);
+                Set& set   = sets[ixset];
+                u32  dest  = set.len[0] == 0 ? 0 : 1;
+                set.hash[dest] = old.hash[way];
+                set.id[dest]   = old.id[way];
+                set.len[dest]  = old.len[way];
+                // Both entries can land in the same set only in the same order,
+                // in this case LRU order of the old set is preserved
+                set.victim     = dest == 1 ? old.victim : 1;
+                memcpy(keys.data() + (ixset * NWAYS + dest) * KEY_SIZE_MAX,
+                       key(ixold, way), old.len[way]);
+            }
+        }
+        sets_.swap(sets);
+        keys_.swap(keys);
+        nsets_ = nsets;
+    }
+
+public:
+    SeriesNameCache()
+        : nsets_(0)
+        , hits_(0)
+        , misses_(0)
+    {
+    }
+
+    static u64 hash(const char* name, size_t len) {
+        u64 h = 0x9E3779B97F4A7C15ull ^ len;
+        while (len >= 8) {
+            u64 w;
+            memcpy(&w, name, 8);
+            h = (h ^ w) * 0xff51afd7ed558ccdull;
+            h ^= h >> 32;
+            name += 8;
+            len  -= 8;
+        }
+        u64 w = 0;
+        memcpy(&w, name, len);
+        h = (h ^ w) * 0xc4ceb9fe1a85ec53ull;
+        return h ^ (h >> 29);
+    }
+
+    /** Find param id by series name.
+      * @param hash should be calculated using `hash` method
+      * @return true on hit
+      */
+    bool lookup(const char* name, size_t len, u64 hash, aku_ParamId* id) {
+        if (nsets_ == 0 || len > KEY_SIZE_MAX) {
+            misses_++;
+            return false;
+        }
+        u64  ixset = hash & (nsets_ - 1);
+        Set& set   = sets_[ixset];
+        for (u32 way = 0; way < NWAYS; way++) {
+            if (set.hash[way] == hash && set.len[way] == len
+                    && memcmp(key(ixset, way), name, len) == 0) {
+                set.victim = static_cast<u16>(way ^ 1);
+                *id = set.id[way];
+                hits_++;
+                return true;
+            }
+        }
+        misses_++;
+        return false;
+    }
+
+    //! Add series name to cache, least recently used entry of the set is replaced
+    void insert(const char* name, size_t len, u64 hash, aku_ParamId id) {
+        if (len == 0 || len > KEY_SIZE_MAX) {
+            return;
+        }
+        if (nsets_ == 0) {
+            resize(MIN_SETS);
+        }
+        u64 ixset = hash & (nsets_ - 1);
+        while (nsets_ < NSETS && sets_[ixset].len[0] != 0 && sets_[ixset].len[1] != 0) {
+            // Set is full, grow instead of evicting
+            resize(nsets_ * 2);
+            ixset = hash & (nsets_ - 1);
+        }
+        Set& set      = sets_[ixset];
+        u32  way      = set.victim;
+        set.hash[way] = hash;
+        set.id[way]   = id;
+        set.len[way]  = static_cast<u16>(len);
+        set.victim    = static_cast<u16>(way ^ 1);
+        memcpy(key(ixset, way), name, len);
+    }
+
+    //! Number of hits since last `reset_stats` call
+    u64 hits() const { return hits_; }
+
+    //! Number of misses since last `reset_stats` call
+    u64 misses() const { return misses_; }
+
+    void reset_stats() {
+        hits_   = 0;
+        misses_ = 0;
+    }
+};
+
+}  // namespace
@@ -0,0 +1,97 @@
+/**
+ * Copyright (c) 2016 Eugene Lazin <4lazin@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include "protocol_consumer.h"
+
+namespace Akumuli {
+
+/** Per-connection series dictionary.
+  * Client can bind short integer alias to series name once and then use
+  * this alias instead of the series name. Series name is normalized and
+  * matched only once (when alias is defined).
+  * Small aliases are stored in the dense table, larger ones in the hash map,
+  * so memory usage depends on the number of defined aliases, not on their values.
+  */
+class SeriesDictionary {
+    std::vector<aku_ParamId>             ids_;     //< Alias -> param id mapping (dense part)
+    std::vector<bool>                    valid_;   //< Alias is defined (dense part)
+    std::unordered_map<u64, aku_ParamId> sparse_;  //< Aliases that doesn't fit the dense part
+
+public:
+    enum {
+        ALIAS_MAX  = 0x100000,  //< Aliases should be less than this value
+        DENSE_MAX  = 0x1000,    //< Aliases below this value are stored in the dense table
+        SPARSE_MAX = 0x4000,    //< Max number of aliases outside the dense table
+    };
+
+    /** Bind alias to series name.
+      * @return AKU_EBAD_ARG if alias is out of range or there are too many aliases,
+      *         or error returned by consumer
+      */
+    aku_Status define(u64 alias, const char* name, size_t len, ProtocolConsumer& consumer) {
+        if (alias >= ALIAS_MAX) {
+            return AKU_EBAD_ARG;
+        }
+        if (alias >= DENSE_MAX && sparse_.size() >= SPARSE_MAX && sparse_.count(alias) == 0) {
+            return AKU_EBAD_ARG;
+        }
+        aku_Sample sample = {};
+        aku_Status status = consumer.series_to_param_id(name, len, &sample);
+        if (status != AKU_SUCCESS) {
+            return status;
+        }
+        if (alias >= DENSE_MAX) {
+            sparse_[alias] = sample.paramid;
+            return AKU_SUCCESS;
+        }
+        if (alias >= ids_.size()) {
+            ids_.resize(alias + 1);
+            valid_.resize(alias + 1);
+        }
+        ids_[alias]   = sample.paramid;
+        valid_[alias] = true;
+        return AKU_SUCCESS;
+    }
+
+    /** Set sample's param id using alias.
+      * @return AKU_ENOT_FOUND if alias is not defined
+      */
+    aku_Status resolve(u64 alias, aku_Sample* sample) const {
+        if (alias < ids_.size()) {
+            if (!valid_[alias]) {
+                return AKU_ENOT_FOUND;
+            }
+            sample->paramid = ids_[alias];
+            return AKU_SUCCESS;
+        }
+        if (alias < DENSE_MAX) {
+            return AKU_ENOT_FOUND;
+        }
+        auto it = sparse_.find(alias);
+        if (it == sparse_.end()) {
+            return AKU_ENOT_FOUND;
+        }
+        sample->paramid = it->second;
+        return AKU_SUCCESS;
+    }
+};
+
+}  // namespace
@@ -14,6 +14,12 @@ struct ServerSettings {
     std::string name;
     int         port;
     int         nworkers;
+    int         buffer_size;  //< Receive buffer size (0 - use default)
+    bool        shard_per_core;  //< Run independent acceptor on each I/O thread
+    bool        pin_threads;     //< Pin I/O threads to CPUs
+    bool        flow_control;    //< Pause reading from clients when pipeline is overloaded
+    int         recv_buffer_size;  //< Socket receive buffer size (SO_RCVBUF, 0 - use default)
+    int         busy_poll;         //< Busy polling timeout in us (SO_BUSY_POLL, 0 - disabled)
 };
 
 
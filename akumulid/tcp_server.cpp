@@ -1,20 +1,80 @@
 #include "tcp_server.h"
 #include "utility.h"
+#include <algorithm>
+#include <map>
 #include <thread>
+#include <pthread.h>
+#include <boost/exception/all.hpp>
 #include <boost/function.hpp>
 
 namespace Akumuli {
 
+//                     //
+//     Buffer Pool     //
+//                     //
+
+BufferPool::BufferPool(size_t buffer_size, size_t max_buffers)
+    : buffer_size_(buffer_size)
+    , max_buffers_(max_buffers)
+    , next_(0)
+{
+}
+
+BufferPool::BufferT BufferPool::make_buffer(size_t size) {
+    Byte *buffer = (Byte*)malloc(size);
+    if (buffer == nullptr) {
+        throw std::bad_alloc();
+    }
+    auto deleter = [](Byte* p) {
+        free((void*)p);
+    };
+    return BufferT(buffer, deleter);
+}
+
+BufferPool::BufferT BufferPool::allocate() {
+    std::lock_guard<std::mutex> guard(mutex_);
+    for (size_t i = 0; i < buffers_.size(); i++) {
+        size_t ix = (next_ + i) % buffers_.size();
+        if (buffers_[ix].use_count() == 1) {
+            // Only pool references this buffer
+            next_ = ix + 1;
+            return buffers_[ix];
+        }
+    }
+    auto buffer = make_buffer(buffer_size_);
+    if (buffers_.size() < max_buffers_) {
+        buffers_.push_back(buffer);
+    }
+    return buffer;
+}
+
+size_t BufferPool::get_buffer_size() const {
+    return buffer_size_;
+}
+
+size_t BufferPool::get_pool_size() {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return buffers_.size();
+}
+
 //                     //
 //     Tcp Session     //
 //                     //
 
-TcpSession::TcpSession(IOServiceT *io, std::shared_ptr<PipelineSpout> spout)
+TcpSession::TcpSession(IOServiceT *io, std::shared_ptr<PipelineSpout> spout, std::shared_ptr<BufferPool> pool,
+                       bool use_strand, bool own_spout)
     : io_(io)
     , socket_(*io)
     , strand_(*io)
+    , use_strand_(use_strand)
+    , own_spout_(own_spout)
     , spout_(spout)
+    , pool_(pool)
     , parser_(spout)
+    , paused_(false)
+    , paused_size_(0)
+    , paused_pos_(0)
+    , paused_nbytes_(0)
     , logger_("tcp-session", 10)
 {
     logger_.info() << "Session created";
@@ -30,27 +90,34 @@ std::tuple<TcpSession::BufferT, size_t, size_t> TcpSession::get_next_buffer(Buff
                                                                             size_t pos,
                                                                             size_t bytes_read)
 {
-    Byte *buffer = (Byte*)malloc(BUFFER_SIZE);
-    auto deleter = [](Byte* p) {
-        free((void*)p);
-    };
-    std::shared_ptr<Byte> bufptr(buffer, deleter);
-    return std::make_tuple(bufptr, BUFFER_SIZE, 0u);
+    if (prev_buf) {
+        // Parser doesn't reference the data after `parse_next` call, so the rest
+        // of the buffer can be used for the next read.
+        size_t next_pos = pos + bytes_read;
+        if (size - next_pos >= BUFFER_SIZE_THRESHOLD) {
+            return std::make_tuple(prev_buf, size, next_pos);
+        }
+        prev_buf.reset();
+    }
+    return std::make_tuple(pool_->allocate(), pool_->get_buffer_size(), 0u);
 }
 
 void TcpSession::start(BufferT buf, size_t buf_size, size_t pos, size_t bytes_read) {
     std::tie(buf, buf_size, pos) = get_next_buffer(buf, buf_size, pos, bytes_read);
-    socket_.async_read_some(
-                boost::asio::buffer(buf.get() + pos, buf_size - pos),
-                strand_.wrap(
-                    boost::bind(&TcpSession::handle_read,
-                                shared_from_this(),
-                                buf,
-                                pos,
-                                buf_size,
-                                boost::asio::placeholders::error,
-                                boost::asio::placeholders::bytes_transferred)
-                ));
+    auto handler = boost::bind(&TcpSession::handle_read,
+                               shared_from_this(),
+                               buf,
+                               pos,
+                               buf_size,
+                               boost::asio::placeholders::error,
+                               boost::asio::placeholders::bytes_transferred);
+    auto buffer = boost::asio::buffer(buf.get() + pos, buf_size - pos);
+    if (use_strand_) {
+        socket_.async_read_some(buffer, strand_.wrap(handler));
+    } else {
+        // Handlers can't run concurrently if io-service is run by one thread
+        socket_.async_read_some(buffer, handler);
+    }
 }
 
 PipelineErrorCb TcpSession::get_error_cb() {
@@ -75,6 +142,22 @@ PipelineErrorCb TcpSession::get_error_cb() {
     return PipelineErrorCb(fn);
 }
 
+PipelineDrainCb TcpSession::get_drain_cb() {
+    auto weak = std::weak_ptr<TcpSession>(shared_from_this());
+    auto fn = [weak]() {
+        auto session = weak.lock();
+        if (session) {
+            auto handler = boost::bind(&TcpSession::handle_drain, session);
+            if (session->use_strand_) {
+                session->strand_.post(handler);
+            } else {
+                session->io_->post(handler);
+            }
+        }
+    };
+    return PipelineDrainCb(fn);
+}
+
 std::shared_ptr<Byte> TcpSession::NO_BUFFER = std::shared_ptr<Byte>();
 
 void TcpSession::handle_read(BufferT buffer,
@@ -85,16 +168,25 @@ void TcpSession::handle_read(BufferT buffer,
     if (error) {
         logger_.error() << error.message();
         parser_.close();
-        drain_pipeline_spout();
+        if (own_spout_) {
+            // Shared spout outlives the session and can be busy all the time
+            drain_pipeline_spout();
+        }
     } else {
         try {
             PDU pdu = {
                 buffer,
-                nbytes,
+                pos + nbytes,
                 pos
             };
             parser_.parse_next(pdu);
-            start(buffer, buf_size, pos, nbytes);
+            if (AKU_UNLIKELY(spout_->is_congested())) {
+                // Pipeline can't keep up, client will be blocked by TCP flow control
+                pause_start_ = std::chrono::steady_clock::now();
+                pause(buffer, buf_size, pos, nbytes);
+            } else {
+                start(buffer, buf_size, pos, nbytes);
+            }
         } catch (RESPError const& resp_err) {
             // This error is related to client so we need to send it back
             logger_.error() << resp_err.what();
@@ -129,6 +221,32 @@ void TcpSession::drain_pipeline_spout() {
     }
 }
 
+void TcpSession::pause(BufferT buffer, size_t buf_size, size_t pos, size_t nbytes) {
+    // Read is restarted by `handle_drain` when pipeline worker releases enough samples
+    paused_        = true;
+    paused_self_   = shared_from_this();
+    paused_buf_    = buffer;
+    paused_size_   = buf_size;
+    paused_pos_    = pos;
+    paused_nbytes_ = nbytes;
+    handle_drain();
+}
+
+void TcpSession::handle_drain() {
+    if (!paused_ || !spout_->wait_for_drain()) {
+        // Spurious call or pipeline is still congested (callback is re-armed)
+        return;
+    }
+    paused_ = false;
+    auto self = std::move(paused_self_);
+    auto pause_time = std::chrono::steady_clock::now() - pause_start_;
+    spout_->report_pause(static_cast<u64>(
+                std::chrono::duration_cast<std::chrono::microseconds>(pause_time).count()));
+    BufferT buffer;
+    buffer.swap(paused_buf_);
+    start(buffer, paused_size_, paused_pos_, paused_nbytes_);
+}
+
 void TcpSession::handle_write_error(boost::system::error_code error) {
     if (!error) {
         socket_.shutdown(SocketT::shutdown_both);
@@ -146,9 +264,14 @@ void TcpSession::handle_write_error(boost::system::error_code error) {
 TcpAcceptor::TcpAcceptor(// Server parameters
                         std::vector<IOServiceT *> io, int port,
                         // Storage & pipeline
-                        std::shared_ptr<IngestionPipeline> pipeline )
-    : acceptor_(own_io_, EndpointT(boost::asio::ip::tcp::v4(), port))
+                        std::shared_ptr<IngestionPipeline> pipeline,
+                        size_t buffer_size,
+                        bool shard,
+                        bool flow_control)
+    : shard_(shard)
+    , acceptor_(shard ? *io.at(0) : own_io_)
     , sessions_io_(io)
+    , flow_control_(flow_control)
     , pipeline_(pipeline)
     , io_index_{0}
     , start_barrier_(2)
@@ -157,14 +280,48 @@ TcpAcceptor::TcpAcceptor(// Server parameters
 {
     logger_.info() << "Server created!";
     logger_.info() << "Port: " << port;
+    logger_.info() << "Buffer size: " << buffer_size;
+    logger_.info() << "Flow control: " << (flow_control ? "on" : "off");
+
+    EndpointT endpoint(boost::asio::ip::tcp::v4(), port);
+    acceptor_.open(endpoint.protocol());
+    acceptor_.set_option(AcceptorT::reuse_address(true));
+    if (shard_) {
+        logger_.info() << "Shard mode, SO_REUSEPORT is set";
+        acceptor_.set_option(ReusePortT(true));
+    }
+    acceptor_.bind(endpoint);
+    acceptor_.listen();
 
     // Blocking I/O services
     for (auto io: sessions_io_) {
         sessions_work_.emplace_back(*io);
     }
+
+    // Buffer pools, several entries of the `sessions_io_` can point to the same io-service
+    // (each entry is run by its own thread).
+    std::map<IOServiceT*, std::shared_ptr<BufferPool>> pools;
+    std::map<IOServiceT*, int> nthreads;
+    for (auto io: sessions_io_) {
+        auto& pool = pools[io];
+        if (!pool) {
+            pool = std::make_shared<BufferPool>(buffer_size);
+        }
+        sessions_pool_.push_back(pool);
+        nthreads[io]++;
+    }
+    for (auto io: sessions_io_) {
+        sessions_strand_.push_back(nthreads[io] > 1);
+    }
 }
 
 void TcpAcceptor::start() {
+    if (shard_) {
+        // Accept handler is run by the session's io-service thread
+        logger_.info() << "Start listening";
+        _start();
+        return;
+    }
     WorkT work(own_io_);
 
     // Run detached thread for accepts
@@ -198,12 +355,64 @@ void TcpAcceptor::_run_one() {
     own_io_.run_one();
 }
 
+std::shared_ptr<PipelineSpout> TcpAcceptor::make_shard_spout() {
+    auto spout = flow_control_ ? pipeline_->make_spout(AKU_FLOW_CONTROL) : pipeline_->make_spout();
+    auto weak = std::weak_ptr<TcpAcceptor>(shared_from_this());
+    auto error_cb = [weak](aku_Status status, u64) {
+        auto self = weak.lock();
+        if (self) {
+            self->logger_.error() << aku_error_message(status);
+        }
+    };
+    spout->set_error_cb(error_cb);
+    if (flow_control_) {
+        auto drain_cb = [weak]() {
+            auto self = weak.lock();
+            if (self) {
+                self->sessions_io_.at(0)->post(boost::bind(&TcpAcceptor::handle_drain, self));
+            }
+        };
+        spout->set_drain_cb(drain_cb);
+    }
+    return spout;
+}
+
+void TcpAcceptor::handle_drain() {
+    // Any session of the shard can be paused, each one checks the spout by itself
+    for (auto const& weak: shard_sessions_) {
+        auto session = weak.lock();
+        if (session) {
+            session->handle_drain();
+        }
+    }
+}
+
 void TcpAcceptor::_start() {
     std::shared_ptr<TcpSession> session;
-    auto spout = pipeline_->make_spout();
-    session.reset(new TcpSession(sessions_io_.at(io_index_++ % sessions_io_.size()), spout));
-    // attach session to spout
-    spout->set_error_cb(session->get_error_cb());
+    auto ix = static_cast<size_t>(io_index_++) % sessions_io_.size();
+    if (shard_) {
+        // Shard's sessions are run by the same thread
+        if (!shard_spout_) {
+            shard_spout_ = make_shard_spout();
+        }
+        session.reset(new TcpSession(sessions_io_.at(ix), shard_spout_, sessions_pool_.at(ix),
+                                     sessions_strand_.at(ix), false));
+        auto expired = [](std::weak_ptr<TcpSession> const& weak) {
+            return weak.expired();
+        };
+        shard_sessions_.erase(std::remove_if(shard_sessions_.begin(), shard_sessions_.end(), expired),
+                              shard_sessions_.end());
+        shard_sessions_.push_back(session);
+    } else {
+        auto spout = flow_control_ ? pipeline_->make_spout(AKU_FLOW_CONTROL) : pipeline_->make_spout();
+        session.reset(new TcpSession(sessions_io_.at(ix), spout, sessions_pool_.at(ix),
+                                     sessions_strand_.at(ix)));
+        // attach session to spout
+        spout->set_error_cb(session->get_error_cb());
+        if (flow_control_) {
+            spout->set_drain_cb(session->get_drain_cb());
+        }
+    }
     // run session
     acceptor_.async_accept(
                 session->socket(),
@@ -219,6 +428,10 @@ void TcpAcceptor::stop() {
     acceptor_.close();
     own_io_.stop();
     sessions_work_.clear();
+    if (shard_) {
+        // There is no acceptor thread
+        return;
+    }
     logger_.info() << "Trying to stop acceptor";
     stop_barrier_.wait();
     logger_.info() << "Acceptor successfully stopped";
@@ -244,18 +457,50 @@ void TcpAcceptor::handle_accept(std::shared_ptr<TcpSession> session, boost::syst
 //     Tcp Server     //
 //                    //
 
-TcpServer::TcpServer(std::shared_ptr<IngestionPipeline> pipeline, int concurrency, int port)
+TcpServer::TcpServer(std::shared_ptr<IngestionPipeline> pipeline, int concurrency, int port,
+                     size_t buffer_size, bool shard_per_core, bool pin_threads, bool flow_control)
     : pline(pipeline)
     , barrier(concurrency)
     , stopped{0}
+    , pin_threads(pin_threads)
     , logger_("tcp-server", 32)
 {
-    for(;concurrency --> 0;) {
-        iovec.push_back(&io);
+    if (shard_per_core) {
+        logger_.info() << "Shard-per-core mode, " << concurrency << " shards";
+        for(;concurrency --> 0;) {
+            // Io-service is run by one thread, concurrency hint allows asio to avoid locking
+            shards_io.emplace_back(new IOServiceT(1));
+            iovec.push_back(shards_io.back().get());
+            std::vector<IOServiceT*> shardvec = { shards_io.back().get() };
+            shards.push_back(std::make_shared<TcpAcceptor>(shardvec, port, pline, buffer_size, true,
+                                                          flow_control));
+        }
+    } else {
+        for(;concurrency --> 0;) {
+            iovec.push_back(&io);
+        }
+        serv = std::make_shared<TcpAcceptor>(iovec, port, pline, buffer_size, false, flow_control);
     }
-    serv = std::make_shared<TcpAcceptor>(iovec, port, pline);
     pline->start();
-    serv->start();
+    if (serv) {
+        serv->start();
+    }
+    for (auto shard: shards) {
+        shard->start();
+    }
+}
+
+//! Pin thread to the CPU
+static void set_thread_affinity(std::thread& thread, unsigned cpu, Logger* logger) {
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu, &cpuset);
+    int err = pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set_t), &cpuset);
+    if (err != 0) {
+        logger->error() << "Can't pin I/O thread to CPU " << cpu << ", error " << err;
+    } else {
+        logger->info() << "I/O thread pinned to CPU " << cpu;
+    }
 }
 
 void TcpServer::start(SignalHandler* sig, int id) {
@@ -278,15 +523,25 @@ void TcpServer::start(SignalHandler* sig, int id) {
         return fn;
     };
 
+    unsigned ncpu = std::max(std::thread::hardware_concurrency(), 1u);
+    unsigned cpu = 0;
     for (auto io: iovec) {
         std::thread iothread(iorun(*io, barrier));
+        if (pin_threads) {
+            set_thread_affinity(iothread, cpu++ % ncpu, logger);
+        }
         iothread.detach();
     }
 }
 
 void TcpServer::stop() {
     if (stopped++ == 0) {
-        serv->stop();
+        if (serv) {
+            serv->stop();
+        }
+        for (auto shard: shards) {
+            shard->stop();
+        }
         logger_.info() << "TcpServer stopped";
 
         // No need to joint I/O threads, just wait until they completes.
@@ -312,7 +567,16 @@ struct TcpServerBuilder {
     std::shared_ptr<Server> operator () (std::shared_ptr<IngestionPipeline> pipeline,
                                          std::shared_ptr<ReadOperationBuilder>,
                                          const ServerSettings& settings) {
-        return std::make_shared<TcpServer>(pipeline, settings.nworkers, settings.port);
+        size_t bufsize = settings.buffer_size > 0 ? static_cast<size_t>(settings.buffer_size)
+                                                  : static_cast<size_t>(TcpSession::BUFFER_SIZE);
+        int nworkers = settings.nworkers;
+        if (settings.shard_per_core && nworkers <= 0) {
+            // One shard per hardware thread
+            nworkers = static_cast<int>(std::max(std::thread::hardware_concurrency(), 1u));
+        }
+        return std::make_shared<TcpServer>(pipeline, nworkers, settings.port, bufsize,
+                                           settings.shard_per_core, settings.pin_threads,
+                                           settings.flow_control);
     }
 };
 
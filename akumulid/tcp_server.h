@@ -16,7 +16,10 @@
 
 #pragma once
 
+#include <chrono>
 #include <memory>
+#include <mutex>
+#include <vector>
 
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
@@ -38,26 +41,86 @@ typedef boost::asio::ip::tcp::socket   SocketT;
 typedef boost::asio::ip::tcp::endpoint EndpointT;
 typedef boost::asio::strand            StrandT;
 typedef boost::asio::io_service::work  WorkT;
+typedef boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT> ReusePortT;
+
+/** Pool of receive buffers.
+  * Buffers are allocated once and then reused. Pool holds one reference to each
+  * buffer, buffer is considered free when all other references are released.
+  * Pool can be shared by several threads (if they run the same io_service).
+  */
+class BufferPool {
+public:
+    typedef std::shared_ptr<Byte> BufferT;
+
+    enum {
+        MAX_BUFFERS = 0x100,  //< Max number of pooled buffers
+    };
+
+private:
+    const size_t         buffer_size_;
+    const size_t         max_buffers_;
+    std::mutex           mutex_;
+    std::vector<BufferT> buffers_;
+    size_t               next_;  //< Position of the next buffer to check
+
+    static BufferT make_buffer(size_t size);
+
+public:
+    BufferPool(size_t buffer_size, size_t max_buffers = MAX_BUFFERS);
+
+    /** Get free buffer from the pool.
+      * New buffer is allocated if all pooled buffers are in use (new buffer is
+      * added to the pool if pool is not full).
+      */
+    BufferT allocate();
+
+    //! Size of the buffer
+    size_t get_buffer_size() const;
+
+    //! Number of pooled buffers
+    size_t get_pool_size();
+};
+
 
 /** Server session. Reads data from socket.
  *  Must be created in the heap.
+ *  If spout uses AKU_FLOW_CONTROL policy session stops reading from
+ *  the socket when pipeline can't keep up and resumes when spout's
+ *  backlog is drained (TCP flow control pushes back on the client).
+ *  Spout can be shared by several sessions if they are run by the
+ *  same single-threaded io-service (shard mode).
   */
 class TcpSession : public std::enable_shared_from_this<TcpSession> {
     // TODO: Unique session ID
-    enum {
-        BUFFER_SIZE           = 0x1000,  //< Buffer size
-        BUFFER_SIZE_THRESHOLD = 0x0200,  //< Min free buffer space
-    };
     IOServiceT*                    io_;
     SocketT                        socket_;
     StrandT                        strand_;
+    const bool                     use_strand_;  //< Serialize handlers using `strand_`
+    const bool                     own_spout_;   //< Spout is not shared with other sessions
     std::shared_ptr<PipelineSpout> spout_;
+    std::shared_ptr<BufferPool>    pool_;
     ProtocolParser                 parser_;
+    bool                           paused_;       //< Reads are paused until spout's backlog is drained
+    std::shared_ptr<TcpSession>    paused_self_;  //< Keeps paused session alive (no read is pending)
+    std::shared_ptr<Byte>          paused_buf_;   //< Read state saved by `pause`
+    size_t                         paused_size_;
+    size_t                         paused_pos_;
+    size_t                         paused_nbytes_;
+    std::chrono::steady_clock::time_point pause_start_;
     Logger                         logger_;
 
 public:
+    enum {
+        BUFFER_SIZE           = 0x10000,  //< Default buffer size
+        BUFFER_SIZE_THRESHOLD = 0x1000,   //< Min free buffer space
+    };
     typedef std::shared_ptr<Byte> BufferT;
-    TcpSession(IOServiceT* io, std::shared_ptr<PipelineSpout> spout);
+    /** C-tor.
+      * @param use_strand should be set to false if `io` is run by a single thread
+      * @param own_spout should be set to false if `spout` is shared with other sessions
+      */
+    TcpSession(IOServiceT* io, std::shared_ptr<PipelineSpout> spout, std::shared_ptr<BufferPool> pool,
+               bool use_strand = true, bool own_spout = true);
 
     SocketT& socket();
 
@@ -65,6 +128,12 @@ public:
 
     PipelineErrorCb get_error_cb();
 
+    //! Callback that resumes paused session (called by the pipeline worker)
+    PipelineDrainCb get_drain_cb();
+
+    //! Resume reading if session is paused and spout's backlog is drained (session's thread only)
+    void handle_drain();
+
     static BufferT NO_BUFFER;
 
 private:
@@ -84,19 +153,34 @@ private:
     void handle_write_error(boost::system::error_code error);
 
     void drain_pipeline_spout();
+
+    //! Stop reading from socket until spout's backlog is drained
+    void pause(BufferT buffer, size_t buf_size, size_t pos, size_t nbytes);
 };
 
 
 /** Tcp server.
-  * Accepts connections and creates new client sessions
+  * Accepts connections and creates new client sessions.
+  * In shard mode acceptor doesn't have its own thread, it accepts connections
+  * using the io-service of its sessions and the listening socket is opened with
+  * SO_REUSEPORT, so several shards can listen on the same port (kernel balances
+  * connections between them). Shard's io-service is run by one thread, so all
+  * sessions of the shard share one spout (and its series name cache). Backend
+  * errors can't be attributed to the session in this case, they are logged.
   */
 class TcpAcceptor : public std::enable_shared_from_this<TcpAcceptor> {
+    const bool               shard_;        //< Shard mode
     IOServiceT               own_io_;       //< Acceptor's own io-service
     AcceptorT                acceptor_;     //< Acceptor
     std::vector<IOServiceT*> sessions_io_;  //< List of io-services for sessions
     std::vector<WorkT> sessions_work_;      //< Work to block io-services from completing too early
+    std::vector<std::shared_ptr<BufferPool>> sessions_pool_;  //< Buffer pools (one per io-service)
+    std::vector<bool> sessions_strand_;     //< Io-service is run by more than one thread
+    const bool                         flow_control_;  //< Pause sessions instead of blocking
     std::shared_ptr<IngestionPipeline> pipeline_;  //< Pipeline instance
     std::atomic<int>                   io_index_;  //< I/O service index
+    std::shared_ptr<PipelineSpout>     shard_spout_;  //< Spout shared by all sessions (shard mode)
+    std::vector<std::weak_ptr<TcpSession>> shard_sessions_;  //< Sessions that use `shard_spout_`
 
     boost::barrier start_barrier_;  //< Barrier to start worker thread
     boost::barrier stop_barrier_;   //< Barrier to stop worker thread
@@ -108,11 +192,17 @@ public:
       * @param io io-service instance
       * @param port port to listen for new connections
       * @param pipeline ingestion pipeline
+      * @param buffer_size size of the session's receive buffer
+      * @param shard run in shard mode (`io` should contain exactly one element)
+      * @param flow_control create spouts with AKU_FLOW_CONTROL policy
       */
     TcpAcceptor(  // Server parameters
         std::vector<IOServiceT*> io, int port,
         // Storage & pipeline
-        std::shared_ptr<IngestionPipeline> pipeline);
+        std::shared_ptr<IngestionPipeline> pipeline,
+        size_t buffer_size = TcpSession::BUFFER_SIZE,
+        bool shard = false,
+        bool flow_control = false);
 
     //! Start listening on socket
     void start();
@@ -132,19 +222,44 @@ public:
 private:
     //! Accept event handler
     void handle_accept(std::shared_ptr<TcpSession> session, boost::system::error_code err);
+
+    //! Create spout shared by all sessions of the shard
+    std::shared_ptr<PipelineSpout> make_shard_spout();
+
+    //! Resume paused sessions of the shard (shard mode)
+    void handle_drain();
 };
 
 
+/** Tcp server.
+  * By default single acceptor hands connections to the pool of I/O threads that
+  * share one io-service. In shard-per-core mode every I/O thread runs its own
+  * io-service with its own SO_REUSEPORT acceptor, so connection is accepted and
+  * served by the same thread (optionally pinned to CPU).
+  */
 struct TcpServer : std::enable_shared_from_this<TcpServer>, Server {
-    std::shared_ptr<IngestionPipeline> pline;
-    std::shared_ptr<TcpAcceptor>       serv;
-    boost::asio::io_service            io;
-    std::vector<IOServiceT*>           iovec;
-    boost::barrier                     barrier;
-    std::atomic<int>                   stopped;
-    Logger                             logger_;
-
-    TcpServer(std::shared_ptr<IngestionPipeline> pipeline, int concurrency, int port);
+    std::shared_ptr<IngestionPipeline>        pline;
+    std::shared_ptr<TcpAcceptor>              serv;    //< Acceptor (shared mode)
+    std::vector<std::shared_ptr<TcpAcceptor>> shards;  //< Acceptors (shard-per-core mode)
+    std::vector<std::unique_ptr<IOServiceT>>  shards_io;
+    boost::asio::io_service                   io;
+    std::vector<IOServiceT*>                  iovec;
+    boost::barrier                            barrier;
+    std::atomic<int>                          stopped;
+    const bool                                pin_threads;
+    Logger                                    logger_;
+
+    /** C-tor.
+      * @param concurrency number of I/O threads (and shards in shard-per-core mode)
+      * @param shard_per_core enable shard-per-core mode
+      * @param pin_threads pin I/O threads to CPUs
+      * @param flow_control pause reading from the clients instead of blocking
+      *        I/O threads when pipeline is overloaded
+      */
+    TcpServer(std::shared_ptr<IngestionPipeline> pipeline, int concurrency, int port,
+              size_t buffer_size = TcpSession::BUFFER_SIZE,
+              bool shard_per_core = false, bool pin_threads = false,
+              bool flow_control = false);
 
     //! Run IO service
     virtual void start(SignalHandler* sig_handler, int id);
@@ -1,5 +1,8 @@
 #include "udp_server.h"
 
+#include <chrono>
+#include <fstream>
+#include <sstream>
 #include <thread>
 
 #include <netinet/ip.h>
@@ -7,20 +10,29 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <time.h>
 
 #include <boost/bind.hpp>
+#include <boost/exception/all.hpp>
 #include <boost/scope_exit.hpp>
 
 namespace Akumuli {
 
-UdpServer::UdpServer(std::shared_ptr<IngestionPipeline> pipeline, int nworkers, int port)
+UdpServer::UdpServer(std::shared_ptr<IngestionPipeline> pipeline, int nworkers, int port,
+                     int rcvbuf, int busy_poll)
     : pipeline_(pipeline)
     , start_barrier_(nworkers + 1)
     , stop_barrier_(nworkers + 1)
     , stop_{0}
     , port_(port)
     , nworkers_(nworkers)
+    , rcvbuf_(rcvbuf)
+    , busy_poll_(busy_poll)
+    , packets_{0}
+    , bytes_{0}
+    , drops_{0}
+    , errors_{0}
     , logger_("UdpServer", 128)
 {
 }
@@ -50,6 +62,56 @@ void UdpServer::stop() {
     stop_.store(1, std::memory_order_relaxed);
     stop_barrier_.wait();
     logger_.info() << "UDP server stopped";
+    logger_.info() << "Packets received: " << packets_.load() << ", bytes received: " << bytes_.load()
+                   << ", packets dropped: " << drops_.load() << ", parsing errors: " << errors_.load();
+}
+
+
+i64 UdpServer::read_drop_counter(u64 inode, const char* path) {
+    std::ifstream input(path);
+    if (!input) {
+        return -1;
+    }
+    std::string line;
+    // Skip header
+    std::getline(input, line);
+    while (std::getline(input, line)) {
+        // sl local_address rem_address st tx_queue:rx_queue tr:tm->when retrnsmt uid timeout inode ref pointer drops
+        std::istringstream fields(line);
+        std::string sl, local, remote, st, queue, timer, retr, pointer;
+        u64 uid, timeout, ino, ref, drops;
+        fields >> sl >> local >> remote >> st >> queue >> timer >> retr >> uid >> timeout >> ino
+               >> ref >> pointer >> drops;
+        if (fields && ino == inode) {
+            return static_cast<i64>(drops);
+        }
+    }
+    return -1;
+}
+
+
+void UdpServer::set_socket_options(int sockfd) {
+    if (rcvbuf_ > 0) {
+        int optval = rcvbuf_;
+        if (setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &optval, sizeof(optval)) == -1) {
+            logger_.error() << "can't set receive buffer size: " << strerror(errno);
+        }
+        // Kernel doubles the value and clamps it by net.core.rmem_max
+        socklen_t len = sizeof(optval);
+        if (getsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &optval, &len) == 0) {
+            logger_.info() << "Socket receive buffer size: " << optval;
+        }
+    }
+    if (busy_poll_ > 0) {
+#ifdef SO_BUSY_POLL
+        int optval = busy_poll_;
+        if (setsockopt(sockfd, SOL_SOCKET, SO_BUSY_POLL, &optval, sizeof(optval)) == -1) {
+            logger_.error() << "can't enable busy polling: " << strerror(errno);
+        }
+#else
+        logger_.error() << "busy polling is not supported";
+#endif
+    }
 }
 
 
@@ -88,6 +150,8 @@ void UdpServer::worker(std::shared_ptr<PipelineSpout> spout) {
             BOOST_THROW_EXCEPTION(err);
         }
 
+        set_socket_options(sockfd);
+
         timeval tval;
         tval.tv_sec = 0;
         tval.tv_usec = 1000;  // 1ms
@@ -112,9 +176,36 @@ void UdpServer::worker(std::shared_ptr<PipelineSpout> spout) {
             BOOST_THROW_EXCEPTION(err);
         }
 
+        // Drop counter is maintained by the kernel for each socket
+        u64 inode = 0;
+        struct stat sockstat;
+        if (fstat(sockfd, &sockstat) == 0) {
+            inode = sockstat.st_ino;
+        }
+        i64 drops = read_drop_counter(inode);
+        if (drops < 0) {
+            logger_.info() << "Drop counter is not available";
+        }
+        auto drops_checked = std::chrono::steady_clock::now();
+
+        // Parser doesn't reference the data after `parse_batch` call so the
+        // same buffer can be used by all `recvmmsg` calls.
         auto iobuf = std::make_shared<IOBuf>();
 
         while(!stop_.load(std::memory_order_relaxed)) {
+            if (drops >= 0) {
+                auto now = std::chrono::steady_clock::now();
+                if (now - drops_checked > std::chrono::seconds(1)) {
+                    drops_checked = now;
+                    i64 newdrops = read_drop_counter(inode);
+                    if (newdrops > drops) {
+                        logger_.error() << (newdrops - drops) << " packets dropped";
+                        drops_ += static_cast<u64>(newdrops - drops);
+                        drops = newdrops;
+                    }
+                }
+            }
+
             retval = recvmmsg(sockfd, iobuf->msgs, NPACKETS, MSG_WAITFORONE, nullptr);
             if (retval == -1) {
                 if (errno == EAGAIN || errno == EINTR) {
@@ -127,26 +218,15 @@ void UdpServer::worker(std::shared_ptr<PipelineSpout> spout) {
                 BOOST_THROW_EXCEPTION(err);
             }
 
-            iobuf->pps++;
-
+            u64 nbytes = 0;
             for (int i = 0; i < retval; i++) {
-                // reset buffer to receive new message
-                iobuf->bps += iobuf->msgs[i].msg_len;
-                size_t mlen = iobuf->msgs[i].msg_len;
-                iobuf->msgs[i].msg_len = 0;
-
-                // parse message content
-                PDU pdu = {
-                    std::shared_ptr<Byte>(iobuf, iobuf->bufs[i]),
-                    mlen,
-                    0u,
-                };
-
-                parser.parse_next(pdu);
-            }
-            if (retval != 0) {
-                iobuf = std::make_shared<IOBuf>();
+                nbytes += iobuf->msgs[i].msg_len;
             }
+            packets_.fetch_add(static_cast<u64>(retval), std::memory_order_relaxed);
+            bytes_.fetch_add(nbytes, std::memory_order_relaxed);
+
+            // Bad datagrams are skipped by the parser
+            errors_ += parser.parse_batch(iobuf->msgs, static_cast<size_t>(retval));
         }
     } catch(...) {
         logger_.error() << boost::current_exception_diagnostic_information();
@@ -167,7 +247,8 @@ struct UdpServerBuilder {
     std::shared_ptr<Server> operator () (std::shared_ptr<IngestionPipeline> pipeline,
                                          std::shared_ptr<ReadOperationBuilder>,
                                          const ServerSettings& settings) {
-        return std::make_shared<UdpServer>(pipeline, settings.nworkers, settings.port);
+        return std::make_shared<UdpServer>(pipeline, settings.nworkers, settings.port,
+                                           settings.recv_buffer_size, settings.busy_poll);
     }
 };
 
@@ -31,6 +31,9 @@ namespace Akumuli {
 
 
 /** UDP server for data ingestion.
+  * Each worker owns SO_REUSEPORT socket and receive buffer. All packets received
+  * by one `recvmmsg` call are parsed at once and passed to the worker's spout
+  * as a single batch.
   */
 class UdpServer : public std::enable_shared_from_this<UdpServer>, public Server {
     std::shared_ptr<IngestionPipeline> pipeline_;
@@ -39,6 +42,14 @@ class UdpServer : public std::enable_shared_from_this<UdpServer>, public Server
     std::atomic<int>                   stop_;
     const int                          port_;
     const int                          nworkers_;
+    const int                          rcvbuf_;     //< SO_RCVBUF value (0 - system default)
+    const int                          busy_poll_;  //< SO_BUSY_POLL value (0 - disabled)
+
+    // Counters
+    std::atomic<u64> packets_;  //< Number of received packets
+    std::atomic<u64> bytes_;    //< Number of received bytes
+    std::atomic<u64> drops_;    //< Number of packets dropped by the kernel
+    std::atomic<u64> errors_;   //< Number of parsing errors
 
     Logger logger_;
 
@@ -46,10 +57,6 @@ class UdpServer : public std::enable_shared_from_this<UdpServer>, public Server
     static const int NPACKETS = 512;
 
     struct IOBuf {
-        // Counters
-        std::atomic<u64> pps;
-        std::atomic<u64> bps;
-
         // Packet recv structs
         mmsghdr msgs[NPACKETS];
         iovec   iovecs[NPACKETS];
@@ -73,16 +80,29 @@ public:
       * @param nworker number of workers
       * @param port port number
       * @param pipeline pointer to ingestion pipeline
+      * @param rcvbuf socket receive buffer size (0 - use system default)
+      * @param busy_poll busy polling timeout in microseconds (0 - disabled)
       */
-    UdpServer(std::shared_ptr<IngestionPipeline> pipeline, int nworkers, int port);
+    UdpServer(std::shared_ptr<IngestionPipeline> pipeline, int nworkers, int port,
+              int rcvbuf = 0, int busy_poll = 0);
 
     //! Start processing packets
     virtual void start(SignalHandler* sig, int id);
 
+    /** Read number of dropped packets from /proc/net/udp (`drops` column).
+      * @param inode socket inode
+      * @param path path to the file (should have the same format as /proc/net/udp)
+      * @return number of packets dropped by the kernel or -1 on error
+      */
+    static i64 read_drop_counter(u64 inode, const char* path = "/proc/net/udp");
+
 private:
     //! Stop processing packets
     void stop();
 
+    //! Set optional socket options (errors are logged but not propagated)
+    void set_socket_options(int sockfd);
+
     void worker(std::shared_ptr<PipelineSpout> spout);
 };
 
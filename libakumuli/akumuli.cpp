@@ -358,6 +358,17 @@ int aku_json_stats(aku_Database *db, char* buffer, size_t size) {
         ptree.put("search_stats.interpolation_search.steps", sstats.istats.n_steps);
         ptree.put("search_stats.interpolation_search.times", sstats.istats.n_times);
 
+        // Chunk cache
+        if (dbi->storage_.cache_) {
+            auto cstats = dbi->storage_.cache_->get_stats();
+            ptree.put("chunk_cache.hits", cstats.hits);
+            ptree.put("chunk_cache.misses", cstats.misses);
+            ptree.put("chunk_cache.evictions", cstats.evictions);
+            ptree.put("chunk_cache.rejections", cstats.rejections);
+            ptree.put("chunk_cache.size_bytes", cstats.size);
+            ptree.put("chunk_cache.nchunks", cstats.nchunks);
+        }
+
         // Get per-volume stats
         auto volumes = dbi->iter_volumes();
         int iter = 0;
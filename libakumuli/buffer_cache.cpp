@@ -1,56 +1,187 @@
 #include "buffer_cache.h"
 
+#include <algorithm>
+
 namespace Akumuli {
 
+//! Finalizer from MurmurHash3
+static u64 mix(u64 x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ull;
+    x ^= x >> 33;
+    return x;
+}
+
+//! Position of the counter in the sketch row (low bits of the hash are used to select shard)
+static size_t sketch_index(u64 hash, int row) {
+    return static_cast<size_t>((hash >> (4 + row*15)) & (ChunkCache::SKETCH_WIDTH - 1));
+}
+
+ChunkCache::Shard::Shard()
+    : hand(0)
+    , size(0)
+    , sketch(SKETCH_WIDTH*SKETCH_DEPTH, 0)
+    , nadditions(0)
+    , stats{}
+{
+}
+
 ChunkCache::ChunkCache(size_t limit)
-    : total_size_(0ul)
-    , size_limit_(limit)
+    : shard_limit_(limit / NSHARDS)
 {
+    for (int i = 0; i < NSHARDS; i++) {
+        shards_.emplace_back(new Shard());
+    }
+}
+
+u64 ChunkCache::pack(KeyT const& key) {
+    return static_cast<u64>(static_cast<u32>(std::get<0>(key))) << 32 | static_cast<u32>(std::get<1>(key));
+}
+
+ChunkCache::Shard& ChunkCache::get_shard(u64 key) const {
+    return *shards_[mix(key) & (NSHARDS - 1)];
+}
+
+void ChunkCache::record(Shard& shard, u64 key) {
+    auto hash = mix(key);
+    for (int row = 0; row < SKETCH_DEPTH; row++) {
+        auto& counter = shard.sketch[static_cast<size_t>(row)*SKETCH_WIDTH + sketch_index(hash, row)];
+        if (counter < 0xFF) {
+            counter++;
+        }
+    }
+    if (++shard.nadditions == 10*SKETCH_WIDTH) {
+        // Aging, old accesses shouldn't dominate
+        for (auto& counter: shard.sketch) {
+            counter /= 2;
+        }
+        shard.nadditions = 0;
+    }
+}
+
+u32 ChunkCache::frequency(Shard const& shard, u64 key) {
+    auto hash = mix(key);
+    u32 result = 0xFF;
+    for (int row = 0; row < SKETCH_DEPTH; row++) {
+        u32 counter = shard.sketch[static_cast<size_t>(row)*SKETCH_WIDTH + sketch_index(hash, row)];
+        result = std::min(result, counter);
+    }
+    return result;
+}
+
+size_t ChunkCache::find_victim(Shard& shard) {
+    while (true) {
+        if (shard.hand >= shard.ring.size()) {
+            shard.hand = 0;
+        }
+        auto pos = shard.hand++;
+        Entry& entry = shard.ring[pos];
+        if (entry.item) {
+            if (!entry.referenced) {
+                return pos;
+            }
+            // Second chance
+            entry.referenced = false;
+        }
+    }
+}
+
+void ChunkCache::evict(Shard& shard, size_t pos) {
+    Entry& entry = shard.ring[pos];
+    shard.size -= entry.size;
+    shard.index.erase(entry.key);
+    entry.item.reset();
+    shard.free.push_back(pos);
+}
+
+size_t ChunkCache::get_size(UncompressedChunk const& chunk) {
+    return sizeof(UncompressedChunk) +
+           chunk.paramids.capacity()   * sizeof(aku_ParamId) +
+           chunk.timestamps.capacity() * sizeof(aku_Timestamp) +
+           chunk.values.capacity()     * sizeof(double);
 }
 
 bool ChunkCache::contains(KeyT key) const {
-    std::lock_guard<std::mutex> lock(mutex_);
-    return cache_.count(key) > 0;
+    auto pkey = pack(key);
+    auto& shard = get_shard(pkey);
+    std::lock_guard<std::mutex> lock(shard.lock);
+    return shard.index.count(pkey) > 0;
 }
 
 ChunkCache::ItemT ChunkCache::get(KeyT key) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    auto it = cache_.find(key);
-    if (it == cache_.end()) {
+    auto pkey = pack(key);
+    auto& shard = get_shard(pkey);
+    std::lock_guard<std::mutex> lock(shard.lock);
+    record(shard, pkey);
+    auto it = shard.index.find(pkey);
+    if (it == shard.index.end()) {
+        shard.stats.misses++;
         return ItemT();
     }
-    return it->second;
-}
-
-static size_t get_size(const std::shared_ptr<UncompressedChunk>& header) {
-    return header->paramids.size()   * sizeof(aku_ParamId) +
-           header->timestamps.size() * sizeof(aku_Timestamp) +
-           header->values.size()     * sizeof(double);
+    shard.stats.hits++;
+    Entry& entry = shard.ring[it->second];
+    entry.referenced = true;
+    return entry.item;
 }
 
 void ChunkCache::put(KeyT key, const std::shared_ptr<UncompressedChunk>& header) {
-    auto szdelta = get_size(header);
-    std::lock_guard<std::mutex> lock(mutex_);
-    if (total_size_ + szdelta > size_limit_) {
-        if (!fifo_.empty()) {
-            // Eviction
-            KeyT ekey;
-            size_t esz;
-            std::tie(ekey, esz) = fifo_.back();
-            fifo_.pop_back();
-            auto it = cache_.find(ekey);
-            if (it != cache_.end()) {
-                cache_.erase(it);
-            } else {
-                // TODO: report error (inconsistent cache)
+    auto pkey = pack(key);
+    auto szdelta = get_size(*header);
+    auto& shard = get_shard(pkey);
+    std::lock_guard<std::mutex> lock(shard.lock);
+    if (szdelta > shard_limit_) {
+        shard.stats.rejections++;
+        return;
+    }
+    auto it = shard.index.find(pkey);
+    if (it != shard.index.end()) {
+        // Chunk was added by concurrent query
+        return;
+    }
+    bool admitted = false;
+    while (shard.size + szdelta > shard_limit_) {
+        auto victim = find_victim(shard);
+        if (!admitted) {
+            if (frequency(shard, pkey) <= frequency(shard, shard.ring[victim].key)) {
+                shard.stats.rejections++;
+                return;
             }
-            total_size_ -= esz;
+            admitted = true;
         }
+        evict(shard, victim);
+        shard.stats.evictions++;
+    }
+    size_t pos;
+    if (shard.free.empty()) {
+        pos = shard.ring.size();
+        shard.ring.emplace_back();
+    } else {
+        pos = shard.free.back();
+        shard.free.pop_back();
     }
-    fifo_.push_front(std::make_tuple(key, szdelta));
-    cache_[key] = header;
-    total_size_ += szdelta;
+    Entry& entry = shard.ring[pos];
+    entry.key = pkey;
+    entry.item = header;
+    entry.size = szdelta;
+    entry.referenced = false;
+    shard.index[pkey] = pos;
+    shard.size += szdelta;
 }
 
+ChunkCache::Stats ChunkCache::get_stats() const {
+    Stats result = {};
+    for (auto const& shard: shards_) {
+        std::lock_guard<std::mutex> lock(shard->lock);
+        result.hits       += shard->stats.hits;
+        result.misses     += shard->stats.misses;
+        result.evictions  += shard->stats.evictions;
+        result.rejections += shard->stats.rejections;
+        result.size       += shard->size;
+        result.nchunks    += shard->index.size();
+    }
+    return result;
 }
 
+}
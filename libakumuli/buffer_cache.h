@@ -2,31 +2,100 @@
 
 #include "storage_engine/compression.h"
 
-#include <list>
-#include <map>
 #include <memory>
 #include <mutex>
+#include <unordered_map>
+#include <vector>
 
 namespace Akumuli {
 
+/** Cache of the decompressed chunks.
+  * Cache is split into shards by key hash, each shard has its own lock, so
+  * concurrent queries contend only if they read the same part of the key space.
+  * Each shard uses CLOCK eviction with TinyLFU admission: shard tracks approximate
+  * access frequency of the keys (including keys that aren't cached) and new chunk
+  * displaces the CLOCK victim only if it was accessed more often. Because of that
+  * single large scan can't flush frequently used chunks out of the cache.
+  */
 struct ChunkCache {
     //! Volume id + entry index
     typedef std::tuple<int, int>     KeyT;
-    typedef std::tuple<KeyT, size_t> QueueItemT;
     typedef std::shared_ptr<UncompressedChunk> ItemT;
 
-    std::map<KeyT, ItemT> cache_;
-    std::list<QueueItemT> fifo_;
-    size_t                total_size_;
-    mutable std::mutex    mutex_;
-    const size_t          size_limit_;
+    enum {
+        NSHARDS      = 16,      //< Number of shards (should be a power of two)
+        SKETCH_WIDTH = 0x1000,  //< Number of counters in each row of the frequency sketch
+        SKETCH_DEPTH = 4,       //< Number of rows in the frequency sketch
+    };
 
+    //! Cache counters
+    struct Stats {
+        u64    hits;
+        u64    misses;
+        u64    evictions;   //< Number of evicted chunks
+        u64    rejections;  //< Number of chunks that wasn't admitted
+        size_t size;        //< Total size of all cached chunks in bytes
+        size_t nchunks;     //< Number of cached chunks
+    };
+
+private:
+    struct Entry {
+        u64    key;         //< Packed key
+        ItemT  item;
+        size_t size;
+        bool   referenced;  //< CLOCK reference bit
+    };
+
+    struct Shard {
+        mutable std::mutex lock;
+        std::unordered_map<u64, size_t> index;  //< Packed key -> position in `ring`
+        std::vector<Entry>  ring;               //< CLOCK ring, empty entries have null `item`
+        std::vector<size_t> free;               //< Empty positions in `ring`
+        size_t              hand;
+        size_t              size;
+        std::vector<u8>     sketch;             //< Count-min sketch (SKETCH_DEPTH rows)
+        u32                 nadditions;         //< Sketch additions since last aging
+        Stats               stats;
+
+        Shard();
+    };
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+    const size_t                        shard_limit_;
+
+    //! Convert key to single integer
+    static u64 pack(KeyT const& key);
+    Shard& get_shard(u64 key) const;
+
+    //! Record access in the frequency sketch (should be called under lock)
+    static void record(Shard& shard, u64 key);
+    //! Approximate number of accesses (should be called under lock)
+    static u32 frequency(Shard const& shard, u64 key);
+    //! Find CLOCK victim (should be called under lock), shard shouldn't be empty
+    static size_t find_victim(Shard& shard);
+    //! Remove entry (should be called under lock)
+    static void evict(Shard& shard, size_t pos);
+
+public:
+    //! C-tor. `limit` is the total size of all cached chunks in bytes.
     ChunkCache(size_t limit);
 
+    ChunkCache(ChunkCache const&) = delete;
+    ChunkCache& operator = (ChunkCache const&) = delete;
+
+    //! Check presence of the chunk, doesn't affect counters and eviction order
     bool contains(KeyT key) const;
 
+    //! Return cached chunk or null pointer
     ItemT get(KeyT key);
 
+    //! Add chunk to cache. Chunk can be rejected by the admission policy.
     void put(KeyT key, const std::shared_ptr<UncompressedChunk>& header);
+
+    //! Return counters (sum for all shards)
+    Stats get_stats() const;
+
+    //! Return size of the decompressed chunk in bytes (including vectors' unused capacity)
+    static size_t get_size(UncompressedChunk const& chunk);
 };
 }
@@ -16,8 +16,13 @@
 
 #include "datetime.h"
 #include <cstdio>
+#include <cstring>
 #include <boost/regex.hpp>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 namespace Akumuli {
 
 //! 1ns interval
@@ -61,8 +66,130 @@ static int parse_n_digits(const char* p, int n, const char* error_message = "can
     return value;
 }
 
+//! Number of days since 1970-01-01 (proleptic Gregorian calendar)
+static i64 days_from_civil(int y, int m, int d) {
+    y -= m <= 2;
+    const int era = (y >= 0 ? y : y - 399) / 400;
+    const int yoe = y - era * 400;                                 // [0, 399]
+    const int doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;  // [0, 365]
+    const int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;         // [0, 146096]
+    return static_cast<i64>(era) * 146097 + doe - 719468;
+}
+
+static bool is_leap_year(int y) {
+    return (y % 4 == 0 && y % 100 != 0) || y % 400 == 0;
+}
+
+//! Layout of the basic format timestamp: 'YYYYMMDDTHHMMSS' + optional fraction
+enum {
+    ISO_BASIC_LENGTH = 15,
+    ISO_FRACTION_DIGITS_MAX = 9,
+    ISO_LENGTH_MAX = ISO_BASIC_LENGTH + 1 + ISO_FRACTION_DIGITS_MAX,
+};
+
+//! Parse N digits (digits should be validated beforehand)
+static inline int digits_to_int(const char* p, int n) {
+    int value = 0;
+    for (int i = 0; i < n; i++) {
+        value = value*10 + (p[i] & 0x0F);
+    }
+    return value;
+}
+
+//! Parse two digits (digits should be validated beforehand)
+static inline int two_digits_to_int(const char* p) {
+    return (p[0] & 0x0F)*10 + (p[1] & 0x0F);
+}
+
+//! Parse eight digits at once (SWAR, digits should be validated beforehand)
+static inline u32 eight_digits_to_int(const char* p) {
+    u64 val;
+    memcpy(&val, p, sizeof(val));
+    val -= 0x3030303030303030ul;
+    val = (val * 10) + (val >> 8);  // pairs of digits
+    val = (((val & 0x000000FF000000FFul) * 0x000F424000000064ul)
+        + (((val >> 16) & 0x000000FF000000FFul) * 0x0000271000000001ul)) >> 32;
+    return static_cast<u32>(val);
+}
+
+/** Fast path for `YYYYMMDDTHHMMSS[.fffffffff]` timestamps.
+  * All digits are validated at once using two overlapping 16-byte loads (first one
+  * covers the beginning of the string and the second one covers the end, so nothing
+  * is read past the zero terminator). Returns false if the string doesn't match the
+  * layout or the value can't be handled without boost.date_time (invalid date, date
+  * before epoch, etc), in this case generic parser should be used.
+  */
+static bool fast_parse_iso(const char* iso_str, size_t len, aku_Timestamp* result) {
+    if (len > ISO_LENGTH_MAX || len == ISO_BASIC_LENGTH + 1) {
+        return false;
+    }
+    if (len > ISO_BASIC_LENGTH && iso_str[15] != '.' && iso_str[15] != ',') {
+        return false;
+    }
+    // Bit N is set if N-th character should be a digit
+    const u32 separators = (1u << 8) | (1u << 15);
+    const u32 expected = ((1u << len) - 1) & ~separators;
+#ifdef __SSE2__
+    const __m128i lo = _mm_set1_epi8('0' - 1);
+    const __m128i hi = _mm_set1_epi8('9' + 1);
+    auto digit_mask = [&](const char* p) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i d = _mm_and_si128(_mm_cmpgt_epi8(x, lo), _mm_cmplt_epi8(x, hi));
+        return static_cast<u32>(_mm_movemask_epi8(d));
+    };
+    // String is at least 16 bytes long (including zero terminator)
+    u32 mask = digit_mask(iso_str);
+    if (len > 16) {
+        mask |= digit_mask(iso_str + len - 16) << (len - 16);
+    }
+#else
+    u32 mask = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (iso_str[i] >= '0' && iso_str[i] <= '9') {
+            mask |= 1u << i;
+        }
+    }
+#endif
+    if ((mask & expected) != expected) {
+        return false;
+    }
+    int year   = two_digits_to_int(iso_str)*100 + two_digits_to_int(iso_str + 2);
+    int month  = two_digits_to_int(iso_str + 4);
+    int date   = two_digits_to_int(iso_str + 6);
+    int hour   = two_digits_to_int(iso_str + 9);
+    int minute = two_digits_to_int(iso_str + 11);
+    int second = two_digits_to_int(iso_str + 13);
+    int nanos  = 0;
+    if (len == ISO_LENGTH_MAX) {
+        nanos = static_cast<int>(eight_digits_to_int(iso_str + 16))*10 + (iso_str[24] & 0x0F);
+    } else if (len > ISO_BASIC_LENGTH) {
+        static const int SCALE[] = { 1, 100000000, 10000000, 1000000, 100000, 10000, 1000, 100, 10, 1 };
+        int n = static_cast<int>(len) - ISO_BASIC_LENGTH - 1;
+        nanos = digits_to_int(iso_str + 16, n) * SCALE[n];
+    }
+
+    static const int DAYS_IN_MONTH[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+    if (year < 1970 || month < 1 || month > 12 || date < 1 || hour > 23 || minute > 59 || second > 59) {
+        return false;
+    }
+    int month_days = DAYS_IN_MONTH[month - 1] + (month == 2 && is_leap_year(year) ? 1 : 0);
+    if (date > month_days) {
+        return false;
+    }
+    u64 days = static_cast<u64>(days_from_civil(year, month, date));
+    u64 seconds = days*86400 + static_cast<u64>(hour*3600 + minute*60 + second);
+    *result = seconds*1000000000ul + static_cast<u64>(nanos);
+    return true;
+}
+
 aku_Timestamp DateTimeUtil::from_iso_string(const char* iso_str) {
     size_t len = std::strlen(iso_str);
+    if (len >= ISO_BASIC_LENGTH && iso_str[8] == 'T') {
+        aku_Timestamp ts;
+        if (fast_parse_iso(iso_str, len, &ts)) {
+            return ts;
+        }
+    }
     if (len < 15 || iso_str[8] != 'T') {
         // Raw timestamp
         aku_Timestamp ts;
@@ -0,0 +1,123 @@
+/**
+ * Copyright (c) 2016 Eugene Lazin <4lazin@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "lastvalue.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+namespace Akumuli {
+
+LastValueTable::LastValueTable(aku_ParamId base)
+    : base_(base)
+{
+    for (auto& chunk: chunks_) {
+        chunk.store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+LastValueTable::~LastValueTable() {
+    for (auto& chunk: chunks_) {
+        free(chunk.load(std::memory_order_relaxed));
+    }
+}
+
+LastValueTable::Slot* LastValueTable::get_slot(u64 index, bool create) const {
+    auto chunk_ix = index / CHUNK_SIZE;
+    if (chunk_ix >= MAX_CHUNKS) {
+        return nullptr;
+    }
+    auto& chunk = chunks_[chunk_ix];
+    Slot* slots = chunk.load(std::memory_order_acquire);
+    if (slots == nullptr) {
+        if (!create) {
+            return nullptr;
+        }
+        void* mem = nullptr;
+        if (posix_memalign(&mem, sizeof(Slot), sizeof(Slot)*CHUNK_SIZE) != 0) {
+            throw std::bad_alloc();
+        }
+        // Zeroed slot is empty
+        memset(mem, 0, sizeof(Slot)*CHUNK_SIZE);
+        Slot* expected = nullptr;
+        if (chunk.compare_exchange_strong(expected, static_cast<Slot*>(mem), std::memory_order_acq_rel)) {
+            slots = static_cast<Slot*>(mem);
+        } else {
+            // Other writer was first
+            free(mem);
+            slots = expected;
+        }
+    }
+    return slots + index % CHUNK_SIZE;
+}
+
+bool LastValueTable::update(aku_ParamId id, aku_Timestamp ts, double value) {
+    if (id < base_) {
+        return false;
+    }
+    Slot* slot = get_slot(id - base_, true);
+    if (slot == nullptr) {
+        return false;
+    }
+    u64 bits;
+    memcpy(&bits, &value, sizeof(bits));
+    // Acquire sequence lock
+    u32 seq = slot->seq.load(std::memory_order_relaxed);
+    while (true) {
+        if (seq % 2 == 1) {
+            seq = slot->seq.load(std::memory_order_relaxed);
+            continue;
+        }
+        if (slot->seq.compare_exchange_weak(seq, seq + 1, std::memory_order_acquire)) {
+            break;
+        }
+    }
+    if (seq == 0 || slot->timestamp.load(std::memory_order_relaxed) <= ts) {
+        slot->timestamp.store(ts, std::memory_order_relaxed);
+        slot->value.store(bits, std::memory_order_relaxed);
+    }
+    slot->seq.store(seq + 2, std::memory_order_release);
+    return true;
+}
+
+bool LastValueTable::get(aku_ParamId id, aku_Timestamp* ts, double* value) const {
+    if (id < base_) {
+        return false;
+    }
+    Slot const* slot = get_slot(id - base_, false);
+    if (slot == nullptr) {
+        return false;
+    }
+    u32 begin, end;
+    u64 ts_bits, value_bits;
+    do {
+        begin = slot->seq.load(std::memory_order_acquire);
+        ts_bits = slot->timestamp.load(std::memory_order_relaxed);
+        value_bits = slot->value.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        end = slot->seq.load(std::memory_order_relaxed);
+    } while (begin % 2 == 1 || begin != end);
+    if (begin == 0) {
+        return false;
+    }
+    *ts = ts_bits;
+    memcpy(value, &value_bits, sizeof(value_bits));
+    return true;
+}
+
+}  // namespace
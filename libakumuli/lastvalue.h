@@ -0,0 +1,78 @@
+/**
+ * PRIVATE HEADER
+ *
+ * Per-series last value table.
+ *
+ * Copyright (c) 2016 Eugene Lazin <4lazin@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#pragma once
+#include <atomic>
+
+#include "akumuli_def.h"
+
+namespace Akumuli {
+
+/** Table that holds the newest sample of each series.
+  * Table is indexed by `paramid - base`. Slots are allocated in chunks on
+  * first write, chunk is never moved or deallocated until the table is
+  * destroyed, so readers doesn't need any locks. Each slot occupies the whole
+  * cache line and protected by its own sequence lock (writers of the different
+  * series never touch the same cache line).
+  */
+class LastValueTable {
+public:
+    enum {
+        CHUNK_SIZE = 0x1000,  //< Number of slots in chunk
+        MAX_CHUNKS = 0x1000,  //< Max number of chunks (16M series)
+    };
+
+private:
+    struct Slot {
+        std::atomic<u32> seq;        //< Sequence lock, odd if write is in progress, 0 if slot is empty
+        std::atomic<u64> timestamp;
+        std::atomic<u64> value;      //< Bit pattern of the double value
+    } __attribute__((aligned(64)));
+
+    const aku_ParamId  base_;
+    mutable std::atomic<Slot*> chunks_[MAX_CHUNKS];  //< Chunks are allocated on demand
+
+    //! Return slot by index, allocate chunk if needed (and `create` is true)
+    Slot* get_slot(u64 index, bool create) const;
+
+public:
+    //! C-tor. `base` is the smallest possible series id.
+    LastValueTable(aku_ParamId base);
+
+    ~LastValueTable();
+
+    LastValueTable(LastValueTable const&) = delete;
+    LastValueTable& operator = (LastValueTable const&) = delete;
+
+    /** Update the series. Value is not changed if `ts` is older than stored timestamp.
+      * Thread safe, lock-free for writers of the different series.
+      * @return false if id is out of range.
+      */
+    bool update(aku_ParamId id, aku_Timestamp ts, double value);
+
+    /** Read the last value of the series. Thread safe, readers never block writers
+      * (read is retried if it overlaps with the write to the same series).
+      * @return false if series wasn't updated yet.
+      */
+    bool get(aku_ParamId id, aku_Timestamp* ts, double* value) const;
+};
+
+}  // namespace
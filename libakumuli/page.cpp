@@ -246,6 +246,80 @@ aku_Status PageHeader::complete_chunk(const UncompressedChunk& data) {
     return status;
 }
 
+aku_Status PageHeader::encode_chunk(const UncompressedChunk& data, EncodedChunk* out) {
+    struct Writer : ChunkWriter {
+        std::vector<unsigned char>* buffer;
+        size_t size;
+
+        Writer(std::vector<unsigned char>* buf)
+            : buffer(buf)
+            , size(0)
+        {
+        }
+
+        virtual aku_MemRange allocate() {
+            return {(void*)buffer->data(), (u32)buffer->size()};
+        }
+
+        virtual aku_Status commit(size_t bytes_written) {
+            size = bytes_written;
+            return AKU_SUCCESS;
+        }
+    };
+
+    // Base128 encoded id or timestamp takes up to 10 bytes, value - up to 9 bytes
+    size_t capacity = data.paramids.size()*32 + 64;
+    aku_Status status = AKU_EOVERFLOW;
+    for (int attempt = 0; attempt < 4 && status == AKU_EOVERFLOW; attempt++) {
+        out->data.resize(capacity);
+        Writer writer(&out->data);
+        status = CompressionUtil::encode_chunk(&out->n_elements, &out->first_ts, &out->last_ts, &writer, data);
+        if (status == AKU_SUCCESS) {
+            out->data.resize(writer.size);
+        }
+        capacity *= 2;
+    }
+    if (status != AKU_SUCCESS) {
+        return status;
+    }
+
+    boost::crc_32_type checksum;
+    checksum.process_block(out->data.data(), out->data.data() + out->data.size());
+    out->checksum = checksum.checksum();
+    return AKU_SUCCESS;
+}
+
+aku_Status PageHeader::append_encoded_chunk(const EncodedChunk& chunk) {
+    // Compressed data and two index entries (see `add_entry`) should fit
+    // into the page, otherwise page is left unchanged
+    const auto ENTRY_SPACE = sizeof(aku_Entry)
+                           + sizeof(CompressedChunkDesc)
+                           + sizeof(aku_EntryIndexRecord);
+    const auto SPACE_REQUIRED = chunk.data.size() + 2*ENTRY_SPACE;
+    if (SPACE_REQUIRED > get_free_space()) {
+        return AKU_EOVERFLOW;
+    }
+    if (chunk.first_ts > chunk.last_ts || (count != 0 && chunk.first_ts < page_index(count - 1)->timestamp)) {
+        return AKU_EBAD_ARG;
+    }
+    CompressedChunkDesc desc;
+    char* begin = payload + next_offset;
+    memcpy(begin, chunk.data.data(), chunk.data.size());
+    next_offset += chunk.data.size();
+
+    desc.n_elements = chunk.n_elements;
+    desc.checksum = chunk.checksum;
+    desc.begin_offset = begin - payload;
+    desc.end_offset = desc.begin_offset + chunk.data.size();
+
+    aku_MemRange head = {&desc, sizeof(desc)};
+    aku_Status status = add_entry(AKU_CHUNK_BWD_ID, chunk.first_ts, head);
+    if (status != AKU_SUCCESS) {
+        return status;
+    }
+    return add_entry(AKU_CHUNK_FWD_ID, chunk.last_ts, head);
+}
+
 const aku_Timestamp PageHeader::read_timestamp_at(u32 index) const {
     return page_index(index)->timestamp;
 }
@@ -349,6 +423,11 @@ struct SearchAlgorithm : InterpolationSearch<SearchAlgorithm>
 
     SearchRange search_range_;
 
+    //! Batch buffers (reused between chunks)
+    std::vector<aku_Timestamp> tsbuf_;
+    std::vector<aku_ParamId>   idbuf_;
+    std::vector<double>        xsbuf_;
+
     SearchAlgorithm(PageHeader const* page, std::shared_ptr<QP::IQueryProcessor> query, std::shared_ptr<ChunkCache> cache)
         : page_(page)
         , query_(query)
@@ -498,10 +577,10 @@ struct SearchAlgorithm : InterpolationSearch<SearchAlgorithm>
 
         auto key = std::make_tuple(npages*nopens + pageid, current_index);
 
-        if (cache_ && cache_->contains(key)) {
-            // Fast path
+        if (cache_) {
             header = cache_->get(key);
-        } else {
+        }
+        if (!header) {
             chunk_header.reset(new UncompressedChunk());
             header.reset(new UncompressedChunk());
             auto pdesc  = reinterpret_cast<CompressedChunkDesc const*>(&probe_entry->value[0]);
@@ -540,24 +619,17 @@ struct SearchAlgorithm : InterpolationSearch<SearchAlgorithm>
             start_pos = static_cast<int>(header->timestamps.size() - 1);
         }
 
-        auto queryproc = query_;
-        auto page = page_;
-
-        auto put_entry = [&header, queryproc, page] (u32 i) {
-            auto id = header->paramids.at(i);
-            if (queryproc->filter().apply(id) == QP::IQueryFilter::PROCESS) {
-                aku_PData pdata{};
-                pdata.type = AKU_PAYLOAD_FLOAT;
-                pdata.float64 = header->values.at(i);
-                pdata.size = sizeof(aku_Sample);
-                aku_Sample result = {
-                    header->timestamps.at(i),
-                    header->paramids.at(i),
-                    pdata,
-                };
-                return queryproc->put(result);
+        // Matching elements are passed to query processor in one batch
+        tsbuf_.clear();
+        idbuf_.clear();
+        xsbuf_.clear();
+        auto add_entry = [&header, this] (u32 i) {
+            auto id = header->paramids[i];
+            if (query_->filter().apply(id) == QP::IQueryFilter::PROCESS) {
+                tsbuf_.push_back(header->timestamps[i]);
+                idbuf_.push_back(id);
+                xsbuf_.push_back(header->values[i]);
             }
-            return true;
         };
 
         if (query_range_.is_backward()) {
@@ -567,11 +639,7 @@ struct SearchAlgorithm : InterpolationSearch<SearchAlgorithm>
                     break;
                 }
                 if (result == IN_RANGE) {
-                    if (!put_entry(static_cast<u32>(i))) {
-                        // Scaning process interrupted by the user (connection closed)
-                        result = INTERRUPTED;
-                        break;
-                    }
+                    add_entry(static_cast<u32>(i));
                 }
             }
         } else {
@@ -582,13 +650,16 @@ struct SearchAlgorithm : InterpolationSearch<SearchAlgorithm>
                     break;
                 }
                 if (result == IN_RANGE) {
-                    if (!put_entry(static_cast<u32>(i))) {
-                        result = INTERRUPTED;
-                        break;
-                    }
+                    add_entry(static_cast<u32>(i));
                 }
             }
         }
+        if (!tsbuf_.empty()) {
+            if (!query_->put_batch(tsbuf_.data(), idbuf_.data(), xsbuf_.data(), tsbuf_.size())) {
+                // Scaning process interrupted by the user (connection closed)
+                result = INTERRUPTED;
+            }
+        }
         return result;
     }
 
@@ -51,6 +51,15 @@ struct CompressedChunkDesc {
     u32 checksum;      //< Checksum
 } __attribute__((packed));
 
+//! Chunk compressed outside of the page (see `PageHeader::encode_chunk`)
+struct EncodedChunk {
+    std::vector<unsigned char> data;
+    u32           n_elements;
+    aku_Timestamp first_ts;
+    aku_Timestamp last_ts;
+    u32           checksum;
+};
+
 
 struct aku_Entry {
     //aku_Timestamp  time;      //< Entry timestamp
@@ -174,6 +183,23 @@ public:
      */
     aku_Status complete_chunk(const UncompressedChunk& data);
 
+    /**
+     * Compress chunk into the memory buffer. Doesn't touch any page, can be
+     * called concurrently from different threads.
+     * @param data chunk data in chunk order (see `CompressionUtil::convert_from_time_order`)
+     * @param out compressed chunk
+     * @returns operation status
+     */
+    static aku_Status encode_chunk(const UncompressedChunk& data, EncodedChunk* out);
+
+    /**
+     * Copy chunk compressed by `encode_chunk` to page, add header and index.
+     * Result is the same as `complete_chunk` call with the same data.
+     * @returns operation status (AKU_EOVERFLOW if chunk doesn't fit, page is
+     *          not modified in this case)
+     */
+    aku_Status append_encoded_chunk(const EncodedChunk& chunk);
+
     /**
      * Get length of the entry.
      * @param entry_index index of the entry.
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <memory>
+#include <vector>
 
 #include "../queryprocessor_framework.h"
 #include "../util.h"  // for panic
@@ -16,6 +17,10 @@ struct FilterByIdNode : std::enable_shared_from_this<FilterByIdNode<Predicate>>,
     //! Id matching predicate
     Predicate             op_;
     std::shared_ptr<Node> next_;
+    //! Batch buffers (reused between `put_batch` calls)
+    std::vector<aku_Timestamp> tsbuf_;
+    std::vector<aku_ParamId>   idbuf_;
+    std::vector<double>        xsbuf_;
 
     FilterByIdNode(Predicate pred, std::shared_ptr<Node> next)
         : op_(pred)
@@ -30,6 +35,23 @@ struct FilterByIdNode : std::enable_shared_from_this<FilterByIdNode<Predicate>>,
         return op_(sample.paramid) ? next_->put(sample) : true;
     }
 
+    virtual bool put_batch(const aku_Timestamp* ts, const aku_ParamId* ids, const double* xs, size_t size) {
+        tsbuf_.clear();
+        idbuf_.clear();
+        xsbuf_.clear();
+        for (size_t i = 0; i < size; i++) {
+            if (op_(ids[i])) {
+                tsbuf_.push_back(ts[i]);
+                idbuf_.push_back(ids[i]);
+                xsbuf_.push_back(xs[i]);
+            }
+        }
+        if (tsbuf_.empty()) {
+            return true;
+        }
+        return next_->put_batch(tsbuf_.data(), idbuf_.data(), xsbuf_.data(), tsbuf_.size());
+    }
+
     void set_error(aku_Status status) {
         if (!next_) {
             AKU_PANIC("bad query processor node, next not set");
@@ -1,5 +1,7 @@
 #include "limiter.h"
 
+#include <algorithm>
+
 namespace Akumuli {
 namespace QP {
 
@@ -21,9 +23,10 @@ bool Limiter::put(const aku_Sample& sample) {
         return true;
     }
     if (counter_ < offset_) {
-        // continue iteration
+        // skip the sample and continue iteration
+        counter_++;
         return true;
-    } else if (counter_ >= limit_) {
+    } else if (counter_ - offset_ >= limit_) {
         // stop iteration
         return false;
     }
@@ -31,6 +34,28 @@ bool Limiter::put(const aku_Sample& sample) {
     return next_->put(sample);
 }
 
+bool Limiter::put_batch(const aku_Timestamp* ts, const aku_ParamId* ids, const double* xs, size_t size) {
+    // Elements that fall into the offset are skipped
+    size_t nskip = 0;
+    if (counter_ < offset_) {
+        nskip = static_cast<size_t>(std::min(static_cast<u64>(size), offset_ - counter_));
+        counter_ += nskip;
+        if (nskip == size) {
+            // continue iteration
+            return true;
+        }
+    }
+    u64 npassed = counter_ - offset_;
+    u64 nleft = npassed < limit_ ? limit_ - npassed : 0;
+    size_t n = static_cast<size_t>(std::min(static_cast<u64>(size - nskip), nleft));
+    counter_ += n;
+    if (n != 0 && !next_->put_batch(ts + nskip, ids + nskip, xs + nskip, n)) {
+        return false;
+    }
+    // stop iteration if some elements were dropped
+    return nskip + n == size;
+}
+
 void Limiter::set_error(aku_Status status) {
     next_->set_error(status);
 }
@@ -9,9 +9,9 @@ namespace QP {
 
 struct Limiter : Node {
 
-    u64                   limit_;
-    u64                   offset_;
-    u64                   counter_;
+    u64                   limit_;    //< Number of samples to pass (after offset)
+    u64                   offset_;   //< Number of samples to skip
+    u64                   counter_;  //< Number of samples seen (skipped or passed)
     std::shared_ptr<Node> next_;
 
     Limiter(u64 limit, u64 offset, std::shared_ptr<Node> next);
@@ -20,6 +20,8 @@ struct Limiter : Node {
 
     virtual bool put(const aku_Sample& sample);
 
+    virtual bool put_batch(const aku_Timestamp* ts, const aku_ParamId* ids, const double* xs, size_t size);
+
     virtual void set_error(aku_Status status);
 
     virtual int get_requirements() const;
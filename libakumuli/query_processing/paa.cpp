@@ -23,6 +23,11 @@ void MeanCounter::add(aku_Sample const& value) {
     num++;
 }
 
+void MeanCounter::merge(MeanCounter const& other) {
+    acc += other.acc;
+    num += other.num;
+}
+
 MeanPAA::MeanPAA(std::shared_ptr<Node> next)
     : PAA<MeanCounter>(next)
 {
@@ -61,6 +66,10 @@ void MedianCounter::add(aku_Sample const& value) {
     acc.push_back(value.payload.float64);
 }
 
+void MedianCounter::merge(MedianCounter const& other) {
+    acc.insert(acc.end(), other.acc.begin(), other.acc.end());
+}
+
 MedianPAA::MedianPAA(std::shared_ptr<Node> next)
     : PAA<MedianCounter>(next)
 {
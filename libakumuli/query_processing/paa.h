@@ -1,22 +1,94 @@
 #pragma once
 
+#include <map>
 #include <memory>
 #include <unordered_map>
 #include <vector>
 
 #include "../queryprocessor_framework.h"
+#include "../util.h"
 
 namespace Akumuli {
 namespace QP {
 
 
-//! Generic piecewise aggregate approximation
+/** Generic piecewise aggregate approximation.
+  * State should implement `add`, `reset`, `ready`, `value` and `merge` methods.
+  *
+  * Parallel execution. Partial node (see `make_partial`) doesn't produce any output,
+  * it stores states of all time buckets instead (time bucket is identified by the
+  * timestamp of the margin). Partial states are merged into the parent node and the
+  * parent node produces output on `complete`. Partial states should be merged in
+  * scan order (this matters for first-paa and last-paa).
+  */
 template <class State> struct PAA : Node {
+    typedef std::unordered_map<aku_ParamId, State> StateMap;
+
     std::shared_ptr<Node> next_;
-    std::unordered_map<aku_ParamId, State> counters_;
+    StateMap counters_;
+    //! Merged or partial states (margin timestamp -> states)
+    std::map<aku_Timestamp, StateMap> buckets_;
+    //! Margin timestamp of the current bucket (partial node only)
+    aku_Timestamp bucket_;
+    //! Scan direction of the query (parallel execution only, set by `make_partial`)
+    bool backward_;
+    //! Partial node flag
+    bool partial_;
+    //! Initial state of every new counter (parametrized states copy their settings from it)
+    State proto_;
+
+    PAA(std::shared_ptr<Node> next, State const& proto = State())
+        : next_(next)
+        , bucket_(0)
+        , backward_(false)
+        , partial_(false)
+        , proto_(proto) {}
+
+    State& get_state(StateMap* map, aku_ParamId id) {
+        auto it = map->find(id);
+        if (AKU_UNLIKELY(it == map->end())) {
+            it = map->insert(std::make_pair(id, proto_)).first;
+        }
+        return it->second;
+    }
 
-    PAA(std::shared_ptr<Node> next)
-        : next_(next) {}
+    void merge_states(StateMap* dest, StateMap const& src) {
+        for (auto const& pair : src) {
+            get_state(dest, pair.first).merge(pair.second);
+        }
+    }
+
+    //! Move states of the current bucket to `buckets_` (partial node only)
+    void stash_bucket() {
+        if (!counters_.empty()) {
+            merge_states(&buckets_[bucket_], counters_);
+            counters_.clear();
+        }
+    }
+
+    //! Produce output for all merged buckets
+    bool output_buckets() {
+        aku_Sample margin = backward_ ? SAMPLING_LO_MARGIN : SAMPLING_HI_MARGIN;
+        if (backward_) {
+            for (auto it = buckets_.rbegin(); it != buckets_.rend(); it++) {
+                std::swap(counters_, it->second);
+                margin.timestamp = it->first;
+                if (!average_samples(margin)) {
+                    return false;
+                }
+            }
+        } else {
+            for (auto it = buckets_.begin(); it != buckets_.end(); it++) {
+                std::swap(counters_, it->second);
+                margin.timestamp = it->first;
+                if (!average_samples(margin)) {
+                    return false;
+                }
+            }
+        }
+        buckets_.clear();
+        return true;
+    }
 
     bool average_samples(aku_Sample const& margin) {
         std::vector<aku_ParamId> ids;
@@ -51,23 +123,61 @@ template <class State> struct PAA : Node {
         return true;
     }
 
-    virtual void complete() { next_->complete(); }
+    virtual void complete() {
+        if (!buckets_.empty()) {
+            output_buckets();
+        }
+        next_->complete();
+    }
 
     virtual bool put(const aku_Sample& sample) {
         if (sample.payload.type > aku_PData::MARGIN) {
-            if (!average_samples(sample)) {
+            if (partial_) {
+                stash_bucket();
+                bucket_ = sample.timestamp;
+            } else if (!average_samples(sample)) {
                 return false;
             }
         } else {
-            auto& state = counters_[sample.paramid];
+            auto& state = get_state(&counters_, sample.paramid);
             state.add(sample);
         }
         return true;
     }
 
+    virtual bool put_batch(const aku_Timestamp* ts, const aku_ParamId* ids, const double* xs, size_t size) {
+        for (size_t i = 0; i < size; i++) {
+            auto& state = get_state(&counters_, ids[i]);
+            state.add(make_float_sample(ts[i], ids[i], xs[i]));
+        }
+        return true;
+    }
+
     virtual void set_error(aku_Status status) { next_->set_error(status); }
 
     virtual int get_requirements() const { return GROUP_BY_REQUIRED; }
+
+    virtual std::shared_ptr<Node> make_partial(bool backward) {
+        // Direction comes from the query, partials that didn't receive any data can't know it
+        backward_          = backward;
+        auto partial       = std::make_shared<PAA<State>>(std::shared_ptr<Node>(), proto_);
+        partial->partial_  = true;
+        partial->backward_ = backward;
+        return partial;
+    }
+
+    virtual void merge(Node const& node) {
+        auto other = dynamic_cast<PAA<State> const*>(&node);
+        if (other == nullptr) {
+            AKU_PANIC("can't merge nodes of different types");
+        }
+        for (auto const& bucket : other->buckets_) {
+            merge_states(&buckets_[bucket.first], bucket.second);
+        }
+        if (!other->counters_.empty()) {
+            merge_states(&buckets_[other->bucket_], other->counters_);
+        }
+    }
 };
 
 
@@ -82,6 +192,8 @@ struct MeanCounter {
     bool ready() const;
 
     void add(aku_Sample const& value);
+
+    void merge(MeanCounter const& other);
 };
 
 struct MeanPAA : PAA<MeanCounter> {
@@ -101,6 +213,8 @@ struct MedianCounter {
     bool ready() const;
 
     void add(aku_Sample const& value);
+
+    void merge(MedianCounter const& other);
 };
 
 struct MedianPAA : PAA<MedianCounter> {
@@ -132,6 +246,20 @@ template <class SelectFn> struct ValueSelector {
         }
         num++;
     }
+
+    //! Merge with state that follows this state in scan order
+    void merge(ValueSelector const& other) {
+        if (!other.num) {
+            return;
+        }
+        if (!num) {
+            acc = other.acc;
+        } else {
+            SelectFn fn;
+            acc = fn(acc, other.acc);
+        }
+        num += other.num;
+    }
 };
 
 template <class SelectFn> struct GenericPAA : PAA<ValueSelector<SelectFn>> {
@@ -0,0 +1,185 @@
+#include "quantile.h"
+#include "../util.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace Akumuli {
+namespace QP {
+
+static const double DEFAULT_QUANTILE = 0.5;
+static const double DEFAULT_ACCURACY = 0.01;
+//! With 1% accuracy 2048 bins covers values from 1 to 1e17
+static const size_t DEFAULT_MAX_BINS = 2048;
+
+//! Check exponent bits directly, `std::isfinite` is folded to `true` by -ffast-math
+static bool is_finite(double x) {
+    u64 bits;
+    memcpy(&bits, &x, sizeof(bits));
+    return (bits & 0x7FF0000000000000ull) != 0x7FF0000000000000ull;
+}
+
+void SketchStore::add(int key, double count, size_t max_bins) {
+    if (bins.empty()) {
+        offset = key;
+        bins.push_back(0);
+    }
+    if (key < offset) {
+        int top = offset + static_cast<int>(bins.size()) - 1;
+        if (top - key + 1 > static_cast<int>(max_bins)) {
+            // Collapse into the lowest bin
+            key = top - static_cast<int>(max_bins) + 1;
+        }
+        if (key < offset) {
+            bins.insert(bins.begin(), static_cast<size_t>(offset - key), 0.0);
+            offset = key;
+        }
+    } else if (key >= offset + static_cast<int>(bins.size())) {
+        bins.resize(static_cast<size_t>(key - offset + 1), 0.0);
+        if (bins.size() > max_bins) {
+            // Collapse lowest bins
+            auto n = bins.size() - max_bins;
+            for (size_t i = 0; i < n; i++) {
+                bins[n] += bins[i];
+            }
+            bins.erase(bins.begin(), bins.begin() + static_cast<std::ptrdiff_t>(n));
+            offset += static_cast<int>(n);
+        }
+    }
+    bins[static_cast<size_t>(key - offset)] += count;
+    total += count;
+}
+
+int SketchStore::key_at_rank(double rank) const {
+    double acc = 0;
+    for (size_t i = 0; i < bins.size(); i++) {
+        acc += bins[i];
+        if (acc > rank) {
+            return offset + static_cast<int>(i);
+        }
+    }
+    return offset + static_cast<int>(bins.size()) - 1;
+}
+
+void SketchStore::merge(SketchStore const& other, size_t max_bins) {
+    for (size_t i = 0; i < other.bins.size(); i++) {
+        if (other.bins[i] != 0.0) {
+            add(other.offset + static_cast<int>(i), other.bins[i], max_bins);
+        }
+    }
+}
+
+void SketchStore::clear() {
+    std::vector<double> tmp;
+    std::swap(tmp, bins);
+    offset = 0;
+    total = 0;
+}
+
+QuantileCounter::QuantileCounter()
+    : QuantileCounter(DEFAULT_QUANTILE, DEFAULT_ACCURACY, DEFAULT_MAX_BINS)
+{
+}
+
+QuantileCounter::QuantileCounter(double q, double accuracy, size_t max_bins)
+    : quantile(q)
+    , max_bins(max_bins)
+    , gamma(1.0 + 2*accuracy/(1.0 - accuracy))
+    , log_gamma(std::log(gamma))
+    , zero(0)
+{
+}
+
+int QuantileCounter::key_of(double x) const {
+    return static_cast<int>(std::ceil(std::log(x) / log_gamma));
+}
+
+double QuantileCounter::value_of(int key) const {
+    // Bin `key` contains values from (gamma^(key-1), gamma^key]
+    return 2*std::pow(gamma, key)/(gamma + 1);
+}
+
+void QuantileCounter::reset() {
+    positive.clear();
+    negative.clear();
+    zero = 0;
+}
+
+double QuantileCounter::value() const {
+    return get_quantile(quantile);
+}
+
+bool QuantileCounter::ready() const {
+    return (positive.total + negative.total + zero) != 0.0;
+}
+
+void QuantileCounter::add(aku_Sample const& value) {
+    double x = value.payload.float64;
+    if (!is_finite(x)) {
+        // NaN and infinities can't be mapped to bins
+        return;
+    }
+    if (x > 0) {
+        positive.add(key_of(x), 1, max_bins);
+    } else if (x < 0) {
+        negative.add(key_of(-x), 1, max_bins);
+    } else {
+        zero++;
+    }
+}
+
+void QuantileCounter::merge(QuantileCounter const& other) {
+    positive.merge(other.positive, max_bins);
+    negative.merge(other.negative, max_bins);
+    zero += other.zero;
+}
+
+double QuantileCounter::get_quantile(double q) const {
+    if (!ready()) {
+        AKU_PANIC("`ready` should be called first");
+    }
+    double count = positive.total + negative.total + zero;
+    double rank = q*(count - 1);
+    if (rank < negative.total) {
+        // Negative values are stored by absolute value, largest absolute value goes first
+        return -value_of(negative.key_at_rank(negative.total - 1 - rank));
+    } else if (rank < negative.total + zero) {
+        return 0;
+    }
+    return value_of(positive.key_at_rank(rank - negative.total - zero));
+}
+
+static QuantileCounter make_counter(double quantile, boost::property_tree::ptree const& ptree) {
+    if (quantile < 0.0 || quantile > 1.0) {
+        QueryParserError error("quantile should be in [0, 1] range");
+        BOOST_THROW_EXCEPTION(error);
+    }
+    double accuracy = ptree.get<double>("accuracy", DEFAULT_ACCURACY);
+    if (accuracy <= 0.0 || accuracy >= 1.0) {
+        QueryParserError error("`accuracy` should be in (0, 1) range");
+        BOOST_THROW_EXCEPTION(error);
+    }
+    return QuantileCounter(quantile, accuracy, DEFAULT_MAX_BINS);
+}
+
+QuantilePAA::QuantilePAA(double quantile, double accuracy, std::shared_ptr<Node> next)
+    : PAA<QuantileCounter>(next, QuantileCounter(quantile, accuracy, DEFAULT_MAX_BINS))
+{
+}
+
+QuantilePAA::QuantilePAA(boost::property_tree::ptree const& ptree, std::shared_ptr<Node> next)
+    : PAA<QuantileCounter>(next, make_counter(ptree.get<double>("quantile", DEFAULT_QUANTILE), ptree))
+{
+}
+
+PercentilePAA::PercentilePAA(boost::property_tree::ptree const& ptree, std::shared_ptr<Node> next)
+    : QuantilePAA(0.0, DEFAULT_ACCURACY, next)
+{
+    proto_ = make_counter(ptree.get<double>("percentile", 100*DEFAULT_QUANTILE)/100.0, ptree);
+}
+
+static QueryParserToken<QuantilePAA> quantile_paa_token("quantile-paa");
+static QueryParserToken<PercentilePAA> percentile_paa_token("percentile-paa");
+
+}}  // namespace
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "paa.h"
+
+namespace Akumuli {
+namespace QP {
+
+/** Dense store of the DDSketch bins.
+  * Bin `key` is stored at `bins[key - offset]`. If number of bins exceeds the limit
+  * lowest bins are collapsed (accuracy is guaranteed only for higher quantiles).
+  */
+struct SketchStore {
+    int offset = 0;
+    std::vector<double> bins;
+    double total = 0;
+
+    void add(int key, double count, size_t max_bins);
+
+    //! Find key of the bin that contains element with rank `rank` (0-based, ascending order)
+    int key_at_rank(double rank) const;
+
+    void merge(SketchStore const& other, size_t max_bins);
+
+    void clear();
+};
+
+/** Quantile estimator (DDSketch).
+  * Values are mapped to logarithmically sized bins, so memory usage doesn't depend
+  * on the number of values and estimate of the q-quantile is within `accuracy` of
+  * the actual value (relative error). Sketches with the same parameters can be merged.
+  */
+struct QuantileCounter {
+    //! Target quantile (between 0 and 1)
+    double quantile;
+    //! Max number of bins per store
+    size_t max_bins;
+    double gamma;
+    double log_gamma;
+
+    SketchStore positive;
+    SketchStore negative;
+    double zero;
+
+    QuantileCounter();
+
+    QuantileCounter(double q, double accuracy, size_t max_bins);
+
+    void reset();
+
+    double value() const;
+
+    bool ready() const;
+
+    //! Add value to the sketch, non-finite values are ignored
+    void add(aku_Sample const& value);
+
+    void merge(QuantileCounter const& other);
+
+    //! Estimate value of the q-quantile
+    double get_quantile(double q) const;
+
+private:
+    int key_of(double x) const;
+    double value_of(int key) const;
+};
+
+/** Approximate quantile PAA.
+  * Query parameters: `quantile` (between 0 and 1, default 0.5) and `accuracy` (relative
+  * error, default 0.01).
+  */
+struct QuantilePAA : PAA<QuantileCounter> {
+
+    QuantilePAA(double quantile, double accuracy, std::shared_ptr<Node> next);
+
+    QuantilePAA(boost::property_tree::ptree const&, std::shared_ptr<Node> next);
+};
+
+/** Same as `QuantilePAA` but target quantile is set using `percentile` query
+  * parameter (e.g. 99.9 for p999).
+  */
+struct PercentilePAA : QuantilePAA {
+
+    PercentilePAA(boost::property_tree::ptree const&, std::shared_ptr<Node> next);
+};
+}
+}  // namespace
@@ -66,6 +66,20 @@ bool RandomSamplingNode::put(const aku_Sample& sample) {
     return true;
 }
 
+bool RandomSamplingNode::put_batch(const aku_Timestamp* ts, const aku_ParamId* ids, const double* xs, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        if (samples_.size() < buffer_size_) {
+            samples_.push_back(make_float_sample(ts[i], ids[i], xs[i]));
+        } else {
+            u32 ix = random_() % samples_.size();
+            if (ix < buffer_size_) {
+                samples_.at(ix) = make_float_sample(ts[i], ids[i], xs[i]);
+            }
+        }
+    }
+    return true;
+}
+
 void RandomSamplingNode::set_error(aku_Status status) {
     next_->set_error(status);
 }
@@ -25,6 +25,8 @@ struct RandomSamplingNode : std::enable_shared_from_this<RandomSamplingNode>, No
 
     virtual bool put(const aku_Sample& sample);
 
+    virtual bool put_batch(const aku_Timestamp* ts, const aku_ParamId* ids, const double* xs, size_t size);
+
     virtual void set_error(aku_Status status);
 
     virtual int get_requirements() const;
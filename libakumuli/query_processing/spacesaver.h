@@ -1,9 +1,13 @@
 #pragma once
 
+#include <algorithm>
+#include <limits>
 #include <memory>
 #include <unordered_map>
+#include <vector>
 
 #include "../queryprocessor_framework.h"
+#include "../util.h"
 
 namespace Akumuli {
 namespace QP {
@@ -134,6 +138,68 @@ struct SpaceSaver : Node {
     virtual void set_error(aku_Status status) { next_->set_error(status); }
 
     virtual int get_requirements() const { return EMPTY | TERMINAL; }
+
+    virtual std::shared_ptr<Node> make_partial(bool) {
+        auto partial = std::make_shared<SpaceSaver>(*this);
+        partial->next_.reset();
+        partial->counters_.clear();
+        partial->N = 0;
+        return partial;
+    }
+
+    //! Smallest counter if summary is full (evicted items can have this count), 0 otherwise
+    double evicted_bound() const {
+        if (counters_.size() < M) {
+            return 0;
+        }
+        double min = std::numeric_limits<double>::max();
+        for (auto const& it : counters_) {
+            min = std::min(min, it.second.count);
+        }
+        return min;
+    }
+
+    /** Merge summaries. Item that is missing in one of the summaries
+      * could be evicted from it, in this case its count is bounded by
+      * the smallest counter of that summary.
+      */
+    virtual void merge(Node const& node) {
+        auto other = dynamic_cast<SpaceSaver const*>(&node);
+        if (other == nullptr) {
+            AKU_PANIC("can't merge nodes of different types");
+        }
+        auto this_bound  = evicted_bound();
+        auto other_bound = other->evicted_bound();
+        for (auto& it : counters_) {
+            if (other->counters_.count(it.first) == 0) {
+                it.second.count += other_bound;
+                it.second.error += other_bound;
+            }
+        }
+        for (auto const& it : other->counters_) {
+            auto local = counters_.find(it.first);
+            if (local == counters_.end()) {
+                counters_[it.first] = { it.second.count + this_bound,
+                                        it.second.error + this_bound };
+            } else {
+                local->second.count += it.second.count;
+                local->second.error += it.second.error;
+            }
+        }
+        N += other->N;
+        if (counters_.size() > M) {
+            // Keep M largest counters
+            std::vector<std::pair<aku_ParamId, Item>> items(counters_.begin(), counters_.end());
+            std::nth_element(items.begin(), items.begin() + static_cast<std::ptrdiff_t>(M), items.end(),
+                             [](std::pair<aku_ParamId, Item> const& lhs,
+                                std::pair<aku_ParamId, Item> const& rhs) {
+                                 return lhs.second.count > rhs.second.count;
+                             });
+            items.resize(M);
+            counters_.clear();
+            counters_.insert(items.begin(), items.end());
+        }
+    }
 };
 }
 }  // namespace
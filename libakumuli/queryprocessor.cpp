@@ -146,27 +146,60 @@ bool GroupByTime::put(aku_Sample const& sample, Node& next) {
             lowerbound_ = aligned;
             upperbound_ = aligned + step_;
         }
-        if (ts >= upperbound_) {
-            // Forward direction
-            aku_Sample empty = SAMPLING_HI_MARGIN;
+        if (ts >= upperbound_ || ts < lowerbound_) {
+            // HI margin in forward direction, LO margin in backward direction
+            aku_Sample empty = ts >= upperbound_ ? SAMPLING_HI_MARGIN : SAMPLING_LO_MARGIN;
             empty.timestamp = upperbound_;
             if (!next.put(empty)) {
                 return false;
             }
-            lowerbound_ += step_;
-            upperbound_ += step_;
-        } else if (ts < lowerbound_) {
-            // Backward direction
-            aku_Sample empty = SAMPLING_LO_MARGIN;
+            // Next bucket is the one that contains `ts` (there can be a gap in the data)
+            lowerbound_ = ts / step_ * step_;
+            upperbound_ = lowerbound_ + step_;
+        }
+    }
+    return next.put(sample);
+}
+
+bool GroupByTime::put_batch(const aku_Timestamp* ts, const aku_ParamId* ids, const double* xs, size_t size, Node& next) {
+    if (step_ == 0) {
+        return next.put_batch(ts, ids, xs, size);
+    }
+    size_t begin = 0;  // first element of the current bucket
+    for (size_t i = 0; i < size; i++) {
+        if (AKU_UNLIKELY(first_hit_ == true)) {
+            first_hit_ = false;
+            lowerbound_ = ts[i] / step_ * step_;
+            upperbound_ = lowerbound_ + step_;
+        }
+        if (ts[i] >= upperbound_ || ts[i] < lowerbound_) {
+            if (i != begin && !next.put_batch(ts + begin, ids + begin, xs + begin, i - begin)) {
+                return false;
+            }
+            begin = i;
+            aku_Sample empty = ts[i] >= upperbound_ ? SAMPLING_HI_MARGIN : SAMPLING_LO_MARGIN;
             empty.timestamp = upperbound_;
             if (!next.put(empty)) {
                 return false;
             }
-            lowerbound_ -= step_;
-            upperbound_ -= step_;
+            lowerbound_ = ts[i] / step_ * step_;
+            upperbound_ = lowerbound_ + step_;
         }
     }
-    return next.put(sample);
+    if (begin != size) {
+        return next.put_batch(ts + begin, ids + begin, xs + begin, size - begin);
+    }
+    return true;
+}
+
+bool GroupByTime::flush(Node& next, bool backward) {
+    if (step_ == 0 || first_hit_) {
+        return true;
+    }
+    first_hit_ = true;
+    aku_Sample empty = backward ? SAMPLING_LO_MARGIN : SAMPLING_HI_MARGIN;
+    empty.timestamp = upperbound_;
+    return next.put(empty);
 }
 
 bool GroupByTime::empty() const {
@@ -326,7 +359,17 @@ bool ScanQueryProcessor::put(const aku_Sample &sample) {
     return groupby_.put(copy, *root_node_);
 }
 
+bool ScanQueryProcessor::put_batch(const aku_Timestamp* ts, const aku_ParamId* ids, const double* xs, size_t size) {
+    if (groupby_tag_) {
+        // Group-by tag statement should see each sample
+        return IQueryProcessor::put_batch(ts, ids, xs, size);
+    }
+    return groupby_.put_batch(ts, ids, xs, size, *root_node_);
+}
+
 void ScanQueryProcessor::stop() {
+    // Last bucket is not followed by the margin
+    groupby_.flush(*root_node_, range_.is_backward());
     root_node_->complete();
 }
 
@@ -338,6 +381,151 @@ QueryRange ScanQueryProcessor::range() const {
     return range_;
 }
 
+//! Immutable copy of the query filter, can be used from many threads
+struct IdSetFilter : IQueryFilter {
+    std::unordered_set<aku_ParamId> ids_;
+
+    IdSetFilter(std::vector<aku_ParamId> const& ids)
+        : ids_(ids.begin(), ids.end())
+    {
+    }
+
+    virtual std::vector<aku_ParamId> get_ids() {
+        return std::vector<aku_ParamId>(ids_.begin(), ids_.end());
+    }
+
+    virtual FilterResult apply(aku_ParamId id) {
+        return ids_.count(id) != 0 ? PROCESS : SKIP_THIS;
+    }
+};
+
+/** Query processor that accumulates partial results of the `ScanQueryProcessor`.
+  * Doesn't share any mutable state with parent query processor.
+  * If group-by time step is set, each sample is preceeded by the margin that identifies
+  * its time bucket (margin is sent only when bucket changes). Unlike `GroupByTime` margin
+  * is sent before the first sample of the bucket and contains upper bound of this bucket,
+  * so results of the different partial query processors can be aligned during merge.
+  */
+struct PartialQueryProcessor : IQueryProcessor {
+    QueryRange range_;
+    IdSetFilter filter_;
+    std::shared_ptr<Node> root_node_;
+    aku_Status status_;
+    aku_Timestamp step_;
+    aku_Timestamp bucket_;
+    bool first_hit_;
+
+    PartialQueryProcessor(QueryRange range,
+                          std::vector<aku_ParamId> const& ids,
+                          std::shared_ptr<Node> root,
+                          aku_Timestamp step)
+        : range_(range)
+        , filter_(ids)
+        , root_node_(root)
+        , status_(AKU_SUCCESS)
+        , step_(step)
+        , bucket_(0)
+        , first_hit_(true)
+    {
+    }
+
+    bool put_margin(aku_Timestamp ts) {
+        aku_Timestamp bucket = ts / step_ * step_ + step_;
+        if (AKU_UNLIKELY(first_hit_ || bucket != bucket_)) {
+            first_hit_ = false;
+            bucket_ = bucket;
+            aku_Sample margin = range_.is_backward() ? SAMPLING_LO_MARGIN : SAMPLING_HI_MARGIN;
+            margin.timestamp = bucket;
+            return root_node_->put(margin);
+        }
+        return true;
+    }
+
+    QueryRange range() const {
+        return range_;
+    }
+
+    IQueryFilter& filter() {
+        return filter_;
+    }
+
+    SeriesMatcher* matcher() {
+        return nullptr;
+    }
+
+    bool start() {
+        return true;
+    }
+
+    bool put(const aku_Sample& sample) {
+        if (AKU_UNLIKELY(sample.payload.type == aku_PData::EMPTY)) {
+            return true;
+        }
+        if (step_ && !put_margin(sample.timestamp)) {
+            return false;
+        }
+        return root_node_->put(sample);
+    }
+
+    bool put_batch(const aku_Timestamp* ts, const aku_ParamId* ids, const double* xs, size_t size) {
+        if (step_ == 0) {
+            return root_node_->put_batch(ts, ids, xs, size);
+        }
+        // Batch is split at bucket boundaries, each part is preceeded by the margin
+        size_t begin = 0;
+        for (size_t i = 0; i < size; i++) {
+            aku_Timestamp bucket = ts[i] / step_ * step_ + step_;
+            if (AKU_UNLIKELY(first_hit_ || bucket != bucket_)) {
+                if (i != begin && !root_node_->put_batch(ts + begin, ids + begin, xs + begin, i - begin)) {
+                    return false;
+                }
+                begin = i;
+                if (!put_margin(ts[i])) {
+                    return false;
+                }
+            }
+        }
+        if (begin != size) {
+            return root_node_->put_batch(ts + begin, ids + begin, xs + begin, size - begin);
+        }
+        return true;
+    }
+
+    void stop() {
+    }
+
+    void set_error(aku_Status error) {
+        status_ = error;
+    }
+};
+
+std::shared_ptr<IQueryProcessor> ScanQueryProcessor::make_partial() {
+    std::shared_ptr<IQueryProcessor> result;
+    if (groupby_tag_ || range_.type != QueryRange::INSTANT) {
+        return result;
+    }
+    if (!groupby_.empty() && (root_node_->get_requirements() & Node::GROUP_BY_REQUIRED) == 0) {
+        // Only nodes that depend on group-by can merge partial results bucket by bucket
+        return result;
+    }
+    auto node = root_node_->make_partial(range_.is_backward());
+    if (node) {
+        result = std::make_shared<PartialQueryProcessor>(range_, filter_->get_ids(), node, groupby_.step_);
+    }
+    return result;
+}
+
+aku_Status ScanQueryProcessor::merge(IQueryProcessor& partial) {
+    auto ppartial = dynamic_cast<PartialQueryProcessor*>(&partial);
+    if (ppartial == nullptr) {
+        return AKU_EBAD_ARG;
+    }
+    if (ppartial->status_ == AKU_SUCCESS) {
+        root_node_->merge(*ppartial->root_node_);
+    }
+    return ppartial->status_;
+}
+
 MetadataQueryProcessor::MetadataQueryProcessor(std::shared_ptr<IQueryFilter> flt, std::shared_ptr<Node> node)
     : filter_(flt)
     , root_(node)
@@ -384,6 +572,81 @@ void MetadataQueryProcessor::set_error(aku_Status error) {
     root_->set_error(error);
 }
 
+LastValueQueryProcessor::LastValueQueryProcessor(std::shared_ptr<IQueryFilter> flt,
+                                                 std::shared_ptr<Node> node,
+                                                 LastValueTable const& table)
+    : filter_(flt)
+    , root_(node)
+    , table_(table)
+{
+}
+
+SeriesMatcher* LastValueQueryProcessor::matcher() {
+    return nullptr;
+}
+
+QueryRange LastValueQueryProcessor::range() const {
+    return QueryRange{AKU_MIN_TIMESTAMP, AKU_MAX_TIMESTAMP, AKU_CURSOR_DIR_BACKWARD, QueryRange::INSTANT};
+}
+
+IQueryFilter& LastValueQueryProcessor::filter() {
+    return missing_;
+}
+
+IQueryFilter::FilterResult LastValueQueryProcessor::MissingFilter::apply(aku_ParamId id) {
+    if (ids.empty()) {
+        return SKIP_ALL;
+    }
+    return ids.count(id) != 0 ? PROCESS : SKIP_THIS;
+}
+
+std::vector<aku_ParamId> LastValueQueryProcessor::MissingFilter::get_ids() {
+    return std::vector<aku_ParamId>(ids.begin(), ids.end());
+}
+
+bool LastValueQueryProcessor::start() {
+    for (auto id: filter_->get_ids()) {
+        aku_Timestamp ts;
+        double value;
+        if (!table_.get(id, &ts, &value)) {
+            // Series wasn't updated since db was opened, should be searched
+            missing_.ids.insert(id);
+            continue;
+        }
+        if (!root_->put(make_float_sample(ts, id, value))) {
+            missing_.ids.clear();
+            break;
+        }
+    }
+    if (missing_.ids.empty()) {
+        root_->complete();
+        // Result is already obtained, there is nothing to scan
+        return false;
+    }
+    return true;
+}
+
+bool LastValueQueryProcessor::put(const aku_Sample &sample) {
+    if (sample.payload.type >= aku_PData::MARGIN) {
+        return !missing_.ids.empty();
+    }
+    // Backward scan, first sample of the series is the newest one
+    if (missing_.ids.erase(sample.paramid) != 0) {
+        if (!root_->put(sample)) {
+            missing_.ids.clear();
+        }
+    }
+    return !missing_.ids.empty();
+}
+
+void LastValueQueryProcessor::stop() {
+    root_->complete();
+}
+
+void LastValueQueryProcessor::set_error(aku_Status error) {
+    root_->set_error(error);
+}
+
 
 
 //                          //
@@ -397,8 +660,7 @@ static boost::optional<std::string> parse_select_stmt(boost::property_tree::ptre
     if (select && select->empty()) {
         // simple select query
         auto str = select->get_value<std::string>("");
-        if (str == "names") {
-            // the only supported select query for now
+        if (str == "names" || str == "last") {
             return str;
         }
         (*logger)(AKU_LOG_ERROR, "Invalid `select` query");
@@ -531,7 +793,8 @@ static std::string to_json(boost::property_tree::ptree const& ptree, bool pretty
 std::shared_ptr<QP::IQueryProcessor> Builder::build_query_processor(const char* query,
                                                                     std::shared_ptr<QP::Node> terminal,
                                                                     const SeriesMatcher &matcher,
-                                                                    aku_logger_cb_t logger) {
+                                                                    aku_logger_cb_t logger,
+                                                                    LastValueTable const* last_values) {
     namespace pt = boost::property_tree;
     using namespace QP;
 
@@ -616,6 +879,14 @@ std::shared_ptr<QP::IQueryProcessor> Builder::build_query_processor(const char*
                                                         QueryRange::INSTANT,  // TODO: parse from query
                                                         filter, groupbytime, std::move(groupbytag));
         }
+        if (*select == "last") {
+            if (last_values == nullptr) {
+                (*logger)(AKU_LOG_ERROR, "`select: last` query is not supported");
+                auto rte = std::runtime_error("`select: last` query is not supported");
+                BOOST_THROW_EXCEPTION(rte);
+            }
+            return std::make_shared<LastValueQueryProcessor>(filter, next, *last_values);
+        }
         return std::make_shared<MetadataQueryProcessor>(filter, next);
 
     } catch(std::exception const& e) {
@@ -17,8 +17,10 @@
 #pragma once
 #include <chrono>
 #include <memory>
+#include <unordered_set>
 
 #include "akumuli.h"
+#include "lastvalue.h"
 #include "queryprocessor_framework.h"
 #include "seriesparser.h"
 #include "stringpool.h"
@@ -35,10 +37,12 @@ struct Builder {
       * @param query should point to 0-terminated query string
       * @param terminal_node should contain valid pointer to terminal(final) node
       * @param logger should contain valid pointer to logging function
+      * @param last_values table used by `select: last` queries (can be null if not supported)
       */
     static std::shared_ptr<QP::IQueryProcessor>
     build_query_processor(const char* query, std::shared_ptr<QP::Node> terminal_node,
-                          const SeriesMatcher& matcher, aku_logger_cb_t logger);
+                          const SeriesMatcher& matcher, aku_logger_cb_t logger,
+                          LastValueTable const* last_values = nullptr);
 };
 
 
@@ -59,6 +63,12 @@ struct GroupByTime {
 
     bool put(aku_Sample const& sample, Node& next);
 
+    //! Batch version of `put`, batch is split at bucket boundaries (margins are sent between parts)
+    bool put_batch(const aku_Timestamp* ts, const aku_ParamId* ids, const double* xs, size_t size, Node& next);
+
+    //! Close the last bucket (send margin to `next`) if any sample was received
+    bool flush(Node& next, bool backward);
+
     bool empty() const;
 };
 
@@ -138,11 +148,22 @@ struct ScanQueryProcessor : IQueryProcessor {
     //! Process value
     bool put(const aku_Sample& sample);
 
+    //! Process batch of values (passed directly to root node if there is no group-by statement)
+    bool put_batch(const aku_Timestamp* ts, const aku_ParamId* ids, const double* xs, size_t size);
+
     //! Should be called when processing completed
     void stop();
 
     //! Set execution error
     void set_error(aku_Status error);
+
+    /** Create partial query processor. Only queries without group-by
+      * statements that consists of mergeable nodes can be split.
+      */
+    std::shared_ptr<IQueryProcessor> make_partial();
+
+    //! Merge results of the partial query processor
+    aku_Status merge(IQueryProcessor& partial);
 };
 
 
@@ -161,5 +182,36 @@ struct MetadataQueryProcessor : IQueryProcessor {
     void stop();
     void set_error(aku_Status error);
 };
+
+
+/** Returns the newest value of each series from the last value table.
+  * Series that wasn't written since db was opened are not in the table, they're
+  * searched in backward direction (only the first sample of each series is used).
+  */
+struct LastValueQueryProcessor : IQueryProcessor {
+
+    //! Accepts series that wasn't found yet
+    struct MissingFilter : IQueryFilter {
+        std::unordered_set<aku_ParamId> ids;
+        FilterResult apply(aku_ParamId id);
+        std::vector<aku_ParamId> get_ids();
+    };
+
+    std::shared_ptr<IQueryFilter> filter_;
+    std::shared_ptr<Node>         root_;
+    LastValueTable const&         table_;
+    MissingFilter                 missing_;
+
+    LastValueQueryProcessor(std::shared_ptr<IQueryFilter> flt, std::shared_ptr<Node> node,
+                            LastValueTable const& table);
+
+    QueryRange     range() const;
+    IQueryFilter&  filter();
+    SeriesMatcher* matcher();
+    bool           start();
+    bool put(const aku_Sample& sample);
+    void stop();
+    void set_error(aku_Status error);
+};
 }
 }  // namespaces
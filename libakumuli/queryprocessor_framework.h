@@ -25,6 +25,17 @@ static const aku_Sample SAMPLING_HI_MARGIN = { 0u,
                                                0u,
                                                { 0.0, sizeof(aku_Sample), aku_PData::HI_MARGIN } };
 
+//! Create float sample
+inline aku_Sample make_float_sample(aku_Timestamp ts, aku_ParamId id, double value) {
+    aku_Sample sample;
+    sample.timestamp       = ts;
+    sample.paramid         = id;
+    sample.payload.type    = AKU_PAYLOAD_FLOAT;
+    sample.payload.size    = sizeof(aku_Sample);
+    sample.payload.float64 = value;
+    return sample;
+}
+
 struct Node {
 
     virtual ~Node() = default;
@@ -37,6 +48,20 @@ struct Node {
       */
     virtual bool put(aku_Sample const& sample) = 0;
 
+    /** Process batch of values in columnar form. All elements of the batch are
+      * plain float samples (margins and empty samples should be sent using `put`).
+      * Return false to interrupt process. Default implementation calls `put`
+      * for each element.
+      */
+    virtual bool put_batch(const aku_Timestamp* ts, const aku_ParamId* ids, const double* xs, size_t size) {
+        for (size_t i = 0; i < size; i++) {
+            if (!put(make_float_sample(ts[i], ids[i], xs[i]))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
     virtual void set_error(aku_Status status) = 0;
 
     // Query validation
@@ -50,6 +75,21 @@ struct Node {
     /** This method returns set of flags that describes its functioning.
       */
     virtual int get_requirements() const = 0;
+
+    // Parallel execution
+
+    /** Create node that accumulates partial state of this node (possibly on
+      * another thread). Partial node shouldn't pass anything to the next node,
+      * its state should be passed back to this node using `merge` method.
+      * `backward` is the scan direction of the query (merged output should follow it).
+      * Return empty pointer if node can't be executed in parallel (default).
+      */
+    virtual std::shared_ptr<Node> make_partial(bool backward) { return std::shared_ptr<Node>(); }
+
+    /** Merge state of the partial node (created by `make_partial`) into this node.
+      * Should be called before `complete`.
+      */
+    virtual void merge(Node const&) {}
 };
 
 
@@ -143,11 +183,35 @@ struct IQueryProcessor {
     //! Get new value
     virtual bool put(const aku_Sample& sample) = 0;
 
+    //! Get batch of values (see `Node::put_batch`), default implementation calls `put`
+    virtual bool put_batch(const aku_Timestamp* ts, const aku_ParamId* ids, const double* xs, size_t size) {
+        for (size_t i = 0; i < size; i++) {
+            if (!put(make_float_sample(ts[i], ids[i], xs[i]))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
     //! Will be called when processing completed without errors
     virtual void stop() = 0;
 
     //! Will be called on error
     virtual void set_error(aku_Status error) = 0;
+
+    // Parallel execution
+
+    /** Create query processor that accumulates partial results of this query
+      * processor. Partial query processor can be used from the other thread, its
+      * results should be passed back using `merge` method. Return empty pointer
+      * if query can't be executed in parallel (default).
+      */
+    virtual std::shared_ptr<IQueryProcessor> make_partial() { return std::shared_ptr<IQueryProcessor>(); }
+
+    /** Merge results of the partial query processor. Return error code
+      * reported to partial query processor (if any).
+      */
+    virtual aku_Status merge(IQueryProcessor&) { return AKU_ENOT_IMPLEMENTED; }
 };
 
 
@@ -20,6 +20,7 @@
 #include "util.h"
 #include "storage_engine/compression.h"
 
+#include <deque>
 #include <future>
 
 #include <boost/heap/skew_heap.hpp>
@@ -136,15 +137,43 @@ std::ostream& operator << (std::ostream& str, TimeSeriesValue const& val) {
     return str;
 }
 
+//! Chunk compression task (see `Sequencer::merge_and_compress`)
+struct CompressionTask {
+    UncompressedChunk chunk;    //< Time ordered data (returned to `ready_` if not written)
+    EncodedChunk      encoded;  //< Result (valid if status is AKU_SUCCESS)
+    aku_Status        status;
+    std::future<void> done;     //< Becomes ready when the task is completed
+
+    //! Compress the chunk, called from the pool thread
+    void run() {
+        status = AKU_EBAD_DATA;
+        try {
+            UncompressedChunk reindexed;
+            if (CompressionUtil::convert_from_time_order(chunk, &reindexed)) {
+                status = PageHeader::encode_chunk(reindexed, &encoded);
+            }
+        } catch (...) {
+            // Writer thread will panic
+            status = AKU_EBAD_DATA;
+        }
+    }
+};
+
 // Sequencer
 
 Sequencer::Sequencer(const aku_FineTuneParams &config)
+    : Sequencer(config, std::shared_ptr<ThreadPool>())
+{
+}
+
+Sequencer::Sequencer(const aku_FineTuneParams &config, std::shared_ptr<ThreadPool> pool)
     : window_size_(config.window_size)
     , top_timestamp_()
     , checkpoint_(0u)
     , sequence_number_ {0}
     , run_locks_(RUN_LOCK_FLAGS_SIZE)
     , c_threshold_(config.compression_threshold)
+    , c_pool_(pool)
 {
     key_.reset(new SortedRun());
     key_->push_back(TimeSeriesValue());
@@ -459,31 +488,38 @@ void Sequencer::merge(Caller& caller, InternalCursor* cur) {
 }
 
 
-aku_Status Sequencer::merge_and_compress(PageHeader* target, bool enforce_write) {
-    bool owns_lock = sequence_number_.load() % 2;  // progress_flag_ must be odd to start
-    if (!owns_lock) {
-        return AKU_EBUSY;
-    }
-    if (ready_.size() == 0) {
-        return AKU_ENO_DATA;
+//! Move up to `threshold` values from `runs` to `chunk` (in time order)
+static void merge_chunk(vector<Sequencer::PSortedRun>& runs, size_t threshold, UncompressedChunk* chunk) {
+    chunk->paramids.reserve(threshold);
+    chunk->timestamps.reserve(threshold);
+    chunk->values.reserve(threshold);
+    auto push_to_header = [&](TimeSeriesValue const& val) {
+        if (threshold --> 0) {
+            val.add_to_header(chunk);
+            return true;
+        }
+        return false;
+    };
+    kway_merge<TimeOrderMergePredicate, AKU_CURSOR_DIR_FORWARD>(runs, push_to_header);
+}
+
+//! Convert time ordered chunk back to sorted run
+static Sequencer::PSortedRun make_run(UncompressedChunk const& chunk) {
+    Sequencer::PSortedRun run(new Sequencer::SortedRun());
+    for (int i = 0; i < (int)chunk.paramids.size(); i++) {
+        run->push_back(TimeSeriesValue(chunk.timestamps.at(i),
+                                       chunk.paramids.at(i),
+                                       chunk.values.at(i)));
     }
+    return run;
+}
 
+aku_Status Sequencer::compress_(PageHeader* target, bool enforce_write) {
     aku_Status status = AKU_SUCCESS;
 
     while(!ready_.empty()) {
         UncompressedChunk chunk_header;
-        chunk_header.paramids.reserve(c_threshold_);
-        chunk_header.timestamps.reserve(c_threshold_);
-        chunk_header.values.reserve(c_threshold_);
-        int threshold = (int)c_threshold_;
-        auto push_to_header = [&](TimeSeriesValue const& val) {
-            if (threshold-->0) {
-                val.add_to_header(&chunk_header);
-                return true;
-            }
-            return false;
-        };
-        kway_merge<TimeOrderMergePredicate, AKU_CURSOR_DIR_FORWARD>(ready_, push_to_header);
+        merge_chunk(ready_, c_threshold_, &chunk_header);
         if (enforce_write || chunk_header.paramids.size() >= c_threshold_) {
             UncompressedChunk reindexed_header;
             if (!CompressionUtil::convert_from_time_order(chunk_header, &reindexed_header)) {
@@ -495,19 +531,99 @@ aku_Status Sequencer::merge_and_compress(PageHeader* target, bool enforce_write)
             status = AKU_ENO_DATA;
         }
         if (status != AKU_SUCCESS) {
-            PSortedRun run(new SortedRun());
-            for (int i = 0; i < (int)chunk_header.paramids.size(); i++) {
-                run->push_back(TimeSeriesValue(chunk_header.timestamps.at(i),
-                                               chunk_header.paramids.at(i),
-                                               chunk_header.values.at(i)));
-            }
-            ready_.push_back(std::move(run));
+            ready_.push_back(make_run(chunk_header));
             if (status == AKU_ENO_DATA) {
                 status = AKU_SUCCESS;
             }
             break;
         }
     }
+    return status;
+}
+
+aku_Status Sequencer::compress_pipelined_(PageHeader* target, bool enforce_write) {
+    typedef CompressionTask Task;
+
+    aku_Status status = AKU_SUCCESS;
+    std::deque<std::unique_ptr<Task>> inflight;  //< Tasks in merge order
+    const size_t max_inflight = 2*std::min(MAX_COMPRESSION_WORKERS, c_pool_->size());
+
+    // Workers reference the tasks, they should be completed before `inflight`
+    // is destroyed (even if merge or page write throws)
+    struct Drain {
+        std::deque<std::unique_ptr<Task>>& inflight;
+        ~Drain() {
+            for (auto& task: inflight) {
+                if (task->done.valid()) {
+                    task->done.wait();
+                }
+            }
+        }
+    } drain = { inflight };
+
+    // Wait for the oldest task and write it to the page
+    auto write_front = [&]() {
+        inflight.front()->done.wait();
+        std::unique_ptr<Task> task = std::move(inflight.front());
+        inflight.pop_front();
+        if (status == AKU_SUCCESS) {
+            status = task->status;
+            if (status == AKU_SUCCESS) {
+                status = target->append_encoded_chunk(task->encoded);
+            }
+        }
+        if (status != AKU_SUCCESS) {
+            // Page is full, this and all subsequent chunks should be written to the next page
+            ready_.push_back(make_run(task->chunk));
+        }
+    };
+
+    while (!ready_.empty() && status == AKU_SUCCESS) {
+        std::unique_ptr<Task> task(new Task());
+        task->status = AKU_SUCCESS;
+        merge_chunk(ready_, c_threshold_, &task->chunk);
+        if (!enforce_write && task->chunk.paramids.size() < c_threshold_) {
+            // Wait for more data
+            ready_.push_back(make_run(task->chunk));
+            break;
+        }
+        inflight.push_back(std::move(task));
+        Task* ptask = inflight.back().get();
+        ptask->done = c_pool_->submit([ptask]() { ptask->run(); });
+        if (inflight.size() > max_inflight) {
+            write_front();
+        }
+    }
+    while (!inflight.empty()) {
+        write_front();
+    }
+    if (status == AKU_EBAD_DATA) {
+        AKU_PANIC("Invalid chunk");
+    }
+    return status;
+}
+
+aku_Status Sequencer::merge_and_compress(PageHeader* target, bool enforce_write) {
+    bool owns_lock = sequence_number_.load() % 2;  // progress_flag_ must be odd to start
+    if (!owns_lock) {
+        return AKU_EBUSY;
+    }
+    if (ready_.size() == 0) {
+        return AKU_ENO_DATA;
+    }
+
+    size_t nsamples = 0;
+    for (auto const& run: ready_) {
+        nsamples += run->size();
+    }
+
+    aku_Status status;
+    if (c_pool_ && nsamples >= 2*c_threshold_) {
+        status = compress_pipelined_(target, enforce_write);
+    } else {
+        // Not enough chunks to keep worker threads busy
+        status = compress_(target, enforce_write);
+    }
 
     if(!ready_.empty()) {
         Lock guard(runs_resize_lock_);
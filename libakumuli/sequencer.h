@@ -24,6 +24,7 @@
 #include "cursor.h"
 #include "page.h"
 #include "queryprocessor_framework.h"
+#include "threadpool.h"
 
 #include <algorithm>
 #include <memory>
@@ -100,6 +101,7 @@ struct Sequencer {
     static const int RUN_LOCK_BUSY_COUNT  = 0xFFF;
     static const int RUN_LOCK_FLAGS_MASK  = 0x0FF;
     static const int RUN_LOCK_FLAGS_SIZE  = 0x100;
+    static const u32 MAX_COMPRESSION_WORKERS = 4;  //< Max number of chunks compressed concurrently
 
     // TODO: space usage should be limited
 
@@ -117,9 +119,18 @@ struct Sequencer {
     mutable Mutex               runs_resize_lock_;
     mutable std::vector<RWLock> run_locks_;
     const size_t                c_threshold_;  //< Compression threshold
+    std::shared_ptr<ThreadPool> c_pool_;       //< Compression threads (null - compress on writer thread)
 
+    //! C-tor, chunks are compressed on writer thread
     Sequencer(aku_FineTuneParams const& config);
 
+    /** C-tor.
+      * @param config configuration
+      * @param pool thread pool used to compress chunks, should be shared by all
+      *        sequencers of the storage (empty - compress on writer thread)
+      */
+    Sequencer(aku_FineTuneParams const& config, std::shared_ptr<ThreadPool> pool);
+
     /** Add new sample to sequence.
       * @brief Timestamp of the sample can be out of order.
       * @returns error code and flag that indicates whether of not new checkpoint is createf
@@ -132,6 +143,8 @@ struct Sequencer {
     /** Merge all values (ts, id, offset, length)
       * and write it to target page.
       * caller and cur parameters used for communication with storage (error reporting).
+      * If there is enough data chunks are compressed by the worker threads while the
+      * writer thread merges the next chunks, chunks are written to the page in merge order.
       */
     aku_Status merge_and_compress(PageHeader* target, bool enforce_write = false);
 
@@ -173,6 +186,12 @@ private:
       */
     std::tuple<aku_Status, int> check_timestamp_(aku_Timestamp ts);
 
+    //! Merge and compress `ready_` runs on the writer thread
+    aku_Status compress_(PageHeader* target, bool enforce_write);
+
+    //! Merge `ready_` runs on the writer thread and compress chunks using worker threads
+    aku_Status compress_pipelined_(PageHeader* target, bool enforce_write);
+
     void filter(PSortedRun run, std::shared_ptr<QP::IQueryProcessor> query,
                 std::vector<PSortedRun>* results) const;
 };
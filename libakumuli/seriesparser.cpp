@@ -23,6 +23,11 @@
 #include <map>
 #include <algorithm>
 #include <regex>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/json_parser.hpp>
@@ -154,6 +159,116 @@ static const char* skip_tag(const char* p, const char* end, bool *error) {
     return c;
 }
 
+/** Positions of the separators in the series name.
+  * Bit N of the mask is set if N-th character matches. Series name is limited
+  * by AKU_LIMITS_MAX_SNAME so masks can be stored in fixed arrays.
+  */
+struct SeparatorMasks {
+    enum {
+        NWORDS = (AKU_LIMITS_MAX_SNAME + 63) / 64,
+    };
+    u64 space[NWORDS];  //< ' '
+    u64 blank[NWORDS];  //< ' ' or '\t'
+    u64 stop[NWORDS];   //< '=', ' ' or '\t'
+    const u32 size;
+
+    SeparatorMasks(const char* begin, u32 size)
+        : size(size)
+    {
+        const u32 nwords = (size + 63) / 64;
+        for (u32 w = 0; w < nwords; w++) {
+            space[w] = blank[w] = stop[w] = 0;
+        }
+        u32 i = 0;
+#ifdef __SSE2__
+        const __m128i sp = _mm_set1_epi8(' ');
+        const __m128i tab = _mm_set1_epi8('\t');
+        const __m128i eq = _mm_set1_epi8('=');
+        for (; i + 16 <= size; i += 16) {
+            __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin + i));
+            __m128i s = _mm_cmpeq_epi8(x, sp);
+            __m128i b = _mm_or_si128(s, _mm_cmpeq_epi8(x, tab));
+            __m128i e = _mm_or_si128(b, _mm_cmpeq_epi8(x, eq));
+            space[i / 64] |= static_cast<u64>(static_cast<u32>(_mm_movemask_epi8(s))) << (i % 64);
+            blank[i / 64] |= static_cast<u64>(static_cast<u32>(_mm_movemask_epi8(b))) << (i % 64);
+            stop[i / 64]  |= static_cast<u64>(static_cast<u32>(_mm_movemask_epi8(e))) << (i % 64);
+        }
+#endif
+        for (; i < size; i++) {
+            u64 bit = 1ul << (i % 64);
+            char c = begin[i];
+            if (c == ' ') {
+                space[i / 64] |= bit;
+            }
+            if (c == ' ' || c == '\t') {
+                blank[i / 64] |= bit;
+            }
+            if (c == ' ' || c == '\t' || c == '=') {
+                stop[i / 64] |= bit;
+            }
+        }
+    }
+
+    //! Find first set bit in `mask` starting from `pos`, returns `size` if not found
+    u32 find(const u64* mask, u32 pos) const {
+        while (pos < size) {
+            u64 word = mask[pos / 64] >> (pos % 64);
+            if (word) {
+                u32 res = pos + static_cast<u32>(__builtin_ctzll(word));
+                return res < size ? res : size;
+            }
+            pos = (pos / 64 + 1) * 64;
+        }
+        return size;
+    }
+
+    //! Find first position starting from `pos` that is not a whitespace
+    u32 skip_blank(u32 pos) const {
+        if (pos + 1 < size && !(blank[(pos + 1) / 64] & (1ul << ((pos + 1) % 64)))) {
+            // Fast path, single separator
+            return (blank[pos / 64] & (1ul << (pos % 64))) ? pos + 1 : pos;
+        }
+        while (pos < size) {
+            u64 word = ~blank[pos / 64] >> (pos % 64);
+            if (word) {
+                u32 res = pos + static_cast<u32>(__builtin_ctzll(word));
+                return res < size ? res : size;
+            }
+            pos = (pos / 64 + 1) * 64;
+        }
+        return size;
+    }
+};
+
+//! Tag position in the series name
+struct TagRef {
+    u16 begin;   //< Offset of the tag
+    u16 keylen;  //< Length of the key
+    u16 len;     //< Length of the tag (key=value)
+};
+
+//! Compare tags by key and then by value (chars are compared as signed values)
+static inline bool tag_less(const char* base, TagRef const& lhs, TagRef const& rhs) {
+    const char* l = base + lhs.begin;
+    const char* r = base + rhs.begin;
+    u32 n = std::min(lhs.keylen, rhs.keylen);
+    for (u32 i = 0; i < n; i++) {
+        if (l[i] != r[i]) {
+            return l[i] < r[i];
+        }
+    }
+    if (lhs.keylen != rhs.keylen) {
+        return lhs.keylen < rhs.keylen;
+    }
+    n = std::min(lhs.len, rhs.len);
+    for (u32 i = lhs.keylen; i < n; i++) {
+        if (l[i] != r[i]) {
+            return l[i] < r[i];
+        }
+    }
+    return lhs.len < rhs.len;
+}
+
 aku_Status SeriesParser::to_normal_form(const char* begin, const char* end,
                                         char* out_begin, char* out_end,
                                         const char** keystr_begin,
@@ -174,81 +289,68 @@ aku_Status SeriesParser::to_normal_form(const char* begin, const char* end,
         return AKU_EBAD_ARG;
     }
 
-    char* it_out = out_begin;
-    const char* it = begin;
-    // Get metric name
-    it = skip_space(it, end);
-    it = copy_until(it, end, ' ', &it_out);
-    it = skip_space(it, end);
+    // Find all separators at once
+    const SeparatorMasks masks(begin, static_cast<u32>(series_name_len));
+    const u32 size = masks.size;
 
-    if (it == end) {
+    // Metric name ends with space (tabs are allowed)
+    u32 metric_begin = masks.skip_blank(0);
+    if (metric_begin == size) {
+        return AKU_EBAD_DATA;
+    }
+    u32 metric_end = masks.find(masks.space, metric_begin + 1);
+    u32 it = masks.skip_blank(metric_end);
+    if (it == size) {
         // At least one tag should be specified
         return AKU_EBAD_DATA;
     }
 
-    *keystr_begin = it_out;
-
-    // Get pointers to the keys
-    const char* tags[AKU_LIMITS_MAX_TAGS];
-    auto ix_tag = 0u;
-    bool error = false;
-    while(it < end && ix_tag < AKU_LIMITS_MAX_TAGS) {
-        tags[ix_tag] = it;
-        it = skip_tag(it, end, &error);
-        it = skip_space(it, end);
-        if (!error) {
-            ix_tag++;
-        } else {
-            break;
+    // Get offsets of the tags, each tag should contain '=' before the first
+    // whitespace and ends with space.
+    TagRef tags[AKU_LIMITS_MAX_TAGS];
+    u32 ix_tag = 0;
+    bool sorted = true;
+    while (it < size && ix_tag < AKU_LIMITS_MAX_TAGS) {
+        u32 eq = masks.find(masks.stop, it);
+        if (eq == size || begin[eq] != '=') {
+            // Bad string
+            return AKU_EBAD_DATA;
         }
-    }
-    if (error) {
-        // Bad string
-        return AKU_EBAD_DATA;
-    }
-    if (ix_tag == 0) {
-        // User should specify at least one tag
-        return AKU_EBAD_DATA;
+        u32 tag_end = masks.find(masks.space, eq);
+        TagRef& tag = tags[ix_tag];
+        tag.begin  = static_cast<u16>(it);
+        tag.keylen = static_cast<u16>(eq - it);
+        tag.len    = static_cast<u16>(tag_end - it);
+        if (ix_tag != 0 && sorted && tag_less(begin, tag, tags[ix_tag - 1])) {
+            sorted = false;
+        }
+        ix_tag++;
+        it = masks.skip_blank(tag_end);
     }
 
-    std::sort(tags, tags + ix_tag, [tags, end](const char* lhs, const char* rhs) {
-        // lhs should be always less thenn rhs
-        auto lenl = 0u;
-        auto lenr = 0u;
-        if (lhs < rhs) {
-            lenl = rhs - lhs;
-            lenr = end - rhs;
-        } else {
-            lenl = end - lhs;
-            lenr = lhs - rhs;
-        }
-        auto it = 0u;
-        while(true) {
-            if (it >= lenl || it >= lenr) {
-                return it < lenl;
-            }
-            if (lhs[it] == '=' || rhs[it] == '=') {
-                return lhs[it] == '=';
+    if (!sorted) {
+        // Insertion sort, number of tags is small
+        for (u32 i = 1; i < ix_tag; i++) {
+            TagRef tag = tags[i];
+            u32 j = i;
+            while (j > 0 && tag_less(begin, tag, tags[j - 1])) {
+                tags[j] = tags[j - 1];
+                j--;
             }
-            if (lhs[it] < rhs[it]) {
-                return true;
-            } else if (lhs[it] > rhs[it]) {
-                return false;
-            }
-            it++;
+            tags[j] = tag;
         }
-        return true;
-    });
+    }
 
-    // Copy tags to output string
-    for (auto i = 0u; i < ix_tag; i++) {
-        // insert space
+    // Copy metric and tags to output string
+    char* it_out = out_begin;
+    memcpy(it_out, begin + metric_begin, metric_end - metric_begin);
+    it_out += metric_end - metric_begin;
+    *keystr_begin = it_out + 1;
+    for (u32 i = 0; i < ix_tag; i++) {
         *it_out++ = ' ';
-        // insert tag
-        const char* tag = tags[i];
-        copy_until(tag, end, ' ', &it_out);
+        memcpy(it_out, begin + tags[i].begin, tags[i].len);
+        it_out += tags[i].len;
     }
-    *keystr_begin = skip_space(*keystr_begin, out_end);
     *keystr_end = it_out;
     return AKU_SUCCESS;
 }
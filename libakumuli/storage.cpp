@@ -47,18 +47,20 @@ static apr_status_t create_page_file(const char* file_name, u32 page_index, u32
 
 Volume::Volume(const char* file_name,
                aku_FineTuneParams conf,
-               aku_logger_cb_t logger)
+               aku_logger_cb_t logger,
+               std::shared_ptr<ThreadPool> pool)
     : mmap_(file_name, conf.enable_huge_tlb != 0)
     , window_(conf.window_size)
     , max_cache_size_(conf.max_cache_size)
     , file_path_(file_name)
     , config_(conf)
     , logger_(logger)
+    , pool_(pool)
     , is_temporary_ {0}
 {
     mmap_.panic_if_bad();  // panic if can't mmap volume
     page_ = reinterpret_cast<PageHeader*>(mmap_.get_pointer());
-    cache_.reset(new Sequencer(conf));
+    cache_.reset(new Sequencer(conf, pool_));
 }
 
 Volume::~Volume() {
@@ -109,7 +111,7 @@ std::shared_ptr<Volume> Volume::safe_realloc() {
         AKU_PANIC("can't create new page file (out of space?)");
     }
 
-    newvol.reset(new Volume(file_path_.c_str(), config_, logger_));
+    newvol.reset(new Volume(file_path_.c_str(), config_, logger_, pool_));
     newvol->page_->set_open_count(open_count);
     newvol->page_->set_close_count(close_count);
     return newvol;
@@ -191,6 +193,7 @@ static void zero_deleter(SeriesMatcher*) {}
 Storage::Storage(const char* path, aku_FineTuneParams const& params)
     : config_(params)
     , open_error_code_(AKU_SUCCESS)
+    , last_values_(AKU_STARTING_SERIES_ID)
     , logger_(params.logger)
     , local_matcher_(&zero_deleter)
 {
@@ -225,10 +228,13 @@ Storage::Storage(const char* path, aku_FineTuneParams const& params)
     // init cache
     cache_.reset(new ChunkCache(config_.max_cache_size));
 
+    // init worker threads (shared by all volumes)
+    pool_ = std::make_shared<ThreadPool>();
+
     // create volumes list
     for(auto path: v_iter.volume_names) {
         PVolume vol;
-        vol.reset(new Volume(path.c_str(), config_, logger_));
+        vol.reset(new Volume(path.c_str(), config_, logger_, pool_));
         vol->make_readonly();
         volumes_.push_back(vol);
     }
@@ -412,7 +418,7 @@ void Storage::search(Caller &caller, InternalCursor* cur, const char* query) con
         auto terminal_node = std::make_shared<TerminalNode>(caller, cur);
         std::shared_ptr<IQueryProcessor> query_processor;
         try {
-            query_processor = Builder::build_query_processor(query, terminal_node, *matcher_, logger_);
+            query_processor = Builder::build_query_processor(query, terminal_node, *matcher_, logger_, &last_values_);
         } catch (const QueryParserError& qpe) {
             log_error(qpe.what());
             cur->set_error(caller, AKU_EQUERY_PARSING_ERROR);
@@ -425,7 +431,9 @@ void Storage::search(Caller &caller, InternalCursor* cur, const char* query) con
 
         if (query_processor->start()) {
 
-            if (!query_processor->range().is_backward()) {
+            if (parallel_search(query_processor)) {
+                // Aggregation query, all volumes were searched concurrently
+            } else if (!query_processor->range().is_backward()) {
                 u32 starting_ix = active_volume_->get_page()->get_page_id() + 1;  // Start from oldest volume
                 for (u32 ix = starting_ix; ix < (starting_ix + volumes_.size()); ix++) {
                     // Search volume
@@ -481,6 +489,56 @@ void Storage::search(Caller &caller, InternalCursor* cur, const char* query) con
     }
 }
 
+bool Storage::parallel_search(std::shared_ptr<QP::IQueryProcessor> query_processor) const {
+    if (volumes_.size() < 2) {
+        return false;
+    }
+    // One partial result per volume and one for all sequencers
+    std::vector<std::shared_ptr<QP::IQueryProcessor>> partials;
+    for (size_t i = 0; i < volumes_.size() + 1; i++) {
+        auto partial = query_processor->make_partial();
+        if (!partial) {
+            return false;
+        }
+        partials.push_back(partial);
+    }
+    // Order of the volumes doesn't matter, volumes are searched by the storage's thread pool
+    pool_->parallel_for(volumes_.size(), [&](size_t ix) {
+        volumes_.at(ix)->get_page()->search(partials.at(ix), cache_);
+    });
+    // Sequencers are searched on the caller's thread
+    auto seqpartial = partials.back();
+    for (PVolume const& volume: volumes_) {
+        int seq_id;
+        aku_Timestamp window;
+        std::tie(window, seq_id) = volume->cache_->get_window();
+        volume->cache_->search(seqpartial, seq_id);
+    }
+    // Partial results should be merged in scan order (same order as in `search` method),
+    // sequencers contain the most recent data.
+    std::vector<size_t> order;
+    const size_t nvolumes = volumes_.size();
+    const size_t active = active_volume_->get_page()->get_page_id();
+    if (!query_processor->range().is_backward()) {
+        for (size_t i = 0; i < nvolumes; i++) {
+            order.push_back((active + 1 + i) % nvolumes);  // oldest first
+        }
+        order.push_back(nvolumes);
+    } else {
+        order.push_back(nvolumes);
+        for (size_t i = 0; i < nvolumes; i++) {
+            order.push_back((active + nvolumes - i) % nvolumes);  // newest first
+        }
+    }
+    for (auto ix: order) {
+        aku_Status status = query_processor->merge(*partials.at(ix));
+        if (status != AKU_SUCCESS) {
+            query_processor->set_error(status);
+            break;
+        }
+    }
+    return true;
+}
 
 void Storage::get_stats(aku_StorageStats* rcv_stats) {
     for (PVolume const& vol: volumes_) {
@@ -548,7 +606,11 @@ aku_Status Storage::_write_impl(TimeSeriesValue ts_value, aku_MemRange data) {
 aku_Status Storage::write_double(aku_ParamId param, aku_Timestamp ts, double value) {
     aku_MemRange m = {};
     TimeSeriesValue ts_value(ts, param, value);
-    return _write_impl(ts_value, m);
+    auto status = _write_impl(ts_value, m);
+    if (status == AKU_SUCCESS) {
+        last_values_.update(param, ts, value);
+    }
+    return status;
 }
 
 aku_Status Storage::series_to_param_id(const char* begin, const char* end, u64 *value) {
@@ -37,6 +37,7 @@
 
 #include "akumuli_def.h"
 #include "cursor.h"
+#include "lastvalue.h"
 #include "metadatastorage.h"
 #include "page.h"
 #include "sequencer.h"
@@ -60,11 +61,15 @@ struct Volume : std::enable_shared_from_this<Volume> {
     std::string                file_path_;
     aku_FineTuneParams         config_;
     aku_logger_cb_t            logger_;
+    std::shared_ptr<ThreadPool> pool_;  //< Storage's thread pool (used by the sequencer)
     std::atomic_bool
         is_temporary_;  //< True if this is temporary volume and underlying file should be deleted
 
-    //! Create new volume stored in file
-    Volume(const char* file_path, aku_FineTuneParams conf, aku_logger_cb_t logger);
+    /** Create new volume stored in file.
+      * @param pool thread pool shared by all volumes of the storage
+      */
+    Volume(const char* file_path, aku_FineTuneParams conf, aku_logger_cb_t logger,
+           std::shared_ptr<ThreadPool> pool);
 
     ~Volume();
 
@@ -98,6 +103,7 @@ struct Storage {
     typedef std::shared_ptr<MetadataStorage> PMetadataStorage;
     typedef std::shared_ptr<SeriesMatcher>   PSeriesMatcher;
     typedef std::shared_ptr<ChunkCache>      PCache;
+    typedef std::shared_ptr<ThreadPool>      PThreadPool;
 
     // Active volume state
     aku_FineTuneParams   config_;
@@ -109,6 +115,7 @@ struct Storage {
     std::vector<PVolume> volumes_;          //< List of all volumes
     PMetadataStorage     metadata_;         //< Metadata storage
     PSeriesMatcher       matcher_;          //< Series matcher
+    LastValueTable       last_values_;      //< Newest value of each series written since db was opened
 
     LockType mutex_;  //< Storage lock (used by worker thread)
 
@@ -116,6 +123,7 @@ struct Storage {
     aku_logger_cb_t logger_;
     Rand            rand_;
     PCache          cache_;
+    PThreadPool     pool_;  //< Worker threads shared by all volumes and queries
 
     //! Local (per query) string pool
     mutable boost::thread_specific_ptr<SeriesMatcher> local_matcher_;
@@ -175,6 +183,12 @@ struct Storage {
     //! Search storage using cursor
     void search(Caller& caller, InternalCursor* cur, const char* query) const;
 
+    /** Search all volumes concurrently. Works only if query can be split into
+      * partial queries (see `IQueryProcessor::make_partial`).
+      * @return false if query can't be executed in parallel
+      */
+    bool parallel_search(std::shared_ptr<QP::IQueryProcessor> query_processor) const;
+
     // Static interface
 
     /** Create new storage and initialize it.
@@ -100,12 +100,21 @@ BlockCache::PBlock BlockCache::loockup(LogicAddr addr) {
 Block::Block(LogicAddr addr, std::vector<u8>&& data)
     : data_(std::move(data))
     , addr_(addr)
+    , timestamp_(0)
 {
 }
 
 Block::Block()
     : data_(static_cast<size_t>(AKU_BLOCK_SIZE), 0)
     , addr_(EMPTY_ADDR)
+    , timestamp_(0)
+{
+}
+
+Block::Block(size_t size)
+    : data_(size, 0)
+    , addr_(EMPTY_ADDR)
+    , timestamp_(0)
 {
 }
 
@@ -129,11 +138,25 @@ void Block::set_addr(LogicAddr addr) {
     addr_ = addr;
 }
 
+aku_Timestamp Block::get_timestamp() const {
+    return timestamp_;
+}
+
+void Block::set_timestamp(aku_Timestamp ts) {
+    timestamp_ = ts;
+}
+
 FixedSizeFileStorage::FixedSizeFileStorage(std::string metapath, std::vector<std::string> volpaths)
     : meta_(MetaVolume::open_existing(metapath.c_str()))
     , current_volume_(0)
     , current_gen_(0)
     , total_size_(0)
+    , block_size_(meta_->get_block_size())
+    , fanout_(meta_->get_fanout())
+    , retention_(meta_->get_retention())
+    , newest_ts_(0)
+    , oldest_ts_(0)
+    , nreclaimed_(0)
 {
     for (u32 ix = 0ul; ix < volpaths.size(); ix++) {
         auto volpath = volpaths.at(ix);
@@ -146,7 +169,7 @@ FixedSizeFileStorage::FixedSizeFileStorage(std::string metapath, std::vector<std
                                                    StatusUtil::str(status)));
             AKU_PANIC("Can't open blockstore - " + StatusUtil::str(status));
         }
-        auto uptr = Volume::open_existing(volpath.c_str(), nblocks);
+        auto uptr = Volume::open_existing(volpath.c_str(), nblocks, block_size_);
         volumes_.push_back(std::move(uptr));
         dirty_.push_back(0);
     }
@@ -174,6 +197,16 @@ FixedSizeFileStorage::FixedSizeFileStorage(std::string metapath, std::vector<std
             break;
         }
     }
+
+    for (u32 i = 0u; i < volumes_.size(); i++) {
+        aku_Status status;
+        aku_Timestamp ts;
+        std::tie(status, ts) = meta_->get_last_timestamp(i);
+        if (status == AKU_SUCCESS) {
+            newest_ts_ = std::max(newest_ts_, ts);
+        }
+    }
+    update_oldest_ts();
 }
 
 std::shared_ptr<FixedSizeFileStorage> FixedSizeFileStorage::open(std::string metapath, std::vector<std::string> volpaths) {
@@ -182,17 +215,26 @@ std::shared_ptr<FixedSizeFileStorage> FixedSizeFileStorage::open(std::string met
 }
 
 void FixedSizeFileStorage::create(std::string metapath,
-                                  std::vector<std::tuple<u32, std::string>> vols)
+                                  std::vector<std::tuple<u32, std::string>> vols,
+                                  u32 block_size,
+                                  u32 fanout)
 {
+    if (block_size < AKU_BLOCK_SIZE || block_size > AKU_MAX_BLOCK_SIZE || (block_size & (block_size - 1)) != 0) {
+        AKU_PANIC("Invalid block size " + std::to_string(block_size));
+    }
+    // Superblock should fit into a single block
+    if (fanout < 2 || fanout > max_nbtree_fanout(block_size)) {
+        AKU_PANIC("Invalid fan-out " + std::to_string(fanout));
+    }
     std::vector<u32> caps;
     for (auto cp: vols) {
         std::string path;
         u32 capacity;
         std::tie(capacity, path) = cp;
-        Volume::create_new(path.c_str(), capacity);
+        Volume::create_new(path.c_str(), capacity, block_size);
         caps.push_back(capacity);
     }
-    MetaVolume::create_new(metapath.c_str(), caps.size(), caps.data());
+    MetaVolume::create_new(metapath.c_str(), caps.size(), caps.data(), block_size, fanout);
 }
 
 static u32 extract_gen(LogicAddr addr) {
@@ -243,7 +285,7 @@ std::tuple<aku_Status, std::shared_ptr<Block>> FixedSizeFileStorage::read_block(
     if (actual_gen != gen || vol >= nblocks) {
         return std::make_tuple(AKU_EBAD_ARG, std::unique_ptr<Block>());
     }
-    std::vector<u8> dest(AKU_BLOCK_SIZE, 0);
+    std::vector<u8> dest(block_size_, 0);
     status = volumes_[volix]->read_block(vol, dest.data());
     if (status != AKU_SUCCESS) {
         return std::make_tuple(status, std::unique_ptr<Block>());
@@ -270,26 +312,111 @@ void FixedSizeFileStorage::advance_volume() {
         AKU_PANIC("Can't read nblocks of the next volume, " + StatusUtil::str(status));
     }
     if (nblocks != 0) {
+        if (retention_ != 0) {
+            aku_Timestamp last_ts;
+            std::tie(status, last_ts) = meta_->get_last_timestamp(current_volume_);
+            if (status == AKU_SUCCESS && last_ts + retention_ >= newest_ts_) {
+                Logger::msg(AKU_LOG_ERROR, "Out of space, volume " + std::to_string(current_volume_) +
+                                           " contains data that is not expired yet");
+            }
+        }
+        recycle_volume(current_volume_);
         current_gen_ += volumes_.size();
-        auto status = meta_->set_generation(current_volume_, current_gen_);
-        if (status != AKU_SUCCESS) {
-            Logger::msg(AKU_LOG_ERROR, "Can't set generation on volume, " + StatusUtil::str(status));
-            AKU_PANIC("Invalid BlockStore state, can't reset volume's generation, " + StatusUtil::str(status));
+    }
+    update_oldest_ts();
+}
+
+void FixedSizeFileStorage::recycle_volume(u32 ix) {
+    aku_Status status;
+    u32 gen;
+    std::tie(status, gen) = meta_->get_generation(ix);
+    if (status == AKU_SUCCESS) {
+        status = meta_->set_generation(ix, gen + static_cast<u32>(volumes_.size()));
+    }
+    if (status != AKU_SUCCESS) {
+        Logger::msg(AKU_LOG_ERROR, "Can't set generation on volume, " + StatusUtil::str(status));
+        AKU_PANIC("Invalid BlockStore state, can't reset volume's generation, " + StatusUtil::str(status));
+    }
+    // Rest selected volume
+    status = meta_->set_nblocks(ix, 0);
+    if (status != AKU_SUCCESS) {
+        Logger::msg(AKU_LOG_ERROR, "Can't reset nblocks on volume, " + StatusUtil::str(status));
+        AKU_PANIC("Invalid BlockStore state, can't reset volume's nblocks, " + StatusUtil::str(status));
+    }
+    meta_->set_last_timestamp(ix, 0);
+    volumes_[ix]->reset();
+    dirty_[ix]++;
+}
+
+void FixedSizeFileStorage::update_oldest_ts() {
+    oldest_ts_ = std::numeric_limits<aku_Timestamp>::max();
+    for (u32 i = 0u; i < volumes_.size(); i++) {
+        aku_Status status;
+        u32 nblocks;
+        aku_Timestamp ts;
+        std::tie(status, nblocks) = meta_->get_nblocks(i);
+        if (status != AKU_SUCCESS || nblocks == 0 || i == current_volume_) {
+            continue;
         }
-        // Rest selected volume
-        status = meta_->set_nblocks(current_volume_, 0);
-        if (status != AKU_SUCCESS) {
-            Logger::msg(AKU_LOG_ERROR, "Can't reset nblocks on volume, " + StatusUtil::str(status));
-            AKU_PANIC("Invalid BlockStore state, can't reset volume's nblocks, " + StatusUtil::str(status));
+        std::tie(status, ts) = meta_->get_last_timestamp(i);
+        if (status == AKU_SUCCESS && ts != 0) {
+            oldest_ts_ = std::min(oldest_ts_, ts);
         }
-        volumes_[current_volume_]->reset();
-        dirty_[current_volume_]++;
     }
 }
 
+size_t FixedSizeFileStorage::reclaim() {
+    if (retention_ == 0 || newest_ts_ <= retention_) {
+        return 0;
+    }
+    aku_Timestamp horizon = newest_ts_ - retention_;
+    size_t nreclaimed = 0;
+    for (u32 i = 0u; i < volumes_.size(); i++) {
+        aku_Status status;
+        u32 nblocks;
+        aku_Timestamp ts;
+        std::tie(status, nblocks) = meta_->get_nblocks(i);
+        if (status != AKU_SUCCESS || nblocks == 0 || i == current_volume_) {
+            continue;
+        }
+        std::tie(status, ts) = meta_->get_last_timestamp(i);
+        if (status != AKU_SUCCESS || ts == 0) {
+            // Age is unknown (volume was written by the older version or blocks
+            // doesn't have timestamps), volume can only be reused by `advance_volume`
+            continue;
+        }
+        if (ts < horizon) {
+            Logger::msg(AKU_LOG_INFO, "Volume " + std::to_string(i) + " expired, last timestamp: "
+                                      + std::to_string(ts) + ", horizon: " + std::to_string(horizon));
+            recycle_volume(i);
+            nreclaimed++;
+        }
+    }
+    nreclaimed_ += nreclaimed;
+    update_oldest_ts();
+    return nreclaimed;
+}
+
+void FixedSizeFileStorage::set_retention(aku_Timestamp retention) {
+    retention_ = retention;
+    meta_->set_retention(retention);
+    reclaim();
+}
+
+aku_Timestamp FixedSizeFileStorage::get_retention() const {
+    return retention_;
+}
+
+u64 FixedSizeFileStorage::get_nreclaimed() const {
+    return nreclaimed_;
+}
+
 std::tuple<aku_Status, LogicAddr> FixedSizeFileStorage::append_block(std::shared_ptr<Block> data) {
     BlockAddr block_addr;
     aku_Status status;
+    if (data->get_size() != block_size_) {
+        return std::make_tuple(AKU_EBAD_ARG, 0ull);
+    }
     std::tie(status, block_addr) = volumes_[current_volume_]->append_block(data->get_data());
     if (status == AKU_EOVERFLOW) {
         // Move to next generation
@@ -305,6 +432,19 @@ std::tuple<aku_Status, LogicAddr> FixedSizeFileStorage::append_block(std::shared
         AKU_PANIC("Invalid BlockStore state, " + StatusUtil::str(status));
     }
     dirty_[current_volume_]++;
+    auto ts = data->get_timestamp();
+    if (ts != 0) {
+        aku_Timestamp last_ts;
+        std::tie(status, last_ts) = meta_->get_last_timestamp(current_volume_);
+        if (status == AKU_SUCCESS && ts > last_ts) {
+            meta_->set_last_timestamp(current_volume_, ts);
+        }
+        newest_ts_ = std::max(newest_ts_, ts);
+        if (retention_ != 0 && newest_ts_ > retention_ && oldest_ts_ < newest_ts_ - retention_) {
+            reclaim();
+        }
+        status = AKU_SUCCESS;
+    }
     return std::make_tuple(status, make_logic(current_gen_, block_addr));
 }
 
@@ -327,22 +467,43 @@ u32 FixedSizeFileStorage::checksum(u8 const* data, size_t size) const {
     return crc32c(data, size);
 }
 
+u32 FixedSizeFileStorage::get_block_size() const {
+    return block_size_;
+}
+
+u32 FixedSizeFileStorage::get_fanout() const {
+    return fanout_;
+}
+
 
 //! Memory resident blockstore for tests (and machines with infinite RAM)
 struct MemStore : BlockStore, std::enable_shared_from_this<MemStore> {
     std::vector<u8> buffer_;
     std::function<void(LogicAddr)> append_callback_;
     u32 write_pos_;
+    u32 block_size_;
+    u32 fanout_;
     u32 pad_;
 
     MemStore()
         : write_pos_(0)
+        , block_size_(AKU_BLOCK_SIZE)
+        , fanout_(AKU_NBTREE_FANOUT)
     {
     }
 
     MemStore(std::function<void(LogicAddr)> append_cb)
         : append_callback_(append_cb)
         , write_pos_(0)
+        , block_size_(AKU_BLOCK_SIZE)
+        , fanout_(AKU_NBTREE_FANOUT)
+    {
+    }
+
+    MemStore(u32 block_size, u32 fanout)
+        : write_pos_(0)
+        , block_size_(block_size)
+        , fanout_(fanout)
     {
     }
 
@@ -351,6 +512,8 @@ struct MemStore : BlockStore, std::enable_shared_from_this<MemStore> {
     virtual void flush();
     virtual bool exists(LogicAddr addr) const;
     virtual u32 checksum(u8 const* data, size_t size) const;
+    virtual u32 get_block_size() const;
+    virtual u32 get_fanout() const;
 };
 
 u32 MemStore::checksum(u8 const* data, size_t size) const {
@@ -359,22 +522,22 @@ u32 MemStore::checksum(u8 const* data, size_t size) const {
 
 std::tuple<aku_Status, std::shared_ptr<Block>> MemStore::read_block(LogicAddr addr) {
     std::shared_ptr<Block> block;
-    u32 offset = static_cast<u32>(AKU_BLOCK_SIZE * addr);
-    if (buffer_.size() < (offset + AKU_BLOCK_SIZE)) {
+    size_t offset = static_cast<size_t>(block_size_ * addr);
+    if (buffer_.size() < (offset + block_size_)) {
         return std::make_tuple(AKU_EBAD_ARG, block);
     }
     std::vector<u8> data;
-    data.reserve(AKU_BLOCK_SIZE);
-    auto begin = buffer_.begin() + offset;
-    auto end = begin + AKU_BLOCK_SIZE;
+    data.reserve(block_size_);
+    auto begin = buffer_.begin() + static_cast<std::ptrdiff_t>(offset);
+    auto end = begin + block_size_;
     std::copy(begin, end, std::back_inserter(data));
     block.reset(new Block(addr, std::move(data)));
     return std::make_tuple(AKU_SUCCESS, block);
 }
 
 std::tuple<aku_Status, LogicAddr> MemStore::append_block(std::shared_ptr<Block> data) {
-    assert(data->get_size() == AKU_BLOCK_SIZE);
-    std::copy(data->get_data(), data->get_data() + AKU_BLOCK_SIZE, std::back_inserter(buffer_));
+    assert(data->get_size() == block_size_);
+    std::copy(data->get_data(), data->get_data() + block_size_, std::back_inserter(buffer_));
     if (append_callback_) {
         append_callback_(write_pos_);
     }
@@ -391,6 +554,14 @@ bool MemStore::exists(LogicAddr addr) const {
     return addr < write_pos_;
 }
 
+u32 MemStore::get_block_size() const {
+    return block_size_;
+}
+
+u32 MemStore::get_fanout() const {
+    return fanout_;
+}
+
 std::shared_ptr<BlockStore> BlockStoreBuilder::create_memstore() {
     return std::make_shared<MemStore>();
 }
@@ -399,4 +570,8 @@ std::shared_ptr<BlockStore> BlockStoreBuilder::create_memstore(std::function<voi
     return std::make_shared<MemStore>(append_cb);
 }
 
+std::shared_ptr<BlockStore> BlockStoreBuilder::create_memstore(u32 block_size, u32 fanout) {
+    return std::make_shared<MemStore>(block_size, fanout);
+}
+
 }}  // namespace
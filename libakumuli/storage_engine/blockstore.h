@@ -75,10 +75,23 @@ struct BlockStore {
 
     //! Compute checksum of the input data.
     virtual u32 checksum(u8 const* begin, size_t size) const = 0;
+
+    //! Size of the block in bytes (all blocks passed to `append_block` should have this size).
+    virtual u32 get_block_size() const = 0;
+
+    //! Fan-out of the NBTree superblocks stored in this block-store.
+    virtual u32 get_fanout() const = 0;
 };
 
 /** Blockstore. Contains collection of volumes.
   * Translates logic adresses into physical ones.
+  *
+  * Retention. Volumes are written one after another. Each volume tracks the
+  * largest timestamp of its blocks (see `Block::set_timestamp`). If retention
+  * is set, volume is recycled (generation is bumped, write position is reset)
+  * as soon as its last timestamp falls behind the horizon (largest timestamp
+  * in the block-store minus retention period). All addresses from the old
+  * generation become invalid, so `exists` returns false for them.
   */
 class FixedSizeFileStorage : public BlockStore,
                              public std::enable_shared_from_this<FixedSizeFileStorage> {
@@ -94,19 +107,46 @@ class FixedSizeFileStorage : public BlockStore,
     u32 current_gen_;
     //! Size of the blockstore in blocks.
     size_t total_size_;
+    //! Block size (from meta-volume).
+    u32 block_size_;
+    //! NBTree fan-out (from meta-volume).
+    u32 fanout_;
+    //! Retention period (from meta-volume), 0 - disabled.
+    aku_Timestamp retention_;
+    //! Largest timestamp written to the block-store.
+    aku_Timestamp newest_ts_;
+    //! Smallest last timestamp of the non-current volumes (retention check is needed when horizon moves past it).
+    aku_Timestamp oldest_ts_;
+    //! Number of volumes recycled due to retention.
+    u64 nreclaimed_;
 
     //! Secret c-tor.
     FixedSizeFileStorage(std::string metapath, std::vector<std::string> volpaths);
 
     void advance_volume();
 
+    //! Reset volume and move it to the next generation.
+    void recycle_volume(u32 ix);
+
+    //! Update `oldest_ts_` value.
+    void update_oldest_ts();
+
 public:
     /** Create BlockStore instance (can be created only on heap).
       */
     static std::shared_ptr<FixedSizeFileStorage> open(std::string              metapath,
                                                       std::vector<std::string> volpaths);
 
-    static void create(std::string metapath, std::vector<std::tuple<u32, std::string>> vols);
+    /** Create meta-volume and volumes.
+      * @param metapath Path to meta-volume.
+      * @param vols List of volumes (capacity in blocks and path).
+      * @param block_size Block size, should be a power of two in [AKU_BLOCK_SIZE, AKU_MAX_BLOCK_SIZE].
+      * @param fanout NBTree fan-out.
+      */
+    static void create(std::string metapath,
+                       std::vector<std::tuple<u32, std::string>> vols,
+                       u32 block_size = AKU_BLOCK_SIZE,
+                       u32 fanout = AKU_NBTREE_FANOUT);
 
     /** Read block from blockstore
       */
@@ -123,18 +163,44 @@ public:
     virtual bool exists(LogicAddr addr) const;
 
     virtual u32 checksum(u8 const* data, size_t size) const;
+
+    virtual u32 get_block_size() const;
+
+    virtual u32 get_fanout() const;
+
+    /** Set retention period (stored in meta-volume, should be flushed).
+      * @param retention Max age of the data (0 disables retention).
+      */
+    void set_retention(aku_Timestamp retention);
+
+    //! Get retention period.
+    aku_Timestamp get_retention() const;
+
+    /** Recycle all volumes that contain only data older than the horizon.
+      * Called automatically by `append_block`.
+      * @return number of recycled volumes.
+      */
+    size_t reclaim();
+
+    //! Number of volumes recycled due to retention since the block-store was opened.
+    u64 get_nreclaimed() const;
 };
 
 //! Represents memory block
 class Block {
     std::vector<u8>           data_;
     LogicAddr                 addr_;
+    aku_Timestamp             timestamp_;  //< Largest timestamp of the data (used by retention)
 
 public:
     Block(LogicAddr addr, std::vector<u8>&& data);
 
+    //! Create empty block of default size
     Block();
 
+    //! Create empty block
+    explicit Block(size_t size);
+
     const u8* get_data() const;
 
     u8* get_data();
@@ -144,12 +210,17 @@ public:
     LogicAddr get_addr() const;
 
     void set_addr(LogicAddr addr);
+
+    aku_Timestamp get_timestamp() const;
+
+    void set_timestamp(aku_Timestamp ts);
 };
 
 //! Should be used to create blockstore
 struct BlockStoreBuilder {
     static std::shared_ptr<BlockStore> create_memstore();
     static std::shared_ptr<BlockStore> create_memstore(std::function<void(LogicAddr)> append_cb);
+    static std::shared_ptr<BlockStore> create_memstore(u32 block_size, u32 fanout);
 };
 
 }
@@ -413,6 +413,10 @@ struct NBTreeSBlockIterator : NBTreeIterator {
                 // Subtree not in [begin_, end_) range. Proceed to next.
                 return std::make_tuple(AKU_ENOT_FOUND, std::move(empty));
             }
+            if (!bstore_->exists(ref.addr)) {
+                // Subtree was reclaimed by retention (generation check, no I/O).
+                return std::make_tuple(AKU_ENOT_FOUND, std::move(empty));
+            }
             if (ref.level == 0) {
                 aku_Status status;
                 std::shared_ptr<Block> block;
@@ -485,10 +489,10 @@ NBTreeSBlockIterator::Direction NBTreeSBlockIterator::get_direction() {
 //    NBTreeLeaf    //
 // //////////////// //
 
-NBTreeLeaf::NBTreeLeaf(aku_ParamId id, LogicAddr prev, u16 fanout_index)
+NBTreeLeaf::NBTreeLeaf(aku_ParamId id, LogicAddr prev, u16 fanout_index, u32 block_size)
     : prev_(prev)
-    , block_(std::make_shared<Block>())
-    , writer_(id, block_->get_data() + sizeof(SubtreeRef), AKU_BLOCK_SIZE - sizeof(SubtreeRef))
+    , block_(std::make_shared<Block>(block_size))
+    , writer_(id, block_->get_data() + sizeof(SubtreeRef), static_cast<int>(block_size - sizeof(SubtreeRef)))
     , fanout_index_(fanout_index)
 {
     SubtreeRef* subtree = subtree_cast(block_->get_data());
@@ -607,6 +611,7 @@ std::tuple<aku_Status, LogicAddr> NBTreeLeaf::commit(std::shared_ptr<BlockStore>
     subtree->fanout_index = fanout_index_;
     // Compute checksum
     subtree->checksum = bstore->checksum(block_->get_data() + sizeof(SubtreeRef), size);
+    block_->set_timestamp(subtree->end);
     return bstore->append_block(block_);
 }
 
@@ -668,10 +673,11 @@ std::unique_ptr<NBTreeIterator> NBTreeLeaf::search(aku_Timestamp begin, aku_Time
 //     NBTreeSuperblock     //
 // //////////////////////// //
 
-NBTreeSuperblock::NBTreeSuperblock(aku_ParamId id, LogicAddr prev, u16 fanout, u16 lvl)
-    : block_(std::make_shared<Block>())
+NBTreeSuperblock::NBTreeSuperblock(aku_ParamId id, LogicAddr prev, u16 fanout, u16 lvl, u32 block_size, u32 capacity)
+    : block_(std::make_shared<Block>(block_size))
     , id_(id)
     , write_pos_(0)
+    , capacity_(capacity)
     , fanout_index_(fanout)
     , level_(lvl)
     , prev_(prev)
@@ -689,6 +695,7 @@ NBTreeSuperblock::NBTreeSuperblock(std::shared_ptr<Block> block)
     fanout_index_ = ref->fanout_index;
     prev_ = ref->addr;
     write_pos_ = ref->payload_size;
+    capacity_ = write_pos_;
     level_ = ref->level;
 }
 
@@ -698,7 +705,8 @@ NBTreeSuperblock::NBTreeSuperblock(LogicAddr addr, std::shared_ptr<BlockStore> b
 }
 
 NBTreeSuperblock::NBTreeSuperblock(LogicAddr addr, std::shared_ptr<BlockStore> bstore, bool remove_last)
-    : block_(std::make_shared<Block>())
+    : block_(std::make_shared<Block>(bstore->get_block_size()))
+    , capacity_(bstore->get_fanout())
     , immutable_(false)
 {
     std::shared_ptr<Block> block = read_block_from_bstore(bstore, addr);
@@ -711,7 +719,7 @@ NBTreeSuperblock::NBTreeSuperblock(LogicAddr addr, std::shared_ptr<BlockStore> b
     if (remove_last && write_pos_ != 0) {
         // We can't use zero-copy here because `block` belongs to other node.
         write_pos_--;
-        memcpy(block_->get_data(), block->get_data(), AKU_BLOCK_SIZE);
+        memcpy(block_->get_data(), block->get_data(), block_->get_size());
     }
     else {
         // Zero copy
@@ -787,18 +795,23 @@ std::tuple<aku_Status, LogicAddr> NBTreeSuperblock::commit(std::shared_ptr<Block
     }
     // This fields should be rewrited to store node's own information
     backref->payload_size = static_cast<u16>(write_pos_);
-    assert(backref->payload_size + sizeof(SubtreeRef) < AKU_BLOCK_SIZE);
+    assert((backref->payload_size + 1u)*sizeof(SubtreeRef) <= block_->get_size());
     backref->fanout_index = fanout_index_;
     backref->id = id_;
     backref->level = level_;
     backref->version = AKUMULI_VERSION;
     // add checksum
     backref->checksum = bstore->checksum(block_->get_data() + sizeof(SubtreeRef), backref->payload_size);
+    block_->set_timestamp(backref->end);
     return bstore->append_block(block_);
 }
 
 bool NBTreeSuperblock::is_full() const {
-    return write_pos_ >= AKU_NBTREE_FANOUT;
+    return write_pos_ >= capacity_;
+}
+
+u32 NBTreeSuperblock::max_fanout(u32 block_size) {
+    return max_nbtree_fanout(block_size);
 }
 
 aku_Status NBTreeSuperblock::read_all(std::vector<SubtreeRef>* refs) const {
@@ -838,8 +851,8 @@ struct NBTreeLeafExtent : NBTreeExtent {
     LogicAddr last_;
     std::shared_ptr<NBTreeLeaf> leaf_;
     u16 fanout_index_;
+    u16 fanout_;
     // padding
-    u16 pad0_;
     u32 pad1_;
 
     NBTreeLeafExtent(std::shared_ptr<BlockStore> bstore,
@@ -851,7 +864,7 @@ struct NBTreeLeafExtent : NBTreeExtent {
         , id_(id)
         , last_(last)
         , fanout_index_(0)
-        , pad0_{}
+        , fanout_(static_cast<u16>(bstore->get_fanout()))
         , pad1_{}
     {
         if (last_ != EMPTY_ADDR) {
@@ -868,7 +881,7 @@ struct NBTreeLeafExtent : NBTreeExtent {
             } else {
                 auto psubtree = subtree_cast(block->get_data());
                 fanout_index_ = psubtree->fanout_index + 1;
-                if (fanout_index_ == AKU_NBTREE_FANOUT) {
+                if (fanout_index_ == fanout_) {
                     fanout_index_ = 0;
                     last_ = EMPTY_ADDR;
                 }
@@ -895,7 +908,7 @@ struct NBTreeLeafExtent : NBTreeExtent {
     }
 
     void reset_leaf() {
-        leaf_.reset(new NBTreeLeaf(id_, last_, fanout_index_));
+        leaf_.reset(new NBTreeLeaf(id_, last_, fanout_index_, bstore_->get_block_size()));
     }
 
     virtual std::tuple<bool, LogicAddr> append(aku_Timestamp ts, double value);
@@ -956,6 +969,7 @@ std::tuple<bool, LogicAddr> NBTreeLeafExtent::commit(bool final) {
         if (!final || roots_collection->get_roots().size() > next_level) {
             parent_saved = roots_collection->append(payload);
         }
+        roots_collection->_on_leaf_commit(*leaf_);
     } else {
         // Invariant broken.
         // Roots collection was destroyed before write process
@@ -963,7 +977,7 @@ std::tuple<bool, LogicAddr> NBTreeLeafExtent::commit(bool final) {
         AKU_PANIC("Roots collection destroyed");
     }
     fanout_index_++;
-    if (fanout_index_ == AKU_NBTREE_FANOUT) {
+    if (fanout_index_ == fanout_) {
         fanout_index_ = 0;
         last_ = EMPTY_ADDR;
     }
@@ -999,8 +1013,9 @@ struct NBTreeSBlockExtent : NBTreeExtent {
     LogicAddr last_;
     u16 fanout_index_;
     u16 level_;
+    u16 fanout_;
     // padding
-    u32 pad_;
+    u16 pad_;
 
     NBTreeSBlockExtent(std::shared_ptr<BlockStore> bstore,
                        std::shared_ptr<NBTreeExtentsList> roots,
@@ -1013,6 +1028,7 @@ struct NBTreeSBlockExtent : NBTreeExtent {
         , last_(EMPTY_ADDR)
         , fanout_index_(0)
         , level_(level)
+        , fanout_(static_cast<u16>(bstore->get_fanout()))
         , pad_{}
     {
         if (addr != EMPTY_ADDR) {
@@ -1028,7 +1044,7 @@ struct NBTreeSBlockExtent : NBTreeExtent {
             } else {
                 auto psubtree = subtree_cast(block->get_data());
                 fanout_index_ = psubtree->fanout_index + 1;
-                if (fanout_index_ == AKU_NBTREE_FANOUT) {
+                if (fanout_index_ == fanout_) {
                     fanout_index_ = 0;
                     last_ = EMPTY_ADDR;
                 }
@@ -1040,12 +1056,12 @@ struct NBTreeSBlockExtent : NBTreeExtent {
             curr_.reset(new NBTreeSuperblock(addr, bstore_, false));
         } else {
             // `addr` is not set. Node should be created from scratch.
-            curr_.reset(new NBTreeSuperblock(id, EMPTY_ADDR, 0, level));
+            curr_.reset(new NBTreeSuperblock(id, EMPTY_ADDR, 0, level, bstore_->get_block_size(), fanout_));
         }
     }
 
     void reset_subtree() {
-        curr_.reset(new NBTreeSuperblock(id_, last_, fanout_index_, level_));
+        curr_.reset(new NBTreeSuperblock(id_, last_, fanout_index_, level_, bstore_->get_block_size(), fanout_));
     }
 
     u16 get_fanout_index() const {
@@ -1117,7 +1133,7 @@ std::tuple<bool, LogicAddr> NBTreeSBlockExtent::commit(bool final) {
         AKU_PANIC("Roots collection destroyed");
     }
     fanout_index_++;
-    if (fanout_index_ == AKU_NBTREE_FANOUT) {
+    if (fanout_index_ == fanout_) {
         fanout_index_ = 0;
         last_ = EMPTY_ADDR;
     }
@@ -1278,6 +1294,24 @@ NBTreeExtentsList::NBTreeExtentsList(aku_ParamId id, std::vector<LogicAddr> addr
     if (rescue_points_.size() >= std::numeric_limits<u16>::max()) {
         AKU_PANIC("Tree depth is too large");
     }
+    auto fanout = bstore_->get_fanout();
+    if (fanout < 2 || fanout > NBTreeSuperblock::max_fanout(bstore_->get_block_size())) {
+        AKU_PANIC("Fan-out " + std::to_string(fanout) + " doesn't fit the block");
+    }
+}
+
+aku_ParamId NBTreeExtentsList::get_id() const {
+    return id_;
+}
+
+void NBTreeExtentsList::set_commit_callback(CommitCallback cb) {
+    commit_cb_ = cb;
+}
+
+void NBTreeExtentsList::_on_leaf_commit(NBTreeLeaf const& leaf) {
+    if (commit_cb_) {
+        commit_cb_(leaf);
+    }
 }
 
 void NBTreeExtentsList::force_init() {
@@ -1404,6 +1438,7 @@ void NBTreeExtentsList::open() {
                         " error: " + StatusUtil::str(status));
             AKU_PANIC("Can't open tree");
         }
+        sref.addr = addr;
         root_extent->append(sref);  // this always should return `false` and `EMPTY_ADDR`, no need to check this.
 
         // Create new empty leaf
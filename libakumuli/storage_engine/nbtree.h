@@ -74,6 +74,7 @@
 #pragma once
 // C++ headers
 #include <deque>
+#include <functional>
 
 // App headers
 #include "blockstore.h"
@@ -88,10 +89,6 @@ enum class NBTreeBlockType {
     INNER,  // super block
 };
 
-enum {
-    AKU_NBTREE_FANOUT = 32,
-};
-
 /** Reference to tree node.
   * Ref contains some metadata: version, level, payload_size, id.
   * This metadata corresponds to the current node.
@@ -131,6 +128,8 @@ struct SubtreeRef {
     u32 checksum;
 } __attribute__((packed));
 
+static_assert(sizeof(SubtreeRef) == AKU_SUBTREE_REF_SIZE, "AKU_SUBTREE_REF_SIZE should match SubtreeRef");
+
 
 /** NBTree iterator.
   * @note all ranges is semi-open. This means that if we're
@@ -185,8 +184,9 @@ public:
       * @param link to block store.
       * @param prev Prev element of the tree.
       * @param fanout_index Index inside current fanout
+      * @param block_size Size of the block (should match block-store's block size)
       */
-    NBTreeLeaf(aku_ParamId id, LogicAddr prev, u16 fanout_index);
+    NBTreeLeaf(aku_ParamId id, LogicAddr prev, u16 fanout_index, u32 block_size);
 
     /** Load from block store.
       * @param block Leaf's serialized data.
@@ -246,14 +246,15 @@ class NBTreeSuperblock {
     std::shared_ptr<Block> block_;
     aku_ParamId            id_;
     u32                    write_pos_;
+    u32                    capacity_;   //< Max number of refs (fan-out)
     u16                    fanout_index_;
     u16                    level_;
     LogicAddr              prev_;
     bool                   immutable_;
 
 public:
-    //! Create new writable node.
-    NBTreeSuperblock(aku_ParamId id, LogicAddr prev, u16 fanout, u16 lvl);
+    //! Create new writable node that can hold `capacity` refs.
+    NBTreeSuperblock(aku_ParamId id, LogicAddr prev, u16 fanout, u16 lvl, u32 block_size, u32 capacity);
 
     //! Read immutable node from block-store.
     NBTreeSuperblock(std::shared_ptr<Block> block);
@@ -273,6 +274,9 @@ public:
     //! Check if node is full (always true if node is immutable - c-tor #2)
     bool is_full() const;
 
+    //! Largest fan-out that fits in the block of the given size
+    static u32 max_fanout(u32 block_size);
+
     aku_Status read_all(std::vector<SubtreeRef>* refs) const;
 
     //! Get node's level
@@ -335,11 +339,17 @@ struct NBTreeExtent {
   * @li create new roots lazily (NBTree starts with only one root and rarely goes above 2)
   */
 class NBTreeExtentsList : public std::enable_shared_from_this<NBTreeExtentsList> {
+public:
+    //! Called after leaf node was written to the block-store
+    typedef std::function<void(NBTreeLeaf const&)> CommitCallback;
+
+private:
     std::shared_ptr<BlockStore> bstore_;
     std::deque<std::unique_ptr<NBTreeExtent>> extents_;
     aku_ParamId id_;
     std::vector<LogicAddr> rescue_points_;
     bool initialized_;
+    CommitCallback commit_cb_;
 
     void init();
     void open();
@@ -364,6 +374,20 @@ public:
     //! Get roots of the tree
     std::vector<LogicAddr> get_roots() const;
 
+    //! Get series id
+    aku_ParamId get_id() const;
+
+    /** Set function that will be called each time leaf node is committed
+      * (including the last leaf committed by `close`). Callback is called from
+      * the writer's thread and shouldn't modify this tree.
+      */
+    void set_commit_callback(CommitCallback cb);
+
+    /** Notify subscriber about committed leaf node.
+      * This method should only be called by the leaf extent.
+      */
+    void _on_leaf_commit(NBTreeLeaf const& leaf);
+
     //! Get pointers to extents (for tests).
     std::vector<NBTreeExtent const*> get_extents() const;
 
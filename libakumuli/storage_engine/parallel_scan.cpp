@@ -0,0 +1,339 @@
+/**
+ * Copyright (c) 2016 Eugene Lazin <4lazin@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+// C++
+#include <algorithm>
+
+// Boost
+#include <boost/heap/skew_heap.hpp>
+
+// App
+#include "parallel_scan.h"
+
+namespace Akumuli {
+namespace StorageEngine {
+
+//! Number of elements that should be read from the iterator at once
+static const size_t READ_CHUNK_SIZE = 0x1000;
+
+//! Number of series (per worker) that should be processed in one wave in series-order mode
+static const size_t SERIES_PER_WORKER = 16;
+
+//! Materialized output of the single series
+struct SeriesBuffer {
+    aku_ParamId                 id;
+    aku_Status                  status;
+    std::vector<aku_Timestamp>  ts;
+    std::vector<double>         xs;
+};
+
+static aku_Status read_series(NBTreeExtentsList const& tree,
+                              aku_Timestamp begin,
+                              aku_Timestamp end,
+                              SeriesBuffer* out)
+{
+    auto it = tree.search(begin, end);
+    while (true) {
+        aku_Status status;
+        size_t sz;
+        size_t pos = out->ts.size();
+        out->ts.resize(pos + READ_CHUNK_SIZE);
+        out->xs.resize(pos + READ_CHUNK_SIZE);
+        std::tie(status, sz) = it->read(out->ts.data() + pos, out->xs.data() + pos, READ_CHUNK_SIZE);
+        out->ts.resize(pos + sz);
+        out->xs.resize(pos + sz);
+        if (status == AKU_ENO_DATA) {
+            break;
+        } else if (status != AKU_SUCCESS) {
+            return status;
+        } else if (sz == 0) {
+            break;
+        }
+    }
+    return AKU_SUCCESS;
+}
+
+//! Read all series from `buffers` using the thread pool
+static void read_all(std::vector<SeriesBuffer>* buffers,
+                     ThreadPool& pool,
+                     aku_Timestamp begin,
+                     aku_Timestamp end,
+                     ParallelScan::Resolver const& resolve)
+{
+    pool.parallel_for(buffers->size(), [&](size_t ix) {
+        SeriesBuffer& buf = buffers->at(ix);
+        auto tree = resolve(buf.id);
+        if (tree) {
+            buf.status = read_series(*tree, begin, end, &buf);
+        }
+    });
+}
+
+//! Batch of elements read from the series iterator
+struct SeriesBatch {
+    std::vector<aku_Timestamp>  ts;
+    std::vector<double>         xs;
+    aku_Status                  status;
+    bool                        last;  //< Iterator is exhausted, no batches after this one
+
+    SeriesBatch()
+        : status(AKU_SUCCESS)
+        , last(false)
+    {
+    }
+};
+
+//! Replace batch content with the next READ_CHUNK_SIZE elements of the iterator
+static void read_batch(NBTreeIterator* iter, SeriesBatch* out) {
+    out->ts.resize(READ_CHUNK_SIZE);
+    out->xs.resize(READ_CHUNK_SIZE);
+    aku_Status status;
+    size_t sz;
+    std::tie(status, sz) = iter->read(out->ts.data(), out->xs.data(), READ_CHUNK_SIZE);
+    if (status != AKU_SUCCESS && status != AKU_ENO_DATA) {
+        out->status = status;
+        sz = 0;
+    }
+    out->last = status != AKU_SUCCESS || sz == 0;
+    out->ts.resize(sz);
+    out->xs.resize(sz);
+}
+
+/** Double-buffered series iterator used by the time-ordered scan.
+  * While the current batch is merged on the caller's thread, the next one
+  * is read by the thread pool. Batches are heap allocated so the cursor can
+  * be moved while the read is in progress.
+  */
+struct SeriesCursor {
+    aku_ParamId                         id;
+    aku_Status                          status;
+    std::shared_ptr<NBTreeExtentsList>  tree;   //< Keeps the tree alive while iterator is used
+    std::unique_ptr<NBTreeIterator>     iter;
+    std::unique_ptr<SeriesBatch>        curr;   //< Batch that is being merged
+    std::unique_ptr<SeriesBatch>        ahead;  //< Next batch (read in background)
+    std::future<void>                   pending;
+    size_t                              pos;    //< Position of the current element in `curr`
+
+    SeriesCursor(aku_ParamId id)
+        : id(id)
+        , status(AKU_SUCCESS)
+        , curr(new SeriesBatch())
+        , ahead(new SeriesBatch())
+        , pos(0)
+    {
+    }
+
+    SeriesCursor(SeriesCursor&&) = default;
+
+    ~SeriesCursor() {
+        // Iterator can't be destroyed while it's used by the worker thread
+        if (pending.valid()) {
+            pending.wait();
+        }
+    }
+
+    //! Open iterator and read first batch
+    void open(aku_Timestamp begin, aku_Timestamp end, ParallelScan::Resolver const& resolve) {
+        tree = resolve(id);
+        if (tree) {
+            iter = tree->search(begin, end);
+            read_batch(iter.get(), curr.get());
+            status = curr->status;
+        } else {
+            curr->last = true;
+        }
+    }
+
+    //! Start reading next batch in background
+    void prefetch(ThreadPool& pool) {
+        if (!curr->last) {
+            NBTreeIterator* it = iter.get();
+            SeriesBatch* out = ahead.get();
+            pending = pool.submit([it, out]() {
+                read_batch(it, out);
+            });
+        }
+    }
+
+    //! Returns true if current element is available
+    bool valid() const {
+        return pos < curr->ts.size();
+    }
+
+    //! Move to the next element, switch to the prefetched batch if needed
+    void next(ThreadPool& pool) {
+        pos++;
+        if (pos == curr->ts.size() && !curr->last) {
+            pending.get();
+            std::swap(curr, ahead);
+            pos = 0;
+            status = curr->status;
+            prefetch(pool);
+        }
+    }
+};
+
+static aku_Sample make_sample(aku_ParamId id, aku_Timestamp ts, double value) {
+    aku_Sample sample;
+    sample.paramid = id;
+    sample.timestamp = ts;
+    sample.payload.type = AKU_PAYLOAD_FLOAT;
+    sample.payload.size = sizeof(aku_Sample);
+    sample.payload.float64 = value;
+    return sample;
+}
+
+/** K-way merge of the series cursors. Cursors are ordered by series (ties are
+  * resolved using cursor index), each cursor is already ordered by timestamp.
+  * Next batch of each cursor is read by the thread pool while the current one is merged.
+  */
+template<bool Forward>
+static aku_Status kway_merge(std::vector<SeriesCursor>& cursors,
+                             ThreadPool& pool,
+                             ParallelScan::Consumer const& cons)
+{
+    // timestamp, cursor index
+    typedef std::tuple<aku_Timestamp, size_t> HeapItem;
+    struct Comp {
+        bool operator () (HeapItem const& lhs, HeapItem const& rhs) const {
+            // boost heap is a max-heap, predicate should return true if `lhs`
+            // should be returned after `rhs`
+            if (std::get<0>(lhs) == std::get<0>(rhs)) {
+                return std::get<1>(lhs) > std::get<1>(rhs);
+            }
+            return Forward ? std::get<0>(lhs) > std::get<0>(rhs)
+                           : std::get<0>(lhs) < std::get<0>(rhs);
+        }
+    };
+    typedef boost::heap::skew_heap<HeapItem, boost::heap::compare<Comp>> Heap;
+    Heap heap;
+    for (size_t ix = 0; ix < cursors.size(); ix++) {
+        if (cursors[ix].valid()) {
+            heap.push(std::make_tuple(cursors[ix].curr->ts[cursors[ix].pos], ix));
+        }
+    }
+    while (!heap.empty()) {
+        HeapItem item = heap.top();
+        heap.pop();
+        size_t ix = std::get<1>(item);
+        SeriesCursor& cur = cursors[ix];
+        if (!cons(make_sample(cur.id, cur.curr->ts[cur.pos], cur.curr->xs[cur.pos]))) {
+            return AKU_SUCCESS;
+        }
+        cur.next(pool);
+        if (cur.status != AKU_SUCCESS) {
+            return cur.status;
+        }
+        if (cur.valid()) {
+            heap.push(std::make_tuple(cur.curr->ts[cur.pos], ix));
+        }
+    }
+    return AKU_SUCCESS;
+}
+
+static std::vector<SeriesBuffer> make_buffers(std::vector<aku_ParamId>::const_iterator begin,
+                                              std::vector<aku_ParamId>::const_iterator end)
+{
+    std::vector<SeriesBuffer> buffers;
+    buffers.reserve(static_cast<size_t>(std::distance(begin, end)));
+    for (auto it = begin; it != end; it++) {
+        SeriesBuffer buf;
+        buf.id = *it;
+        buf.status = AKU_SUCCESS;
+        buffers.push_back(std::move(buf));
+    }
+    return buffers;
+}
+
+static aku_Status first_error(std::vector<SeriesBuffer> const& buffers) {
+    for (auto const& buf: buffers) {
+        if (buf.status != AKU_SUCCESS) {
+            return buf.status;
+        }
+    }
+    return AKU_SUCCESS;
+}
+
+ParallelScan::ParallelScan(u32 nworkers)
+    : pool_(std::make_shared<ThreadPool>(nworkers))
+{
+}
+
+ParallelScan::ParallelScan(std::shared_ptr<ThreadPool> pool)
+    : pool_(pool)
+{
+}
+
+u32 ParallelScan::get_nworkers() const {
+    return pool_->size();
+}
+
+aku_Status ParallelScan::execute(std::vector<aku_ParamId> const& ids,
+                                 aku_Timestamp begin,
+                                 aku_Timestamp end,
+                                 ScanOrder order,
+                                 Resolver const& resolve,
+                                 Consumer const& cons) const
+{
+    if (order == ScanOrder::TIME) {
+        // Up to two batches per series are kept in memory, first batches are
+        // read in parallel, next ones are prefetched during the merge
+        std::vector<SeriesCursor> cursors;
+        cursors.reserve(ids.size());
+        for (auto id: ids) {
+            cursors.emplace_back(id);
+        }
+        pool_->parallel_for(cursors.size(), [&](size_t ix) {
+            cursors[ix].open(begin, end, resolve);
+        });
+        for (auto const& cur: cursors) {
+            if (cur.status != AKU_SUCCESS) {
+                return cur.status;
+            }
+        }
+        for (auto& cur: cursors) {
+            cur.prefetch(*pool_);
+        }
+        if (begin < end) {
+            return kway_merge<true>(cursors, *pool_, cons);
+        }
+        return kway_merge<false>(cursors, *pool_, cons);
+    }
+    // Series order, series are processed in waves
+    const size_t wave_size = (pool_->size() + 1) * SERIES_PER_WORKER;
+    for (size_t wave = 0; wave < ids.size(); wave += wave_size) {
+        auto wbegin = ids.begin() + static_cast<std::ptrdiff_t>(wave);
+        auto wend = ids.begin() + static_cast<std::ptrdiff_t>(std::min(wave + wave_size, ids.size()));
+        auto buffers = make_buffers(wbegin, wend);
+        read_all(&buffers, *pool_, begin, end, resolve);
+        aku_Status status = first_error(buffers);
+        if (status != AKU_SUCCESS) {
+            return status;
+        }
+        for (auto const& buf: buffers) {
+            for (size_t i = 0; i < buf.ts.size(); i++) {
+                if (!cons(make_sample(buf.id, buf.ts[i], buf.xs[i]))) {
+                    return AKU_SUCCESS;
+                }
+            }
+        }
+    }
+    return AKU_SUCCESS;
+}
+
+}
+}  // namespaces
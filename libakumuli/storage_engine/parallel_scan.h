@@ -0,0 +1,94 @@
+/**
+ * Copyright (c) 2016 Eugene Lazin <4lazin@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/** Parallel multi-series scan.
+  * Query that touches N series produces N independent NBTree iterators.
+  * This code distributes these iterators between worker threads of the
+  * thread pool (each series is read by at most one thread at a time, so
+  * NBTreeExtentsList instances are never accessed concurrently) and merges
+  * results on the caller's thread.
+  *
+  * Two output orders are supported:
+  * @li series order - all data points of the first series, then all data points
+  *     of the second series, etc. Series are processed in waves so memory usage
+  *     is bounded by the size of the wave.
+  * @li time order - data points of all series merged by timestamp (k-way merge),
+  *     ties are resolved using series order. Up to two batches of data points per
+  *     series are kept in memory: the one that is being merged and the next one that
+  *     is read by the worker thread in the meantime.
+  */
+
+#pragma once
+// C++ headers
+#include <functional>
+#include <memory>
+#include <vector>
+
+// App headers
+#include "nbtree.h"
+#include "threadpool.h"
+
+namespace Akumuli {
+namespace StorageEngine {
+
+//! Output order of the `ParallelScan`
+enum class ScanOrder {
+    SERIES,
+    TIME,
+};
+
+class ParallelScan {
+    std::shared_ptr<ThreadPool> pool_;
+public:
+    //! Returns NBTree for series id or empty pointer if series doesn't exists.
+    typedef std::function<std::shared_ptr<NBTreeExtentsList>(aku_ParamId)> Resolver;
+    //! Receives merged data points, should return false to interrupt the scan.
+    typedef std::function<bool(aku_Sample const&)> Consumer;
+
+    /** C-tor.
+      * @param nworkers Number of worker threads, 0 - use number of hardware threads.
+      */
+    ParallelScan(u32 nworkers = 0);
+
+    /** C-tor.
+      * @param pool Thread pool shared with other components. `execute` waits for
+      *        tasks submitted to this pool so it shouldn't be called from its threads.
+      */
+    ParallelScan(std::shared_ptr<ThreadPool> pool);
+
+    /** Read data from all series in [begin, end) range and pass merged results to consumer.
+      * Scan direction is defined by `begin` and `end` (backward if `begin` > `end`).
+      * @param ids List of series ids (filter's `get_ids()` output).
+      * @param resolve Function that maps series ids to NBTree instances (called from
+      *        worker threads, should be thread-safe).
+      * @param cons Result consumer, called only from caller's thread.
+      * @return AKU_SUCCESS on success (or if consumer interrupted the scan), or error
+      *         code of the first failed NBTree iterator.
+      */
+    aku_Status execute(std::vector<aku_ParamId> const& ids,
+                       aku_Timestamp begin,
+                       aku_Timestamp end,
+                       ScanOrder order,
+                       Resolver const& resolve,
+                       Consumer const& cons) const;
+
+    //! Get number of worker threads
+    u32 get_nworkers() const;
+};
+
+}
+}  // namespaces
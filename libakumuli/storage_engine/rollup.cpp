@@ -0,0 +1,343 @@
+/**
+ * Copyright (c) 2016 Eugene Lazin <4lazin@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "rollup.h"
+#include "log_iface.h"
+#include "status_util.h"
+#include "util.h"
+
+#include <algorithm>
+
+namespace Akumuli {
+namespace StorageEngine {
+
+const aku_Timestamp RollupEngine::MINUTE;
+const aku_Timestamp RollupEngine::HOUR;
+
+static const size_t READ_BATCH_SIZE = 0x1000;
+
+static RollupBucket make_bucket(aku_Timestamp begin, double value) {
+    RollupBucket bucket;
+    bucket.begin = begin;
+    bucket.count = 1;
+    bucket.sum = value;
+    bucket.min = value;
+    bucket.max = value;
+    bucket.last = value;
+    return bucket;
+}
+
+//! Merge `next` into `out`, `next` should contain newer data than `out.back()`
+static void merge_bucket(std::vector<RollupBucket>* out, RollupBucket const& next) {
+    if (out->empty() || out->back().begin != next.begin) {
+        out->push_back(next);
+        return;
+    }
+    RollupBucket& curr = out->back();
+    curr.count += next.count;
+    curr.sum   += next.sum;
+    curr.min    = std::min(curr.min, next.min);
+    curr.max    = std::max(curr.max, next.max);
+    curr.last   = next.last;
+}
+
+RollupEngine::RollupEngine(std::shared_ptr<BlockStore> bstore, std::vector<aku_Timestamp> resolutions)
+    : bstore_(bstore)
+    , resolutions_(std::move(resolutions))
+{
+    if (!std::is_sorted(resolutions_.begin(), resolutions_.end())) {
+        AKU_PANIC("Rollup resolutions should be sorted");
+    }
+    for (auto res: resolutions_) {
+        if (res < NFIELDS) {
+            AKU_PANIC("Rollup resolution is too small: " + std::to_string(res));
+        }
+    }
+}
+
+void RollupEngine::add(Level& level, aku_Timestamp ts, double value) {
+    if (ts < level.next) {
+        // Already accounted
+        return;
+    }
+    level.next = ts + 1;
+    aku_Timestamp bucket = ts / level.res * level.res;
+    if (level.open.count != 0 && level.open.begin != bucket) {
+        // Bucket is complete, write row to the rollup tree
+        auto const& row = level.open;
+        level.tree->append(row.begin + 0, static_cast<double>(row.count));
+        level.tree->append(row.begin + 1, row.sum);
+        level.tree->append(row.begin + 2, row.min);
+        level.tree->append(row.begin + 3, row.max);
+        level.tree->append(row.begin + 4, row.last);
+        // There is no data between the end of the row and the new bucket
+        level.watermark = bucket;
+        level.open.count = 0;
+    }
+    if (level.open.count == 0) {
+        level.open = make_bucket(bucket, value);
+    } else {
+        level.open.count++;
+        level.open.sum += value;
+        level.open.min = std::min(level.open.min, value);
+        level.open.max = std::max(level.open.max, value);
+        level.open.last = value;
+    }
+}
+
+void RollupEngine::attach(std::shared_ptr<NBTreeExtentsList> tree, std::vector<std::vector<LogicAddr>> const& roots) {
+    auto id = tree->get_id();
+    auto series = std::make_shared<Series>();
+    series->raw = tree;
+    auto& levels = series->levels;
+    aku_Timestamp oldest = AKU_MAX_TIMESTAMP;
+    for (size_t i = 0; i < resolutions_.size(); i++) {
+        Level level = {};
+        level.res = resolutions_[i];
+        auto addrlist = i < roots.size() ? roots[i] : std::vector<LogicAddr>();
+        level.tree = std::make_shared<NBTreeExtentsList>(id, addrlist, bstore_);
+        // Watermark is the end of the last row
+        auto it = level.tree->search(AKU_MAX_TIMESTAMP, 0);
+        aku_Timestamp ts;
+        double value;
+        aku_Status status;
+        size_t sz;
+        std::tie(status, sz) = it->read(&ts, &value, 1);
+        if (sz == 1) {
+            level.watermark = ts / resolutions_[i] * resolutions_[i] + resolutions_[i];
+        }
+        level.next = level.watermark;
+        oldest = std::min(oldest, level.watermark);
+        levels.push_back(std::move(level));
+    }
+
+    // Restore open buckets, series is not visible to other threads yet
+    if (!levels.empty()) {
+        auto it = tree->search(oldest, AKU_MAX_TIMESTAMP);
+        std::vector<aku_Timestamp> ts(READ_BATCH_SIZE);
+        std::vector<double> xs(READ_BATCH_SIZE);
+        while (true) {
+            aku_Status status;
+            size_t sz;
+            std::tie(status, sz) = it->read(ts.data(), xs.data(), READ_BATCH_SIZE);
+            for (size_t i = 0; i < levels.size(); i++) {
+                for (size_t j = 0; j < sz; j++) {
+                    add(levels[i], ts[j], xs[j]);
+                }
+            }
+            if (status != AKU_SUCCESS || sz == 0) {
+                break;
+            }
+        }
+    }
+    std::weak_ptr<Series> weak = series;
+    {
+        std::lock_guard<std::mutex> guard(lock_); AKU_UNUSED(guard);
+        series_[id] = std::move(series);
+    }
+    tree->set_commit_callback([weak](NBTreeLeaf const& leaf) {
+        auto series = weak.lock();
+        if (series) {
+            update(*series, leaf);
+        }
+    });
+}
+
+std::vector<std::vector<LogicAddr>> RollupEngine::close(aku_ParamId id) {
+    std::vector<std::vector<LogicAddr>> result;
+    std::shared_ptr<Series> series;
+    {
+        std::lock_guard<std::mutex> guard(lock_); AKU_UNUSED(guard);
+        auto it = series_.find(id);
+        if (it == series_.end()) {
+            return result;
+        }
+        series = std::move(it->second);
+        series_.erase(it);
+    }
+    auto raw = series->raw.lock();
+    if (raw) {
+        raw->set_commit_callback(NBTreeExtentsList::CommitCallback());
+    }
+    std::lock_guard<std::mutex> guard(series->lock); AKU_UNUSED(guard);
+    for (auto& level: series->levels) {
+        result.push_back(level.tree->close());
+    }
+    return result;
+}
+
+std::shared_ptr<RollupEngine::Series> RollupEngine::find(aku_ParamId id) const {
+    std::lock_guard<std::mutex> guard(lock_); AKU_UNUSED(guard);
+    auto it = series_.find(id);
+    if (it == series_.end()) {
+        return std::shared_ptr<Series>();
+    }
+    return it->second;
+}
+
+void RollupEngine::update(Series& series, NBTreeLeaf const& leaf) {
+    std::vector<aku_Timestamp> ts;
+    std::vector<double> xs;
+    aku_Status status = leaf.read_all(&ts, &xs);
+    if (status != AKU_SUCCESS) {
+        Logger::msg(AKU_LOG_ERROR, "Can't update rollup, leaf read error: " + StatusUtil::str(status));
+        return;
+    }
+    std::lock_guard<std::mutex> guard(series.lock); AKU_UNUSED(guard);
+    for (auto& level: series.levels) {
+        for (size_t j = 0; j < ts.size(); j++) {
+            add(level, ts[j], xs[j]);
+        }
+    }
+}
+
+void RollupEngine::on_commit(NBTreeLeaf const& leaf) {
+    auto series = find(leaf.get_id());
+    if (series) {
+        update(*series, leaf);
+    }
+}
+
+aku_Timestamp RollupEngine::match_resolution(aku_Timestamp step) const {
+    for (auto it = resolutions_.rbegin(); it != resolutions_.rend(); it++) {
+        if (step >= *it && step % *it == 0) {
+            return *it;
+        }
+    }
+    return 0;
+}
+
+aku_Status RollupEngine::aggregate_raw(NBTreeExtentsList const& tree,
+                                       aku_Timestamp begin,
+                                       aku_Timestamp end,
+                                       aku_Timestamp step,
+                                       std::vector<RollupBucket>* out,
+                                       u64* nread)
+{
+    if (begin >= end) {
+        return AKU_SUCCESS;
+    }
+    auto it = tree.search(begin, end);
+    std::vector<aku_Timestamp> ts(READ_BATCH_SIZE);
+    std::vector<double> xs(READ_BATCH_SIZE);
+    while (true) {
+        aku_Status status;
+        size_t sz;
+        std::tie(status, sz) = it->read(ts.data(), xs.data(), READ_BATCH_SIZE);
+        for (size_t i = 0; i < sz; i++) {
+            merge_bucket(out, make_bucket(ts[i] / step * step, xs[i]));
+        }
+        *nread += sz;
+        if (status == AKU_ENO_DATA || (status == AKU_SUCCESS && sz == 0)) {
+            break;
+        } else if (status != AKU_SUCCESS) {
+            return status;
+        }
+    }
+    return AKU_SUCCESS;
+}
+
+aku_Status RollupEngine::aggregate_rollup(NBTreeExtentsList const& tree,
+                                          aku_Timestamp res,
+                                          aku_Timestamp begin,
+                                          aku_Timestamp end,
+                                          aku_Timestamp step,
+                                          std::vector<RollupBucket>* out,
+                                          u64* nread)
+{
+    auto it = tree.search(begin, end);
+    std::vector<aku_Timestamp> ts(READ_BATCH_SIZE);
+    std::vector<double> xs(READ_BATCH_SIZE);
+    RollupBucket row = {};
+    while (true) {
+        aku_Status status;
+        size_t sz;
+        std::tie(status, sz) = it->read(ts.data(), xs.data(), READ_BATCH_SIZE);
+        for (size_t i = 0; i < sz; i++) {
+            switch (ts[i] % res) {
+            case 0:
+                row.begin = ts[i] / step * step;
+                row.count = static_cast<u64>(xs[i]);
+                break;
+            case 1:
+                row.sum = xs[i];
+                break;
+            case 2:
+                row.min = xs[i];
+                break;
+            case 3:
+                row.max = xs[i];
+                break;
+            case 4:
+                row.last = xs[i];
+                merge_bucket(out, row);
+                *nread += 1;
+                break;
+            default:
+                return AKU_EBAD_DATA;
+            }
+        }
+        if (status == AKU_ENO_DATA || (status == AKU_SUCCESS && sz == 0)) {
+            break;
+        } else if (status != AKU_SUCCESS) {
+            return status;
+        }
+    }
+    return AKU_SUCCESS;
+}
+
+aku_Status RollupEngine::group_aggregate(NBTreeExtentsList const& tree,
+                                         aku_Timestamp begin,
+                                         aku_Timestamp end,
+                                         aku_Timestamp step,
+                                         std::vector<RollupBucket>* out,
+                                         u64* nread) const
+{
+    if (begin >= end || step == 0) {
+        return AKU_EBAD_ARG;
+    }
+    u64 dummy = 0;
+    nread = nread ? nread : &dummy;
+    *nread = 0;
+    aku_Timestamp res = match_resolution(step);
+    aku_Status status = AKU_SUCCESS;
+    aku_Timestamp rbegin = begin, rend = begin;
+    auto series = res ? find(tree.get_id()) : std::shared_ptr<Series>();
+    if (series) {
+        std::lock_guard<std::mutex> guard(series->lock); AKU_UNUSED(guard);
+        auto ix = static_cast<size_t>(std::find(resolutions_.begin(), resolutions_.end(), res) - resolutions_.begin());
+        auto const& level = series->levels.at(ix);
+        rbegin = (begin + res - 1) / res * res;
+        rend = std::min(end / res * res, level.watermark);
+        if (rbegin < rend) {
+            // Head should be read before the rollup rows to keep buckets ordered
+            status = aggregate_raw(tree, begin, rbegin, step, out, nread);
+            if (status == AKU_SUCCESS) {
+                status = aggregate_rollup(*level.tree, res, rbegin, rend, step, out, nread);
+            }
+        } else {
+            rend = begin;
+        }
+    }
+    if (status == AKU_SUCCESS) {
+        status = aggregate_raw(tree, rend, end, step, out, nread);
+    }
+    return status;
+}
+
+}
+}  // namespaces
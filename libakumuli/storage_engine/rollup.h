@@ -0,0 +1,174 @@
+/**
+ * Copyright (c) 2016 Eugene Lazin <4lazin@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/** Downsampling rollups.
+  * Outline:
+  *
+  * For each configured resolution (1m and 1h by default) every series gets
+  * its own rollup NBTree. Rollup tree contains one row per time bucket, row
+  * is stored as five consecutive samples:
+  *
+  *   [bucket + 0, count][bucket + 1, sum][bucket + 2, min][bucket + 3, max][bucket + 4, last]
+  *
+  * Rollups are updated incrementally. Engine subscribes to leaf commits of the
+  * raw tree (`NBTreeExtentsList::set_commit_callback`), data from the committed
+  * leaf is added to the open bucket, bucket is written to the rollup tree when
+  * the first sample of the next bucket arrives. Everything before the watermark
+  * (end of the last written bucket) is available in the rollup tree, everything
+  * after it should be read from the raw tree. Every series has its own lock, commits
+  * of different series are processed concurrently.
+  *
+  * Group-by-time queries with a step that is a multiple of the resolution are
+  * served from the rollup tree, only the head and the tail of the range (parts that
+  * are not aligned to the resolution or newer than watermark) are read from the raw tree.
+  */
+
+#pragma once
+// C++ headers
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// App headers
+#include "nbtree.h"
+
+namespace Akumuli {
+namespace StorageEngine {
+
+//! Aggregates of the time bucket
+struct RollupBucket {
+    aku_Timestamp begin;  //< Bucket start (aligned to step)
+    u64           count;
+    double        sum;
+    double        min;
+    double        max;
+    double        last;   //< Value of the newest sample in the bucket
+};
+
+
+class RollupEngine {
+public:
+    enum {
+        NFIELDS = 5,  //< Samples per rollup row
+    };
+
+    //! Default resolutions (1 minute and 1 hour)
+    static const aku_Timestamp MINUTE = 60000000000ull;
+    static const aku_Timestamp HOUR   = 60*MINUTE;
+
+private:
+    //! Rollup state of the series for one resolution
+    struct Level {
+        std::shared_ptr<NBTreeExtentsList> tree;
+        aku_Timestamp res;        //< Resolution of the level
+        aku_Timestamp watermark;  //< Everything before this timestamp is in `tree`
+        RollupBucket  open;       //< Bucket that is not written yet (valid if count != 0)
+        aku_Timestamp next;       //< Samples older than this are already added
+    };
+
+    //! Rollup state of the series
+    struct Series {
+        std::mutex                       lock;    //< Protects `levels`
+        std::vector<Level>               levels;  //< One level per resolution
+        std::weak_ptr<NBTreeExtentsList> raw;     //< Raw tree (commit callback owner)
+    };
+
+    std::shared_ptr<BlockStore>       bstore_;
+    const std::vector<aku_Timestamp>  resolutions_;  //< Sorted (finest first)
+    mutable std::mutex                lock_;         //< Protects `series_` (but not its content)
+    std::unordered_map<aku_ParamId, std::shared_ptr<Series>> series_;
+
+    //! Add sample to the rollup level (should be called under series lock)
+    static void add(Level& level, aku_Timestamp ts, double value);
+
+    //! Add content of the committed leaf to the rollup levels of the series
+    static void update(Series& series, NBTreeLeaf const& leaf);
+
+    //! Find series state, returns empty pointer if series is not attached
+    std::shared_ptr<Series> find(aku_ParamId id) const;
+
+    //! Aggregate raw data in [begin, end) range
+    static aku_Status aggregate_raw(NBTreeExtentsList const& tree,
+                                    aku_Timestamp begin,
+                                    aku_Timestamp end,
+                                    aku_Timestamp step,
+                                    std::vector<RollupBucket>* out,
+                                    u64* nread);
+
+    //! Aggregate rollup rows in [begin, end) range, range should be aligned to resolution
+    static aku_Status aggregate_rollup(NBTreeExtentsList const& tree,
+                                       aku_Timestamp res,
+                                       aku_Timestamp begin,
+                                       aku_Timestamp end,
+                                       aku_Timestamp step,
+                                       std::vector<RollupBucket>* out,
+                                       u64* nread);
+
+public:
+    /** C-tor.
+      * @param bstore Block-store for rollup trees.
+      * @param resolutions List of resolutions (bucket widths).
+      */
+    RollupEngine(std::shared_ptr<BlockStore> bstore,
+                 std::vector<aku_Timestamp> resolutions = { MINUTE, HOUR });
+
+    RollupEngine(RollupEngine const&) = delete;
+    RollupEngine& operator = (RollupEngine const&) = delete;
+
+    /** Start maintaining rollups for the tree. Installs commit callback, callback
+      * doesn't reference the engine so the tree can outlive it (callback becomes no-op).
+      * Data that was written to the tree after the last rollup row is re-read
+      * to restore the open buckets.
+      * @param tree Raw series tree.
+      * @param roots Roots of the rollup trees (one list per resolution) returned
+      *        by `close` or empty list.
+      */
+    void attach(std::shared_ptr<NBTreeExtentsList> tree,
+                std::vector<std::vector<LogicAddr>> const& roots = std::vector<std::vector<LogicAddr>>());
+
+    /** Close rollup trees of the series. Should be called after the raw
+      * tree was closed, removes commit callback of the raw tree. Open buckets
+      * are not saved, they're restored from the raw tree by `attach`.
+      * @return roots of the rollup trees (one list per resolution).
+      */
+    std::vector<std::vector<LogicAddr>> close(aku_ParamId id);
+
+    //! Commit callback (installed by `attach`)
+    void on_commit(NBTreeLeaf const& leaf);
+
+    /** Find resolution that can serve group-by-time query.
+      * @return largest resolution that divides `step` or 0 if there is no such resolution.
+      */
+    aku_Timestamp match_resolution(aku_Timestamp step) const;
+
+    /** Group-by-time aggregation query, [begin, end) forward scan.
+      * @param tree Raw series tree (attached to this engine).
+      * @param step Bucket width, output buckets are aligned to step.
+      * @param out Output buckets, only non-empty buckets are returned.
+      * @param nread If not null, receives number of data points that was read
+      *        (rollup rows and raw samples).
+      */
+    aku_Status group_aggregate(NBTreeExtentsList const& tree,
+                               aku_Timestamp begin,
+                               aku_Timestamp end,
+                               aku_Timestamp step,
+                               std::vector<RollupBucket>* out,
+                               u64* nread = nullptr) const;
+};
+
+}
+}  // namespaces
@@ -85,6 +85,11 @@ struct VolumeRef {
     u32 nblocks;
     u32 capacity;
     u32 generation;
+    u32 block_size;  //< Data block size (zero in old records)
+    u32 fanout;      //< NBTree fan-out (zero in old records)
+    u32 pad;
+    aku_Timestamp last_ts;    //< Largest timestamp of the data in the volume
+    aku_Timestamp retention;  //< Retention period (same in all records)
 };
 
 MetaVolume::MetaVolume(const char *path)
@@ -100,7 +105,22 @@ size_t MetaVolume::get_nvolumes() const {
     return file_size_/AKU_BLOCK_SIZE;
 }
 
-void MetaVolume::create_new(const char* path, size_t capacity, const u32 *vol_capacities) {
+u32 MetaVolume::get_block_size() const {
+    auto pvol = reinterpret_cast<VolumeRef const*>(double_write_buffer_.data());
+    return pvol->block_size ? pvol->block_size : static_cast<u32>(AKU_BLOCK_SIZE);
+}
+
+u32 MetaVolume::get_fanout() const {
+    auto pvol = reinterpret_cast<VolumeRef const*>(double_write_buffer_.data());
+    return pvol->fanout ? pvol->fanout : static_cast<u32>(AKU_NBTREE_FANOUT);
+}
+
+void MetaVolume::create_new(const char* path,
+                            size_t capacity,
+                            const u32 *vol_capacities,
+                            u32 block_size,
+                            u32 fanout)
+{
     size_t size = capacity * AKU_BLOCK_SIZE;
     _create_file(path, size);
     MemoryMappedFile mmap(path, false);
@@ -115,6 +135,10 @@ void MetaVolume::create_new(const char* path, size_t capacity, const u32 *vol_ca
         pvolume->id = id;
         pvolume->nblocks = 0;
         pvolume->version = AKUMULI_VERSION;
+        pvolume->block_size = block_size;
+        pvolume->fanout = fanout;
+        pvolume->last_ts = 0;
+        pvolume->retention = 0;
         it += AKU_BLOCK_SIZE;
         id++;
     }
@@ -162,6 +186,19 @@ std::tuple<aku_Status, u32> MetaVolume::get_generation(u32 id) const {
     return std::make_tuple(AKU_EBAD_ARG, 0u);
 }
 
+std::tuple<aku_Status, aku_Timestamp> MetaVolume::get_last_timestamp(u32 id) const {
+    if (id < file_size_/AKU_BLOCK_SIZE) {
+        auto pvol = get_volref(double_write_buffer_.data(), id);
+        aku_Timestamp ts = pvol->last_ts;
+        return std::make_tuple(AKU_SUCCESS, ts);
+    }
+    return std::make_tuple(AKU_EBAD_ARG, 0ull);
+}
+
+aku_Timestamp MetaVolume::get_retention() const {
+    return get_volref(double_write_buffer_.data(), 0)->retention;
+}
+
 aku_Status MetaVolume::update(u32 id, u32 nblocks, u32 capacity, u32 gen) {
     if (id < file_size_/AKU_BLOCK_SIZE) {
         auto pvol = get_volref(double_write_buffer_.data(), id);
@@ -200,6 +237,21 @@ aku_Status MetaVolume::set_generation(u32 id, u32 gen) {
     return AKU_EBAD_ARG;  // id out of range
 }
 
+aku_Status MetaVolume::set_last_timestamp(u32 id, aku_Timestamp ts) {
+    if (id < file_size_/AKU_BLOCK_SIZE) {
+        auto pvol = get_volref(double_write_buffer_.data(), id);
+        pvol->last_ts = ts;
+        return AKU_SUCCESS;
+    }
+    return AKU_EBAD_ARG;  // id out of range
+}
+
+void MetaVolume::set_retention(aku_Timestamp retention) {
+    for (u32 id = 0; id < file_size_/AKU_BLOCK_SIZE; id++) {
+        get_volref(double_write_buffer_.data(), id)->retention = retention;
+    }
+}
+
 void MetaVolume::flush() {
     memcpy(mmap_ptr_, double_write_buffer_.data(), mmap_.get_size());
     auto status = mmap_.flush();
@@ -220,10 +272,11 @@ aku_Status MetaVolume::flush(u32 id) {
 
 //--------------------------- Volume -----------------------------------//
 
-Volume::Volume(const char* path, size_t write_pos)
+Volume::Volume(const char* path, size_t write_pos, u32 block_size)
     : apr_pool_(_make_apr_pool())
     , apr_file_handle_(_open_file(path, apr_pool_.get()))
-    , file_size_(static_cast<u32>(_get_file_size(apr_file_handle_.get())/AKU_BLOCK_SIZE))
+    , block_size_(block_size)
+    , file_size_(static_cast<u32>(_get_file_size(apr_file_handle_.get())/block_size))
     , write_pos_(static_cast<u32>(write_pos))
 {
 }
@@ -232,27 +285,28 @@ void Volume::reset() {
     write_pos_ = 0;
 }
 
-void Volume::create_new(const char* path, size_t capacity) {
-    auto size = capacity * AKU_BLOCK_SIZE;
+void Volume::create_new(const char* path, size_t capacity, u32 block_size) {
+    auto size = static_cast<u64>(capacity) * block_size;
     _create_file(path, size);
 }
 
-std::unique_ptr<Volume> Volume::open_existing(const char* path, size_t pos) {
+std::unique_ptr<Volume> Volume::open_existing(const char* path, size_t pos, u32 block_size) {
     std::unique_ptr<Volume> result;
-    result.reset(new Volume(path, pos));
+    result.reset(new Volume(path, pos, block_size));
     return std::move(result);
 }
 
-//! Append block to file (source size should be 4 at least BLOCK_SIZE)
+//! Append block to file (source size should be at least block size)
 std::tuple<aku_Status, BlockAddr> Volume::append_block(const u8* source) {
     if (write_pos_ >= file_size_) {
         return std::make_tuple(AKU_EOVERFLOW, 0u);
     }
-    apr_off_t seek_off = write_pos_ * AKU_BLOCK_SIZE;
+    std::lock_guard<std::mutex> guard(io_lock_); AKU_UNUSED(guard);
+    apr_off_t seek_off = static_cast<apr_off_t>(write_pos_) * block_size_;
     apr_status_t status = apr_file_seek(apr_file_handle_.get(), APR_SET, &seek_off);
     panic_on_error(status, "Volume seek error");
     apr_size_t bytes_written = 0;
-    status = apr_file_write_full(apr_file_handle_.get(), source, AKU_BLOCK_SIZE, &bytes_written);
+    status = apr_file_write_full(apr_file_handle_.get(), source, block_size_, &bytes_written);
     panic_on_error(status, "Volume write error");
     auto result = write_pos_++;
     return std::make_tuple(AKU_SUCCESS, result);
@@ -263,11 +317,12 @@ aku_Status Volume::read_block(u32 ix, u8* dest) const {
     if (ix >= write_pos_) {
         return AKU_EBAD_ARG;
     }
-    apr_off_t offset = ix * AKU_BLOCK_SIZE;
+    std::lock_guard<std::mutex> guard(io_lock_); AKU_UNUSED(guard);
+    apr_off_t offset = static_cast<apr_off_t>(ix) * block_size_;
     apr_status_t status = apr_file_seek(apr_file_handle_.get(), APR_SET, &offset);
     panic_on_error(status, "Volume seek error");
     apr_size_t outsize = 0;
-    status = apr_file_read_full(apr_file_handle_.get(), dest, AKU_BLOCK_SIZE, &outsize);
+    status = apr_file_read_full(apr_file_handle_.get(), dest, block_size_, &outsize);
     panic_on_error(status, "Volume read error");
     return AKU_SUCCESS;
 }
@@ -281,4 +336,8 @@ u32 Volume::get_size() const {
     return file_size_;
 }
 
+u32 Volume::get_block_size() const {
+    return block_size_;
+}
+
 }}  // namespace
@@ -20,6 +20,7 @@
 #include <cstdint>
 #include <future>
 #include <memory>
+#include <mutex>
 
 // libraries
 #include <apr.h>
@@ -35,7 +36,20 @@ namespace StorageEngine {
 
 //! Address of the block inside volume (index of the block)
 typedef u32 BlockAddr;
-enum { AKU_BLOCK_SIZE = 4096 };
+enum {
+    AKU_BLOCK_SIZE       = 4096,     //< Default block size (and size of the meta-volume record)
+    AKU_MAX_BLOCK_SIZE   = 0x10000,  //< Largest block size (leaf payload size should fit in u16)
+    AKU_NBTREE_FANOUT    = 32,       //< Default NBTree fan-out
+    AKU_SUBTREE_REF_SIZE = 76,       //< Size of the NBTree node reference (`SubtreeRef`)
+};
+
+/** Largest NBTree fan-out for the block size. Superblock contains its own
+  * header followed by `fanout` node references, everything should fit into
+  * a single block.
+  */
+inline u32 max_nbtree_fanout(u32 block_size) {
+    return block_size/AKU_SUBTREE_REF_SIZE - 1;
+}
 
 typedef std::unique_ptr<apr_pool_t, void (*)(apr_pool_t*)> AprPoolPtr;
 typedef std::unique_ptr<apr_file_t, void (*)(apr_file_t*)> AprFilePtr;
@@ -49,6 +63,14 @@ typedef std::unique_ptr<apr_file_t, void (*)(apr_file_t*)> AprFilePtr;
   * 4KB and sector writes are atomic (each write less or equal to 4K will be
   * fully written to disk or not, FS checksum failure is a hardware bug, not
   * a result of the partial sector write).
+  *
+  * Block size and NBTree fan-out are chosen when the database is created and
+  * can't be changed afterwards. Both values are stored in every record. Records
+  * created by the older versions contain zeroes in these fields, default values
+  * are used in this case.
+  *
+  * Each record also stores the largest timestamp of the data written to the
+  * volume. Retention uses it to find volumes that contain only expired data.
   */
 class MetaVolume {
     MemoryMappedFile        mmap_;
@@ -63,9 +85,15 @@ public:
       * @param path Path to created file.
       * @param capacity Size of the created file (in blocks).
       * @param vol_capacities Array of capacities of all volumes.
+      * @param block_size Size of the data block in bytes.
+      * @param fanout NBTree fan-out.
       * @throw std::runtime_exception
       */
-    static void create_new(const char* path, size_t capacity, u32 const* vol_capacities);
+    static void create_new(const char* path,
+                           size_t capacity,
+                           u32 const* vol_capacities,
+                           u32 block_size = AKU_BLOCK_SIZE,
+                           u32 fanout = AKU_NBTREE_FANOUT);
 
     /** Open existing meta-volume.
       * @param path Path to meta-volume.
@@ -87,6 +115,18 @@ public:
 
     size_t get_nvolumes() const;
 
+    //! Get size of the data block (same for all volumes).
+    u32 get_block_size() const;
+
+    //! Get NBTree fan-out.
+    u32 get_fanout() const;
+
+    //! Get largest timestamp of the data stored in the volume.
+    std::tuple<aku_Status, aku_Timestamp> get_last_timestamp(u32 id) const;
+
+    //! Get retention period (0 means that retention is disabled).
+    aku_Timestamp get_retention() const;
+
     // Mutators
 
     aku_Status update(u32 id, u32 nblocks, u32 capacity, u32 gen);
@@ -100,6 +140,12 @@ public:
     //! Set generation
     aku_Status set_generation(u32 id, u32 nblocks);
 
+    //! Set largest timestamp of the data stored in the volume
+    aku_Status set_last_timestamp(u32 id, aku_Timestamp ts);
+
+    //! Set retention period
+    void set_retention(aku_Timestamp retention);
+
     //! Flush entire file
     void flush();
 
@@ -111,32 +157,37 @@ public:
 class Volume {
     AprPoolPtr apr_pool_;
     AprFilePtr apr_file_handle_;
+    u32        block_size_;
     u32        file_size_;
     u32        write_pos_;
+    //! Serializes seek+read/write pairs (volume can be read from many threads).
+    mutable std::mutex io_lock_;
 
-    Volume(const char* path, size_t write_pos);
+    Volume(const char* path, size_t write_pos, u32 block_size);
 
 public:
     /** Create new volume.
       * @param path Path to volume.
       * @param capacity Size of the volume in blocks.
+      * @param block_size Size of the block in bytes.
       * @throw std::runtime_exception on error.
       */
-    static void create_new(const char* path, size_t capacity);
+    static void create_new(const char* path, size_t capacity, u32 block_size = AKU_BLOCK_SIZE);
 
     /** Open volume.
       * @throw std::runtime_error on error.
       * @param path Path to volume file.
       * @param pos Write position inside volume (in blocks).
+      * @param block_size Size of the block in bytes.
       * @return New instance of V2::Volume.
       */
-    static std::unique_ptr<Volume> open_existing(const char* path, size_t pos);
+    static std::unique_ptr<Volume> open_existing(const char* path, size_t pos, u32 block_size = AKU_BLOCK_SIZE);
 
     // Mutators
 
     void reset();
 
-    //! Append block to file (source size should be 4 at least BLOCK_SIZE)
+    //! Append block to file (source size should be at least block size)
     std::tuple<aku_Status, BlockAddr> append_block(const u8* source);
 
     //! Flush volume
@@ -149,6 +200,9 @@ public:
 
     //! Return size in blocks
     u32 get_size() const;
+
+    //! Return block size in bytes
+    u32 get_block_size() const;
 };
 
 }  // namespace V2
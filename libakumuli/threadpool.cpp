@@ -0,0 +1,128 @@
+/**
+ * Copyright (c) 2016 Eugene Lazin <4lazin@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "threadpool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+
+namespace Akumuli {
+
+ThreadPool::ThreadPool(u32 nthreads)
+    : stop_(false)
+{
+    if (nthreads == 0) {
+        nthreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (u32 i = 0; i < nthreads; i++) {
+        workers_.emplace_back(&ThreadPool::worker, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        stop_ = true;
+    }
+    cond_.notify_all();
+    for (auto& th: workers_) {
+        th.join();
+    }
+}
+
+u32 ThreadPool::size() const {
+    return static_cast<u32>(workers_.size());
+}
+
+void ThreadPool::worker() {
+    while (true) {
+        std::packaged_task<void()> task;
+        {
+            std::unique_lock<std::mutex> guard(lock_);
+            cond_.wait(guard, [this] { return stop_ || !queue_.empty(); });
+            if (queue_.empty()) {
+                // Stop only when all submitted tasks are done
+                return;
+            }
+            task = std::move(queue_.front());
+            queue_.pop_front();
+        }
+        task();
+    }
+}
+
+std::future<void> ThreadPool::submit(std::function<void()> fn) {
+    std::packaged_task<void()> task(std::move(fn));
+    auto future = task.get_future();
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        queue_.push_back(std::move(task));
+    }
+    cond_.notify_one();
+    return future;
+}
+
+void ThreadPool::parallel_for(size_t n, std::function<void(size_t)> const& fn) {
+    // State is shared with helper tasks that can start after this function
+    // returns (if all workers were busy), these tasks will find that nothing
+    // left to do and won't touch `fn`.
+    struct State {
+        std::atomic<size_t>     next;
+        std::mutex              lock;
+        std::condition_variable cond;
+        size_t                  ndone;
+        std::exception_ptr      error;
+    };
+    auto state = std::make_shared<State>();
+    state->next = 0;
+    state->ndone = 0;
+    auto work = [state, n, &fn]() {
+        while (true) {
+            size_t ix = state->next.fetch_add(1);
+            if (ix >= n) {
+                return;
+            }
+            std::exception_ptr error;
+            try {
+                fn(ix);
+            } catch (...) {
+                error = std::current_exception();
+            }
+            std::lock_guard<std::mutex> guard(state->lock);
+            if (error && !state->error) {
+                state->error = error;
+            }
+            if (++state->ndone == n) {
+                state->cond.notify_all();
+            }
+        }
+    };
+    size_t nhelpers = std::min(static_cast<size_t>(size()), n ? n - 1 : 0);
+    for (size_t i = 0; i < nhelpers; i++) {
+        submit(work);
+    }
+    work();
+    std::unique_lock<std::mutex> guard(state->lock);
+    state->cond.wait(guard, [&] { return state->ndone == n; });
+    if (state->error) {
+        std::rethrow_exception(state->error);
+    }
+}
+
+}  // namespace
@@ -0,0 +1,74 @@
+/**
+ * Copyright (c) 2016 Eugene Lazin <4lazin@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "akumuli_def.h"
+
+namespace Akumuli {
+
+/** Fixed size pool of long-lived worker threads.
+  * Should be created once and shared by all components that need to run
+  * something in background, this way number of threads doesn't grow with
+  * number of volumes, sequencers or concurrent queries.
+  */
+class ThreadPool {
+    std::mutex                             lock_;
+    std::condition_variable                cond_;
+    std::deque<std::packaged_task<void()>> queue_;
+    bool                                   stop_;
+    std::vector<std::thread>               workers_;
+
+    void worker();
+public:
+    /** C-tor.
+      * @param nthreads Number of worker threads, 0 - use number of hardware threads.
+      */
+    ThreadPool(u32 nthreads = 0);
+
+    //! Waits for all submitted tasks and stops worker threads
+    ~ThreadPool();
+
+    ThreadPool(ThreadPool const&) = delete;
+    ThreadPool& operator = (ThreadPool const&) = delete;
+
+    //! Number of worker threads
+    u32 size() const;
+
+    /** Run task on one of the worker threads.
+      * @return future that becomes ready when task completes (exception thrown
+      *         by the task is rethrown by `future::get`)
+      */
+    std::future<void> submit(std::function<void()> task);
+
+    /** Call `fn(ix)` for each index in [0, n) and wait for completion.
+      * Caller's thread takes part in processing, so this function can be
+      * called from the worker thread of the same pool without deadlock (in
+      * the worst case all indexes will be processed by the caller). First
+      * exception thrown by `fn` is rethrown after all indexes are processed.
+      */
+    void parallel_for(size_t n, std::function<void(size_t)> const& fn);
+};
+
+}  // namespace
@@ -3,6 +3,17 @@
 
 using namespace Akumuli;
 
+//! Parse all strings N times, returns elapsed time
+static double run(const char** test_strings, int nstrings, aku_Timestamp* tsacc) {
+    PerfTimer timer;
+    for(int k = 100000; k --> 0;) {
+        for(int i = nstrings; i --> 0;) {
+            *tsacc += DateTimeUtil::from_iso_string(test_strings[i]);
+        }
+    }
+    return timer.elapsed();
+}
+
 int main() {
 
     const char* test_strings[] = {
@@ -17,15 +28,28 @@ int main() {
         "20060902T180403.111111111",
         "20061002T190404.000000000"
     };
+    // Dates before epoch are not handled by the fast path
+    const char* fallback_strings[] = {
+        "19600102T100405.999999999",
+        "19600202T110406.888888888",
+        "19600302T120407.777777777",
+        "19600402T130408.666666666",
+        "19600502T140409.555555555",
+        "19600602T150400.444444444",
+        "19600702T160401.333333333",
+        "19600802T170402.222222222",
+        "19600902T180403.111111111",
+        "19601002T190404.000000000"
+    };
     aku_Timestamp tsacc = 0;
-    PerfTimer timer;
-    for(int k = 100000; k --> 0;) {
-        for(int i = 10; i --> 0;) {
-            tsacc += DateTimeUtil::from_iso_string(test_strings[i]);
-        }
-    }
-    double elapsed = timer.elapsed();
+    double elapsed = run(test_strings, 10, &tsacc);
     std::cout << "Summ: " << tsacc << std::endl;
     std::cout << "Elapsed: " << elapsed << std::endl;
+
+    tsacc = 0;
+    double fallback = run(fallback_strings, 10, &tsacc);
+    std::cout << "Summ (generic parser): " << tsacc << std::endl;
+    std::cout << "Elapsed (generic parser): " << fallback << std::endl;
+    std::cout << "Speedup: " << fallback/elapsed << "x" << std::endl;
     return 0;
 }
@@ -1,5 +1,14 @@
+/**
+ * NBTree write/read benchmark. Measures append and scan speed for different
+ * block sizes and fan-outs.
+ *
+ * Usage:
+ *   perf_nbtree                              - run all predefined configurations
+ *   perf_nbtree <block_size> <fanout> [N]    - run single configuration
+ */
 // C++ headers
 #include <iostream>
+#include <iomanip>
 #include <vector>
 
 // Lib headers
@@ -29,26 +38,38 @@ private:
     timeval _start_time;
 };
 
-int main() {
-    apr_initialize();
+//! Results of the single run
+struct RunStats {
+    u32    block_size;
+    u32    fanout;
+    double write_time;    //< Total append time
+    double scan_time;     //< Full scan of all sampled series
+    double commit_time;   //< Time spent in `close`
+    size_t nleafs;        //< Number of committed leaf nodes
+    size_t height;        //< Max number of extents (tree height)
+    size_t nscanned;      //< Number of samples read during scan
+};
+
+static const u64 VOLUME_SIZE = 4ull*1024*1024*1024;  // 4GB per volume
 
-    // Create volumes
+static RunStats run(u32 block_size, u32 fanout, int N, int numids) {
+    // Create volumes, volume size doesn't depend on block size
     std::string metapath = "/tmp/metavol.db";
     std::vector<std::string> paths = {
         "/tmp/volume0.db",
         "/tmp/volume1.db",
     };
+    u32 capacity = static_cast<u32>(VOLUME_SIZE/block_size);
     std::vector<std::tuple<u32, std::string>> volumes {
-        std::make_tuple(1024*1024, paths[0]),
-        std::make_tuple(1024*1024, paths[1])
+        std::make_tuple(capacity, paths[0]),
+        std::make_tuple(capacity, paths[1])
     };
 
-    FixedSizeFileStorage::create(metapath, volumes);
+    FixedSizeFileStorage::create(metapath, volumes, block_size, fanout);
 
     auto bstore = FixedSizeFileStorage::open(metapath, paths);
 
     std::vector<std::shared_ptr<NBTreeExtentsList>> trees;
-    const int numids = 10000;
     for (int i = 0; i < numids; i++) {
         auto id = static_cast<aku_ParamId>(i);
         std::vector<LogicAddr> empty;
@@ -56,12 +77,15 @@ int main() {
         trees.push_back(std::move(ext));
     }
 
-    const int N = 500000000;
+    RunStats stats = {};
+    stats.block_size = block_size;
+    stats.fanout = fanout;
+
+    std::cout << "Block size: " << block_size << ", fan-out: " << fanout << std::endl;
 
     Timer tm;
     Timer total;
     size_t rr = 0;
-    size_t flush = 0;
     size_t nsamples = 0;
     std::vector<aku_ParamId> ids;
     for (int i = 1; i < (N+1); i++) {
@@ -72,11 +96,7 @@ int main() {
         }
         aku_ParamId id = rr++ % trees.size();
         if (trees[id]->append(ts, value)) {
-            flush++;
-            if (flush % trees.size() == 0) {
-                //std::cout << "About to call flush" << std::endl;
-                //bstore->flush();
-            }
+            stats.nleafs++;
         }
         if (nsamples < 10) {
             ids.push_back(id);
@@ -87,40 +107,100 @@ int main() {
             }
         }
         nsamples++;
-        if (i % 1000000 == 0) {
+        if (i % 10000000 == 0) {
             std::cout << i << "\t" << tm.elapsed() << " sec" << std::endl;
             tm.restart();
         }
     }
+    stats.write_time = total.elapsed();
 
-    std::cout << "Write time: " << total.elapsed() << "s" << std::endl;
+    std::cout << "Write time: " << stats.write_time << "s" << std::endl;
 
+    for (auto const& tree: trees) {
+        stats.height = std::max(stats.height, tree->get_roots().size());
+    }
+
+    total.restart();
     for (auto id: ids) {
-        total.restart();
-        auto it = trees[id]->search(N+1, 0);
+        auto it = trees[id]->search(static_cast<aku_Timestamp>(N+1), 0);
         double sum = 0;
-        size_t total_sum = 0;
         aku_Status status = AKU_SUCCESS;
         std::vector<aku_Timestamp> ts(0x1000, 0);
         std::vector<double> xs(0x1000, 0.0);
         while(status == AKU_SUCCESS) {
             size_t sz;
             std::tie(status, sz) = it->read(ts.data(), xs.data(), 0x1000);
-            total_sum += sz;
+            stats.nscanned += sz;
             for (size_t i = 0; i < sz; i++) {
                 sum += xs[i];
             }
         }
-        std::cout << "From id: " << id << " n: " << total_sum << " sum: "
-                  << sum << " calculated in " << total.elapsed() << "s" << std::endl;
+        if (sum < 0) {
+            std::cout << "Invalid sum " << sum << std::endl;  // prevents dead code elimination
+        }
     }
+    stats.scan_time = total.elapsed();
+
+    std::cout << "Scan time: " << stats.scan_time << "s" << std::endl;
 
     total.restart();
     for (size_t i = 0; i < trees.size(); i++) {
         trees[i]->close();
     }
+    stats.commit_time = total.elapsed();
+
+    std::cout << "Commit time: " << stats.commit_time << "s" << std::endl;
+
+    return stats;
+}
+
+static void print_summary(std::vector<RunStats> const& results, int N) {
+    std::cout << std::endl;
+    std::cout << std::setw(10) << "block"
+              << std::setw(8)  << "fanout"
+              << std::setw(8)  << "height"
+              << std::setw(14) << "writes/sec"
+              << std::setw(14) << "reads/sec"
+              << std::setw(12) << "commit(s)"
+              << std::setw(14) << "bytes/sample" << std::endl;
+    for (auto const& r: results) {
+        double bytes = static_cast<double>(r.nleafs)*r.block_size;
+        std::cout << std::setw(10) << r.block_size
+                  << std::setw(8)  << r.fanout
+                  << std::setw(8)  << r.height
+                  << std::setw(14) << static_cast<u64>(N/r.write_time)
+                  << std::setw(14) << static_cast<u64>(r.nscanned/r.scan_time)
+                  << std::setw(12) << r.commit_time
+                  << std::setw(14) << bytes/N << std::endl;
+    }
+}
+
+int main(int argc, char** argv) {
+    apr_initialize();
 
-    std::cout << "Commit time: " << total.elapsed() << "s" << std::endl;
+    const int numids = 10000;
+    int N = 100000000;
+    std::vector<std::pair<u32, u32>> configs = {
+        { 0x1000,  32 },
+        { 0x1000,  52 },
+        { 0x4000,  32 },
+        { 0x4000,  128 },
+        { 0x10000, 128 },
+        { 0x10000, 512 },
+    };
+    if (argc >= 3) {
+        configs = {
+            { static_cast<u32>(std::stoul(argv[1])), static_cast<u32>(std::stoul(argv[2])) }
+        };
+        if (argc == 4) {
+            N = std::stoi(argv[3]);
+        }
+    }
 
+    std::vector<RunStats> results;
+    for (auto cfg: configs) {
+        results.push_back(run(cfg.first, cfg.second, N, numids));
+    }
+    print_summary(results, N);
     return 0;
 }
@@ -0,0 +1,78 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "numparser.h"
+#include "perftest_tools.h"
+
+using namespace Akumuli;
+
+//! Generate values that looks like typical metrics
+static std::vector<std::string> generate_values(size_t n) {
+    std::mt19937 rng(42);
+    std::vector<std::string> result;
+    char buffer[64];
+    for (size_t i = 0; i < n; i++) {
+        switch (i % 4) {
+        case 0:  // counter
+            snprintf(buffer, sizeof(buffer), "%u", static_cast<unsigned>(rng() % 10000000u));
+            break;
+        case 1:  // percentage
+            snprintf(buffer, sizeof(buffer), "%.2f", (rng() % 10000u) / 100.0);
+            break;
+        case 2:  // gauge with more precision
+            snprintf(buffer, sizeof(buffer), "%.6f", (rng() % 100000000u) / 1000.0);
+            break;
+        case 3:  // large value in scientific notation
+            snprintf(buffer, sizeof(buffer), "%.9e", rng() * 1.0e3);
+            break;
+        }
+        result.push_back(std::string(buffer) + "\r\n");
+    }
+    return result;
+}
+
+int main() {
+    auto values = generate_values(1000);
+    const int N = 1000;
+
+    double acc = 0;
+    PerfTimer timer;
+    for (int k = 0; k < N; k++) {
+        for (auto const& v: values) {
+            acc += strtod(v.data(), nullptr);
+        }
+    }
+    double strtod_elapsed = timer.elapsed();
+    std::cout << "strtod sum: " << acc << std::endl;
+    std::cout << "strtod elapsed: " << strtod_elapsed << std::endl;
+
+    acc = 0;
+    timer.restart();
+    for (int k = 0; k < N; k++) {
+        for (auto const& v: values) {
+            double x;
+            NumParser::parse_double(v.data(), v.data() + v.size() - 2, &x);
+            acc += x;
+        }
+    }
+    double elapsed = timer.elapsed();
+    std::cout << "NumParser sum: " << acc << std::endl;
+    std::cout << "NumParser elapsed: " << elapsed << std::endl;
+    std::cout << "Speedup: " << strtod_elapsed/elapsed << "x" << std::endl;
+
+    // Results should be identical
+    for (auto const& v: values) {
+        double x;
+        NumParser::parse_double(v.data(), v.data() + v.size() - 2, &x);
+        if (x != strtod(v.data(), nullptr)) {
+            std::cout << "Error: " << v << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -3,6 +3,7 @@
  * ingestion pipeline component:
  *
  * - PipelineSpout speed compared to the baseline.
+ * - Multi-writer pipeline throughput (1, 2, 4... writers).
  *
  *
  * Copyright (c) 2014 Eugene Lazin <4lazin@gmail.com>
@@ -26,8 +27,11 @@
 
 #include <boost/lockfree/queue.hpp>
 
+#include <algorithm>
+#include <atomic>
 #include <thread>
 #include <iostream>
+#include <vector>
 
 using namespace Akumuli;
 
@@ -35,9 +39,16 @@ namespace detail {
     bool err_shown = false;
     const static int TAG = 111222333;
     struct ConnectionMock : Akumuli::DbConnection {
-        int cnt;
+        std::atomic<int> cnt;
+        int work = 0;  //< Number of iterations of the busy loop (simulates write cost)
         aku_Status write(const aku_Sample &sample) {
-            if (AKU_LIKELY(sample.paramid == TAG)) {
+            if (work) {
+                volatile u64 acc = sample.timestamp;
+                for (int i = work; i --> 0;) {
+                    acc = acc * 31 + 1;
+                }
+            }
+            if (AKU_LIKELY(sample.paramid >= TAG)) {
                 cnt++;
             } else {
                 if (!err_shown) {
@@ -57,6 +68,11 @@ namespace detail {
         aku_Status series_to_param_id(const char *name, size_t size, aku_Sample *sample) {
             throw "not implemented";
         }
+        void close() {
+        }
+        std::string get_all_stats() {
+            throw "not implemented";
+        }
     };
 };
 
@@ -103,15 +119,26 @@ struct SpoutTest {
         return e;
     }
 
-    static double run_pipeline() {
+    //! Data is sent using `write_batch` if `batch_size` is greater than one
+    static double run_pipeline(int batch_size = 1) {
         using namespace detail;
         std::shared_ptr<ConnectionMock> con = std::make_shared<ConnectionMock>();
         con->cnt = 0;
         auto pipeline = std::make_shared<IngestionPipeline>(con, AKU_LINEAR_BACKOFF);
         auto worker = [&]() {
             auto spout = pipeline->make_spout();
-            for (int i = N_ITERS/2; i --> 0;) {
-                spout->write({(aku_Timestamp)i, (aku_ParamId)detail::TAG});
+            if (batch_size > 1) {
+                std::vector<aku_Sample> batch(batch_size, aku_Sample{0, (aku_ParamId)detail::TAG});
+                for (int i = N_ITERS/2/batch_size; i --> 0;) {
+                    spout->write_batch(batch.data(), batch.size());
+                }
+            } else {
+                for (int i = N_ITERS/2; i --> 0;) {
+                    spout->write({(aku_Timestamp)i, (aku_ParamId)detail::TAG});
+                }
+            }
+            while (!spout->is_empty()) {
+                std::this_thread::yield();
             }
         };
         PerfTimer tm;
@@ -122,7 +149,44 @@ struct SpoutTest {
         workerB.join();
         pipeline->stop();
         double e = tm.elapsed();
-        if (con->cnt != N_ITERS) {
+        int expected = batch_size > 1 ? N_ITERS/2/batch_size*batch_size*2 : N_ITERS;
+        if (con->cnt != expected) {
+            std::cout << "Error in pipeline " << con->cnt << std::endl;
+        }
+        return e;
+    }
+
+    /** Multi-writer pipeline, `nspouts` threads are writing data points of
+      * 1000 different series, each write costs `work` iterations of the busy loop.
+      */
+    static double run_multi_writer(int nworkers, int nspouts, int work) {
+        using namespace detail;
+        std::shared_ptr<ConnectionMock> con = std::make_shared<ConnectionMock>();
+        con->cnt = 0;
+        con->work = work;
+        auto pipeline = std::make_shared<IngestionPipeline>(con, AKU_LINEAR_BACKOFF, nworkers);
+        const int N = N_ITERS/10;
+        auto worker = [&]() {
+            auto spout = pipeline->make_spout();
+            for (int i = N/nspouts; i --> 0;) {
+                spout->write({(aku_Timestamp)i, (aku_ParamId)(detail::TAG + i % 1000)});
+            }
+            while (!spout->is_empty()) {
+                std::this_thread::yield();
+            }
+        };
+        PerfTimer tm;
+        pipeline->start();
+        std::vector<std::thread> threads;
+        for (int i = 0; i < nspouts; i++) {
+            threads.emplace_back(worker);
+        }
+        for (auto& th: threads) {
+            th.join();
+        }
+        pipeline->stop();
+        double e = tm.elapsed();
+        if (con->cnt != N/nspouts*nspouts) {
             std::cout << "Error in pipeline " << con->cnt << std::endl;
         }
         return e;
@@ -138,6 +202,8 @@ int main(int argc, char* argv[]) {
     std::cout << "- pipeline " << e << "s" << std::endl;
     double rel = b/e;
     std::cout << "relative speedup " << rel << std::endl;
+    double eb = SpoutTest::run_pipeline(256);
+    std::cout << "- pipeline (write_batch, 256) " << eb << "s" << std::endl;
     bool push_to_graphite = false;
     if (argc == 2) {
         push_to_graphite = std::string(argv[1]) == "graphite";
@@ -145,4 +211,17 @@ int main(int argc, char* argv[]) {
     if (push_to_graphite) {
         push_metric_to_graphite("pipeline", rel);
     }
+
+    std::cout << "Multi-writer test (" << std::thread::hardware_concurrency() << " CPUs)" << std::endl;
+    int max_writers = std::max(4u, std::thread::hardware_concurrency());
+    double single = 0;
+    for (int nworkers = 1; nworkers <= max_writers; nworkers *= 2) {
+        double t = SpoutTest::run_multi_writer(nworkers, 4, 200);
+        if (nworkers == 1) {
+            single = t;
+        }
+        std::cout << "- " << nworkers << " writer(s) " << t << "s, "
+                  << (SpoutTest::N_ITERS/10)/t/1000000.0 << "M writes/s, speedup "
+                  << single/t << std::endl;
+    }
 }
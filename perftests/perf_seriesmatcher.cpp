@@ -2,6 +2,8 @@
 #include <sstream>
 #include <chrono>
 #include <cstdlib>
+#include <string>
+#include <vector>
 #include <time.h>
 #include <stdio.h>
 
@@ -37,7 +39,39 @@ double PerfTimer::elapsed() const {
            double(curr.tv_nsec - _start_time.tv_nsec)/1000000000.0;
 }
 
+//! Normalize series names, returns number of names per second
+static double normalization_throughput(const char* series_name_fmt) {
+    const int NNAMES = 1000;
+    std::vector<std::string> names;
+    char input[0x1000];
+    for (int i = 0; i < NNAMES; i++) {
+        int n = sprintf(input, series_name_fmt, i, i);
+        names.push_back(std::string(input, input + n));
+    }
+    char output[0x1000];
+    size_t acc = 0;
+    PerfTimer tm;
+    for(int i = 0; i < NELEMENTS; i++) {
+        auto const& name = names[static_cast<size_t>(i % NNAMES)];
+        const char* keystr = nullptr;
+        const char* outend = nullptr;
+        SeriesParser::to_normal_form(name.data(), name.data() + name.size(), output,
+                                     output + name.size() + 1, &keystr, &outend);
+        acc += static_cast<size_t>(outend - output);
+    }
+    double elapsed = tm.elapsed();
+    std::cout << "Normalized " << NELEMENTS << " names (" << acc << " bytes) in "
+              << elapsed << " seconds, " << series_name_fmt << std::endl;
+    return NELEMENTS/elapsed;
+}
+
 int main() {
+    // Normalization throughput (names/sec)
+    double ordered = normalization_throughput("memory host=%d port=%d region=eu-west rack=r1 zone=z1");
+    double unordered = normalization_throughput("memory zone=z1 port=%d host=%d region=eu-west rack=r1");
+    std::cout << "Normalization throughput: " << ordered << " names/sec (tags ordered), "
+              << unordered << " names/sec (tags unordered)" << std::endl;
+
     SeriesMatcher matcher(1ul);
 
     PerfTimer tm;
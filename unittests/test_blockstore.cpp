@@ -126,3 +126,142 @@ BOOST_AUTO_TEST_CASE(Test_blockstore_1) {
     delete_blockstore();
 }
 
+BOOST_AUTO_TEST_CASE(Test_blockstore_retention_no_timestamps) {
+    delete_blockstore();
+    create_blockstore();
+    auto bstore = open_blockstore();
+
+    // Blocks without timestamps (e.g. written by the older version)
+    auto buffer = std::make_shared<Block>();
+    aku_Status status;
+    LogicAddr addr;
+    std::vector<LogicAddr> addrlist;
+    for (int i = 0; i < 10; i++) {
+        std::tie(status, addr) = bstore->append_block(buffer);
+        BOOST_REQUIRE_EQUAL(status, AKU_SUCCESS);
+        addrlist.push_back(addr);
+    }
+    bstore->set_retention(1000000);
+    buffer->set_timestamp(1000000000);
+    std::tie(status, addr) = bstore->append_block(buffer);
+    BOOST_REQUIRE_EQUAL(status, AKU_SUCCESS);
+
+    // Age of the old data is unknown, it shouldn't be reclaimed
+    BOOST_REQUIRE_EQUAL(bstore->get_nreclaimed(), 0);
+    for (auto old: addrlist) {
+        BOOST_REQUIRE(bstore->exists(old));
+    }
+    BOOST_REQUIRE(bstore->exists(addr));
+
+    delete_blockstore();
+}
+
+BOOST_AUTO_TEST_CASE(Test_blockstore_block_size) {
+    delete_blockstore();
+    std::vector<std::tuple<u32, std::string>> vols = {
+        std::make_tuple(CAPACITIES[0], VOLPATH[0]),
+        std::make_tuple(CAPACITIES[1], VOLPATH[1]),
+    };
+    FixedSizeFileStorage::create(METAPATH, vols, 0x4000, 64);
+    auto bstore = open_blockstore();
+    BOOST_REQUIRE_EQUAL(bstore->get_block_size(), 0x4000);
+    BOOST_REQUIRE_EQUAL(bstore->get_fanout(), 64);
+
+    aku_Status status;
+    LogicAddr addr;
+
+    // Block of the wrong size should be rejected
+    auto small = std::make_shared<Block>();
+    std::tie(status, addr) = bstore->append_block(small);
+    BOOST_REQUIRE_EQUAL(status, AKU_EBAD_ARG);
+
+    auto buffer = std::make_shared<Block>(0x4000);
+    for (int i = 0; i < 4; i++) {
+        buffer->get_data()[0] = static_cast<u8>(i);
+        buffer->get_data()[0x3FFF] = static_cast<u8>(i + 1);
+        std::tie(status, addr) = bstore->append_block(buffer);
+        BOOST_REQUIRE_EQUAL(status, AKU_SUCCESS);
+        BOOST_REQUIRE_EQUAL(addr, i);
+    }
+    bstore->flush();
+    bstore.reset();
+
+    // Parameters should be read from the meta-volume
+    bstore = open_blockstore();
+    BOOST_REQUIRE_EQUAL(bstore->get_block_size(), 0x4000);
+    BOOST_REQUIRE_EQUAL(bstore->get_fanout(), 64);
+    for (int i = 0; i < 4; i++) {
+        std::shared_ptr<Block> block;
+        std::tie(status, block) = bstore->read_block(static_cast<LogicAddr>(i));
+        BOOST_REQUIRE_EQUAL(status, AKU_SUCCESS);
+        BOOST_REQUIRE_EQUAL(block->get_size(), 0x4000);
+        BOOST_REQUIRE_EQUAL(block->get_data()[0], i);
+        BOOST_REQUIRE_EQUAL(block->get_data()[0x3FFF], i + 1);
+    }
+
+    delete_blockstore();
+}
+
+BOOST_AUTO_TEST_CASE(Test_blockstore_bad_fanout) {
+    delete_blockstore();
+    std::vector<std::tuple<u32, std::string>> vols = {
+        std::make_tuple(CAPACITIES[0], VOLPATH[0]),
+        std::make_tuple(CAPACITIES[1], VOLPATH[1]),
+    };
+    u32 max_fanout = max_nbtree_fanout(4096);
+    BOOST_REQUIRE_THROW(FixedSizeFileStorage::create(METAPATH, vols, 4096, max_fanout + 1), Exception);
+    BOOST_REQUIRE_THROW(FixedSizeFileStorage::create(METAPATH, vols, 4096, 1), Exception);
+    FixedSizeFileStorage::create(METAPATH, vols, 4096, max_fanout);
+    auto bstore = open_blockstore();
+    BOOST_REQUIRE_EQUAL(bstore->get_fanout(), max_fanout);
+    bstore.reset();
+    delete_blockstore();
+}
+
+BOOST_AUTO_TEST_CASE(Test_blockstore_retention) {
+    delete_blockstore();
+    create_blockstore();
+    auto bstore = open_blockstore();
+    bstore->set_retention(50);
+    BOOST_REQUIRE_EQUAL(bstore->get_retention(), 50);
+
+    auto buffer = std::make_shared<Block>();
+    aku_Status status;
+    LogicAddr addr;
+    std::vector<LogicAddr> addrlist;
+    // Volume 0 gets timestamps 10-80, volume 1 - 90-160
+    for (int i = 1; i <= 16; i++) {
+        buffer->set_timestamp(static_cast<aku_Timestamp>(i*10));
+        std::tie(status, addr) = bstore->append_block(buffer);
+        BOOST_REQUIRE_EQUAL(status, AKU_SUCCESS);
+        addrlist.push_back(addr);
+        if (i*10 <= 130) {
+            // Horizon is below the last timestamp of the volume 0
+            BOOST_REQUIRE(bstore->exists(addrlist.front()));
+            BOOST_REQUIRE_EQUAL(bstore->get_nreclaimed(), 0);
+        } else {
+            // All data in volume 0 is expired
+            BOOST_REQUIRE(!bstore->exists(addrlist.front()));
+            BOOST_REQUIRE(!bstore->exists(addrlist.at(7)));
+            BOOST_REQUIRE(bstore->exists(addrlist.at(8)));
+            BOOST_REQUIRE_EQUAL(bstore->get_nreclaimed(), 1);
+        }
+    }
+
+    // Reclaimed volume should be reused
+    buffer->set_timestamp(170);
+    std::tie(status, addr) = bstore->append_block(buffer);
+    BOOST_REQUIRE_EQUAL(status, AKU_SUCCESS);
+    BOOST_REQUIRE_EQUAL(addr, (2ull << 32));
+    BOOST_REQUIRE(bstore->exists(addrlist.back()));
+    bstore->flush();
+    bstore.reset();
+
+    // Retention should be stored in the meta-volume
+    bstore = open_blockstore();
+    BOOST_REQUIRE_EQUAL(bstore->get_retention(), 50);
+    BOOST_REQUIRE(bstore->exists(addr));
+    BOOST_REQUIRE(!bstore->exists(addrlist.front()));
+
+    delete_blockstore();
+}
@@ -0,0 +1,129 @@
+#include <atomic>
+#include <iostream>
+#include <thread>
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE Main
+
+#include <boost/test/unit_test.hpp>
+
+#include "buffer_cache.h"
+
+using namespace Akumuli;
+
+static std::shared_ptr<UncompressedChunk> make_chunk(size_t nelements) {
+    auto chunk = std::make_shared<UncompressedChunk>();
+    for (size_t i = 0; i < nelements; i++) {
+        chunk->timestamps.push_back(i);
+        chunk->paramids.push_back(i);
+        chunk->values.push_back(static_cast<double>(i));
+    }
+    return chunk;
+}
+
+BOOST_AUTO_TEST_CASE(Test_chunk_cache_get_put) {
+    ChunkCache cache(1024*1024);
+    auto key = std::make_tuple(1, 2);
+    BOOST_REQUIRE(!cache.contains(key));
+    BOOST_REQUIRE(!cache.get(key));
+    auto chunk = make_chunk(100);
+    cache.put(key, chunk);
+    BOOST_REQUIRE(cache.contains(key));
+    BOOST_REQUIRE(cache.get(key) == chunk);
+    BOOST_REQUIRE(!cache.get(std::make_tuple(2, 1)));
+
+    auto stats = cache.get_stats();
+    BOOST_REQUIRE_EQUAL(stats.hits, 1);
+    BOOST_REQUIRE_EQUAL(stats.misses, 2);
+    BOOST_REQUIRE_EQUAL(stats.nchunks, 1);
+    BOOST_REQUIRE_EQUAL(stats.size, ChunkCache::get_size(*chunk));
+    BOOST_REQUIRE(stats.size >= 100*(sizeof(aku_Timestamp) + sizeof(aku_ParamId) + sizeof(double)));
+}
+
+BOOST_AUTO_TEST_CASE(Test_chunk_cache_size_limit) {
+    const size_t limit = 1024*1024;
+    ChunkCache cache(limit);
+    auto chunk_size = ChunkCache::get_size(*make_chunk(100));
+    for (int i = 0; i < 10000; i++) {
+        auto key = std::make_tuple(0, i);
+        // Chunks from the second half are accessed more often and should
+        // displace chunks from the first half
+        int naccesses = i < 5000 ? 1 : 3;
+        for (int j = 1; j < naccesses; j++) {
+            cache.get(key);
+        }
+        if (!cache.get(key)) {
+            cache.put(key, make_chunk(100));
+        }
+        BOOST_REQUIRE(cache.get_stats().size <= limit);
+    }
+    auto stats = cache.get_stats();
+    BOOST_REQUIRE_EQUAL(stats.size, stats.nchunks*chunk_size);
+    BOOST_REQUIRE(stats.evictions > 0);
+    BOOST_REQUIRE(stats.size > limit/2);
+
+    // Chunk that is larger than the shard can't be cached
+    auto key = std::make_tuple(1, 1);
+    cache.put(key, make_chunk(limit));
+    BOOST_REQUIRE(!cache.contains(key));
+}
+
+BOOST_AUTO_TEST_CASE(Test_chunk_cache_scan_resistance) {
+    // Hot set occupies about half of the cache
+    const size_t limit = 1024*1024;
+    ChunkCache cache(limit);
+    auto chunk_size = ChunkCache::get_size(*make_chunk(100));
+    const int nhot = static_cast<int>(limit/chunk_size/2);
+    for (int round = 0; round < 4; round++) {
+        for (int i = 0; i < nhot; i++) {
+            auto key = std::make_tuple(0, i);
+            if (!cache.get(key)) {
+                cache.put(key, make_chunk(100));
+            }
+        }
+    }
+    // Large scan, each chunk is accessed once
+    for (int i = 0; i < nhot*10; i++) {
+        auto key = std::make_tuple(1, i);
+        if (!cache.get(key)) {
+            cache.put(key, make_chunk(100));
+        }
+    }
+    int nfound = 0;
+    for (int i = 0; i < nhot; i++) {
+        if (cache.contains(std::make_tuple(0, i))) {
+            nfound++;
+        }
+    }
+    BOOST_REQUIRE(nfound > nhot*9/10);
+}
+
+BOOST_AUTO_TEST_CASE(Test_chunk_cache_concurrent_access) {
+    ChunkCache cache(1024*1024);
+    const int nthreads = 8;
+    const int niters = 20000;
+    std::atomic<int> nerrors = {0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < nthreads; t++) {
+        threads.emplace_back([&cache, &nerrors, t]() {
+            for (int i = 0; i < niters; i++) {
+                auto key = std::make_tuple(0, (i*(t + 1)) % 1000);
+                auto chunk = cache.get(key);
+                if (chunk) {
+                    if (chunk->timestamps.size() != 10) {
+                        nerrors++;
+                    }
+                } else {
+                    cache.put(key, make_chunk(10));
+                }
+            }
+        });
+    }
+    for (auto& th: threads) {
+        th.join();
+    }
+    BOOST_REQUIRE_EQUAL(nerrors.load(), 0);
+    auto stats = cache.get_stats();
+    BOOST_REQUIRE_EQUAL(stats.hits + stats.misses, static_cast<u64>(nthreads*niters));
+    BOOST_REQUIRE(stats.hits > stats.misses);
+}
@@ -76,3 +76,45 @@ BOOST_AUTO_TEST_CASE(Test_string_to_duration_minutes) {
     aku_Duration expected = 111*60*1000000000ul;
     BOOST_REQUIRE_EQUAL(actual, expected);
 }
+
+static aku_Timestamp boost_iso_to_timestamp(int year, int month, int day, int h, int m, int s, int ns) {
+    auto date = boost::gregorian::date(year, month, day);
+    auto time = boost::posix_time::time_duration(h, m, s, ns);
+    return DateTimeUtil::from_boost_ptime(boost::posix_time::ptime(date, time));
+}
+
+BOOST_AUTO_TEST_CASE(Test_string_iso_to_timestamp_fast_path) {
+
+    struct TestCase {
+        const char* str;
+        int year, month, day, h, m, s, ns;
+    } cases[] = {
+        { "19700101T000000",           1970, 1,  1,  0,  0,  0,  0 },
+        { "20000229T235959.5",         2000, 2,  29, 23, 59, 59, 500000000 },
+        { "20160229T120000,123",       2016, 2,  29, 12, 0,  0,  123000000 },
+        { "21000301T010203.000000001", 2100, 3,  1,  1,  2,  3,  1 },
+        { "20991231T235959.999999999", 2099, 12, 31, 23, 59, 59, 999999999 },
+        // Handled by the generic parser
+        { "19690101T000000",           1969, 1,  1,  0,  0,  0,  0 },
+        { "20060102T150405.",          2006, 1,  2,  15, 4,  5,  0 },
+    };
+    for (auto const& c: cases) {
+        aku_Timestamp actual = DateTimeUtil::from_iso_string(c.str);
+        aku_Timestamp expected = boost_iso_to_timestamp(c.year, c.month, c.day, c.h, c.m, c.s, c.ns);
+        BOOST_REQUIRE_EQUAL(actual, expected);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Test_string_iso_to_timestamp_errors) {
+
+    const char* cases[] = {
+        "20060230T150405",       // bad date
+        "20061302T150405",       // bad month
+        "2006010aT150405.999",   // not a digit
+        "20060102T150405.99x",   // not a digit in fraction
+        "20060102T150405x999",   // bad separator
+    };
+    for (auto str: cases) {
+        BOOST_REQUIRE_THROW(DateTimeUtil::from_iso_string(str), std::exception);
+    }
+}
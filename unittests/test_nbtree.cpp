@@ -1,4 +1,6 @@
+#include <algorithm>
 #include <iostream>
+#include <unordered_map>
 
 #define BOOST_TEST_DYN_LINK
 #define BOOST_TEST_MODULE Main
@@ -11,6 +13,7 @@
 #include "storage_engine/blockstore.h"
 #include "storage_engine/volume.h"
 #include "storage_engine/nbtree.h"
+#include "storage_engine/parallel_scan.h"
 #include "log_iface.h"
 
 void test_logger(aku_LogLevel tag, const char* msg) {
@@ -281,7 +284,141 @@ BOOST_AUTO_TEST_CASE(Test_nbtree_reopen_6) {
     test_reopen_storage(32*32, -1);
 }
 
+BOOST_AUTO_TEST_CASE(Test_nbtree_reopen_single_leaf) {
+    // Tree that consists of a single leaf gets a new root on reopen, root should point to
+    // that leaf. Another tree is written first, so the leaf is not the first block.
+    std::shared_ptr<BlockStore> bstore = BlockStoreBuilder::create_memstore();
+    std::vector<LogicAddr> other, addrlist;
+    auto first = std::make_shared<NBTreeExtentsList>(41, other, bstore);
+    for (u32 i = 0; i < 10; i++) {
+        first->append(1000 + i, 1000 + i);
+    }
+    other = first->close();
+    auto collection = std::make_shared<NBTreeExtentsList>(42, addrlist, bstore);
+    const u32 N = 10;
+    for (u32 i = 0; i < N; i++) {
+        collection->append(i, i);
+    }
+    addrlist = collection->close();
+    BOOST_REQUIRE_EQUAL(addrlist.size(), 1);
+    BOOST_REQUIRE(addrlist.front() != other.front());
+
+    collection = std::make_shared<NBTreeExtentsList>(42, addrlist, bstore);
+    collection->force_init();
+    auto extents = collection->get_extents();
+    for (size_t i = 0; i < extents.size(); i++) {
+        check_tree_consistency(bstore, i, extents[i]);
+    }
+
+    std::unique_ptr<NBTreeIterator> it = collection->search(0, 2*N);
+    std::vector<aku_Timestamp> ts(2*N, 0);
+    std::vector<double> xs(2*N, 0);
+    aku_Status status = AKU_SUCCESS;
+    size_t sz = 0;
+    std::tie(status, sz) = it->read(ts.data(), xs.data(), 2*N);
+    BOOST_REQUIRE(status == AKU_SUCCESS || status == AKU_ENO_DATA);
+    BOOST_REQUIRE_EQUAL(sz, N);
+    for (u32 i = 0; i < N; i++) {
+        if (ts[i] != i || !same_value(xs[i], static_cast<double>(i))) {
+            BOOST_FAIL("Invalid value at " << i);
+        }
+    }
+}
+
 //! Reopen storage that has been closed without final commit.
+void test_block_size_and_fanout(u32 block_size, u32 fanout, u32 N) {
+    std::shared_ptr<BlockStore> bstore = BlockStoreBuilder::create_memstore(block_size, fanout);
+    std::vector<LogicAddr> addrlist;
+    auto collection = std::make_shared<NBTreeExtentsList>(42, addrlist, bstore);
+    for (u32 i = 0; i < N; i++) {
+        collection->append(i, i);
+    }
+    addrlist = collection->close();
+
+    collection = std::make_shared<NBTreeExtentsList>(42, addrlist, bstore);
+    collection->force_init();
+    auto extents = collection->get_extents();
+    for (size_t i = 0; i < extents.size(); i++) {
+        check_tree_consistency(bstore, i, extents[i]);
+    }
+
+    std::unique_ptr<NBTreeIterator> it = collection->search(0, N);
+    std::vector<aku_Timestamp> ts(N, 0);
+    std::vector<double> xs(N, 0);
+    aku_Status status = AKU_SUCCESS;
+    size_t sz = 0;
+    std::tie(status, sz) = it->read(ts.data(), xs.data(), N);
+    BOOST_REQUIRE_EQUAL(status, AKU_SUCCESS);
+    BOOST_REQUIRE_EQUAL(sz, N);
+    for (u32 i = 0; i < N; i++) {
+        if (ts[i] != i || !same_value(xs[i], static_cast<double>(i))) {
+            BOOST_FAIL("Invalid value at " << i);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Test_nbtree_small_fanout) {
+    // Deep tree, 4 extents at least
+    test_block_size_and_fanout(4096, 4, 100000);
+}
+
+BOOST_AUTO_TEST_CASE(Test_nbtree_large_blocks) {
+    test_block_size_and_fanout(0x4000, 32, 200000);
+    test_block_size_and_fanout(0x10000, 128, 200000);
+}
+
+BOOST_AUTO_TEST_CASE(Test_nbtree_retention) {
+    const std::string metapath = "retention_meta";
+    const std::vector<std::string> volpaths = { "retention_vol0", "retention_vol1", "retention_vol2" };
+    std::vector<std::tuple<u32, std::string>> vols;
+    for (auto const& path: volpaths) {
+        vols.push_back(std::make_tuple(32u, path));
+    }
+    FixedSizeFileStorage::create(metapath, vols);
+    auto bstore = FixedSizeFileStorage::open(metapath, volpaths);
+    const aku_Timestamp retention = 20000;
+    bstore->set_retention(retention);
+
+    std::vector<LogicAddr> addrlist;
+    auto collection = std::make_shared<NBTreeExtentsList>(42, addrlist, bstore);
+    const u32 N = 100000;
+    for (u32 i = 1; i <= N; i++) {
+        collection->append(i, i);
+    }
+    BOOST_REQUIRE(bstore->get_nreclaimed() > 0);
+
+    // Expired subtrees should be skipped
+    for (auto dir: { ScanDir::FWD, ScanDir::BWD }) {
+        auto it = dir == ScanDir::FWD ? collection->search(0, N + 1) : collection->search(N, 0);
+        std::vector<aku_Timestamp> ts(N, 0);
+        std::vector<double> xs(N, 0);
+        aku_Status status;
+        size_t sz;
+        std::tie(status, sz) = it->read(ts.data(), xs.data(), N);
+        BOOST_REQUIRE(status == AKU_SUCCESS || status == AKU_ENO_DATA);
+        BOOST_REQUIRE(sz >= retention);
+        BOOST_REQUIRE(sz < N);
+        ts.resize(sz);
+        if (dir == ScanDir::BWD) {
+            std::reverse(ts.begin(), ts.end());
+        }
+        BOOST_REQUIRE_EQUAL(ts.back(), N);
+        for (size_t i = 1; i < sz; i++) {
+            BOOST_REQUIRE_EQUAL(ts[i], ts[i - 1] + 1);
+        }
+    }
+
+    collection->close();
+    bstore.reset();
+    apr_pool_t* pool;
+    apr_pool_create(&pool, nullptr);
+    apr_file_remove(metapath.c_str(), pool);
+    for (auto const& path: volpaths) {
+        apr_file_remove(path.c_str(), pool);
+    }
+    apr_pool_destroy(pool);
+}
+
 void test_storage_recovery_status(u32 N, u32 N_values) {
     LogicAddr last_block = EMPTY_ADDR;
     auto cb = [&last_block] (LogicAddr addr) {
@@ -442,3 +579,110 @@ BOOST_AUTO_TEST_CASE(Test_nbtree_recovery_5) {
 BOOST_AUTO_TEST_CASE(Test_nbtree_recovery_6) {
     test_storage_recovery(33*33, ~0u);
 }
+
+//! Series-order is tested only in forward direction
+void test_parallel_scan(u32 nseries, u32 N, ScanOrder order, bool forward) {
+    std::shared_ptr<BlockStore> bstore = BlockStoreBuilder::create_memstore();
+    std::unordered_map<aku_ParamId, std::shared_ptr<NBTreeExtentsList>> trees;
+    std::vector<aku_ParamId> ids;
+    for (u32 id = 0; id < nseries; id++) {
+        std::vector<LogicAddr> addrlist;
+        trees[id] = std::make_shared<NBTreeExtentsList>(id, addrlist, bstore);
+        ids.push_back(id);
+    }
+    // Series `id` contains timestamps `id`, `id + nseries`, `id + 2*nseries`, etc
+    for (u32 i = 0; i < N; i++) {
+        for (u32 id = 0; id < nseries; id++) {
+            aku_Timestamp ts = i*nseries + id;
+            trees[id]->append(ts, ts);
+        }
+    }
+    auto resolve = [&trees](aku_ParamId id) {
+        return trees.at(id);
+    };
+    std::vector<aku_Sample> results;
+    auto consume = [&results](aku_Sample const& sample) {
+        results.push_back(sample);
+        return true;
+    };
+    const aku_Timestamp total = static_cast<aku_Timestamp>(N)*nseries;
+    ParallelScan scan(4);
+    aku_Status status = forward ? scan.execute(ids, 0, total, order, resolve, consume)
+                                : scan.execute(ids, total, 0, order, resolve, consume);
+    BOOST_REQUIRE_EQUAL(status, AKU_SUCCESS);
+    // In backward direction `end` (0) is excluded
+    const size_t expected = forward ? total : total - 1;
+    BOOST_REQUIRE_EQUAL(results.size(), expected);
+    for (size_t i = 0; i < results.size(); i++) {
+        aku_Timestamp ts;
+        if (order == ScanOrder::TIME) {
+            ts = forward ? i : total - 1 - i;
+        } else {
+            // Each series is returned as a whole
+            aku_ParamId id = i / N;
+            size_t pos = i % N;
+            ts = pos*nseries + id;
+        }
+        if (results[i].timestamp != ts) {
+            BOOST_FAIL("Invalid timestamp at " << i << ", expected: " << ts << ", actual: " << results[i].timestamp);
+        }
+        if (results[i].paramid != ts % nseries) {
+            BOOST_FAIL("Invalid id at " << i << ", expected: " << ts % nseries << ", actual: " << results[i].paramid);
+        }
+        if (!same_value(results[i].payload.float64, ts)) {
+            BOOST_FAIL("Invalid value at " << i);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Test_parallel_scan_time_order_fwd) {
+    test_parallel_scan(100, 1000, ScanOrder::TIME, true);
+}
+
+BOOST_AUTO_TEST_CASE(Test_parallel_scan_time_order_bwd) {
+    test_parallel_scan(100, 1000, ScanOrder::TIME, false);
+}
+
+BOOST_AUTO_TEST_CASE(Test_parallel_scan_time_order_multiple_batches) {
+    // Each series is larger than the read-ahead buffer
+    test_parallel_scan(4, 10000, ScanOrder::TIME, true);
+    test_parallel_scan(4, 10000, ScanOrder::TIME, false);
+}
+
+BOOST_AUTO_TEST_CASE(Test_parallel_scan_time_order_interrupted) {
+    // Consumer stops the scan while next batches are being prefetched
+    std::shared_ptr<BlockStore> bstore = BlockStoreBuilder::create_memstore();
+    std::unordered_map<aku_ParamId, std::shared_ptr<NBTreeExtentsList>> trees;
+    std::vector<aku_ParamId> ids;
+    const u32 nseries = 4, N = 10000;
+    for (u32 id = 0; id < nseries; id++) {
+        std::vector<LogicAddr> addrlist;
+        trees[id] = std::make_shared<NBTreeExtentsList>(id, addrlist, bstore);
+        ids.push_back(id);
+        for (u32 i = 0; i < N; i++) {
+            aku_Timestamp ts = i*nseries + id;
+            trees[id]->append(ts, ts);
+        }
+    }
+    auto resolve = [&trees](aku_ParamId id) {
+        return trees.at(id);
+    };
+    auto pool = std::make_shared<ThreadPool>(2);
+    ParallelScan scan(pool);
+    for (size_t limit: { 1ul, 5000ul, 20000ul }) {
+        size_t count = 0;
+        aku_Timestamp last = 0;
+        auto consume = [&](aku_Sample const& sample) {
+            last = sample.timestamp;
+            return ++count < limit;
+        };
+        aku_Status status = scan.execute(ids, 0, N*nseries, ScanOrder::TIME, resolve, consume);
+        BOOST_REQUIRE_EQUAL(status, AKU_SUCCESS);
+        BOOST_REQUIRE_EQUAL(count, limit);
+        BOOST_REQUIRE_EQUAL(last, limit - 1);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Test_parallel_scan_series_order_fwd) {
+    test_parallel_scan(100, 1000, ScanOrder::SERIES, true);
+}
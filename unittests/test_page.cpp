@@ -241,6 +241,39 @@ BOOST_AUTO_TEST_CASE(TestPaging7)
 }
 
 
+BOOST_AUTO_TEST_CASE(TestPaging_append_encoded_chunk_overflow)
+{
+    UncompressedChunk data;
+    for (u32 i = 0; i < 100; i++) {
+        data.paramids.push_back(1);
+        data.timestamps.push_back(1000 + i);
+        data.values.push_back(i);
+    }
+    EncodedChunk chunk;
+    auto status = PageHeader::encode_chunk(data, &chunk);
+    BOOST_REQUIRE_EQUAL(status, AKU_SUCCESS);
+
+    // Compressed data and two index entries
+    const size_t required = chunk.data.size()
+                          + 2*(sizeof(aku_Entry) + sizeof(CompressedChunkDesc) + sizeof(aku_EntryIndexRecord));
+
+    // Page that can hold data and one entry shouldn't be modified
+    std::vector<char> small_mem(sizeof(PageHeader) + required - 1);
+    auto small = new (small_mem.data()) PageHeader(0, small_mem.size(), 0, 1);
+    status = small->append_encoded_chunk(chunk);
+    BOOST_REQUIRE_EQUAL(status, AKU_EOVERFLOW);
+    BOOST_REQUIRE_EQUAL(small->get_entries_count(), 0u);
+    BOOST_REQUIRE_EQUAL(small->get_free_space(), required - 1);
+
+    std::vector<char> page_mem(sizeof(PageHeader) + required);
+    auto page = new (page_mem.data()) PageHeader(0, page_mem.size(), 0, 1);
+    status = page->append_encoded_chunk(chunk);
+    BOOST_REQUIRE_EQUAL(status, AKU_SUCCESS);
+    BOOST_REQUIRE_EQUAL(page->get_entries_count(), 2u);
+    BOOST_REQUIRE_EQUAL(page->get_free_space(), 0u);
+}
+
+
 void generic_compression_test
     ( aku_ParamId param_id
     , aku_Timestamp begin
@@ -180,6 +180,26 @@ BOOST_AUTO_TEST_CASE(Test_seriesparser_5) {
     BOOST_REQUIRE_EQUAL(status, AKU_EBAD_ARG);
 }
 
+BOOST_AUTO_TEST_CASE(Test_seriesparser_long_name) {
+
+    // Series name spans several 64-byte words, some tags are already ordered
+    const char* series1 = "\tcpu.user  zone=us-east-1a host=ip-10-0-0-1.ec2.internal\thost "
+                          "hostgroup=web ab=2 a=1 rack=r42  region=us-east  ";
+    auto len = strlen(series1);
+    char out[200];
+    const char* pbegin = nullptr;
+    const char* pend = nullptr;
+    int status = SeriesParser::to_normal_form(series1, series1 + len, out, out + len, &pbegin, &pend);
+
+    BOOST_REQUIRE_EQUAL(status, AKU_SUCCESS);
+
+    std::string expected = "cpu.user a=1 ab=2 host=ip-10-0-0-1.ec2.internal\thost hostgroup=web "
+                           "rack=r42 region=us-east zone=us-east-1a";
+    std::string actual = std::string((const char*)out, pend);
+    BOOST_REQUIRE_EQUAL(expected, actual);
+    BOOST_REQUIRE_EQUAL(pbegin, out + strlen("cpu.user "));
+}
+
 BOOST_AUTO_TEST_CASE(Test_seriesparser_6) {
     const char* tags[] = {
         "tag2",
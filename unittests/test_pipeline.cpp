@@ -5,6 +5,10 @@
 #include <boost/test/unit_test.hpp>
 #include <vector>
 #include <thread>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <set>
 
 #include "ingestion_pipeline.h"
 
@@ -63,3 +67,269 @@ BOOST_AUTO_TEST_CASE(Test_spout_in_single_thread) {
         BOOST_REQUIRE_EQUAL(con->cntt, sumt);
         BOOST_REQUIRE_EQUAL(con->cntp, sump);
 }
+
+struct SeriesConnectionMock : ConnectionMock {
+    int nlookups = 0;
+
+    aku_Status series_to_param_id(const char *name, size_t size, aku_Sample *sample) {
+        nlookups++;
+        if (size < 4) {
+            return AKU_EBAD_DATA;
+        }
+        sample->paramid = std::hash<std::string>()(std::string(name, size));
+        return AKU_SUCCESS;
+    }
+};
+
+BOOST_AUTO_TEST_CASE(Test_series_name_cache_eviction) {
+
+    SeriesNameCache cache;
+    aku_ParamId id = 0;
+    const char* names[] = { "cpu host=1", "cpu host=2", "cpu host=3" };
+    // All names are placed into the same set
+    BOOST_REQUIRE(!cache.lookup(names[0], 10, 1, &id));
+    cache.insert(names[0], 10, 1, 100);
+    cache.insert(names[1], 10, 1, 101);
+    BOOST_REQUIRE(cache.lookup(names[0], 10, 1, &id));
+    BOOST_REQUIRE_EQUAL(id, 100u);
+    // Least recently used entry (names[1]) should be replaced
+    cache.insert(names[2], 10, 1, 102);
+    BOOST_REQUIRE(!cache.lookup(names[1], 10, 1, &id));
+    BOOST_REQUIRE(cache.lookup(names[2], 10, 1, &id));
+    BOOST_REQUIRE_EQUAL(id, 102u);
+    BOOST_REQUIRE(cache.lookup(names[0], 10, 1, &id));
+    BOOST_REQUIRE_EQUAL(id, 100u);
+    // Hash collision shouldn't produce a hit
+    BOOST_REQUIRE(!cache.lookup("cpu host=4", 10, 1, &id));
+    BOOST_REQUIRE_EQUAL(cache.hits(), 3u);
+    BOOST_REQUIRE_EQUAL(cache.misses(), 3u);
+}
+
+BOOST_AUTO_TEST_CASE(Test_spout_series_name_cache) {
+
+    auto con = std::make_shared<SeriesConnectionMock>();
+    auto pipeline = std::make_shared<IngestionPipeline>(con, AKU_LINEAR_BACKOFF);
+    auto spout = pipeline->make_spout();
+    std::vector<std::string> names;
+    for (int i = 0; i < 100; i++) {
+        names.push_back("cpu.user host=host_" + std::to_string(i));
+    }
+    for (int round = 0; round < 10; round++) {
+        for (auto const& name: names) {
+            aku_Sample sample = {};
+            auto status = spout->series_to_param_id(name.data(), name.size(), &sample);
+            BOOST_REQUIRE_EQUAL(status, AKU_SUCCESS);
+            BOOST_REQUIRE_EQUAL(sample.paramid, std::hash<std::string>()(name));
+        }
+    }
+    BOOST_REQUIRE_EQUAL(con->nlookups, 100);
+
+    // Errors shouldn't be cached
+    aku_Sample sample = {};
+    BOOST_REQUIRE_EQUAL(spout->series_to_param_id("cpu", 3, &sample), AKU_EBAD_DATA);
+    BOOST_REQUIRE_EQUAL(spout->series_to_param_id("cpu", 3, &sample), AKU_EBAD_DATA);
+    BOOST_REQUIRE_EQUAL(con->nlookups, 102);
+
+    spout->flush_cache_stats();
+    u64 hits, misses;
+    pipeline->get_series_cache_stats(&hits, &misses);
+    BOOST_REQUIRE_EQUAL(hits, 900u);
+    BOOST_REQUIRE_EQUAL(misses, 102u);
+
+    // Counters are published through the stats output
+    std::map<std::string, u64> stats;
+    pipeline->get_stats(&stats);
+    BOOST_REQUIRE_EQUAL(stats["series_cache.hits"], 900u);
+    BOOST_REQUIRE_EQUAL(stats["series_cache.misses"], 102u);
+}
+
+struct OrderCheckingConnectionMock : ConnectionMock {
+    std::mutex                             mutex;
+    std::map<aku_ParamId, aku_Timestamp>   last;     //< Last timestamp of the series
+    std::map<aku_ParamId, std::thread::id> writer;   //< Thread that writes the series
+    std::set<std::thread::id>              threads;
+    int                                    nerrors = 0;
+    int                                    nwrites = 0;
+
+    aku_Status write(const aku_Sample &sample) {
+        std::lock_guard<std::mutex> guard(mutex);
+        auto tid = std::this_thread::get_id();
+        threads.insert(tid);
+        nwrites++;
+        auto it = last.find(sample.paramid);
+        if (it != last.end()) {
+            if (it->second >= sample.timestamp || writer[sample.paramid] != tid) {
+                nerrors++;
+            }
+        } else {
+            writer[sample.paramid] = tid;
+        }
+        last[sample.paramid] = sample.timestamp;
+        return AKU_SUCCESS;
+    }
+};
+
+BOOST_AUTO_TEST_CASE(Test_pipeline_multiple_writers) {
+
+    auto con = std::make_shared<OrderCheckingConnectionMock>();
+    auto pipeline = std::make_shared<IngestionPipeline>(con, AKU_LINEAR_BACKOFF, 4);
+    BOOST_REQUIRE_EQUAL(pipeline->get_nworkers(), 4u);
+    pipeline->start();
+    const int NSERIES = 100;
+    const int NSAMPLES = 1000;
+    auto generate = [&](aku_ParamId first) {
+        auto spout = pipeline->make_spout();
+        for (int i = 1; i <= NSAMPLES; i++) {
+            for (aku_ParamId id = first; id < first + NSERIES; id++) {
+                aku_Sample sample = { static_cast<aku_Timestamp>(i), id };
+                spout->write(sample);
+            }
+        }
+        while (!spout->is_empty()) {
+            std::this_thread::yield();
+        }
+    };
+    std::thread gen1(generate, 0);
+    std::thread gen2(generate, NSERIES);
+    gen1.join();
+    gen2.join();
+    pipeline->stop();
+    BOOST_REQUIRE_EQUAL(con->nwrites, 2*NSERIES*NSAMPLES);
+    BOOST_REQUIRE_EQUAL(con->nerrors, 0);
+    BOOST_REQUIRE_EQUAL(con->threads.size(), 4u);
+    BOOST_REQUIRE_EQUAL(con->last.size(), 2u*NSERIES);
+}
+
+BOOST_AUTO_TEST_CASE(Test_sample_ring) {
+
+    SampleRing ring;
+    u64 written = 0, read = 0;
+    for (int round = 0; round < 5; round++) {
+        // Fill the ring
+        while (true) {
+            aku_Sample sample = { written, 42 };
+            if (!ring.push(sample)) {
+                break;
+            }
+            written++;
+        }
+        BOOST_REQUIRE_EQUAL(written - read, static_cast<u64>(SampleRing::CAPACITY));
+        const aku_Sample* samples;
+        if (round == 0) {
+            // Nothing is visible before publish
+            BOOST_REQUIRE_EQUAL(ring.peek(&samples), 0u);
+        }
+        ring.publish();
+        BOOST_REQUIRE(!ring.empty());
+        // Consume part of the data (ring wraps around on next iteration)
+        u32 n = ring.peek(&samples);
+        BOOST_REQUIRE(n > 0);
+        n = std::min(n, 100u + round);
+        for (u32 i = 0; i < n; i++) {
+            BOOST_REQUIRE_EQUAL(samples[i].timestamp, read++);
+        }
+        ring.release(n);
+    }
+    // Drain
+    const aku_Sample* samples;
+    while (u32 n = ring.peek(&samples)) {
+        for (u32 i = 0; i < n; i++) {
+            BOOST_REQUIRE_EQUAL(samples[i].timestamp, read++);
+        }
+        ring.release(n);
+    }
+    BOOST_REQUIRE(ring.empty());
+    BOOST_REQUIRE_EQUAL(read, written);
+}
+
+BOOST_AUTO_TEST_CASE(Test_spout_flow_control) {
+
+    auto con = std::make_shared<OrderCheckingConnectionMock>();
+    auto pipeline = std::make_shared<IngestionPipeline>(con, AKU_THROTTLE);
+    auto spout = pipeline->make_spout(AKU_FLOW_CONTROL);
+    // Pipeline is not started yet so rings can't be drained
+    const int NSAMPLES = 3*SampleRing::CAPACITY;
+    std::vector<aku_Sample> samples;
+    for (int i = 1; i <= NSAMPLES; i++) {
+        aku_Sample sample = { static_cast<aku_Timestamp>(i), 42 };
+        samples.push_back(sample);
+    }
+    spout->write_batch(samples.data(), samples.size()/2);
+    BOOST_REQUIRE(spout->is_congested());
+    BOOST_REQUIRE(!spout->drain_backlog());
+    // New data shouldn't bypass the backlog
+    spout->write_batch(samples.data() + samples.size()/2, samples.size() - samples.size()/2);
+    BOOST_REQUIRE_EQUAL(pipeline->get_queue_depth(), static_cast<u64>(SampleRing::CAPACITY));
+
+    pipeline->start();
+    while (!spout->drain_backlog()) {
+        std::this_thread::yield();
+    }
+    spout->report_pause(100);
+    BOOST_REQUIRE(!spout->is_congested());
+    while (!spout->is_empty()) {
+        std::this_thread::yield();
+    }
+    pipeline->stop();
+    BOOST_REQUIRE_EQUAL(con->nwrites, NSAMPLES);
+    BOOST_REQUIRE_EQUAL(con->nerrors, 0);
+    BOOST_REQUIRE_EQUAL(con->last[42], static_cast<aku_Timestamp>(NSAMPLES));
+    u64 npauses, pause_time;
+    pipeline->get_flow_control_stats(&npauses, &pause_time);
+    BOOST_REQUIRE_EQUAL(npauses, 1u);
+    BOOST_REQUIRE_EQUAL(pause_time, 100u);
+}
+
+BOOST_AUTO_TEST_CASE(Test_spout_flow_control_drain_cb) {
+
+    auto con = std::make_shared<OrderCheckingConnectionMock>();
+    auto pipeline = std::make_shared<IngestionPipeline>(con, AKU_THROTTLE, 2);
+    auto spout = pipeline->make_spout(AKU_FLOW_CONTROL);
+    std::mutex mutex;
+    std::condition_variable cond;
+    int ncalls = 0;
+    spout->set_drain_cb([&]() {
+        std::lock_guard<std::mutex> guard(mutex);
+        ncalls++;
+        cond.notify_one();
+    });
+    const int NSAMPLES = 8*SampleRing::CAPACITY;
+    std::vector<aku_Sample> samples;
+    for (int i = 1; i <= NSAMPLES; i++) {
+        aku_Sample sample = { static_cast<aku_Timestamp>(i), static_cast<aku_ParamId>(i % 2) };
+        samples.push_back(sample);
+    }
+    spout->write_batch(samples.data(), samples.size());
+    BOOST_REQUIRE(spout->is_congested());
+    BOOST_REQUIRE(!spout->wait_for_drain());
+
+    // Writers should resume the spout without polling
+    pipeline->start();
+    int nwaits = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cond.wait(lock, [&] { return ncalls > 0; });
+            ncalls = 0;
+        }
+        nwaits++;
+        if (spout->wait_for_drain()) {
+            break;
+        }
+    }
+    BOOST_REQUIRE(!spout->is_congested());
+    BOOST_REQUIRE(nwaits > 0);
+    while (!spout->is_empty()) {
+        std::this_thread::yield();
+    }
+    spout->report_pause(10);
+
+    std::map<std::string, u64> stats;
+    pipeline->get_stats(&stats);
+    BOOST_REQUIRE_EQUAL(stats["flow_control.pauses"], 1u);
+    BOOST_REQUIRE_EQUAL(stats["flow_control.pause_time_us"], 10u);
+    BOOST_REQUIRE_EQUAL(stats["pipeline.queue_depth"], 0u);
+    pipeline->stop();
+    BOOST_REQUIRE_EQUAL(con->nwrites, NSAMPLES);
+    BOOST_REQUIRE_EQUAL(con->nerrors, 0);
+}
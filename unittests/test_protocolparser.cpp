@@ -1,4 +1,7 @@
+#include <cstring>
+#include <functional>
 #include <iostream>
+#include <map>
 
 #define BOOST_TEST_DYN_LINK
 #define BOOST_TEST_MODULE Main
@@ -6,6 +9,7 @@
 
 #include "protocolparser.h"
 #include "resp.h"
+#include "series_dictionary.h"
 
 using namespace Akumuli;
 
@@ -130,3 +134,442 @@ BOOST_AUTO_TEST_CASE(Test_protocol_parse_error_format) {
     parser.start();
     BOOST_REQUIRE_EXCEPTION(parser.parse_next(pdu), RESPError, check_resp_error);
 }
+
+BOOST_AUTO_TEST_CASE(Test_protocol_parse_split_anywhere) {
+
+    // Each element can be split between two PDUs at any position
+    const char *messages = ":1\r\n+20150101T000000.000000001\r\n+34.5\r\n:6\n:7\n:8\n";
+    const size_t size = strlen(messages);
+    for (size_t split = 0; split < size; split++) {
+        auto buffer = buffer_from_static_string(messages);
+        PDU pdu1 = {
+            buffer,
+            split,
+            0u
+        };
+        PDU pdu2 = {
+            buffer,
+            size,
+            split
+        };
+        std::shared_ptr<ConsumerMock> cons(new ConsumerMock);
+        ProtocolParser parser(cons);
+        parser.start();
+        parser.parse_next(pdu1);
+        parser.parse_next(pdu2);
+        parser.close();
+
+        BOOST_REQUIRE_EQUAL(cons->param_.size(), 2);
+        BOOST_REQUIRE_EQUAL(cons->param_[0], 1);
+        BOOST_REQUIRE_EQUAL(cons->ts_[0], 1420070400000000001ul);
+        BOOST_REQUIRE_EQUAL(cons->data_[0], 34.5);
+        BOOST_REQUIRE_EQUAL(cons->param_[1], 6);
+        BOOST_REQUIRE_EQUAL(cons->ts_[1], 7);
+        BOOST_REQUIRE_EQUAL(cons->data_[1], 8);
+    }
+}
+
+struct BatchConsumerMock : ConsumerMock {
+    std::vector<size_t> batches_;
+
+    void write_batch(const aku_Sample* samples, size_t n) {
+        batches_.push_back(n);
+        ConsumerMock::write_batch(samples, n);
+    }
+};
+
+BOOST_AUTO_TEST_CASE(Test_protocol_parse_batch) {
+
+    std::string messages;
+    for (int i = 0; i < 1000; i++) {
+        messages += ":" + std::to_string(i) + "\r\n:" + std::to_string(i) + "\r\n+1.5\r\n";
+    }
+    auto buffer = buffer_from_static_string(messages.c_str());
+    PDU pdu = {
+        buffer,
+        messages.size(),
+        0u
+    };
+    std::shared_ptr<BatchConsumerMock> cons(new BatchConsumerMock);
+    ProtocolParser parser(cons);
+    parser.start();
+    parser.parse_next(pdu);
+    parser.close();
+
+    BOOST_REQUIRE_EQUAL(cons->param_.size(), 1000);
+    BOOST_REQUIRE(cons->batches_.size() < 10);
+    for (size_t i = 0; i < 1000; i++) {
+        BOOST_REQUIRE_EQUAL(cons->param_[i], i);
+        BOOST_REQUIRE_EQUAL(cons->ts_[i], i);
+        BOOST_REQUIRE_EQUAL(cons->data_[i], 1.5);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Test_protocol_parse_binary) {
+
+    std::vector<char> stream(BinaryProtocol::MAGIC, BinaryProtocol::MAGIC + sizeof(BinaryProtocol::MAGIC));
+    std::vector<aku_Timestamp> ts = { 100, 101, 1000000, 999999, 2000000 };
+    std::vector<double> xs = { 1.5, -2.5, 3.25, 0.0, 1e100 };
+    BinaryProtocol::encode_frame(42, "", ts.data(), xs.data(), 5, &stream);
+    BinaryProtocol::encode_frame(43, "", ts.data(), xs.data(), 2, &stream);
+    // Each frame can be split between two PDUs at any position (including magic prefix)
+    for (size_t split = 0; split < stream.size(); split++) {
+        auto buffer = std::shared_ptr<const Byte>(stream.data(), &null_deleter);
+        PDU pdu1 = {
+            buffer,
+            split,
+            0u
+        };
+        PDU pdu2 = {
+            buffer,
+            stream.size(),
+            split
+        };
+        std::shared_ptr<ConsumerMock> cons(new ConsumerMock);
+        ProtocolParser parser(cons);
+        parser.start();
+        parser.parse_next(pdu1);
+        parser.parse_next(pdu2);
+        parser.close();
+
+        BOOST_REQUIRE_EQUAL(cons->param_.size(), 7);
+        for (size_t i = 0; i < 7; i++) {
+            size_t ix = i < 5 ? i : i - 5;
+            BOOST_REQUIRE_EQUAL(cons->param_[i], i < 5 ? 42 : 43);
+            BOOST_REQUIRE_EQUAL(cons->ts_[i], ts[ix]);
+            BOOST_REQUIRE_EQUAL(cons->data_[i], xs[ix]);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Test_protocol_parse_binary_error) {
+
+    std::vector<char> stream(BinaryProtocol::MAGIC, BinaryProtocol::MAGIC + sizeof(BinaryProtocol::MAGIC));
+    aku_Timestamp ts = 1;
+    double xs = 2.0;
+    BinaryProtocol::encode_frame(1, "", &ts, &xs, 1, &stream);
+    BinaryProtocol::encode_frame(2, "", &ts, &xs, 1, &stream);
+    // Second frame has bad type (magic + first frame + size field)
+    stream.at(sizeof(BinaryProtocol::MAGIC) + 33 + 4) = 7;
+    auto buffer = std::shared_ptr<const Byte>(stream.data(), &null_deleter);
+    PDU pdu = {
+        buffer,
+        stream.size(),
+        0u
+    };
+    std::shared_ptr<ConsumerMock> cons(new ConsumerMock);
+    ProtocolParser parser(cons);
+    parser.start();
+    BOOST_REQUIRE_THROW(parser.parse_next(pdu), ProtocolParserError);
+    // First frame should be decoded
+    BOOST_REQUIRE_EQUAL(cons->param_.size(), 1);
+    BOOST_REQUIRE_EQUAL(cons->param_[0], 1);
+}
+
+//! Frame that fails validation after the header shouldn't produce any samples
+void test_protocol_parse_binary_bad_frame(std::function<void(std::vector<char>*, size_t)> const& corrupt) {
+    std::vector<char> stream(BinaryProtocol::MAGIC, BinaryProtocol::MAGIC + sizeof(BinaryProtocol::MAGIC));
+    std::vector<aku_Timestamp> ts = { 100, 101, 102, 103, 104 };
+    std::vector<double> xs = { 1.0, 2.0, 3.0, 4.0, 5.0 };
+    BinaryProtocol::encode_frame(1, "", ts.data(), xs.data(), 1, &stream);
+    size_t offset = stream.size();
+    BinaryProtocol::encode_frame(2, "", ts.data(), xs.data(), 5, &stream);
+    corrupt(&stream, offset);
+    auto buffer = std::shared_ptr<const Byte>(stream.data(), &null_deleter);
+    PDU pdu = {
+        buffer,
+        stream.size(),
+        0u
+    };
+    std::shared_ptr<ConsumerMock> cons(new ConsumerMock);
+    ProtocolParser parser(cons);
+    parser.start();
+    BOOST_REQUIRE_THROW(parser.parse_next(pdu), ProtocolParserError);
+    // Only the first frame should be written
+    BOOST_REQUIRE_EQUAL(cons->param_.size(), 1);
+    BOOST_REQUIRE_EQUAL(cons->param_[0], 1);
+    BOOST_REQUIRE_EQUAL(cons->data_[0], 1.0);
+}
+
+BOOST_AUTO_TEST_CASE(Test_protocol_parse_binary_truncated_values) {
+    // Last value is cut off, frame size is adjusted accordingly
+    test_protocol_parse_binary_bad_frame([](std::vector<char>* stream, size_t offset) {
+        stream->resize(stream->size() - sizeof(double));
+        u32 size;
+        memcpy(&size, stream->data() + offset, sizeof(u32));
+        size -= sizeof(double);
+        memcpy(stream->data() + offset, &size, sizeof(u32));
+    });
+}
+
+BOOST_AUTO_TEST_CASE(Test_protocol_parse_binary_bad_delta) {
+    // Timestamp deltas never terminate (size + type + id + count + first timestamp)
+    test_protocol_parse_binary_bad_frame([](std::vector<char>* stream, size_t offset) {
+        size_t deltas = offset + sizeof(u32) + 1 + sizeof(u64) + sizeof(u32) + sizeof(u64);
+        std::fill(stream->begin() + deltas, stream->end(), static_cast<char>(0x80));
+    });
+}
+
+struct NameConsumerMock : ConsumerMock {
+    std::map<std::string, aku_ParamId> names_;
+    int ncalls_ = 0;
+
+    aku_Status series_to_param_id(const char *str, size_t strlen, aku_Sample *sample) {
+        ncalls_++;
+        auto name = std::string(str, str + strlen);
+        auto it = names_.find(name);
+        if (it == names_.end()) {
+            it = names_.insert(std::make_pair(name, names_.size() + 100)).first;
+        }
+        sample->paramid = it->second;
+        return AKU_SUCCESS;
+    }
+};
+
+BOOST_AUTO_TEST_CASE(Test_protocol_parse_alias) {
+
+    const char *messages = "*2\r\n:1\r\n+cpu host=A\r\n"
+                           "*2\r\n:2\r\n+cpu host=B\r\n"
+                           "@1\r\n:10\r\n+1.0\r\n"
+                           "@2\r\n:11\r\n+2.0\r\n"
+                           "@1\r\n:12\r\n+3.0\r\n";
+    auto buffer = buffer_from_static_string(messages);
+    PDU pdu = {
+        buffer,
+        strlen(messages),
+        0u
+    };
+    std::shared_ptr<NameConsumerMock> cons(new NameConsumerMock);
+    ProtocolParser parser(cons);
+    parser.start();
+    parser.parse_next(pdu);
+    parser.close();
+
+    BOOST_REQUIRE_EQUAL(cons->ncalls_, 2);
+    BOOST_REQUIRE_EQUAL(cons->param_.size(), 3);
+    BOOST_REQUIRE_EQUAL(cons->param_[0], cons->names_["cpu host=A"]);
+    BOOST_REQUIRE_EQUAL(cons->param_[1], cons->names_["cpu host=B"]);
+    BOOST_REQUIRE_EQUAL(cons->param_[2], cons->names_["cpu host=A"]);
+    BOOST_REQUIRE_EQUAL(cons->ts_[2], 12);
+    BOOST_REQUIRE_EQUAL(cons->data_[2], 3.0);
+}
+
+BOOST_AUTO_TEST_CASE(Test_series_dictionary_large_alias) {
+    NameConsumerMock cons;
+    SeriesDictionary dict;
+    aku_Sample sample = {};
+    const char* name = "cpu host=A";
+    // Large aliases don't extend the dense table
+    BOOST_REQUIRE_EQUAL(dict.define(SeriesDictionary::ALIAS_MAX - 1, name, strlen(name), cons), AKU_SUCCESS);
+    BOOST_REQUIRE_EQUAL(dict.resolve(SeriesDictionary::ALIAS_MAX - 1, &sample), AKU_SUCCESS);
+    BOOST_REQUIRE_EQUAL(sample.paramid, cons.names_[name]);
+    BOOST_REQUIRE_EQUAL(dict.resolve(SeriesDictionary::ALIAS_MAX - 2, &sample), AKU_ENOT_FOUND);
+    BOOST_REQUIRE_EQUAL(dict.resolve(1, &sample), AKU_ENOT_FOUND);
+    BOOST_REQUIRE_EQUAL(dict.define(SeriesDictionary::ALIAS_MAX, name, strlen(name), cons), AKU_EBAD_ARG);
+
+    // Number of aliases outside of the dense table is limited
+    for (u64 i = 1; i < SeriesDictionary::SPARSE_MAX; i++) {
+        BOOST_REQUIRE_EQUAL(dict.define(SeriesDictionary::DENSE_MAX + i, name, strlen(name), cons), AKU_SUCCESS);
+    }
+    BOOST_REQUIRE_EQUAL(dict.define(SeriesDictionary::DENSE_MAX, name, strlen(name), cons), AKU_EBAD_ARG);
+    // Existing alias can be redefined, dense table is not affected by the limit
+    BOOST_REQUIRE_EQUAL(dict.define(SeriesDictionary::DENSE_MAX + 1, name, strlen(name), cons), AKU_SUCCESS);
+    BOOST_REQUIRE_EQUAL(dict.define(SeriesDictionary::DENSE_MAX - 1, name, strlen(name), cons), AKU_SUCCESS);
+    BOOST_REQUIRE_EQUAL(dict.resolve(SeriesDictionary::DENSE_MAX - 1, &sample), AKU_SUCCESS);
+}
+
+BOOST_AUTO_TEST_CASE(Test_protocol_parse_unknown_alias) {
+
+    const char *messages = "*2\r\n:1\r\n+cpu host=A\r\n"
+                           "@1\r\n:10\r\n+1.0\r\n"
+                           "@2\r\n:11\r\n+2.0\r\n";
+    auto buffer = buffer_from_static_string(messages);
+    PDU pdu = {
+        buffer,
+        strlen(messages),
+        0u
+    };
+    std::shared_ptr<NameConsumerMock> cons(new NameConsumerMock);
+    ProtocolParser parser(cons);
+    parser.start();
+    BOOST_REQUIRE_THROW(parser.parse_next(pdu), ProtocolParserError);
+    BOOST_REQUIRE_EQUAL(cons->param_.size(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(Test_protocol_parse_binary_alias) {
+
+    std::vector<char> stream(BinaryProtocol::MAGIC, BinaryProtocol::MAGIC + sizeof(BinaryProtocol::MAGIC));
+    std::vector<aku_Timestamp> ts = { 1, 2, 3 };
+    std::vector<double> xs = { 1.0, 2.0, 3.0 };
+    BinaryProtocol::encode_alias_definition(7, "mem host=A", &stream);
+    BinaryProtocol::encode_alias_frame(7, ts.data(), xs.data(), 3, &stream);
+    BinaryProtocol::encode_alias_frame(7, ts.data(), xs.data(), 1, &stream);
+    auto buffer = std::shared_ptr<const Byte>(stream.data(), &null_deleter);
+    PDU pdu = {
+        buffer,
+        stream.size(),
+        0u
+    };
+    std::shared_ptr<NameConsumerMock> cons(new NameConsumerMock);
+    ProtocolParser parser(cons);
+    parser.start();
+    parser.parse_next(pdu);
+    parser.close();
+
+    BOOST_REQUIRE_EQUAL(cons->ncalls_, 1);
+    BOOST_REQUIRE_EQUAL(cons->param_.size(), 4);
+    for (auto id: cons->param_) {
+        BOOST_REQUIRE_EQUAL(id, cons->names_["mem host=A"]);
+    }
+}
+
+//! Wrap datagrams into `mmsghdr` array (strings should stay alive)
+static std::vector<mmsghdr> make_msgs(std::vector<std::string>& packets, std::vector<iovec>* iovecs) {
+    iovecs->resize(packets.size());
+    std::vector<mmsghdr> msgs(packets.size());
+    for (size_t i = 0; i < packets.size(); i++) {
+        (*iovecs)[i].iov_base = &packets[i][0];
+        (*iovecs)[i].iov_len = packets[i].size();
+        msgs[i].msg_hdr.msg_iov = &(*iovecs)[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_len = static_cast<unsigned>(packets[i].size());
+    }
+    return msgs;
+}
+
+BOOST_AUTO_TEST_CASE(Test_protocol_parse_mmsghdr_batch) {
+
+    std::vector<std::string> packets;
+    for (int i = 0; i < 300; i += 3) {
+        std::string packet;
+        for (int j = i; j < i + 3; j++) {
+            packet += ":" + std::to_string(j) + "\r\n:" + std::to_string(j) + "\r\n+1.5\r\n";
+        }
+        packets.push_back(packet);
+    }
+    std::vector<iovec> iovecs;
+    auto msgs = make_msgs(packets, &iovecs);
+    std::shared_ptr<BatchConsumerMock> cons(new BatchConsumerMock);
+    ProtocolParser parser(cons);
+    parser.start();
+    BOOST_REQUIRE_EQUAL(parser.parse_batch(msgs.data(), msgs.size()), 0);
+
+    // All samples should be passed to consumer at once
+    BOOST_REQUIRE_EQUAL(cons->batches_.size(), 1);
+    BOOST_REQUIRE_EQUAL(cons->param_.size(), 300);
+    for (size_t i = 0; i < 300; i++) {
+        BOOST_REQUIRE_EQUAL(cons->param_[i], i);
+        BOOST_REQUIRE_EQUAL(cons->ts_[i], i);
+        BOOST_REQUIRE_EQUAL(cons->data_[i], 1.5);
+    }
+
+    parser.parse_batch(msgs.data(), 2);
+    parser.close();
+    BOOST_REQUIRE_EQUAL(cons->batches_.size(), 2);
+    BOOST_REQUIRE_EQUAL(cons->param_.size(), 306);
+}
+
+BOOST_AUTO_TEST_CASE(Test_protocol_parse_mmsghdr_batch_independent) {
+
+    // Element split between datagrams can't be completed by the next datagram
+    std::vector<std::string> packets = {
+        ":1\r\n:10\r",
+        "\n+1.5\r\n",
+        ":2\r\n:20\r\n",
+        ":3\r\n:30\r\n+3.5\r\n",
+    };
+    std::vector<iovec> iovecs;
+    auto msgs = make_msgs(packets, &iovecs);
+    std::shared_ptr<BatchConsumerMock> cons(new BatchConsumerMock);
+    ProtocolParser parser(cons);
+    parser.start();
+    BOOST_REQUIRE_EQUAL(parser.parse_batch(msgs.data(), msgs.size()), 3);
+    parser.close();
+
+    BOOST_REQUIRE_EQUAL(cons->param_.size(), 1);
+    BOOST_REQUIRE_EQUAL(cons->param_[0], 3);
+    BOOST_REQUIRE_EQUAL(cons->ts_[0], 30);
+    BOOST_REQUIRE_EQUAL(cons->data_[0], 3.5);
+}
+
+BOOST_AUTO_TEST_CASE(Test_protocol_parse_mmsghdr_batch_aliases) {
+
+    // Aliases can't be defined or used in datagrams
+    std::vector<char> binary(BinaryProtocol::MAGIC, BinaryProtocol::MAGIC + sizeof(BinaryProtocol::MAGIC));
+    BinaryProtocol::encode_alias_definition(7, "mem host=A", &binary);
+    std::vector<std::string> packets = {
+        "*2\r\n:1\r\n+cpu host=A\r\n",
+        "@1\r\n:10\r\n+1.5\r\n",
+        std::string(binary.begin(), binary.end()),
+        ":2\r\n:20\r\n+2.5\r\n",
+    };
+    std::vector<iovec> iovecs;
+    auto msgs = make_msgs(packets, &iovecs);
+    std::shared_ptr<NameConsumerMock> cons(new NameConsumerMock);
+    ProtocolParser parser(cons);
+    parser.start();
+    BOOST_REQUIRE_EQUAL(parser.parse_batch(msgs.data(), msgs.size()), 3);
+    parser.close();
+
+    BOOST_REQUIRE_EQUAL(cons->ncalls_, 0);
+    BOOST_REQUIRE_EQUAL(cons->param_.size(), 1);
+    BOOST_REQUIRE_EQUAL(cons->param_[0], 2);
+}
+
+BOOST_AUTO_TEST_CASE(Test_protocol_parse_mmsghdr_batch_error) {
+
+    // Bad datagram in the middle of the batch shouldn't affect the following datagrams
+    std::vector<std::string> packets = {
+        ":1\r\n:10\r\n+1.5\r\n",
+        ":2\r\n:bad\r\n+2.5\r\n",
+        ":3\r\n:30\r\n+3.5\r\n",
+        ":4\r\n:40\r\n+4.5\r\n",
+    };
+    std::vector<iovec> iovecs;
+    auto msgs = make_msgs(packets, &iovecs);
+    std::shared_ptr<BatchConsumerMock> cons(new BatchConsumerMock);
+    ProtocolParser parser(cons);
+    parser.start();
+    BOOST_REQUIRE_EQUAL(parser.parse_batch(msgs.data(), msgs.size()), 1);
+    parser.close();
+
+    std::vector<aku_ParamId> expected = { 1, 3, 4 };
+    BOOST_REQUIRE_EQUAL(cons->param_.size(), expected.size());
+    for (size_t i = 0; i < expected.size(); i++) {
+        BOOST_REQUIRE_EQUAL(cons->param_[i], expected[i]);
+        BOOST_REQUIRE_EQUAL(cons->ts_[i], expected[i]*10);
+        BOOST_REQUIRE_EQUAL(cons->data_[i], expected[i] + 0.5);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Test_protocol_parse_values) {
+
+    const char* values[] = {
+        "0", "-0", "42", "+42", "3.14", "-0.001", "1e10", "1.5E-7", "123456789012345678",
+        "1.7976931348623157e308", "4.9e-324", "2.2250738585072014e-308", "0.1", "9007199254740993",
+        "12345678901234567890123", "0.000000000000000000000000123", "1e400", "inf", "-nan", "5.",
+    };
+    std::string messages;
+    for (auto value: values) {
+        messages += std::string(":1\r\n:2\r\n+") + value + "\r\n";
+    }
+    auto buffer = buffer_from_static_string(messages.c_str());
+    PDU pdu = {
+        buffer,
+        messages.size(),
+        0u
+    };
+    std::shared_ptr<ConsumerMock> cons(new ConsumerMock);
+    ProtocolParser parser(cons);
+    parser.start();
+    parser.parse_next(pdu);
+    parser.close();
+
+    size_t n = sizeof(values)/sizeof(const char*);
+    BOOST_REQUIRE_EQUAL(cons->data_.size(), n);
+    for (size_t i = 0; i < n; i++) {
+        double expected = strtod(values[i], nullptr);
+        // Bitwise comparison (results should be identical to strtod, including signed zero and nan)
+        BOOST_REQUIRE(memcmp(&expected, &cons->data_[i], sizeof(double)) == 0);
+    }
+}
@@ -1,4 +1,5 @@
 #include <iostream>
+#include <limits>
 #include <memory>
 
 #define BOOST_TEST_DYN_LINK
@@ -10,6 +11,9 @@
 #include "queryprocessor.h"
 #include "query_processing/randomsamplingnode.h"
 #include "query_processing/paa.h"
+#include "query_processing/quantile.h"
+#include "query_processing/limiter.h"
+#include "query_processing/filterbyid.h"
 #include "datetime.h"
 
 using namespace Akumuli;
@@ -194,6 +198,90 @@ BOOST_AUTO_TEST_CASE(Test_moving_average_bwd) {
     BOOST_REQUIRE_EQUAL(ts_sum, 99000);
 }
 
+BOOST_AUTO_TEST_CASE(Test_moving_average_batch) {
+    aku_Sample margin = {};
+    margin.payload.type = aku_PData::HI_MARGIN;
+    margin.payload.size = sizeof(aku_Sample);
+    auto mock = std::make_shared<NodeMock>();
+    auto ma = std::make_shared<MeanPAA>(mock);
+
+    // two parameters, 10 elements per step, 100 steps
+    std::vector<aku_Timestamp> ts;
+    std::vector<aku_ParamId> ids;
+    std::vector<double> xs;
+    for (int i = 0; i < 10; i++) {
+        ts.push_back(i);
+        ids.push_back(0);
+        xs.push_back(1.0);
+        ts.push_back(i);
+        ids.push_back(1);
+        xs.push_back(2.0);
+    }
+    for (int step = 0; step < 100; step++) {
+        BOOST_REQUIRE(ma->put_batch(ts.data(), ids.data(), xs.data(), ts.size()));
+        margin.timestamp = step;
+        BOOST_REQUIRE(ma->put(margin));
+    }
+    ma->complete();
+    BOOST_REQUIRE_EQUAL(mock->timestamps.size(), 200);
+    double values_sum = std::accumulate(mock->values.begin(), mock->values.end(), 0.0,
+                                        [](double a, double b) { return a + b; });
+    BOOST_REQUIRE_CLOSE(values_sum, 300.0, 0.00001);
+}
+
+BOOST_AUTO_TEST_CASE(Test_filter_and_limiter_batch) {
+    auto mock = std::make_shared<NodeMock>();
+    auto limiter = std::make_shared<Limiter>(15, 0, mock);
+    auto even = [](aku_ParamId id) { return id % 2 == 0; };
+    auto filter = std::make_shared<FilterByIdNode<decltype(even)>>(even, limiter);
+
+    std::vector<aku_Timestamp> ts;
+    std::vector<aku_ParamId> ids;
+    std::vector<double> xs;
+    for (int i = 0; i < 20; i++) {
+        ts.push_back(i);
+        ids.push_back(i);
+        xs.push_back(i);
+    }
+    // 10 elements out of 20 should pass the filter and the limiter
+    BOOST_REQUIRE(filter->put_batch(ts.data(), ids.data(), xs.data(), ts.size()));
+    // only 5 elements out of 10 should pass the limiter
+    BOOST_REQUIRE(!filter->put_batch(ts.data(), ids.data(), xs.data(), ts.size()));
+    BOOST_REQUIRE_EQUAL(mock->ids.size(), 15);
+    for (size_t i = 0; i < mock->ids.size(); i++) {
+        BOOST_REQUIRE_EQUAL(mock->ids.at(i), (i*2) % 20);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Test_limiter_offset) {
+    auto mock = std::make_shared<NodeMock>();
+    auto limiter = std::make_shared<Limiter>(8, 12, mock);
+
+    std::vector<aku_Timestamp> ts;
+    std::vector<aku_ParamId> ids;
+    std::vector<double> xs;
+    for (int i = 0; i < 7; i++) {
+        ts.push_back(i);
+        ids.push_back(i);
+        xs.push_back(i);
+    }
+    // 12 elements are skipped, both batches and single samples count
+    BOOST_REQUIRE(limiter->put_batch(ts.data(), ids.data(), xs.data(), ts.size()));
+    BOOST_REQUIRE(limiter->put(make(7, 7, 7)));
+    BOOST_REQUIRE(mock->ids.empty());
+    // offset ends in the middle of the batch
+    BOOST_REQUIRE(limiter->put_batch(ts.data(), ids.data(), xs.data(), ts.size()));
+    // limit ends in the middle of the batch
+    BOOST_REQUIRE(!limiter->put_batch(ts.data(), ids.data(), xs.data(), ts.size()));
+    BOOST_REQUIRE(!limiter->put(make(7, 7, 7)));
+
+    std::vector<aku_ParamId> expected = { 4, 5, 6, 0, 1, 2, 3, 4 };
+    BOOST_REQUIRE_EQUAL(mock->ids.size(), expected.size());
+    for (size_t i = 0; i < expected.size(); i++) {
+        BOOST_REQUIRE_EQUAL(mock->ids.at(i), expected.at(i));
+    }
+}
+
 BOOST_AUTO_TEST_CASE(Test_queryprocessor_building_1) {
 
     SeriesMatcher matcher(1ul);
@@ -251,3 +339,446 @@ BOOST_AUTO_TEST_CASE(Test_queryprocessor_building_1) {
     BOOST_REQUIRE_EQUAL(terminal->ids.at(1), 2);
     BOOST_REQUIRE_EQUAL(terminal->values.at(1), 0.234);
 }
+
+struct TerminalMock : NodeMock {
+    int get_requirements() const { return TERMINAL; }
+};
+
+BOOST_AUTO_TEST_CASE(Test_queryprocessor_partial_frequent_items) {
+
+    SeriesMatcher matcher(1ul);
+    const char* series1[] = {
+        "cpu key=1",
+        "cpu key=2",
+        "cpu key=3",
+        "cpu key=4",
+    };
+    for(int i = 0; i < 4; i++) {
+        const char* sname = series1[i];
+        int slen = strlen(sname);
+        matcher.add(sname, sname+slen);
+    }
+    const char* json = R"(
+            {
+                "sample": [{ "name": "frequent-items", "error": "0.01", "portion": "0.1" }],
+                "metric": "cpu",
+                "range" : {
+                    "from": "20150101T000000",
+                    "to"  : "20150102T000000"
+                }
+            }
+    )";
+    auto terminal = std::make_shared<TerminalMock>();
+    auto qproc = QP::Builder::build_query_processor(json, terminal, matcher, &logger_stub);
+    auto first = qproc->make_partial();
+    auto second = qproc->make_partial();
+    BOOST_REQUIRE(first);
+    BOOST_REQUIRE(second);
+
+    // Id 1 - 50 times, id 2 - 30 times, id 3 - 15 times, id 4 - 5 times
+    // (each partial query processor receives half of the data)
+    const int counts[] = { 50, 30, 15, 5 };
+    for (aku_ParamId id = 1; id < 5; id++) {
+        for (int i = 0; i < counts[id - 1]; i++) {
+            auto& partial = i % 2 ? first : second;
+            BOOST_REQUIRE(partial->filter().apply(id) == IQueryFilter::PROCESS);
+            partial->put(make(static_cast<aku_Timestamp>(i), id, 1.0));
+        }
+    }
+    BOOST_REQUIRE_EQUAL(qproc->merge(*first), AKU_SUCCESS);
+    BOOST_REQUIRE_EQUAL(qproc->merge(*second), AKU_SUCCESS);
+    qproc->stop();
+
+    BOOST_REQUIRE_EQUAL(terminal->ids.size(), 3);
+    BOOST_REQUIRE_EQUAL(terminal->ids.at(0), 1);
+    BOOST_REQUIRE_EQUAL(terminal->values.at(0), 50);
+    BOOST_REQUIRE_EQUAL(terminal->ids.at(1), 2);
+    BOOST_REQUIRE_EQUAL(terminal->values.at(1), 30);
+    BOOST_REQUIRE_EQUAL(terminal->ids.at(2), 3);
+    BOOST_REQUIRE_EQUAL(terminal->values.at(2), 15);
+}
+
+void test_partial_paa(const char* name, std::vector<double> const& expected, double tolerance = 0.0001) {
+    SeriesMatcher matcher(1ul);
+    const char* series1[] = {
+        "cpu key=1",
+        "cpu key=2",
+    };
+    for(int i = 0; i < 2; i++) {
+        const char* sname = series1[i];
+        int slen = strlen(sname);
+        matcher.add(sname, sname+slen);
+    }
+    std::string json = R"(
+            {
+                "sample": [{ "name": ")" + std::string(name) + R"(" }],
+                "metric": "cpu",
+                "group-by": { "time": "10n" },
+                "range" : {
+                    "from": "20150101T000000",
+                    "to"  : "20150102T000000"
+                }
+            }
+    )";
+    auto terminal = std::make_shared<TerminalMock>();
+    auto qproc = QP::Builder::build_query_processor(json.c_str(), terminal, matcher, &logger_stub);
+    auto first = qproc->make_partial();
+    auto second = qproc->make_partial();
+    BOOST_REQUIRE(first);
+    BOOST_REQUIRE(second);
+
+    // Time range is split between two partial query processors in
+    // the middle of the second bucket
+    for (aku_Timestamp ts = 0; ts < 30; ts++) {
+        for (aku_ParamId id = 1; id < 3; id++) {
+            auto& partial = ts < 15 ? first : second;
+            partial->put(make(ts, id, static_cast<double>(ts)));
+        }
+    }
+    BOOST_REQUIRE_EQUAL(qproc->merge(*first), AKU_SUCCESS);
+    BOOST_REQUIRE_EQUAL(qproc->merge(*second), AKU_SUCCESS);
+    qproc->stop();
+
+    BOOST_REQUIRE_EQUAL(terminal->ids.size(), expected.size()*2);
+    for (size_t i = 0; i < expected.size(); i++) {
+        for (size_t j = 0; j < 2; j++) {
+            size_t ix = i*2 + j;
+            BOOST_REQUIRE_EQUAL(terminal->ids.at(ix), j + 1);
+            BOOST_REQUIRE_EQUAL(terminal->timestamps.at(ix), (i + 1)*10);
+            BOOST_REQUIRE_CLOSE(terminal->values.at(ix), expected.at(i), tolerance);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Test_queryprocessor_partial_paa) {
+    test_partial_paa("paa", { 4.5, 14.5, 24.5 });
+}
+
+BOOST_AUTO_TEST_CASE(Test_queryprocessor_partial_last_paa) {
+    test_partial_paa("last-paa", { 9, 19, 29 });
+}
+
+BOOST_AUTO_TEST_CASE(Test_queryprocessor_partial_max_paa) {
+    test_partial_paa("max-paa", { 9, 19, 29 });
+}
+
+/** Run group-by query sequentially and using partial query processors (one of them
+  * doesn't receive any data, like a volume that has nothing in range), compare outputs.
+  */
+void test_partial_paa_matches_sequential(const char* name, bool backward) {
+    SeriesMatcher matcher(1ul);
+    const char* series1[] = {
+        "cpu key=1",
+        "cpu key=2",
+    };
+    for(int i = 0; i < 2; i++) {
+        const char* sname = series1[i];
+        int slen = strlen(sname);
+        matcher.add(sname, sname+slen);
+    }
+    const char* from = backward ? "20150102T000000" : "20150101T000000";
+    const char* to   = backward ? "20150101T000000" : "20150102T000000";
+    std::string json = R"(
+            {
+                "sample": [{ "name": ")" + std::string(name) + R"(" }],
+                "metric": "cpu",
+                "group-by": { "time": "10n" },
+                "range" : {
+                    "from": ")" + std::string(from) + R"(",
+                    "to"  : ")" + std::string(to) + R"("
+                }
+            }
+    )";
+    // Data points in scan order, there is a gap between 25 and 57
+    std::vector<aku_Timestamp> timestamps;
+    for (aku_Timestamp ts = 3; ts < 100; ts++) {
+        if (ts < 25 || ts > 57) {
+            timestamps.push_back(ts);
+        }
+    }
+    if (backward) {
+        std::reverse(timestamps.begin(), timestamps.end());
+    }
+
+    auto seqterm = std::make_shared<TerminalMock>();
+    auto seqproc = QP::Builder::build_query_processor(json.c_str(), seqterm, matcher, &logger_stub);
+    for (auto ts: timestamps) {
+        for (aku_ParamId id = 1; id < 3; id++) {
+            seqproc->put(make(ts, id, static_cast<double>(ts*id)));
+        }
+    }
+    seqproc->stop();
+
+    // Same data in batches (batches cross bucket boundaries)
+    auto put_batches = [&](std::shared_ptr<IQueryProcessor> const& proc, size_t begin, size_t end) {
+        const size_t batch_size = 7;
+        for (size_t i = begin; i < end; i += batch_size) {
+            std::vector<aku_Timestamp> ts;
+            std::vector<aku_ParamId> ids;
+            std::vector<double> xs;
+            for (size_t j = i; j < std::min(i + batch_size, end); j++) {
+                for (aku_ParamId id = 1; id < 3; id++) {
+                    ts.push_back(timestamps[j]);
+                    ids.push_back(id);
+                    xs.push_back(static_cast<double>(timestamps[j]*id));
+                }
+            }
+            BOOST_REQUIRE(proc->put_batch(ts.data(), ids.data(), xs.data(), ts.size()));
+        }
+    };
+    auto batchterm = std::make_shared<TerminalMock>();
+    auto batchproc = QP::Builder::build_query_processor(json.c_str(), batchterm, matcher, &logger_stub);
+    put_batches(batchproc, 0, timestamps.size());
+    batchproc->stop();
+
+    auto parbatchterm = std::make_shared<TerminalMock>();
+    auto parbatchproc = QP::Builder::build_query_processor(json.c_str(), parbatchterm, matcher, &logger_stub);
+    auto lhs = parbatchproc->make_partial();
+    auto rhs = parbatchproc->make_partial();
+    BOOST_REQUIRE(lhs);
+    BOOST_REQUIRE(rhs);
+    put_batches(lhs, 0, timestamps.size()/2);
+    put_batches(rhs, timestamps.size()/2, timestamps.size());
+    BOOST_REQUIRE_EQUAL(parbatchproc->merge(*lhs), AKU_SUCCESS);
+    BOOST_REQUIRE_EQUAL(parbatchproc->merge(*rhs), AKU_SUCCESS);
+    parbatchproc->stop();
+
+    for (auto const& term: { batchterm, parbatchterm }) {
+        BOOST_REQUIRE_EQUAL(seqterm->ids.size(), term->ids.size());
+        for (size_t i = 0; i < seqterm->ids.size(); i++) {
+            BOOST_REQUIRE_EQUAL(seqterm->ids.at(i), term->ids.at(i));
+            BOOST_REQUIRE_EQUAL(seqterm->timestamps.at(i), term->timestamps.at(i));
+            BOOST_REQUIRE_CLOSE(seqterm->values.at(i), term->values.at(i), 0.0001);
+        }
+    }
+
+    auto parterm = std::make_shared<TerminalMock>();
+    auto parproc = QP::Builder::build_query_processor(json.c_str(), parterm, matcher, &logger_stub);
+    std::vector<std::shared_ptr<IQueryProcessor>> partials;
+    for (int i = 0; i < 3; i++) {
+        partials.push_back(parproc->make_partial());
+        BOOST_REQUIRE(partials.back());
+    }
+    // Split in the middle of the bucket, last partial (in scan order) is empty
+    for (size_t i = 0; i < timestamps.size(); i++) {
+        auto& partial = i < timestamps.size()/2 ? partials.at(0) : partials.at(1);
+        for (aku_ParamId id = 1; id < 3; id++) {
+            partial->put(make(timestamps[i], id, static_cast<double>(timestamps[i]*id)));
+        }
+    }
+    for (auto const& partial: partials) {
+        BOOST_REQUIRE_EQUAL(parproc->merge(*partial), AKU_SUCCESS);
+    }
+    parproc->stop();
+
+    BOOST_REQUIRE(!seqterm->ids.empty());
+    BOOST_REQUIRE_EQUAL(seqterm->ids.size(), parterm->ids.size());
+    for (size_t i = 0; i < seqterm->ids.size(); i++) {
+        BOOST_REQUIRE_EQUAL(seqterm->ids.at(i), parterm->ids.at(i));
+        BOOST_REQUIRE_EQUAL(seqterm->timestamps.at(i), parterm->timestamps.at(i));
+        BOOST_REQUIRE_CLOSE(seqterm->values.at(i), parterm->values.at(i), 0.0001);
+    }
+    // Buckets should follow scan direction, last bucket is not lost
+    auto first = backward ? 100u : 10u;
+    auto last  = backward ? 10u : 100u;
+    BOOST_REQUIRE_EQUAL(seqterm->timestamps.front(), first);
+    BOOST_REQUIRE_EQUAL(seqterm->timestamps.back(), last);
+}
+
+BOOST_AUTO_TEST_CASE(Test_queryprocessor_partial_paa_matches_sequential_fwd) {
+    test_partial_paa_matches_sequential("paa", false);
+    test_partial_paa_matches_sequential("last-paa", false);
+}
+
+BOOST_AUTO_TEST_CASE(Test_queryprocessor_partial_paa_matches_sequential_bwd) {
+    test_partial_paa_matches_sequential("paa", true);
+    test_partial_paa_matches_sequential("first-paa", true);
+}
+
+BOOST_AUTO_TEST_CASE(Test_quantile_counter) {
+    const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+    QuantileCounter counter(0.5, 0.01, 2048);
+    std::vector<double> values;
+    for (int i = 0; i < 100000; i++) {
+        // Values are not ordered and some of them are negative
+        double x = static_cast<double>((i * 7919) % 100000) - 1000.0;
+        values.push_back(x);
+        counter.add(make(static_cast<aku_Timestamp>(i), 1, x));
+    }
+    std::sort(values.begin(), values.end());
+    BOOST_REQUIRE(counter.ready());
+    for (auto q: quantiles) {
+        double expected = values.at(static_cast<size_t>(q*(values.size() - 1)));
+        double actual = counter.get_quantile(q);
+        BOOST_REQUIRE(std::abs(actual - expected) <= 0.01*std::abs(expected));
+    }
+    counter.reset();
+    BOOST_REQUIRE(!counter.ready());
+}
+
+BOOST_AUTO_TEST_CASE(Test_quantile_counter_non_finite) {
+    QuantileCounter counter(0.5, 0.01, 2048);
+    const double bad[] = {
+        std::numeric_limits<double>::quiet_NaN(),
+        std::numeric_limits<double>::infinity(),
+        -std::numeric_limits<double>::infinity(),
+    };
+    for (auto x: bad) {
+        counter.add(make(0, 1, x));
+    }
+    BOOST_REQUIRE(!counter.ready());
+    for (int i = 1; i <= 100; i++) {
+        counter.add(make(static_cast<aku_Timestamp>(i), 1, static_cast<double>(i)));
+        counter.add(make(static_cast<aku_Timestamp>(i), 1, bad[i % 3]));
+    }
+    BOOST_REQUIRE(std::abs(counter.get_quantile(0.5) - 50.0) <= 1.0);
+    BOOST_REQUIRE(std::abs(counter.get_quantile(0.0) - 1.0) <= 0.01);
+}
+
+BOOST_AUTO_TEST_CASE(Test_quantile_counter_merge) {
+    QuantileCounter first(0.99, 0.01, 2048);
+    QuantileCounter second(0.99, 0.01, 2048);
+    for (int i = 1; i <= 10000; i++) {
+        auto& counter = i % 3 ? first : second;
+        counter.add(make(static_cast<aku_Timestamp>(i), 1, static_cast<double>(i)));
+    }
+    first.merge(second);
+    BOOST_REQUIRE(std::abs(first.value() - 9900.0) <= 99.0);
+    BOOST_REQUIRE(std::abs(first.get_quantile(0.5) - 5000.0) <= 50.0);
+}
+
+BOOST_AUTO_TEST_CASE(Test_quantile_paa) {
+    auto mock = std::make_shared<NodeMock>();
+    boost::property_tree::ptree ptree;
+    ptree.put("percentile", 99);
+    auto paa = std::make_shared<PercentilePAA>(ptree, mock);
+    // Two series, second one is scaled by 10
+    for (aku_Timestamp ts = 0; ts < 1000; ts++) {
+        paa->put(make(ts, 1, static_cast<double>(ts)));
+        paa->put(make(ts, 2, static_cast<double>(ts*10)));
+    }
+    auto margin = SAMPLING_HI_MARGIN;
+    margin.timestamp = 1000;
+    paa->put(margin);
+    BOOST_REQUIRE_EQUAL(mock->ids.size(), 2);
+    BOOST_REQUIRE_EQUAL(mock->ids.at(0), 1);
+    BOOST_REQUIRE(std::abs(mock->values.at(0) - 989.0) <= 9.89);
+    BOOST_REQUIRE_EQUAL(mock->ids.at(1), 2);
+    BOOST_REQUIRE(std::abs(mock->values.at(1) - 9890.0) <= 98.9);
+}
+
+BOOST_AUTO_TEST_CASE(Test_queryprocessor_partial_quantile_paa) {
+    test_partial_paa("quantile-paa", { 4, 14, 24 }, 1.0);
+}
+
+BOOST_AUTO_TEST_CASE(Test_queryprocessor_select_last) {
+
+    SeriesMatcher matcher(1ul);
+    const char* series1[] = {
+        "cpu key=1",
+        "cpu key=2",
+        "mem key=1",
+        "cpu key=3",
+    };
+    for(int i = 0; i < 4; i++) {
+        const char* sname = series1[i];
+        int slen = strlen(sname);
+        matcher.add(sname, sname+slen);
+    }
+    LastValueTable table(1ul);
+    for (aku_Timestamp ts = 0; ts < 10; ts++) {
+        for (aku_ParamId id = 1; id < 4; id++) {
+            table.update(id, ts, static_cast<double>(ts*id));
+        }
+    }
+    // Late write shouldn't affect the table
+    BOOST_REQUIRE(table.update(2, 5, 100.0));
+    // Out of range
+    BOOST_REQUIRE(!table.update(0, 5, 100.0));
+    BOOST_REQUIRE(!table.update(1 + LastValueTable::CHUNK_SIZE*LastValueTable::MAX_CHUNKS, 5, 100.0));
+
+    const char* json = R"(
+            {
+                "select": "last",
+                "metric": "cpu"
+            }
+    )";
+    auto terminal = std::make_shared<TerminalMock>();
+    auto qproc = QP::Builder::build_query_processor(json, terminal, matcher, &logger_stub, &table);
+    // Series 4 wasn't written since db was opened, it should be searched
+    BOOST_REQUIRE(qproc->start());
+    BOOST_REQUIRE(qproc->range().is_backward());
+    BOOST_REQUIRE_EQUAL(qproc->filter().apply(1), IQueryFilter::SKIP_THIS);
+    BOOST_REQUIRE_EQUAL(qproc->filter().apply(4), IQueryFilter::PROCESS);
+
+    BOOST_REQUIRE_EQUAL(terminal->ids.size(), 2);
+    for (size_t i = 0; i < terminal->ids.size(); i++) {
+        auto id = terminal->ids.at(i);
+        BOOST_REQUIRE(id == 1 || id == 2);
+        BOOST_REQUIRE_EQUAL(terminal->timestamps.at(i), 9);
+        BOOST_REQUIRE_EQUAL(terminal->values.at(i), 9.0*id);
+    }
+
+    // Scan stops when all series are found
+    BOOST_REQUIRE(!qproc->put(make(7, 4, 42.0)));
+    qproc->stop();
+    BOOST_REQUIRE_EQUAL(terminal->ids.size(), 3);
+    BOOST_REQUIRE_EQUAL(terminal->ids.at(2), 4);
+    BOOST_REQUIRE_EQUAL(terminal->timestamps.at(2), 7);
+    BOOST_REQUIRE_EQUAL(terminal->values.at(2), 42.0);
+
+    // Every series is in the table, result should be produced without scan
+    table.update(4, 10, 1.0);
+    terminal = std::make_shared<TerminalMock>();
+    qproc = QP::Builder::build_query_processor(json, terminal, matcher, &logger_stub, &table);
+    BOOST_REQUIRE(!qproc->start());
+    BOOST_REQUIRE_EQUAL(terminal->ids.size(), 3);
+
+    // Query can't be executed without the table
+    BOOST_REQUIRE_THROW(QP::Builder::build_query_processor(json, terminal, matcher, &logger_stub),
+                        QueryParserError);
+}
+
+BOOST_AUTO_TEST_CASE(Test_queryprocessor_select_last_after_reopen) {
+
+    SeriesMatcher matcher(1ul);
+    const char* series1[] = {
+        "cpu key=1",
+        "cpu key=2",
+        "mem key=1",
+    };
+    for(int i = 0; i < 3; i++) {
+        const char* sname = series1[i];
+        int slen = strlen(sname);
+        matcher.add(sname, sname+slen);
+    }
+    // Database was just opened, table is empty
+    LastValueTable table(1ul);
+
+    const char* json = R"(
+            {
+                "select": "last",
+                "metric": "cpu"
+            }
+    )";
+    auto terminal = std::make_shared<TerminalMock>();
+    auto qproc = QP::Builder::build_query_processor(json, terminal, matcher, &logger_stub, &table);
+    BOOST_REQUIRE(qproc->start());
+    BOOST_REQUIRE(terminal->ids.empty());
+
+    // Backward scan, newest samples go first
+    BOOST_REQUIRE_EQUAL(qproc->filter().apply(3), IQueryFilter::SKIP_THIS);
+    BOOST_REQUIRE(qproc->put(make(9, 2, 18.0)));
+    BOOST_REQUIRE_EQUAL(qproc->filter().apply(2), IQueryFilter::SKIP_THIS);
+    BOOST_REQUIRE(qproc->put(make(8, 2, 16.0)));
+    BOOST_REQUIRE(!qproc->put(make(8, 1, 8.0)));
+    qproc->stop();
+
+    BOOST_REQUIRE_EQUAL(terminal->ids.size(), 2);
+    BOOST_REQUIRE_EQUAL(terminal->ids.at(0), 2);
+    BOOST_REQUIRE_EQUAL(terminal->timestamps.at(0), 9);
+    BOOST_REQUIRE_EQUAL(terminal->values.at(0), 18.0);
+    BOOST_REQUIRE_EQUAL(terminal->ids.at(1), 1);
+    BOOST_REQUIRE_EQUAL(terminal->timestamps.at(1), 8);
+    BOOST_REQUIRE_EQUAL(terminal->values.at(1), 8.0);
+}
@@ -0,0 +1,251 @@
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE Main
+
+#include <boost/test/unit_test.hpp>
+
+#include <apr.h>
+
+#include "akumuli.h"
+#include "storage_engine/blockstore.h"
+#include "storage_engine/nbtree.h"
+#include "storage_engine/rollup.h"
+#include "log_iface.h"
+
+void test_logger(aku_LogLevel tag, const char* msg) {
+    AKU_UNUSED(tag);
+    BOOST_MESSAGE(msg);
+}
+
+struct AkumuliInitializer {
+    AkumuliInitializer() {
+        apr_initialize();
+        Akumuli::Logger::set_logger(&test_logger);
+    }
+};
+
+static AkumuliInitializer initializer;
+
+using namespace Akumuli;
+using namespace Akumuli::StorageEngine;
+
+static const aku_Timestamp SECOND = 1000000000ull;
+
+//! Sample values are integers, so sums doesn't depend on the order of additions
+static double value_at(aku_Timestamp ts) {
+    return static_cast<double>((ts / SECOND * 7919) % 1000);
+}
+
+//! Brute force aggregation of the raw data
+static std::vector<RollupBucket> expected_buckets(NBTreeExtentsList const& tree,
+                                                  aku_Timestamp begin,
+                                                  aku_Timestamp end,
+                                                  aku_Timestamp step)
+{
+    std::vector<RollupBucket> result;
+    auto it = tree.search(begin, end);
+    std::vector<aku_Timestamp> ts(0x1000);
+    std::vector<double> xs(0x1000);
+    while (true) {
+        aku_Status status;
+        size_t sz;
+        std::tie(status, sz) = it->read(ts.data(), xs.data(), ts.size());
+        for (size_t i = 0; i < sz; i++) {
+            aku_Timestamp bucket = ts[i] / step * step;
+            if (result.empty() || result.back().begin != bucket) {
+                result.push_back({ bucket, 1, xs[i], xs[i], xs[i], xs[i] });
+            } else {
+                auto& b = result.back();
+                b.count++;
+                b.sum += xs[i];
+                b.min = std::min(b.min, xs[i]);
+                b.max = std::max(b.max, xs[i]);
+                b.last = xs[i];
+            }
+        }
+        if (status != AKU_SUCCESS || sz == 0) {
+            break;
+        }
+    }
+    return result;
+}
+
+static void check_query(RollupEngine const& rollup,
+                        NBTreeExtentsList const& tree,
+                        aku_Timestamp begin,
+                        aku_Timestamp end,
+                        aku_Timestamp step,
+                        u64* nread)
+{
+    std::vector<RollupBucket> actual;
+    auto status = rollup.group_aggregate(tree, begin, end, step, &actual, nread);
+    BOOST_REQUIRE_EQUAL(status, AKU_SUCCESS);
+    auto expected = expected_buckets(tree, begin, end, step);
+    BOOST_REQUIRE_EQUAL(actual.size(), expected.size());
+    for (size_t i = 0; i < actual.size(); i++) {
+        BOOST_REQUIRE_EQUAL(actual[i].begin, expected[i].begin);
+        BOOST_REQUIRE_EQUAL(actual[i].count, expected[i].count);
+        BOOST_REQUIRE_EQUAL(actual[i].sum,   expected[i].sum);
+        BOOST_REQUIRE_EQUAL(actual[i].min,   expected[i].min);
+        BOOST_REQUIRE_EQUAL(actual[i].max,   expected[i].max);
+        BOOST_REQUIRE_EQUAL(actual[i].last,  expected[i].last);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Test_rollup_match_resolution) {
+    auto bstore = BlockStoreBuilder::create_memstore();
+    RollupEngine rollup(bstore);
+    BOOST_REQUIRE_EQUAL(rollup.match_resolution(SECOND), 0u);
+    BOOST_REQUIRE_EQUAL(rollup.match_resolution(90*SECOND), 0u);
+    BOOST_REQUIRE_EQUAL(rollup.match_resolution(RollupEngine::MINUTE), RollupEngine::MINUTE);
+    BOOST_REQUIRE_EQUAL(rollup.match_resolution(5*RollupEngine::MINUTE), RollupEngine::MINUTE);
+    BOOST_REQUIRE_EQUAL(rollup.match_resolution(RollupEngine::HOUR), RollupEngine::HOUR);
+    BOOST_REQUIRE_EQUAL(rollup.match_resolution(24*RollupEngine::HOUR), RollupEngine::HOUR);
+}
+
+BOOST_AUTO_TEST_CASE(Test_rollup_group_aggregate) {
+    const aku_ParamId id = 42;
+    const aku_Timestamp N = 100000;  // ~28 hours of data, one sample per second
+    auto bstore = BlockStoreBuilder::create_memstore();
+    auto tree = std::make_shared<NBTreeExtentsList>(id, std::vector<LogicAddr>(), bstore);
+    RollupEngine rollup(bstore);
+    rollup.attach(tree);
+    for (aku_Timestamp i = 0; i < N; i++) {
+        aku_Timestamp ts = i*SECOND + 123;
+        tree->append(ts, value_at(ts));
+    }
+
+    u64 nread = 0;
+    aku_Timestamp begin = 1234*SECOND + 17;
+    aku_Timestamp end = (N - 777)*SECOND;
+    // Not aligned to resolutions, served by the raw tree
+    check_query(rollup, *tree, begin, end, 90*SECOND, &nread);
+    BOOST_REQUIRE_EQUAL(nread, end/SECOND - begin/SECOND);
+
+    check_query(rollup, *tree, begin, end, RollupEngine::MINUTE, &nread);
+    BOOST_REQUIRE(nread < (end - begin)/SECOND/10);
+
+    check_query(rollup, *tree, begin, end, 15*RollupEngine::MINUTE, &nread);
+    check_query(rollup, *tree, begin, end, RollupEngine::HOUR, &nread);
+    // Should touch ~27 rollup rows and few thousands of raw samples at the edges
+    BOOST_REQUIRE(nread < 10000);
+
+    check_query(rollup, *tree, 0, AKU_MAX_TIMESTAMP, 2*RollupEngine::HOUR, &nread);
+    check_query(rollup, *tree, 10*SECOND, 20*SECOND, RollupEngine::HOUR, &nread);
+}
+
+BOOST_AUTO_TEST_CASE(Test_rollup_reattach) {
+    const aku_ParamId id = 1;
+    const aku_Timestamp N = 50000;
+    auto bstore = BlockStoreBuilder::create_memstore();
+    auto tree = std::make_shared<NBTreeExtentsList>(id, std::vector<LogicAddr>(), bstore);
+    std::unique_ptr<RollupEngine> rollup(new RollupEngine(bstore));
+    rollup->attach(tree);
+    aku_Timestamp i = 0;
+    for (; i < N/2; i++) {
+        aku_Timestamp ts = i*SECOND;
+        tree->append(ts, value_at(ts));
+    }
+    // Restart
+    auto roots = tree->close();
+    auto rollup_roots = rollup->close(id);
+    BOOST_REQUIRE_EQUAL(rollup_roots.size(), 2u);
+    rollup.reset(new RollupEngine(bstore));
+    tree = std::make_shared<NBTreeExtentsList>(id, roots, bstore);
+    tree->force_init();
+    rollup->attach(tree, rollup_roots);
+    for (; i < N; i++) {
+        aku_Timestamp ts = i*SECOND;
+        tree->append(ts, value_at(ts));
+    }
+
+    u64 nread = 0;
+    check_query(*rollup, *tree, 0, N*SECOND, RollupEngine::MINUTE, &nread);
+    BOOST_REQUIRE(nread < N/10);
+    check_query(*rollup, *tree, 0, N*SECOND, RollupEngine::HOUR, &nread);
+}
+
+BOOST_AUTO_TEST_CASE(Test_rollup_engine_destroyed_before_tree) {
+    const aku_ParamId id = 2;
+    const aku_Timestamp N = 50000;
+    auto bstore = BlockStoreBuilder::create_memstore();
+    auto tree = std::make_shared<NBTreeExtentsList>(id, std::vector<LogicAddr>(), bstore);
+    std::unique_ptr<RollupEngine> rollup(new RollupEngine(bstore));
+    rollup->attach(tree);
+    aku_Timestamp i = 0;
+    for (; i < N/2; i++) {
+        tree->append(i*SECOND, value_at(i*SECOND));
+    }
+    rollup.reset();
+    // Leaf commits shouldn't reach destroyed engine
+    for (; i < N; i++) {
+        tree->append(i*SECOND, value_at(i*SECOND));
+    }
+    tree->close();
+}
+
+//! MemStore is not thread-safe, this wrapper serializes access to it
+struct LockedStore : BlockStore {
+    std::shared_ptr<BlockStore> base;
+    mutable std::mutex lock;
+
+    LockedStore(std::shared_ptr<BlockStore> base) : base(base) {}
+
+    virtual std::tuple<aku_Status, std::shared_ptr<Block>> read_block(LogicAddr addr) {
+        std::lock_guard<std::mutex> guard(lock);
+        return base->read_block(addr);
+    }
+    virtual std::tuple<aku_Status, LogicAddr> append_block(std::shared_ptr<Block> data) {
+        std::lock_guard<std::mutex> guard(lock);
+        return base->append_block(data);
+    }
+    virtual void flush() {
+        std::lock_guard<std::mutex> guard(lock);
+        base->flush();
+    }
+    virtual bool exists(LogicAddr addr) const {
+        std::lock_guard<std::mutex> guard(lock);
+        return base->exists(addr);
+    }
+    virtual u32 checksum(u8 const* begin, size_t size) const {
+        return base->checksum(begin, size);
+    }
+    virtual u32 get_block_size() const {
+        return base->get_block_size();
+    }
+    virtual u32 get_fanout() const {
+        return base->get_fanout();
+    }
+};
+
+BOOST_AUTO_TEST_CASE(Test_rollup_concurrent_series) {
+    const u32 NSERIES = 4;
+    const aku_Timestamp N = 50000;
+    std::shared_ptr<BlockStore> bstore = std::make_shared<LockedStore>(BlockStoreBuilder::create_memstore());
+    RollupEngine rollup(bstore);
+    std::vector<std::shared_ptr<NBTreeExtentsList>> trees;
+    for (u32 s = 0; s < NSERIES; s++) {
+        trees.push_back(std::make_shared<NBTreeExtentsList>(s + 100, std::vector<LogicAddr>(), bstore));
+        rollup.attach(trees.back());
+    }
+    std::vector<std::thread> threads;
+    for (u32 s = 0; s < NSERIES; s++) {
+        threads.emplace_back([&, s]() {
+            for (aku_Timestamp i = 0; i < N; i++) {
+                aku_Timestamp ts = i*SECOND + s;
+                trees[s]->append(ts, value_at(ts));
+            }
+        });
+    }
+    for (auto& t: threads) {
+        t.join();
+    }
+    for (auto tree: trees) {
+        u64 nread = 0;
+        check_query(rollup, *tree, 0, N*SECOND, RollupEngine::MINUTE, &nread);
+        BOOST_REQUIRE(nread < N/10);
+    }
+}
@@ -311,3 +311,136 @@ BOOST_AUTO_TEST_CASE(Test_sequencer_search_backward) {
 BOOST_AUTO_TEST_CASE(Test_sequencer_search_forward) {
     test_sequencer_searching(AKU_CURSOR_DIR_FORWARD);
 }
+
+/** Merge and compress values to the page, read back everything
+  * from the page and the sequencer and compare with the input.
+  * Data is compressed on writer thread if `nworkers` is 0.
+  */
+void test_sequencer_merge_and_compress(size_t page_size, int nvalues, bool enforce_write, u32 nworkers) {
+    const u32 THRESHOLD = 100;
+
+    aku_FineTuneParams params = {};
+    params.window_size = AKU_MAX_TIMESTAMP;
+    params.compression_threshold = THRESHOLD;
+    std::shared_ptr<ThreadPool> pool;
+    if (nworkers) {
+        pool = std::make_shared<ThreadPool>(nworkers);
+    }
+    Sequencer seq(params, pool);
+
+    std::vector<double> expected;
+    for (int i = 0; i < nvalues; i++) {
+        int status;
+        int lock = 0;
+        tie(status, lock) = seq.add(TimeSeriesValue(static_cast<aku_Timestamp>(100 + i), 42u, i));
+        BOOST_REQUIRE_EQUAL(status, AKU_SUCCESS);
+        BOOST_REQUIRE(lock % 2 == 0);
+        expected.push_back(i);
+    }
+
+    std::vector<char> page_mem;
+    page_mem.resize(sizeof(PageHeader) + page_size);
+    auto page = new (page_mem.data()) PageHeader(0, page_mem.size(), 0, 1);
+
+    int lock = seq.reset();
+    BOOST_REQUIRE(lock % 2 == 1);
+    auto status = seq.merge_and_compress(page, enforce_write);
+    BOOST_REQUIRE(status == AKU_SUCCESS || status == AKU_EOVERFLOW);
+
+    // Page contains the prefix of the input, sequencer contains the rest
+    Caller caller;
+    RecordingCursor page_cursor;
+    page->search(std::make_shared<TestQueryProcessor>(std::make_shared<Node>(caller, page_cursor),
+                                                      AKU_MIN_TIMESTAMP, AKU_MAX_TIMESTAMP,
+                                                      AKU_CURSOR_DIR_FORWARD));
+    RecordingCursor seq_cursor;
+    aku_Timestamp window;
+    int seq_id;
+    std::tie(window, seq_id) = seq.get_window();
+    seq.search(std::make_shared<TestQueryProcessor>(std::make_shared<Node>(caller, seq_cursor),
+                                                    AKU_MIN_TIMESTAMP, AKU_MAX_TIMESTAMP,
+                                                    AKU_CURSOR_DIR_FORWARD), seq_id);
+
+    auto npage = page_cursor.results.size();
+    if (npage != expected.size()) {
+        // Only the last chunk can be incomplete
+        BOOST_REQUIRE_EQUAL(npage % THRESHOLD, 0u);
+    }
+    BOOST_REQUIRE_EQUAL(npage + seq_cursor.results.size(), expected.size());
+    if (status == AKU_SUCCESS) {
+        auto nchunks = enforce_write ? (nvalues + THRESHOLD - 1)/THRESHOLD : nvalues/THRESHOLD;
+        BOOST_REQUIRE_EQUAL(page->get_entries_count(), 2*nchunks);
+    } else {
+        BOOST_REQUIRE(npage < expected.size());
+    }
+    for (auto i = 0u; i < npage; i++) {
+        BOOST_REQUIRE_EQUAL(page_cursor.results[i].payload.float64, expected[i]);
+    }
+    for (auto i = 0u; i < seq_cursor.results.size(); i++) {
+        BOOST_REQUIRE_EQUAL(seq_cursor.results[i].payload.float64, expected[npage + i]);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Test_sequencer_merge_and_compress_single_chunk) {
+    test_sequencer_merge_and_compress(0x100000, 150, true, 0);
+}
+
+BOOST_AUTO_TEST_CASE(Test_sequencer_merge_and_compress_single_chunk_pipelined) {
+    test_sequencer_merge_and_compress(0x100000, 150, true, 3);
+}
+
+BOOST_AUTO_TEST_CASE(Test_sequencer_merge_and_compress_many_chunks) {
+    test_sequencer_merge_and_compress(0x100000, 10000, true, 0);
+}
+
+BOOST_AUTO_TEST_CASE(Test_sequencer_merge_and_compress_many_chunks_pipelined) {
+    test_sequencer_merge_and_compress(0x100000, 10000, true, 3);
+}
+
+BOOST_AUTO_TEST_CASE(Test_sequencer_merge_and_compress_partial_chunk) {
+    test_sequencer_merge_and_compress(0x100000, 10050, false, 0);
+}
+
+BOOST_AUTO_TEST_CASE(Test_sequencer_merge_and_compress_partial_chunk_pipelined) {
+    test_sequencer_merge_and_compress(0x100000, 10050, false, 3);
+}
+
+BOOST_AUTO_TEST_CASE(Test_sequencer_merge_and_compress_page_overflow) {
+    test_sequencer_merge_and_compress(0x1000, 10000, true, 0);
+}
+
+BOOST_AUTO_TEST_CASE(Test_sequencer_merge_and_compress_page_overflow_pipelined) {
+    test_sequencer_merge_and_compress(0x1000, 10000, true, 3);
+}
+
+BOOST_AUTO_TEST_CASE(Test_sequencer_merge_and_compress_pool_reuse) {
+    const u32 THRESHOLD = 100;
+    const int NVALUES = 1000;
+    aku_FineTuneParams params = {};
+    params.window_size = AKU_MAX_TIMESTAMP;
+    params.compression_threshold = THRESHOLD;
+    // Sequencers share the same worker threads, same threads should
+    // serve every checkpoint
+    auto pool = std::make_shared<ThreadPool>(2);
+    Sequencer seq1(params, pool);
+    Sequencer seq2(params, pool);
+    for (int round = 0; round < 4; round++) {
+        for (Sequencer* seq: { &seq1, &seq2 }) {
+            for (int i = 0; i < NVALUES; i++) {
+                int status;
+                int lock = 0;
+                auto ts = static_cast<aku_Timestamp>(100 + round*NVALUES + i);
+                tie(status, lock) = seq->add(TimeSeriesValue(ts, 42u, i));
+                BOOST_REQUIRE_EQUAL(status, AKU_SUCCESS);
+            }
+            std::vector<char> page_mem;
+            page_mem.resize(sizeof(PageHeader) + 0x100000);
+            auto page = new (page_mem.data()) PageHeader(0, page_mem.size(), 0, 1);
+            int lock = seq->reset();
+            BOOST_REQUIRE(lock % 2 == 1);
+            auto status = seq->merge_and_compress(page, true);
+            BOOST_REQUIRE_EQUAL(status, AKU_SUCCESS);
+            BOOST_REQUIRE_EQUAL(page->get_entries_count(), 2*NVALUES/THRESHOLD);
+        }
+    }
+}
@@ -287,5 +287,193 @@ BOOST_AUTO_TEST_CASE(Test_tcp_server_backend_error_handling) {
         char buffer[0x1000];
         is.getline(buffer, 0x1000);
         BOOST_REQUIRE_EQUAL(std::string(buffer, buffer + 3), "-DB");
+        suite.pline->stop();
     });
 }
+
+BOOST_AUTO_TEST_CASE(Test_buffer_pool_reuse) {
+
+    BufferPool pool(0x1000, 2);
+    Byte* first;
+    {
+        auto buf = pool.allocate();
+        first = buf.get();
+    }
+    // Released buffer should be reused
+    auto buf1 = pool.allocate();
+    BOOST_REQUIRE(buf1.get() == first);
+    BOOST_REQUIRE_EQUAL(pool.get_pool_size(), 1);
+
+    // Buffer is in use, new one should be allocated
+    auto buf2 = pool.allocate();
+    BOOST_REQUIRE(buf2.get() != first);
+    BOOST_REQUIRE_EQUAL(pool.get_pool_size(), 2);
+
+    // Pool is full, new buffer shouldn't be pooled
+    auto buf3 = pool.allocate();
+    BOOST_REQUIRE_EQUAL(pool.get_pool_size(), 2);
+    BOOST_REQUIRE_EQUAL(pool.get_buffer_size(), 0x1000);
+
+    buf2.reset();
+    auto buf4 = pool.allocate();
+    BOOST_REQUIRE(buf4.get() != buf1.get());
+    BOOST_REQUIRE(buf4.get() != buf3.get());
+}
+
+BOOST_AUTO_TEST_CASE(Test_tcp_server_shards) {
+
+    auto dbcon = std::make_shared<DbMock>();
+    auto pline = std::make_shared<IngestionPipeline>(dbcon, AKU_LINEAR_BACKOFF);
+    pline->start();
+
+    // Two shards should be able to listen on the same port
+    IOServiceT io;
+    std::vector<IOServiceT*> iovec = { &io };
+    auto shard0 = std::make_shared<TcpAcceptor>(iovec, PORT + 1, pline, TcpSession::BUFFER_SIZE, true);
+    auto shard1 = std::make_shared<TcpAcceptor>(iovec, PORT + 1, pline, TcpSession::BUFFER_SIZE, true);
+    shard0->start();
+    shard1->start();
+
+    SocketT socket(io);
+    auto loopback = boost::asio::ip::address_v4::loopback();
+    boost::asio::ip::tcp::endpoint peer(loopback, PORT + 1);
+    socket.connect(peer);
+    io.run_one();  // handle_accept (in the shard's io-service)
+
+    boost::asio::streambuf stream;
+    std::ostream os(&stream);
+    os << ":1\r\n" << ":2\r\n" << "+3.14\r\n";
+    boost::asio::write(socket, stream);
+
+    io.run_one();  // handle_read
+    pline->stop();
+
+    BOOST_REQUIRE_EQUAL(dbcon->results.size(), 1);
+    aku_ParamId id;
+    aku_Timestamp ts;
+    double value;
+    std::tie(id, ts, value) = dbcon->results.at(0);
+    BOOST_REQUIRE_EQUAL(id, 1);
+    BOOST_REQUIRE_EQUAL(ts, 2);
+
+    shard0->stop();
+    shard1->stop();
+}
+
+BOOST_AUTO_TEST_CASE(Test_tcp_server_flow_control) {
+
+    auto dbcon = std::make_shared<DbMock>();
+    auto pline = std::make_shared<IngestionPipeline>(dbcon, AKU_THROTTLE);
+
+    IOServiceT io;
+    std::vector<IOServiceT*> iovec = { &io };
+    auto serv = std::make_shared<TcpAcceptor>(iovec, PORT + 2, pline, TcpSession::BUFFER_SIZE,
+                                              false, true);
+    serv->_start();
+
+    SocketT socket(io);
+    auto loopback = boost::asio::ip::address_v4::loopback();
+    boost::asio::ip::tcp::endpoint peer(loopback, PORT + 2);
+    socket.connect(peer);
+    serv->_run_one();  // handle_accept
+
+    // Pipeline is not started, so the session should be paused instead of dropping data
+    const int NSAMPLES = 2*SampleRing::CAPACITY;
+    boost::asio::streambuf stream;
+    std::ostream os(&stream);
+    for (int i = 0; i < NSAMPLES; i++) {
+        os << ":1\r\n" << ":" << i << "\r\n" << "+3.14\r\n";
+    }
+    boost::asio::write(socket, stream);
+    while (pline->get_queue_depth() < SampleRing::CAPACITY) {
+        io.run_one();  // handle_read
+    }
+
+    // Resume
+    pline->start();
+    u64 npauses = 0, pause_time = 0;
+    while (npauses == 0) {
+        io.run_one();  // handle_drain (posted by the pipeline worker)
+        pline->get_flow_control_stats(&npauses, &pause_time);
+    }
+    for (int i = 0; i < 100; i++) {
+        io.poll();  // read the rest
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    pline->stop();
+    serv->_stop();
+
+    BOOST_REQUIRE_EQUAL(npauses, 1u);
+    BOOST_REQUIRE_EQUAL(dbcon->results.size(), static_cast<size_t>(NSAMPLES));
+    for (int i = 0; i < NSAMPLES; i++) {
+        BOOST_REQUIRE_EQUAL(std::get<1>(dbcon->results.at(i)), static_cast<aku_Timestamp>(i));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Test_tcp_server_shard_flow_control) {
+
+    auto dbcon = std::make_shared<DbMock>();
+    auto pline = std::make_shared<IngestionPipeline>(dbcon, AKU_THROTTLE);
+
+    // Sessions of the shard share one spout, both of them should be paused and resumed
+    IOServiceT io;
+    std::vector<IOServiceT*> iovec = { &io };
+    auto shard = std::make_shared<TcpAcceptor>(iovec, PORT + 3, pline, TcpSession::BUFFER_SIZE,
+                                               true, true);
+    shard->start();
+
+    auto loopback = boost::asio::ip::address_v4::loopback();
+    boost::asio::ip::tcp::endpoint peer(loopback, PORT + 3);
+    SocketT socket0(io);
+    socket0.connect(peer);
+    io.run_one();  // handle_accept
+    SocketT socket1(io);
+    socket1.connect(peer);
+    io.run_one();  // handle_accept
+
+    // Pipeline is not started, so the sessions should be paused instead of dropping data
+    const int NSAMPLES = 2*SampleRing::CAPACITY;
+    int ix = 0;
+    for (auto socket: { &socket0, &socket1 }) {
+        boost::asio::streambuf stream;
+        std::ostream os(&stream);
+        for (int i = 0; i < NSAMPLES; i++) {
+            os << ":" << ix + 1 << "\r\n" << ":" << i << "\r\n" << "+3.14\r\n";
+        }
+        boost::asio::write(*socket, stream);
+        ix++;
+    }
+    while (pline->get_queue_depth() < SampleRing::CAPACITY) {
+        io.run_one();  // handle_read
+    }
+    for (int i = 0; i < 100; i++) {
+        io.poll();  // second session should be paused as well
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    BOOST_REQUIRE_EQUAL(pline->get_queue_depth(), SampleRing::CAPACITY);
+
+    // Resume
+    pline->start();
+    const size_t expected = static_cast<size_t>(2*NSAMPLES);
+    for (int i = 0; i < 10000; i++) {
+        io.poll();  // handle_drain (posted by the pipeline worker) and read the rest
+        if (pline->get_queue_depth() == 0 && dbcon->results.size() == expected) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    pline->stop();
+    shard->stop();
+
+    u64 npauses = 0, pause_time = 0;
+    pline->get_flow_control_stats(&npauses, &pause_time);
+    BOOST_REQUIRE_EQUAL(npauses, 2u);
+    BOOST_REQUIRE_EQUAL(dbcon->results.size(), expected);
+    // Samples of each series are written in order
+    std::vector<aku_Timestamp> next = { 0, 0 };
+    for (auto const& value: dbcon->results) {
+        auto id = std::get<0>(value);
+        BOOST_REQUIRE_EQUAL(std::get<1>(value), next.at(id - 1));
+        next.at(id - 1)++;
+    }
+}
@@ -0,0 +1,75 @@
+#include <atomic>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE Main
+
+#include <boost/test/unit_test.hpp>
+
+#include "threadpool.h"
+
+using namespace Akumuli;
+
+BOOST_AUTO_TEST_CASE(Test_threadpool_submit) {
+    ThreadPool pool(2);
+    BOOST_REQUIRE_EQUAL(pool.size(), 2u);
+    std::atomic<int> counter = {0};
+    std::vector<std::future<void>> futures;
+    for (int i = 0; i < 100; i++) {
+        futures.push_back(pool.submit([&counter]() { counter++; }));
+    }
+    for (auto& f: futures) {
+        f.get();
+    }
+    BOOST_REQUIRE_EQUAL(counter.load(), 100);
+}
+
+BOOST_AUTO_TEST_CASE(Test_threadpool_submit_error) {
+    ThreadPool pool(1);
+    auto f = pool.submit([]() { throw std::runtime_error("error"); });
+    BOOST_REQUIRE_THROW(f.get(), std::runtime_error);
+    // Worker should survive the exception
+    pool.submit([]() {}).get();
+}
+
+BOOST_AUTO_TEST_CASE(Test_threadpool_parallel_for) {
+    ThreadPool pool(3);
+    for (size_t n: { 0ul, 1ul, 2ul, 1000ul }) {
+        std::vector<int> hits(n, 0);
+        pool.parallel_for(n, [&hits](size_t ix) {
+            hits.at(ix)++;
+        });
+        for (auto h: hits) {
+            BOOST_REQUIRE_EQUAL(h, 1);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Test_threadpool_parallel_for_error) {
+    ThreadPool pool(2);
+    std::atomic<int> counter = {0};
+    auto fn = [&counter](size_t ix) {
+        counter++;
+        if (ix == 10) {
+            throw std::runtime_error("error");
+        }
+    };
+    BOOST_REQUIRE_THROW(pool.parallel_for(100, fn), std::runtime_error);
+    // Other indexes are still processed
+    BOOST_REQUIRE_EQUAL(counter.load(), 100);
+}
+
+BOOST_AUTO_TEST_CASE(Test_threadpool_nested_parallel_for) {
+    // All workers are busy with outer loop, inner loops should be completed
+    // by the callers
+    ThreadPool pool(2);
+    std::atomic<int> counter = {0};
+    pool.parallel_for(8, [&](size_t) {
+        pool.parallel_for(8, [&](size_t) {
+            counter++;
+        });
+    });
+    BOOST_REQUIRE_EQUAL(counter.load(), 64);
+}